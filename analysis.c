@@ -0,0 +1,927 @@
+/*
+ * analysis.c - what we know about an image beyond its listing
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+const size_t section_elem_size[NR_SECTIONS] = {
+        [SEC_INSNS] = sizeof(insn_rec),
+        [SEC_REGIONS] = sizeof(region),
+        [SEC_SYMBOLS] = sizeof(symbol),
+        [SEC_XREFS] = sizeof(xref),
+        [SEC_COMMENTS] = sizeof(comment),
+        [SEC_STRINGS] = 1,
+};
+
+static int
+image_reserve(image *img, section_id id, uint32_t n)
+{
+        section *sec = &img->sections[id];
+        uint32_t capacity;
+        void *base;
+
+        if (sec->count + n <= sec->capacity)
+                return 0;
+        if (img->db)
+                return db_grow(img, id, sec->count + n);
+
+        capacity = sec->capacity ? sec->capacity * 2 : 64;
+        if (capacity < sec->count + n)
+                capacity = sec->count + n;
+        base = arena_realloc(&img->arena, sec->base,
+                             sec->capacity * section_elem_size[id],
+                             capacity * section_elem_size[id]);
+        if (!base)
+                return -1;
+        sec->base = base;
+        sec->capacity = capacity;
+        return 0;
+}
+
+/*
+ * Open up a zeroed slot at index and return it.  This may move the
+ * section, so don't hold on to pointers into the image across it.
+ */
+void *
+image_insert(image *img, section_id id, uint32_t index)
+{
+        section *sec = &img->sections[id];
+        size_t esz = section_elem_size[id];
+        uint8_t *slot;
+
+        if (image_reserve(img, id, 1) < 0)
+                return NULL;
+
+        slot = (uint8_t *)sec->base + index * esz;
+        memmove(slot + esz, slot, (sec->count - index) * esz);
+        memset(slot, 0, esz);
+        sec->count++;
+        return slot;
+}
+
+int64_t
+image_string(image *img, const char * const s)
+{
+        section *sec = &img->sections[SEC_STRINGS];
+        size_t len = strlen(s) + 1;
+        uint32_t off;
+
+        if (image_reserve(img, SEC_STRINGS, len) < 0)
+                return -1;
+        off = sec->count;
+        memcpy((char *)sec->base + off, s, len);
+        sec->count += len;
+        return off;
+}
+
+void
+free_image(image *img)
+{
+        if (img->db)
+                db_close(img);
+        arena_free(&img->arena);
+        memset(img->sections, 0, sizeof(img->sections));
+}
+
+/*
+ * Binary searches; these return the first entry at or after addr.
+ */
+#define lower_bound(img, id, type, field, key)                          \
+        ({                                                              \
+                const type *base_ = image_section(img, id, type);       \
+                uint32_t lo_ = 0, hi_ = image_count(img, id);           \
+                while (lo_ < hi_) {                                     \
+                        uint32_t mid_ = lo_ + (hi_ - lo_) / 2;          \
+                        if (base_[mid_].field < (key))                  \
+                                lo_ = mid_ + 1;                         \
+                        else                                            \
+                                hi_ = mid_;                             \
+                }                                                       \
+                lo_;                                                    \
+        })
+
+int64_t
+find_insn(const image * const img, uint32_t addr)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t i = lower_bound(img, SEC_INSNS, insn_rec, addr, addr);
+
+        if (i < image_count(img, SEC_INSNS) && recs[i].addr == addr)
+                return i;
+        return -1;
+}
+
+/*
+ * The instruction addr is part of, or -1 if it's past the end.
+ */
+int64_t
+find_insn_containing(const image * const img, uint32_t addr)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t i = lower_bound(img, SEC_INSNS, insn_rec, addr, addr + 1);
+
+        if (i && addr < recs[i - 1].addr + recs[i - 1].len)
+                return i - 1;
+        return -1;
+}
+
+symbol *
+find_symbol(const image * const img, uint32_t addr)
+{
+        symbol *syms = image_section(img, SEC_SYMBOLS, symbol);
+        uint32_t i = lower_bound(img, SEC_SYMBOLS, symbol, addr, addr);
+
+        if (i < image_count(img, SEC_SYMBOLS) && syms[i].addr == addr)
+                return &syms[i];
+        return NULL;
+}
+
+/*
+ * The symbol at or before addr, if there is one.
+ */
+symbol *
+nearest_symbol(const image * const img, uint32_t addr)
+{
+        symbol *syms = image_section(img, SEC_SYMBOLS, symbol);
+        uint32_t i = lower_bound(img, SEC_SYMBOLS, symbol, addr, addr + 1);
+
+        return i ? &syms[i - 1] : NULL;
+}
+
+symbol *
+find_symbol_name(const image * const img, const char * const name)
+{
+        symbol *syms = image_section(img, SEC_SYMBOLS, symbol);
+
+        for (uint32_t i = 0; i < image_count(img, SEC_SYMBOLS); i++)
+                if (!strcmp(image_str(img, syms[i].name), name))
+                        return &syms[i];
+        return NULL;
+}
+
+/*
+ * The xrefs to addr are xrefs[*first .. *first + return value).
+ */
+uint32_t
+find_xrefs(const image * const img, uint32_t addr, uint32_t *first)
+{
+        const xref *xrefs = image_section(img, SEC_XREFS, xref);
+        uint32_t n = image_count(img, SEC_XREFS);
+        uint32_t i;
+
+        i = *first = lower_bound(img, SEC_XREFS, xref, to, addr);
+        while (i < n && xrefs[i].to == addr)
+                i++;
+        return i - *first;
+}
+
+void
+rec_to_insn(const insn_rec * const rec, insn *insn)
+{
+        int page = (rec->prefix >> 4) & 3;
+
+        memset(insn, 0, sizeof(*insn));
+        insn->pos = rec->addr;
+        insn->prefix = rec->prefix;
+        insn->opcode = rec->opcode;
+        insn->len = rec->len;
+        insn->slack = rec->flags & INSN_BYTES;
+        insn->packed = packed_opcodes[page][rec->opcode];
+        insn->op = &opcodes[page][rec->opcode];
+        for (int i = 0; i < 4; i++)
+                insn->values[i] = rec->values[i];
+}
+
+/*
+ * Where a direct branch, jump, or call goes, or -1 if it isn't one.
+ */
+int64_t
+branch_target(const insn * const insn)
+{
+        const shape *shape = &shapes[insn->packed.shape];
+        uint8_t flow = insn_flow(insn);
+
+        if (!(flow & (FLOW_BRANCH | FLOW_CALL)) || (flow & FLOW_INDIRECT))
+                return -1;
+
+        for (int i = 0; i < shape->nargs; i++) {
+                const shape_arg *arg = &shape->args[i];
+
+                if (opkinds[arg->kind].rel || arg->kind == OPK_ADDR20)
+                        return arg_value(shape, arg, insn);
+        }
+        return -1;
+}
+
+static int
+add_insn(image *img, const insn * const insn, uint8_t flags)
+{
+        insn_rec *rec;
+
+        rec = image_insert(img, SEC_INSNS, image_count(img, SEC_INSNS));
+        if (!rec)
+                return -1;
+        rec->addr = insn->pos;
+        rec->len = insn->len;
+        rec->prefix = insn->prefix;
+        rec->opcode = insn->opcode;
+        rec->flags = flags;
+        for (int i = 0; i < 4; i++)
+                rec->values[i] = insn->values[i];
+        return 0;
+}
+
+static int
+add_region(image *img, uint32_t start, uint32_t end, uint32_t type)
+{
+        region *regions = image_section(img, SEC_REGIONS, region);
+        uint32_t n = image_count(img, SEC_REGIONS);
+        region *r;
+
+        if (n && regions[n - 1].type == type &&
+            regions[n - 1].end == start) {
+                regions[n - 1].end = end;
+                return 0;
+        }
+
+        r = image_insert(img, SEC_REGIONS, n);
+        if (!r)
+                return -1;
+        r->start = start;
+        r->end = end;
+        r->type = type;
+        return 0;
+}
+
+static int
+cmp_xref(const void *a, const void *b)
+{
+        const xref *xa = a, *xb = b;
+
+        if (xa->to != xb->to)
+                return xa->to < xb->to ? -1 : 1;
+        if (xa->from != xb->from)
+                return xa->from < xb->from ? -1 : 1;
+        return 0;
+}
+
+/*
+ * Every branch target that starts an instruction gets a name: sub_XXXXX
+ * if anything calls it, loc_XXXXX otherwise.  Data an indexed operand
+ * points at doesn't.
+ */
+static int
+name_targets(image *img)
+{
+        uint32_t nxrefs = image_count(img, SEC_XREFS);
+
+        for (uint32_t i = 0; i < nxrefs; ) {
+                const xref *xrefs = image_section(img, SEC_XREFS, xref);
+                uint32_t to = xrefs[i].to;
+                uint32_t flags = SYM_AUTO;
+                int code = 0;
+                char name[16];
+
+                for (; i < nxrefs && xrefs[i].to == to; i++) {
+                        if (xrefs[i].flow & (FLOW_BRANCH | FLOW_CALL))
+                                code = 1;
+                        if (xrefs[i].flow & FLOW_CALL)
+                                flags |= SYM_FUNC;
+                }
+
+                if (!code || find_insn(img, to) < 0)
+                        continue;
+                snprintf(name, sizeof(name), "%s_%05x",
+                         flags & SYM_FUNC ? "sub" : "loc", to);
+                if (set_label(img, to, name, flags) < 0)
+                        return -1;
+        }
+        return 0;
+}
+
+static int
+add_bytes(image *img, uint32_t start, uint32_t end)
+{
+        for (uint32_t pos = start; pos < end; pos++) {
+                insn insn;
+
+                memset(&insn, 0, sizeof(insn));
+                insn.pos = pos;
+                insn.opcode = img->buf[pos];
+                insn.len = 1;
+                if (add_insn(img, &insn, INSN_BYTES) < 0 ||
+                    add_region(img, pos, pos + 1, REGION_DATA) < 0)
+                        return -1;
+        }
+        return 0;
+}
+
+static int
+add_xref(image *img, uint32_t from, uint32_t to, uint32_t flow)
+{
+        xref *x;
+
+        x = image_insert(img, SEC_XREFS, image_count(img, SEC_XREFS));
+        if (!x)
+                return -1;
+        x->from = from;
+        x->to = to;
+        x->flow = flow;
+        return 0;
+}
+
+/*
+ * What jump tables have told us: where the tables are, which are always
+ * data, and where their targets are, which always start an instruction.
+ * Both only ever grow.
+ */
+typedef struct hints_s {
+        arena arena;
+        region *tables;         // sorted by start
+        uint32_t ntables;
+        uint32_t *starts;       // sorted
+        uint32_t nstarts;
+        int again;              // one of them is behind the sweep
+} hints;
+
+/*
+ * Make room for one more of n; these grow by doubling from 16.
+ */
+static int
+grow(hints *h, void **v, uint32_t n, size_t size)
+{
+        void *p;
+
+        if (!n) {
+                *v = arena_alloc(&h->arena, 16 * size);
+                return *v ? 0 : -1;
+        }
+        if (n < 16 || (n & (n - 1)))
+                return 0;
+        p = arena_realloc(&h->arena, *v, n * size, 2 * n * size);
+        if (!p)
+                return -1;
+        *v = p;
+        return 0;
+}
+
+static int
+add_start(hints *h, uint32_t addr, uint32_t pos)
+{
+        uint32_t i = 0;
+
+        while (i < h->nstarts && h->starts[i] < addr)
+                i++;
+        if (i < h->nstarts && h->starts[i] == addr)
+                return 0;
+        if (grow(h, (void **)&h->starts, h->nstarts,
+                 sizeof(*h->starts)) < 0)
+                return -1;
+        memmove(&h->starts[i + 1], &h->starts[i],
+                (h->nstarts - i) * sizeof(*h->starts));
+        h->starts[i] = addr;
+        h->nstarts++;
+        h->again |= addr < pos;
+        return 0;
+}
+
+static int
+add_table(hints *h, uint32_t start, uint32_t end, uint32_t pos)
+{
+        uint32_t i = 0;
+
+        while (i < h->ntables && h->tables[i].start < start)
+                i++;
+        if (i < h->ntables && h->tables[i].start == start) {
+                if (h->tables[i].end >= end)
+                        return 0;
+                h->tables[i].end = end;
+                h->again |= start < pos;
+                return 0;
+        }
+        if (grow(h, (void **)&h->tables, h->ntables,
+                 sizeof(*h->tables)) < 0)
+                return -1;
+        memmove(&h->tables[i + 1], &h->tables[i],
+                (h->ntables - i) * sizeof(*h->tables));
+        h->tables[i].start = start;
+        h->tables[i].end = end;
+        h->tables[i].type = REGION_DATA;
+        h->ntables++;
+        h->again |= start < pos;
+        return 0;
+}
+
+/*
+ * The end of the table pos is in, if it's in one.  Otherwise 0, and
+ * *stop is the next place the sweep has to resync at.
+ */
+static uint32_t
+next_hint(const hints * const h, uint32_t pos, uint32_t *stop)
+{
+        uint32_t lo = 0, hi = h->ntables;
+
+        *stop = UINT32_MAX;
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                if (h->tables[mid].start <= pos)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        if (lo && pos < h->tables[lo - 1].end)
+                return h->tables[lo - 1].end;
+        if (lo < h->ntables)
+                *stop = h->tables[lo].start;
+
+        lo = 0;
+        hi = h->nstarts;
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                if (h->starts[mid] <= pos)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        if (lo < h->nstarts && h->starts[lo] < *stop)
+                *stop = h->starts[lo];
+        return 0;
+}
+
+/*
+ * If the instruction at index i dispatches through a table, remember the
+ * table and its targets, and cross-reference them.
+ */
+static int
+note_jump_table(image *img, hints *h, uint32_t i)
+{
+        const insn_rec *rec = &image_section(img, SEC_INSNS, insn_rec)[i];
+        uint32_t from = rec->addr, next = rec->addr + rec->len;
+        jump_table t;
+        insn insn;
+
+        if (!find_jump_table(img, i, &t))
+                return 0;
+        rec_to_insn(rec, &insn);
+
+        if (add_table(h, t.base, t.base + 2 * t.count, next) < 0 ||
+            add_xref(img, t.load, t.base, FLOW_RESOLVED) < 0)
+                return -1;
+        for (uint32_t k = 0; k < t.count; k++) {
+                uint32_t to = jump_table_target(img, &t, k);
+                uint32_t j;
+
+                for (j = 0; j < k; j++)
+                        if (jump_table_target(img, &t, j) == to)
+                                break;
+                if (j < k)
+                        continue;
+                if (add_start(h, to, next) < 0 ||
+                    add_xref(img, from, to,
+                             insn_flow(&insn) | FLOW_RESOLVED) < 0)
+                        return -1;
+        }
+        return 0;
+}
+
+/*
+ * A linear sweep, like disass(), that keeps what it finds, lists jump
+ * tables as data, and resyncs at their targets.
+ */
+static int
+sweep(image *img, hints *h)
+{
+        size_t pos;
+
+        image_count(img, SEC_INSNS) = 0;
+        image_count(img, SEC_REGIONS) = 0;
+        image_count(img, SEC_XREFS) = 0;
+        h->again = 0;
+
+        for (pos = 0; pos < img->size; ) {
+                insn insn;
+                uint8_t flags = 0;
+                uint32_t stop, end;
+                int64_t to;
+
+                if ((end = next_hint(h, pos, &stop)) != 0) {
+                        if (end > img->size)
+                                end = img->size;
+                        if (add_bytes(img, pos, end) < 0)
+                                return -1;
+                        pos = end;
+                        continue;
+                }
+                if (stop > img->size)
+                        stop = img->size;
+
+                if (decode_insn(img->buf, img->size, pos, &insn) < 0 ||
+                    pos + insn.len > stop) {
+                        if (add_bytes(img, pos, stop) < 0)
+                                return -1;
+                        pos = stop;
+                        continue;
+                }
+
+                if (!packed_is_defined(insn.packed) || insn.slack)
+                        flags |= INSN_BYTES;
+                if (add_insn(img, &insn, flags) < 0 ||
+                    add_region(img, pos, pos + insn.len,
+                               flags & INSN_BYTES ? REGION_DATA
+                                                  : REGION_CODE) < 0)
+                        return -1;
+
+                to = flags & INSN_BYTES ? -1 : branch_target(&insn);
+                if (to >= 0 &&
+                    add_xref(img, pos, to, insn_flow(&insn)) < 0)
+                        return -1;
+                if (!(flags & INSN_BYTES) &&
+                    (insn_flow(&insn) & FLOW_INDIRECT) &&
+                    note_jump_table(img, h,
+                                    image_count(img, SEC_INSNS) - 1) < 0)
+                        return -1;
+
+                pos += insn.len;
+        }
+        return 0;
+}
+
+/*
+ * Sweep until no jump table turns up behind where we found it, then work
+ * out what else we can and name things.
+ */
+int
+analyze_image(image *img)
+{
+        hints h = { { NULL, }, };
+        int rc = -1;
+
+        if (image_string(img, "") < 0)
+                return -1;
+
+        do {
+                if (sweep(img, &h) < 0)
+                        goto out;
+        } while (h.again);
+
+        if (resolve_indexed(img) < 0)
+                goto out;
+
+        if (image_count(img, SEC_XREFS))
+                qsort(img->sections[SEC_XREFS].base,
+                      image_count(img, SEC_XREFS), sizeof(xref), cmp_xref);
+
+        if (name_targets(img) < 0)
+                goto out;
+        for (uint32_t i = 0; i < h.ntables; i++) {
+                uint32_t addr = h.tables[i].start;
+                char name[16];
+
+                if (find_symbol(img, addr) || find_insn(img, addr) < 0)
+                        continue;
+                snprintf(name, sizeof(name), "tab_%05x", addr);
+                if (set_label(img, addr, name, SYM_AUTO) < 0)
+                        goto out;
+        }
+        rc = 0;
+out:
+        arena_free(&h.arena);
+        return rc;
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+        uint32_t ua = *(const uint32_t *)a, ub = *(const uint32_t *)b;
+
+        return ua < ub ? -1 : ua > ub;
+}
+
+/*
+ * Where control can go after the instruction at index i, not counting
+ * calls: up to MAX_SUCC addresses, since a jump table can go to any of
+ * its entries.  Returns -1 if it ends in something we can't follow (an
+ * indirect jump we don't know the table for, or raw bytes).
+ */
+#define MAX_SUCC        (JUMP_TABLE_MAX + 1)
+
+static int
+successors(const image * const img, uint32_t i, uint32_t succ[MAX_SUCC])
+{
+        const insn_rec *rec = &image_section(img, SEC_INSNS, insn_rec)[i];
+        uint32_t next = rec->addr + rec->len;
+        insn insn;
+        uint8_t flow;
+        int64_t to;
+        int n = 0;
+
+        if (rec->flags & INSN_BYTES)
+                return -1;
+
+        rec_to_insn(rec, &insn);
+        flow = insn_flow(&insn);
+        if ((flow & FLOW_BRANCH) && (flow & FLOW_INDIRECT)) {
+                jump_table t;
+
+                if (!find_jump_table(img, i, &t))
+                        return -1;
+                for (uint32_t k = 0; k < t.count; k++) {
+                        uint32_t to = jump_table_target(img, &t, k);
+                        int j;
+
+                        for (j = 0; j < n && succ[j] != to; j++)
+                                ;
+                        if (j == n)
+                                succ[n++] = to;
+                }
+                return n;
+        }
+
+        if ((flow & FLOW_BRANCH) && (to = branch_target(&insn)) >= 0)
+                succ[n++] = to;
+        if (!(flow & FLOW_STOP) && next < img->size)
+                succ[n++] = next;
+        return n;
+}
+
+/*
+ * The basic blocks reachable from entry without following calls, in
+ * address order.  A block ends at a branch, just before another block
+ * starts, or where we lose track of where control goes.  Everything,
+ * including *blocksp, comes from scratch.
+ */
+int
+function_blocks(const image * const img, uint32_t entry, arena *scratch,
+                block **blocksp, uint32_t *nblocksp)
+{
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint8_t *reached, *leads;
+        uint32_t *stack, *order, succ[MAX_SUCC];
+        uint32_t nstack = 0, norder = 0;
+        block *blocks;
+        uint32_t nblocks = 0;
+        int64_t i;
+
+        if ((i = find_insn(img, entry)) < 0)
+                return -1;
+
+        reached = arena_alloc(scratch, ninsns);
+        leads = arena_alloc(scratch, ninsns);
+        stack = arena_alloc(scratch, ninsns * sizeof(*stack));
+        order = arena_alloc(scratch, ninsns * sizeof(*order));
+        if (!reached || !leads || !stack || !order)
+                return -1;
+
+        leads[i] = reached[i] = 1;
+        stack[nstack++] = i;
+        while (nstack) {
+                int n;
+
+                i = stack[--nstack];
+                order[norder++] = i;
+
+                n = successors(img, i, succ);
+                for (int j = 0; j < n; j++) {
+                        int64_t k = find_insn(img, succ[j]);
+
+                        if (k < 0)
+                                continue;
+                        if (n > 1 || k != i + 1)
+                                leads[k] = 1;
+                        if (!reached[k]) {
+                                reached[k] = 1;
+                                stack[nstack++] = k;
+                        }
+                }
+        }
+
+        qsort(order, norder, sizeof(*order), cmp_u32);
+        for (uint32_t o = 0; o < norder; o++)
+                if (leads[order[o]])
+                        nblocks++;
+        blocks = arena_alloc(scratch, nblocks * sizeof(*blocks));
+        if (!blocks)
+                return -1;
+
+        nblocks = 0;
+        for (uint32_t o = 0; o < norder; o++) {
+                uint32_t l = order[o];
+                block *b;
+                int n;
+
+                if (!leads[l])
+                        continue;
+                b = &blocks[nblocks++];
+                for (i = l; ; i++) {
+                        n = successors(img, i, succ);
+                        if (n != 1 || i + 1 >= ninsns ||
+                            succ[0] != recs[i + 1].addr || leads[i + 1])
+                                break;
+                }
+                b->start = recs[l].addr;
+                b->end = recs[i].addr + recs[i].len;
+                b->nsucc = n < 0 ? 0 : n;
+                b->open = n < 0;
+                b->succ = arena_alloc(scratch,
+                                      b->nsucc * sizeof(*b->succ));
+                if (!b->succ)
+                        return -1;
+                memcpy(b->succ, succ, b->nsucc * sizeof(*b->succ));
+                qsort(b->succ, b->nsucc, sizeof(b->succ[0]), cmp_u32);
+        }
+
+        *blocksp = blocks;
+        *nblocksp = nblocks;
+        return 0;
+}
+
+int
+valid_label(const char * const name)
+{
+        if (!name[0] || isdigit((unsigned char)name[0]))
+                return 0;
+        for (const char *p = name; *p; p++)
+                if (!isalnum((unsigned char)*p) && *p != '_' && *p != '.')
+                        return 0;
+        return 1;
+}
+
+int
+set_label(image *img, uint32_t addr, const char * const name,
+          uint32_t flags)
+{
+        int64_t off;
+        symbol *sym;
+
+        if (!valid_label(name)) {
+                warnx("\"%s\" is not a valid label", name);
+                return -1;
+        }
+        if (find_insn(img, addr) < 0) {
+                warnx("0x%05x is not the start of an instruction", addr);
+                return -1;
+        }
+
+        off = image_string(img, name);
+        if (off < 0)
+                return -1;
+
+        sym = find_symbol(img, addr);
+        if (!sym) {
+                sym = image_insert(img, SEC_SYMBOLS,
+                                   lower_bound(img, SEC_SYMBOLS, symbol,
+                                               addr, addr));
+                if (!sym)
+                        return -1;
+                sym->addr = addr;
+        } else if (!(flags & SYM_AUTO)) {
+                flags |= sym->flags & SYM_FUNC;
+        }
+        sym->name = off;
+        sym->flags = flags;
+        return 0;
+}
+
+int
+add_comment(image *img, uint32_t addr, const char * const text)
+{
+        int64_t off;
+        uint32_t i;
+        comment *c;
+
+        if (addr >= img->size) {
+                warnx("0x%05x is past the end of \"%s\"", addr,
+                      img->filename);
+                return -1;
+        }
+        if (strchr(text, '\n')) {
+                warnx("comments must be a single line");
+                return -1;
+        }
+
+        off = image_string(img, text);
+        if (off < 0)
+                return -1;
+
+        /* after any comments already there, so they stay in order */
+        i = lower_bound(img, SEC_COMMENTS, comment, addr, addr + 1);
+        c = image_insert(img, SEC_COMMENTS, i);
+        if (!c)
+                return -1;
+        c->addr = addr;
+        c->text = off;
+        return 0;
+}
+
+static int
+cmp_xref_from(const void *a, const void *b)
+{
+        const xref *xa = a, *xb = b;
+
+        if (xa->from != xb->from)
+                return xa->from < xb->from ? -1 : 1;
+        return 0;
+}
+
+/*
+ * The same listing disass() prints, with labels and comments, and where
+ * any indexed operand we could work out points to.  It still assembles
+ * back to the image.  If there's an fn, it gets each record first, and
+ * can put lines of its own above the labels and more in the note.
+ */
+void
+print_listing_notes(FILE *out, image *img, listing_fn fn, void *data)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        const symbol *syms = image_section(img, SEC_SYMBOLS, symbol);
+        const comment *comments = image_section(img, SEC_COMMENTS,
+                                                comment);
+        const xref *xrefs = image_section(img, SEC_XREFS, xref);
+        uint32_t nsyms = image_count(img, SEC_SYMBOLS);
+        uint32_t ncomments = image_count(img, SEC_COMMENTS);
+        uint32_t nxrefs = image_count(img, SEC_XREFS);
+        uint32_t s = 0, c = 0, r = 0, nresolved = 0;
+        xref *resolved = NULL;
+        arena_pos pos;
+
+        arena_mark(&img->arena, &pos);
+        for (uint32_t i = 0; i < nxrefs; i++)
+                nresolved += !!(xrefs[i].flow & FLOW_RESOLVED);
+        if (nresolved) {
+                resolved = arena_alloc(&img->arena,
+                                       nresolved * sizeof(*resolved));
+                if (!resolved)
+                        nresolved = 0;
+                for (uint32_t i = 0, j = 0; j < nresolved; i++)
+                        if (xrefs[i].flow & FLOW_RESOLVED)
+                                resolved[j++] = xrefs[i];
+                qsort(resolved, nresolved, sizeof(*resolved),
+                      cmp_xref_from);
+        }
+
+        for (uint32_t i = 0; i < image_count(img, SEC_INSNS); i++) {
+                const insn_rec *rec = &recs[i];
+                const char *to = NULL;
+                char note[INSN_LINE_MAX], extra[64] = "", addr[16];
+                insn insn;
+
+                rec_to_insn(rec, &insn);
+                if (fn)
+                        fn(out, data, i, &insn, extra, sizeof(extra));
+                for (; s < nsyms && syms[s].addr <= rec->addr; s++)
+                        if (syms[s].addr == rec->addr)
+                                fprintf(out, "%s:\n",
+                                        image_str(img, syms[s].name));
+                for (; c < ncomments &&
+                       comments[c].addr < rec->addr + rec->len; c++)
+                        fprintf(out, "; %s\n",
+                                image_str(img, comments[c].text));
+
+                for (; r < nresolved && resolved[r].from < rec->addr; r++)
+                        ;
+                /* a jump through a table goes too many places to say */
+                if (r < nresolved && resolved[r].from == rec->addr &&
+                    (r + 1 == nresolved ||
+                     resolved[r + 1].from != rec->addr)) {
+                        const symbol *sym = find_symbol(img,
+                                                        resolved[r].to);
+
+                        snprintf(addr, sizeof(addr), "0x%05x",
+                                 resolved[r].to);
+                        to = sym ? image_str(img, sym->name)
+                                 : reg_name(resolved[r].to);
+                        if (!to)
+                                to = addr;
+                }
+                if (to && extra[0])
+                        snprintf(note, sizeof(note), "%s, %s", to, extra);
+                else
+                        snprintf(note, sizeof(note), "%s",
+                                 to ? to : extra);
+                print_insn_note(out, img->buf, &insn,
+                                note[0] ? note : NULL);
+        }
+        arena_reset(&img->arena, &pos);
+}
+
+void
+print_listing(FILE *out, image *img)
+{
+        print_listing_notes(out, img, NULL, NULL);
+}
+
+// vim:fenc=utf-8:tw=75:et
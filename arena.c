@@ -0,0 +1,205 @@
+/*
+ * arena.c - bump allocation for per-image state
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * An arena is a list of mmap()ed chunks, newest first, and allocating
+ * is bumping the newest chunk's used count.  Nothing is freed on its
+ * own; arena_reset() drops everything since a mark, and arena_free()
+ * drops everything.  Dropped chunks are kept for reuse until then.
+ *
+ * A zero-filled arena is ready to use.
+ */
+#define ARENA_ALIGN     16
+#define ARENA_CHUNK     (1ul << 20)
+#define HUGE_PAGE       (2ul << 20)
+
+int arena_huge_pages = 0;
+
+struct arena_chunk_s {
+        arena_chunk *next;
+        size_t size;            // usable bytes after the header
+        size_t used;
+        size_t dirty;           // bytes below this may not be zero
+        size_t maplen;
+};
+
+/* the header is padded so the data after it is ARENA_ALIGN aligned */
+#define CHUNK_HEADER \
+        ((sizeof(arena_chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define chunk_data(c) ((uint8_t *)(c) + CHUNK_HEADER)
+
+static size_t
+round_up(size_t n, size_t to)
+{
+        return (n + to - 1) & ~(to - 1);
+}
+
+/*
+ * Memory handed out again after a reset has to be cleared.
+ */
+static void
+zero_dirty(arena_chunk *c, size_t from, size_t to)
+{
+        if (from < c->dirty)
+                memset(chunk_data(c) + from, 0,
+                       (to < c->dirty ? to : c->dirty) - from);
+        if (to > c->dirty)
+                c->dirty = to;
+}
+
+static arena_chunk *
+map_chunk(size_t size)
+{
+        size_t maplen = round_up(size + CHUNK_HEADER, ARENA_CHUNK);
+        arena_chunk *c = MAP_FAILED;
+
+        if (arena_huge_pages) {
+                maplen = round_up(maplen, HUGE_PAGE);
+                c = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (c == MAP_FAILED) {
+                c = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (c == MAP_FAILED)
+                        return NULL;
+                if (arena_huge_pages)
+                        madvise(c, maplen, MADV_HUGEPAGE);
+        }
+
+        c->maplen = maplen;
+        c->size = maplen - CHUNK_HEADER;
+        return c;
+}
+
+static arena_chunk *
+new_chunk(arena *a, size_t size)
+{
+        arena_chunk **pp, *c;
+
+        for (pp = &a->spare; *pp; pp = &(*pp)->next) {
+                if ((*pp)->size >= size) {
+                        c = *pp;
+                        *pp = c->next;
+                        goto found;
+                }
+        }
+
+        c = map_chunk(size);
+        if (!c)
+                return NULL;
+found:
+        c->used = 0;
+        c->next = a->chunks;
+        a->chunks = c;
+        return c;
+}
+
+/*
+ * Zeroed, 16-byte aligned memory that lives until the arena is reset
+ * past it or freed.
+ */
+void *
+arena_alloc(arena *a, size_t size)
+{
+        arena_chunk *c = a->chunks;
+        uint8_t *p;
+
+        size = round_up(size ? size : 1, ARENA_ALIGN);
+        if (!c || c->size - c->used < size) {
+                c = new_chunk(a, size);
+                if (!c) {
+                        errno = ENOMEM;
+                        return NULL;
+                }
+        }
+
+        p = chunk_data(c) + c->used;
+        zero_dirty(c, c->used, c->used + size);
+        c->used += size;
+        return p;
+}
+
+/*
+ * Grow an allocation.  If it's the newest thing in the arena it grows in
+ * place; otherwise it's copied, and the old copy is wasted until the
+ * arena goes away.
+ */
+void *
+arena_realloc(arena *a, void *old, size_t oldsize, size_t newsize)
+{
+        arena_chunk *c = a->chunks;
+        size_t oldround = round_up(oldsize ? oldsize : 1, ARENA_ALIGN);
+        size_t newround = round_up(newsize ? newsize : 1, ARENA_ALIGN);
+        void *p;
+
+        if (old && c &&
+            (uint8_t *)old + oldround == chunk_data(c) + c->used &&
+            c->used - oldround + newround <= c->size) {
+                size_t start = c->used - oldround;
+
+                if (newround > oldround)
+                        zero_dirty(c, c->used, start + newround);
+                c->used = start + newround;
+                return old;
+        }
+
+        p = arena_alloc(a, newsize);
+        if (p && old)
+                memcpy(p, old, oldsize < newsize ? oldsize : newsize);
+        return p;
+}
+
+void
+arena_mark(const arena * const a, arena_pos *pos)
+{
+        pos->chunk = a->chunks;
+        pos->used = a->chunks ? a->chunks->used : 0;
+}
+
+/*
+ * Forget everything allocated since pos.
+ */
+void
+arena_reset(arena *a, const arena_pos * const pos)
+{
+        while (a->chunks && a->chunks != pos->chunk) {
+                arena_chunk *c = a->chunks;
+
+                a->chunks = c->next;
+                c->next = a->spare;
+                a->spare = c;
+        }
+        if (a->chunks)
+                a->chunks->used = pos->used;
+}
+
+void
+arena_free(arena *a)
+{
+        arena_chunk *lists[] = { a->chunks, a->spare };
+
+        for (int i = 0; i < 2; i++) {
+                while (lists[i]) {
+                        arena_chunk *c = lists[i];
+
+                        lists[i] = c->next;
+                        munmap(c, c->maplen);
+                }
+        }
+        a->chunks = a->spare = NULL;
+}
+
+// vim:fenc=utf-8:tw=75:et
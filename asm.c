@@ -0,0 +1,645 @@
+/*
+ * asm.c - assembler for hc16dis listings
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The reverse index is built from opcodes[][] the first time it's
+ * needed.  Every defined entry becomes a "form": its encoding plus the
+ * shape of its operand list as print_insn() writes it, i.e. the text in
+ * front of each operand and how many hex digits it has.  Forms are
+ * grouped by mnemonic, and mnemonics are found through a
+ * hash-and-displace perfect hash, so a lookup is one string hash and one
+ * strcmp no matter how the table grows.
+ */
+typedef struct asm_arg_s {
+        const char *prefix;
+        const shape_arg *arg;
+        int digits;
+} asm_arg;
+
+typedef struct asm_form_s {
+        uint8_t prefix;
+        uint8_t opcode;
+        op *op;
+        const shape *shape;
+        int nargs;
+        asm_arg args[4];
+} asm_form;
+
+typedef struct mnem_slot_s {
+        const char *mnemonic;
+        uint16_t first;
+        uint16_t count;
+} mnem_slot;
+
+#define MNEM_SLOTS 512
+#define MNEM_BUCKETS 128
+
+static asm_form forms[4 * 0x100];
+static int nforms;
+static mnem_slot slots[MNEM_SLOTS];
+static uint16_t displacements[MNEM_BUCKETS];
+static pthread_once_t index_once = PTHREAD_ONCE_INIT;
+
+static const uint8_t prebytes[4] = { 0x00, 0x17, 0x27, 0x37 };
+
+static uint32_t
+fnv1a(const char *s, size_t len, uint32_t hash)
+{
+        for (size_t i = 0; i < len; i++) {
+                hash ^= (uint8_t)s[i];
+                hash *= 16777619;
+        }
+        return hash;
+}
+
+#define hash(s, len) fnv1a(s, len, 2166136261u)
+
+/*
+ * Each displacement re-mixes the whole hash, so two mnemonics that share
+ * a bucket can always be pulled apart unless their hashes are identical.
+ */
+static inline unsigned int
+slot_of(uint32_t h, uint16_t d)
+{
+        h ^= d * 0x9e3779b9u;
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h & (MNEM_SLOTS - 1);
+}
+
+static int
+form_cmp(const void *a, const void *b)
+{
+        const asm_form *fa = a, *fb = b;
+        int rc = strcmp(fa->op->mnemonic, fb->op->mnemonic);
+
+        if (rc)
+                return rc;
+        if (fa->prefix != fb->prefix)
+                return fa->prefix - fb->prefix;
+        return fa->opcode - fb->opcode;
+}
+
+typedef struct mnem_key_s {
+        const char *mnemonic;
+        uint16_t first;
+        uint16_t count;
+        uint32_t h;
+} mnem_key;
+
+typedef struct mnem_bucket_s {
+        int bucket;
+        int nkeys;
+        int keys[8];
+} mnem_bucket;
+
+static int
+bucket_cmp(const void *a, const void *b)
+{
+        const mnem_bucket *ba = a, *bb = b;
+
+        return bb->nkeys - ba->nkeys;
+}
+
+static void
+build_index(void)
+{
+        static mnem_key keys[4 * 0x100];
+        static mnem_bucket buckets[MNEM_BUCKETS];
+        int nkeys = 0;
+
+        for (int page = 0; page < 4; page++) {
+                for (int opcode = 0; opcode < 0x100; opcode++) {
+                        op *op = &opcodes[page][opcode];
+                        packed_op packed = packed_opcodes[page][opcode];
+                        const shape *shape = &shapes[packed.shape];
+                        asm_form *form;
+
+                        if (!packed_is_defined(packed))
+                                continue;
+
+                        form = &forms[nforms++];
+                        form->prefix = prebytes[page];
+                        form->opcode = opcode;
+                        form->op = op;
+                        form->shape = shape;
+                        if (mode_operand(packed.mode)) {
+                                form->nargs = 1;
+                                form->args[0].prefix =
+                                        mode_operand(packed.mode);
+                                continue;
+                        }
+                        for (int i = 0; i < shape->nargs; i++) {
+                                const shape_arg *arg;
+
+                                arg = &shape->args[arg_order(packed.mode,
+                                                             shape, i)];
+                                form->args[i].arg = arg;
+                                form->args[i].prefix =
+                                        arg_prefix(arg, packed.mode);
+                                form->args[i].digits =
+                                        opkinds[arg->kind].digits;
+                        }
+                        form->nargs = shape->nargs;
+                }
+        }
+        qsort(forms, nforms, sizeof(forms[0]), form_cmp);
+
+        for (int i = 0; i < nforms; i++) {
+                const char *mnemonic = forms[i].op->mnemonic;
+                mnem_key *key;
+
+                if (nkeys && !strcmp(keys[nkeys-1].mnemonic, mnemonic)) {
+                        keys[nkeys-1].count += 1;
+                        continue;
+                }
+                key = &keys[nkeys++];
+                key->mnemonic = mnemonic;
+                key->first = i;
+                key->count = 1;
+                key->h = hash(mnemonic, strlen(mnemonic));
+        }
+
+        for (int b = 0; b < MNEM_BUCKETS; b++)
+                buckets[b].bucket = b;
+        for (int i = 0; i < nkeys; i++) {
+                mnem_bucket *bucket = &buckets[keys[i].h % MNEM_BUCKETS];
+
+                if (bucket->nkeys == 8)
+                        errx(8, "Too many mnemonics in hash bucket %d",
+                             bucket->bucket);
+                bucket->keys[bucket->nkeys++] = i;
+        }
+        qsort(buckets, MNEM_BUCKETS, sizeof(buckets[0]), bucket_cmp);
+
+        for (int b = 0; b < MNEM_BUCKETS && buckets[b].nkeys; b++) {
+                mnem_bucket *bucket = &buckets[b];
+                unsigned int placed[8];
+                uint16_t d;
+
+                for (d = 0; d < UINT16_MAX; d++) {
+                        int k;
+
+                        for (k = 0; k < bucket->nkeys; k++) {
+                                mnem_key *key = &keys[bucket->keys[k]];
+                                unsigned int slot = slot_of(key->h, d);
+
+                                if (slots[slot].mnemonic)
+                                        break;
+                                for (int j = 0; j < k; j++)
+                                        if (placed[j] == slot)
+                                                goto next;
+                                placed[k] = slot;
+                        }
+                        if (k == bucket->nkeys)
+                                break;
+next:
+                        continue;
+                }
+                if (d == UINT16_MAX)
+                        errx(8, "Could not build mnemonic hash");
+
+                displacements[bucket->bucket] = d;
+                for (int k = 0; k < bucket->nkeys; k++) {
+                        mnem_key *key = &keys[bucket->keys[k]];
+
+                        slots[placed[k]].mnemonic = key->mnemonic;
+                        slots[placed[k]].first = key->first;
+                        slots[placed[k]].count = key->count;
+                }
+        }
+}
+
+static const mnem_slot *
+lookup_mnemonic(const char *s, size_t len)
+{
+        uint32_t h = hash(s, len);
+        const mnem_slot *slot;
+
+        slot = &slots[slot_of(h, displacements[h % MNEM_BUCKETS])];
+        if (!slot->mnemonic || strncmp(slot->mnemonic, s, len) ||
+            slot->mnemonic[len])
+                return NULL;
+        return slot;
+}
+
+typedef struct asm_token_s {
+        const char *prefix;
+        size_t prefixlen;
+        int negative;
+        int digits;
+        uint32_t value;
+} asm_token;
+
+static inline int
+hexval(char c)
+{
+        if (c >= '0' && c <= '9')
+                return c - '0';
+        if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+        return -1;
+}
+
+static inline int
+is_space(char c)
+{
+        return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *
+skip_space(const char *p, const char *end)
+{
+        while (p < end && is_space(*p))
+                p++;
+        return p;
+}
+
+/*
+ * A token is whatever prefix text format_arg() put in front of the
+ * number, an optional sign, then "0x" and the number itself.  Tokens
+ * without a number (like "[%x]+%e") are all prefix.
+ */
+static int
+parse_token(const char *p, const char *end, asm_token *token)
+{
+        const char *q;
+
+        while (end > p && is_space(end[-1]))
+                end--;
+
+        token->prefix = p;
+        token->negative = 0;
+        token->digits = 0;
+        token->value = 0;
+
+        for (q = p; q + 1 < end; q++)
+                if (q[0] == '0' && (q[1] == 'x' || q[1] == 'X'))
+                        break;
+        if (q + 1 >= end) {
+                token->prefixlen = end - p;
+                return 0;
+        }
+
+        token->prefixlen = q - p;
+        if (q > p && (q[-1] == '+' || q[-1] == '-')) {
+                token->negative = q[-1] == '-';
+                token->prefixlen -= 1;
+        }
+        for (q += 2; q < end; q++) {
+                int v = hexval(*q);
+
+                if (v < 0 || token->digits == 8)
+                        return -1;
+                token->value = (token->value << 4) | v;
+                token->digits += 1;
+        }
+
+        return token->digits ? 0 : -1;
+}
+
+/*
+ * Whether token's number could be this operand.  Branch targets depend
+ * on where the instruction ends up, so unformat_arg() checks those.  The
+ * listing writes signed operands with a sign, so "#0xff" is never an
+ * 8-bit -1.
+ */
+static int
+token_fits(const asm_arg * const arg, const asm_token * const token)
+{
+        const opkind_info *kind;
+        uint64_t max;
+
+        if (!arg->arg)
+                return !token->digits;
+        if (!token->digits)
+                return 0;
+        kind = &opkinds[arg->arg->kind];
+        if (kind->rel)
+                return 1;
+        if (!kind->sext)
+                return !token->negative &&
+                       token->value <= (1ull << kind->bits) - 1;
+        max = (1ull << (kind->bits - 1)) - !token->negative;
+        return token->value <= max;
+}
+
+/*
+ * The form whose operands look like these.  Numbers can have any number
+ * of digits; when more than one form would take them (ind8 and ind16,
+ * say), the one with the digits the listing would have used wins, or
+ * failing that, the narrowest.
+ */
+static const asm_form *
+match_form(const mnem_slot *slot, const asm_token *tokens, int ntokens)
+{
+        const asm_form *best = NULL;
+        int best_digits = 0;
+
+        for (int i = slot->first; i < slot->first + slot->count; i++) {
+                const asm_form *form = &forms[i];
+                int j, exact = 1, digits = 0;
+
+                if (form->nargs != ntokens)
+                        continue;
+                for (j = 0; j < ntokens; j++) {
+                        const asm_arg *arg = &form->args[j];
+
+                        if (strlen(arg->prefix) != tokens[j].prefixlen ||
+                            strncmp(arg->prefix, tokens[j].prefix,
+                                    tokens[j].prefixlen) ||
+                            !token_fits(arg, &tokens[j]))
+                                break;
+                        if (arg->digits != tokens[j].digits)
+                                exact = 0;
+                        digits += arg->digits;
+                }
+                if (j < ntokens)
+                        continue;
+                if (exact)
+                        return form;
+                if (!best || digits < best_digits) {
+                        best = form;
+                        best_digits = digits;
+                }
+        }
+
+        return best;
+}
+
+/*
+ * The inverse of format_arg(): turn what's in the listing back into the
+ * operand's fields.
+ */
+static int
+unformat_arg(const shape * const shape, const shape_arg * const arg,
+             const asm_token * const token, insn *insn)
+{
+        const opkind_info *kind = &opkinds[arg->kind];
+        uint32_t mask = (1u << kind->bits) - 1;
+        int64_t value = token->value;
+        int shift = 0;
+
+        if (token->negative) {
+                if (!kind->sext || kind->rel)
+                        return -1;
+                value = -value;
+        }
+
+        if (kind->rel) {
+                value = (value - rel_base(insn)) & 0xfffff;
+                if (value & 0x80000)
+                        value -= 0x100000;
+        }
+
+        if (kind->sext) {
+                if (value < -(1ll << (kind->bits - 1)) || value > mask)
+                        return -1;
+                if (kind->rel && value >= 1ll << (kind->bits - 1))
+                        return -1;
+        } else if (value > mask) {
+                return -1;
+        }
+        value &= mask;
+
+        for (int i = arg->first + arg->nfields - 1; i >= arg->first; i--) {
+                insn->values[i] = (value >> shift) &
+                                  ((1u << shape->fbits[i]) - 1);
+                shift += shape->fbits[i];
+        }
+
+        return 0;
+}
+
+typedef struct asm_output_s {
+        uint8_t *buf;
+        size_t len;
+        size_t size;
+} asm_output;
+
+static int
+emit(asm_output *out, const uint8_t *bytes, size_t len)
+{
+        if (out->len + len > out->size) {
+                size_t size = out->size ? out->size * 2 : 4096;
+                uint8_t *buf;
+
+                while (size < out->len + len)
+                        size *= 2;
+                buf = realloc(out->buf, size);
+                if (!buf)
+                        return -1;
+                out->buf = buf;
+                out->size = size;
+        }
+        memcpy(out->buf + out->len, bytes, len);
+        out->len += len;
+        return 0;
+}
+
+/*
+ * Lines look like what print_insn() writes:
+ *
+ *   00000010: 170512345678        ldaa [%x]+0x1234
+ *
+ * The address and hex columns are optional and ignored when present, so
+ * a listing can be edited and fed straight back in.  Anything after a
+ * ';' is a comment, and a word ending in ':' is a label.
+ */
+static int
+assemble_line(const char *filename, size_t lineno, const char *p,
+              const char *end, asm_output *out)
+{
+        asm_token tokens[MAX_INSN_LEN];
+        int ntokens = 0;
+        const char *q, *mnemonic;
+        size_t mnemlen;
+        const mnem_slot *slot;
+        const asm_form *form;
+        uint8_t bytes[MAX_INSN_LEN];
+        insn insn;
+        int len;
+
+        for (q = p; q < end; q++)
+                if (*q == ';')
+                        break;
+        end = q;
+
+        p = skip_space(p, end);
+        for (q = p; q < end && hexval(*q) >= 0; q++)
+                ;
+        if (q > p && q < end && *q == ':') {
+                p = skip_space(q + 1, end);
+                for (q = p; q < end && hexval(*q) >= 0; q++)
+                        ;
+                p = skip_space(q, end);
+        }
+        for (q = p; q < end && !is_space(*q); q++)
+                ;
+        if (q > p && q[-1] == ':')
+                p = skip_space(q, end);
+        if (p == end)
+                return 0;
+
+        mnemonic = p;
+        while (p < end && !is_space(*p))
+                p++;
+        mnemlen = p - mnemonic;
+        p = skip_space(p, end);
+
+        while (p < end) {
+                for (q = p; q < end && *q != ','; q++)
+                        ;
+                if (ntokens == MAX_INSN_LEN ||
+                    parse_token(p, q, &tokens[ntokens++]) < 0) {
+                        warnx("%s:%zu: bad operand \"%.*s\"", filename,
+                              lineno, (int)(q - p), p);
+                        return -1;
+                }
+                p = q < end ? skip_space(q + 1, end) : end;
+        }
+
+        if (mnemlen == 5 && !strncmp(mnemonic, ".byte", 5)) {
+                for (int i = 0; i < ntokens; i++) {
+                        if (tokens[i].prefixlen || tokens[i].digits > 2) {
+                                warnx("%s:%zu: bad .byte value", filename,
+                                      lineno);
+                                return -1;
+                        }
+                        bytes[i] = tokens[i].value;
+                }
+                return emit(out, bytes, ntokens);
+        }
+
+        slot = lookup_mnemonic(mnemonic, mnemlen);
+        if (!slot) {
+                warnx("%s:%zu: unknown instruction \"%.*s\"", filename,
+                      lineno, (int)mnemlen, mnemonic);
+                return -1;
+        }
+
+        form = match_form(slot, tokens, ntokens);
+        if (!form) {
+                warnx("%s:%zu: no form of \"%s\" takes these operands",
+                      filename, lineno, slot->mnemonic);
+                return -1;
+        }
+
+        memset(&insn, 0, sizeof(insn));
+        insn.pos = out->len;
+        insn.prefix = form->prefix;
+        insn.opcode = form->opcode;
+        insn.op = form->op;
+        for (int i = 0; i < ntokens && form->args[i].arg; i++) {
+                if (unformat_arg(form->shape, form->args[i].arg,
+                                 &tokens[i], &insn) < 0) {
+                        warnx("%s:%zu: operand %d of \"%s\" is out of "
+                              "range", filename, lineno, i + 1,
+                              slot->mnemonic);
+                        return -1;
+                }
+        }
+
+        len = encode_insn(&insn, bytes, sizeof(bytes));
+        if (len < 0)
+                return len;
+        return emit(out, bytes, len);
+}
+
+int
+assemble(const char *filename, const char *text, size_t size,
+         uint8_t **outp, size_t *outlen)
+{
+        asm_output out = { NULL, 0, 0 };
+        const char *p = text, *end = text + size;
+        size_t lineno = 0;
+        int errors = 0;
+
+        pthread_once(&index_once, build_index);
+
+        while (p < end) {
+                const char *eol = memchr(p, '\n', end - p);
+
+                if (!eol)
+                        eol = end;
+                lineno++;
+                if (assemble_line(filename, lineno, p, eol, &out) < 0)
+                        errors++;
+                p = eol + 1;
+        }
+
+        if (errors) {
+                free(out.buf);
+                errno = EINVAL;
+                return -1;
+        }
+
+        *outp = out.buf;
+        *outlen = out.len;
+        return 0;
+}
+
+int
+asm_file(const char * const infile, const char * const outfile)
+{
+        FILE *in, *out;
+        struct stat sb;
+        char *text;
+        uint8_t *bin = NULL;
+        size_t sz, binlen = 0;
+        int rc;
+
+        in = fopen(infile, "r");
+        if (!in)
+                err(2, "Could not open \"%s\"", infile);
+
+        rc = fstat(fileno(in), &sb);
+        if (rc < 0)
+                err(3, "Could not stat input");
+
+        text = malloc(sb.st_size + 1);
+        if (!text)
+                err(4, "Could not allocate memory");
+
+        sz = fread(text, 1, sb.st_size, in);
+        if (sz != (uint64_t)sb.st_size)
+                err(5, "Could not read file");
+        fclose(in);
+
+        rc = assemble(infile, text, sz, &bin, &binlen);
+        free(text);
+        if (rc < 0)
+                return rc;
+
+        out = fopen(outfile, "w");
+        if (!out)
+                err(2, "Could not open \"%s\"", outfile);
+        if (fwrite(bin, 1, binlen, out) != binlen || fclose(out) == EOF)
+                err(5, "Could not write \"%s\"", outfile);
+        free(bin);
+
+        return 0;
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,550 @@
+/*
+ * banks.c - list images that bank-switch several things into one window
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A memory model says where the parts of a flash image show up in the
+ * CPU's address space, one directive per line:
+ *
+ *      window ADDR SIZE                the bank-switched window
+ *      common FILEOFF ADDR SIZE        always mapped, outside the window
+ *      bank NAME FILEOFF               SIZE bytes shown in the window
+ *      stub ADDR BANK TARGET           calling ADDR calls TARGET in BANK
+ *      farcall ADDR                    calling ADDR calls the BANK and
+ *                                      TARGET in the 3 bytes after it
+ *
+ * Addresses, offsets and sizes are hex; lines starting with '#' are
+ * comments.  A farcall's bank byte is the bank's position in the model,
+ * counting from 0, and its 16-bit target is in the window's 64 KiB bank.
+ *
+ * Each common region is listed once, and then each bank is listed as the
+ * CPU would see it with that bank switched in, so branches inside it and
+ * out to common code come out right.  Calls through the stubs and far
+ * call routines are noted with the bank and address they end up at, and
+ * calls from common code straight into the window are noted as banked,
+ * since nothing says which bank they get.
+ *
+ * Banks tend to share a lot, so each bank is listed a page at a time,
+ * and a page with the same bytes at the same place in the window, that
+ * the listing runs into at the same offset, is only decoded the first
+ * time; after that its text is just copied out.  Whatever straddles the
+ * end of a page depends on the next one, so that's always decoded.
+ */
+#define ADDR_SPACE      0x100000
+#define BANK_PAGE       4096
+#define FARCALL_BYTES   3
+
+typedef struct mapping_s {
+        char *name;             // NULL for common maps
+        uint64_t off;
+        uint32_t addr;
+        uint32_t size;
+} mapping;
+
+typedef struct stub_s {
+        uint32_t addr;
+        char *bank;
+        uint32_t target;
+        int farcall;
+} stub;
+
+typedef struct page_text_s {
+        struct page_text_s *next;       // others at the same place
+        const uint8_t *bytes;           // in the image
+        uint32_t entry;                 // where in the page we started
+        uint32_t exit;                  // where the next item starts
+        char *text;
+        size_t len;
+} page_text;
+
+typedef struct model_s {
+        uint32_t win_addr;
+        uint32_t win_size;
+        mapping *maps;
+        uint32_t nmaps;
+        stub *stubs;
+        uint32_t nstubs;
+        uint8_t *view;                  // the address space
+        page_text **pages;              // by page in the window
+        uint32_t npages;
+        uint32_t decoded;
+        uint32_t shared;
+} model;
+
+static int
+hex(const char * const s, uint64_t max, uint64_t *value)
+{
+        char *end = NULL;
+
+        if (!s)
+                return -1;
+        errno = 0;
+        *value = strtoull(s, &end, 16);
+        return errno || !end || *end || end == s || *value > max ? -1 : 0;
+}
+
+static int
+add_map(model *m, char *name, uint64_t off, uint32_t addr, uint32_t size)
+{
+        mapping *new;
+
+        new = reallocarray(m->maps, m->nmaps + 1, sizeof(*new));
+        if (!new)
+                return -1;
+        m->maps = new;
+        m->maps[m->nmaps++] = (mapping){ name, off, addr, size };
+        return 0;
+}
+
+static int
+add_stub(model *m, uint32_t addr, char *bank, uint32_t target, int farcall)
+{
+        stub *new;
+
+        new = reallocarray(m->stubs, m->nstubs + 1, sizeof(*new));
+        if (!new)
+                return -1;
+        m->stubs = new;
+        m->stubs[m->nstubs++] = (stub){ addr, bank, target, farcall };
+        return 0;
+}
+
+/*
+ * One directive.  Returns 0, or -1 if it's wrong, or -2 if we ran out of
+ * memory.
+ */
+static int
+parse_line(model *m, char *line)
+{
+        char *save = NULL, *words[5] = { NULL, };
+        uint64_t a, b, c;
+        int n = 0;
+
+        for (char *w = strtok_r(line, " \t\r\n", &save); w;
+             w = strtok_r(NULL, " \t\r\n", &save)) {
+                if (n == 5)
+                        return -1;
+                words[n++] = w;
+        }
+        if (!n || words[0][0] == '#')
+                return 0;
+
+        if (!strcmp(words[0], "window") && n == 3) {
+                if (m->win_size || hex(words[1], ADDR_SPACE - 1, &a) < 0 ||
+                    hex(words[2], ADDR_SPACE - a, &b) < 0 || !b)
+                        return -1;
+                m->win_addr = a;
+                m->win_size = b;
+        } else if (!strcmp(words[0], "common") && n == 4) {
+                if (hex(words[1], UINT64_MAX, &a) < 0 ||
+                    hex(words[2], ADDR_SPACE - 1, &b) < 0 ||
+                    hex(words[3], ADDR_SPACE - b, &c) < 0 || !c)
+                        return -1;
+                return add_map(m, NULL, a, b, c) < 0 ? -2 : 0;
+        } else if (!strcmp(words[0], "bank") && n == 3) {
+                char *name;
+
+                if (hex(words[2], UINT64_MAX, &a) < 0)
+                        return -1;
+                name = strdup(words[1]);
+                if (!name || add_map(m, name, a, 0, 0) < 0) {
+                        free(name);
+                        return -2;
+                }
+        } else if (!strcmp(words[0], "stub") && n == 4) {
+                char *name;
+
+                if (hex(words[1], ADDR_SPACE - 1, &a) < 0 ||
+                    hex(words[3], ADDR_SPACE - 1, &c) < 0)
+                        return -1;
+                name = strdup(words[2]);
+                if (!name || add_stub(m, a, name, c, 0) < 0) {
+                        free(name);
+                        return -2;
+                }
+        } else if (!strcmp(words[0], "farcall") && n == 2) {
+                if (hex(words[1], ADDR_SPACE - 1, &a) < 0)
+                        return -1;
+                return add_stub(m, a, NULL, 0, 1) < 0 ? -2 : 0;
+        } else {
+                return -1;
+        }
+        return 0;
+}
+
+static const mapping *
+find_bank(const model * const m, const char * const name, uint32_t number)
+{
+        uint32_t k = 0;
+
+        for (uint32_t i = 0; i < m->nmaps; i++) {
+                if (!m->maps[i].name)
+                        continue;
+                if (name ? !strcmp(m->maps[i].name, name) : k == number)
+                        return &m->maps[i];
+                k++;
+        }
+        return NULL;
+}
+
+/*
+ * Check everything fits together, and fits in an image of size bytes.
+ */
+static int
+check_model(model *m, const char * const path, size_t size)
+{
+        int nbanks = 0;
+
+        if (!m->win_size) {
+                warnx("%s: no window", path);
+                return -1;
+        }
+        for (uint32_t i = 0; i < m->nmaps; i++) {
+                mapping *r = &m->maps[i];
+
+                if (r->name) {
+                        r->addr = m->win_addr;
+                        r->size = m->win_size;
+                        nbanks++;
+                } else if (r->addr < m->win_addr + m->win_size &&
+                           m->win_addr < r->addr + r->size) {
+                        warnx("%s: common region at 0x%05x overlaps the "
+                              "window", path, r->addr);
+                        return -1;
+                }
+                if (r->off > size || size - r->off < r->size) {
+                        warnx("%s: %s at 0x%llx is past the end of the "
+                              "image", path, r->name ? r->name : "common",
+                              (unsigned long long)r->off);
+                        return -1;
+                }
+        }
+        if (!nbanks) {
+                warnx("%s: no banks", path);
+                return -1;
+        }
+        for (uint32_t i = 0; i < m->nstubs; i++) {
+                const char *bank = m->stubs[i].bank;
+
+                if (bank && !find_bank(m, bank, 0)) {
+                        warnx("%s: no bank \"%s\"", path, bank);
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int
+load_model(model *m, const char * const path, size_t size)
+{
+        FILE *f = fopen(path, "r");
+        char *line = NULL;
+        size_t linesize = 0, lineno = 0;
+        int rc = 0;
+
+        if (!f)
+                return -1;
+        while (rc == 0 && getline(&line, &linesize, f) >= 0) {
+                lineno++;
+                rc = parse_line(m, line);
+                if (rc == -1) {
+                        warnx("%s:%zu: invalid memory model", path,
+                              lineno);
+                        errno = EINVAL;
+                }
+        }
+        if (rc == 0 && ferror(f))
+                rc = -1;
+        free(line);
+        fclose(f);
+        if (rc == 0 && check_model(m, path, size) < 0) {
+                errno = EINVAL;
+                rc = -1;
+        }
+        return rc < 0 ? -1 : 0;
+}
+
+static void
+free_model(model *m)
+{
+        for (uint32_t i = 0; i < m->nmaps; i++)
+                free(m->maps[i].name);
+        for (uint32_t i = 0; i < m->nstubs; i++)
+                free(m->stubs[i].bank);
+        for (uint32_t p = 0; p < m->npages; p++) {
+                page_text *next;
+
+                for (page_text *t = m->pages[p]; t; t = next) {
+                        next = t->next;
+                        free(t->text);
+                        free(t);
+                }
+        }
+        free(m->pages);
+        free(m->maps);
+        free(m->stubs);
+        free(m->view);
+}
+
+static const stub *
+find_stub(const model * const m, int64_t addr)
+{
+        for (uint32_t i = 0; i < m->nstubs; i++)
+                if (m->stubs[i].addr == addr)
+                        return &m->stubs[i];
+        return NULL;
+}
+
+static int
+in_window(const model * const m, int64_t addr)
+{
+        return addr >= m->win_addr && addr < m->win_addr + m->win_size;
+}
+
+/*
+ * List one instruction, and the far call data after it if there is any.
+ * Returns how many bytes that was, or -1 if nothing decodes at pos.  If
+ * limit isn't 0 and it doesn't all fit before limit, nothing is listed.
+ */
+static int
+print_item(FILE *out, const model * const m, uint32_t pos, uint32_t limit,
+           int banked)
+{
+        const uint8_t *v = m->view;
+        const stub *s = NULL;
+        char note[64] = "";
+        int64_t to;
+        insn insn;
+        int len;
+
+        if (decode_insn(v, ADDR_SPACE, pos, &insn) < 0)
+                return -1;
+        len = insn.len;
+        to = branch_target(&insn);
+        if (to >= 0 && packed_is_defined(insn.packed) && !insn.slack &&
+            (s = find_stub(m, to))) {
+                if (s->farcall && pos + len + FARCALL_BYTES <= ADDR_SPACE)
+                        len += FARCALL_BYTES;
+                else if (s->farcall)
+                        s = NULL;
+        }
+        if (limit && pos + len > limit)
+                return len;
+
+        if (s && s->farcall)
+                snprintf(note, sizeof(note), "far call");
+        else if (s)
+                snprintf(note, sizeof(note), "-> %s:0x%05x", s->bank,
+                         s->target);
+        else if (to >= 0 && !banked && in_window(m, to) &&
+                 (insn_flow(&insn) & (FLOW_BRANCH | FLOW_CALL)))
+                snprintf(note, sizeof(note), "banked");
+        print_insn_note(out, v, &insn, note[0] ? note : NULL);
+
+        if (s && s->farcall) {
+                const uint8_t *d = v + pos + insn.len;
+                const mapping *bank = find_bank(m, NULL, d[0]);
+                uint32_t target = (m->win_addr & 0xf0000) |
+                                  (d[1] << 8 | d[2]);
+
+                fprintf(out, "%08x: %02hhx%02hhx%02hhx%14s"
+                        ".byte 0x%02hhx, 0x%02hhx, 0x%02hhx  ; ",
+                        pos + insn.len, d[0], d[1], d[2], "",
+                        d[0], d[1], d[2]);
+                if (bank)
+                        fprintf(out, "-> %s:0x%05x\n", bank->name, target);
+                else
+                        fprintf(out, "-> bank %hhu?:0x%05x\n", d[0],
+                                target);
+        }
+        return len;
+}
+
+/*
+ * What's left when nothing decodes, a byte to a line.
+ */
+static void
+print_rest(FILE *out, const model * const m, uint32_t pos, uint32_t end)
+{
+        for (; pos < end; pos++)
+                fprintf(out, "%08x: %02hhx%18s.byte 0x%02hhx\n", pos,
+                        m->view[pos], "", m->view[pos]);
+}
+
+/*
+ * List [start, end) of the view from pos on; returns where we stopped,
+ * which is past end if the last thing listed runs over it.
+ */
+static uint32_t
+print_span(FILE *out, const model * const m, uint32_t pos, uint32_t end,
+           int banked)
+{
+        while (pos < end) {
+                int len = print_item(out, m, pos, 0, banked);
+
+                if (len < 0) {
+                        print_rest(out, m, pos, end);
+                        return end;
+                }
+                pos += len;
+        }
+        return pos;
+}
+
+/*
+ * The text for everything that fits in page p of the window from pos,
+ * decoded now or from the last bank that had the same page.  Sets *pos to
+ * where the next item starts.
+ */
+static int
+print_page(FILE *out, model *m, const mapping * const bank,
+           const uint8_t * const buf, uint32_t p, uint32_t *pos)
+{
+        uint32_t start = m->win_addr + p * BANK_PAGE;
+        uint32_t end = start + BANK_PAGE;
+        const uint8_t *bytes = buf + bank->off + p * BANK_PAGE;
+        page_text *t;
+        FILE *text;
+
+        if (end > m->win_addr + m->win_size)
+                end = m->win_addr + m->win_size;
+        for (t = m->pages[p]; t; t = t->next) {
+                if (t->entry == *pos - start &&
+                    !memcmp(t->bytes, bytes, end - start)) {
+                        if (fwrite(t->text, 1, t->len, out) != t->len)
+                                return -1;
+                        *pos = start + t->exit;
+                        m->shared++;
+                        return 0;
+                }
+        }
+
+        t = calloc(1, sizeof(*t));
+        if (!t)
+                return -1;
+        t->bytes = bytes;
+        t->entry = *pos - start;
+        text = open_memstream(&t->text, &t->len);
+        if (!text) {
+                free(t);
+                return -1;
+        }
+        while (*pos < end) {
+                int len = print_item(text, m, *pos, end, 1);
+
+                if (len < 0 || *pos + len > end)
+                        break;
+                *pos += len;
+        }
+        if (fclose(text) == EOF) {
+                free(t);
+                return -1;
+        }
+        t->exit = *pos - start;
+        t->next = m->pages[p];
+        m->pages[p] = t;
+        m->decoded++;
+        return fwrite(t->text, 1, t->len, out) == t->len ? 0 : -1;
+}
+
+static int
+print_bank(FILE *out, model *m, const mapping * const bank,
+           const uint8_t * const buf)
+{
+        uint32_t pos = m->win_addr, end = m->win_addr + m->win_size;
+
+        memcpy(m->view + m->win_addr, buf + bank->off, m->win_size);
+        fprintf(out, "; bank %s at 0x%05x-0x%05x, from 0x%llx\n",
+                bank->name, m->win_addr, end,
+                (unsigned long long)bank->off);
+        for (uint32_t p = 0; p < m->npages; p++) {
+                uint32_t page_end = m->win_addr + (p + 1) * BANK_PAGE;
+
+                if (pos >= page_end)
+                        continue;
+                if (print_page(out, m, bank, buf, p, &pos) < 0)
+                        return -1;
+                /* whatever runs into the next page, or stopped decoding */
+                if (pos < page_end && pos < end)
+                        pos = print_span(out, m, pos,
+                                         pos + 1 > end ? end : pos + 1, 1);
+        }
+        return 0;
+}
+
+/*
+ * List filename according to the memory model at path.  Returns 0, -1
+ * with errno set if the model is no good, one of read_image()'s status
+ * codes if the image couldn't be read, or 7 if its checksums don't match.
+ */
+int
+print_banked(FILE *out, const char * const filename,
+             const char * const path)
+{
+        model m = { 0, };
+        uint8_t *buf;
+        size_t size;
+        int rc;
+
+        rc = read_image(filename, &buf, &size);
+        if (rc)
+                return rc;
+        rc = check_image(filename, buf, size);
+        if (rc)
+                goto out;
+        if (load_model(&m, path, size) < 0) {
+                rc = -1;
+                goto out;
+        }
+        m.npages = (m.win_size + BANK_PAGE - 1) / BANK_PAGE;
+        m.view = calloc(1, ADDR_SPACE);
+        m.pages = calloc(m.npages, sizeof(*m.pages));
+        if (!m.view || !m.pages) {
+                rc = 4;
+                goto out;
+        }
+
+        for (uint32_t i = 0; i < m.nmaps; i++) {
+                const mapping *r = &m.maps[i];
+
+                if (!r->name)
+                        memcpy(m.view + r->addr, buf + r->off, r->size);
+        }
+        for (uint32_t i = 0; i < m.nmaps; i++) {
+                const mapping *r = &m.maps[i];
+
+                if (r->name)
+                        continue;
+                fprintf(out, "; common at 0x%05x-0x%05x, from 0x%llx\n",
+                        r->addr, r->addr + r->size,
+                        (unsigned long long)r->off);
+                print_span(out, &m, r->addr, r->addr + r->size, 0);
+        }
+        for (uint32_t i = 0; i < m.nmaps; i++) {
+                if (m.maps[i].name &&
+                    print_bank(out, &m, &m.maps[i], buf) < 0) {
+                        rc = 4;
+                        goto out;
+                }
+        }
+        fprintf(out, "; %u bank pages decoded, %u shared\n", m.decoded,
+                m.shared);
+out:
+        free_model(&m);
+        free(buf);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,378 @@
+/*
+ * checksum.c - check an image's checksums before we list it
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A checksum file says where an image keeps its checksums, one per line:
+ *
+ *      sum16 OFF SIZE AT [OPTION ...]
+ *      crc16 OFF SIZE AT [OPTION ...]
+ *      crc32 OFF SIZE AT [OPTION ...]
+ *
+ * SIZE bytes from file offset OFF are summed as big-endian words, or run
+ * through the CRC, and the result has to match the big-endian value
+ * stored at AT.  The options are poly=HEX, init=HEX and xorout=HEX, and
+ * reflect or noreflect, with the usual meanings; the defaults are
+ * CRC-16/CCITT-FALSE (1021, ffff, 0, not reflected) and the usual CRC-32
+ * (04c11db7, ffffffff, ffffffff, reflected), and for sums, an init and
+ * xorout of 0.  Numbers are hex; lines starting with '#' are comments.
+ *
+ * Images are checked in memory, right after they're read or mapped and
+ * before anything decodes them; --watch keeps the listing it had when
+ * an image fails, rather than exiting.  The CRCs are slicing-by-8:
+ * eight tables per CRC, made when the file is loaded, so each 8 bytes
+ * of the image take two loads and eight lookups; reflected CRCs shift
+ * right and take the bytes little-endian, and the rest are done 32 bits
+ * wide with the CRC in the top bits.  Sums add 8 bytes at a time, the
+ * even and odd bytes in four 16-bit lanes each, folding the lanes before
+ * they can carry.
+ */
+#define MAX_WORDS       8
+
+enum {
+        CK_SUM16,
+        CK_CRC16,
+        CK_CRC32,
+};
+
+typedef struct checksum_s {
+        uint8_t kind;
+        uint8_t width;          // bits
+        uint8_t reflect;
+        uint64_t off;
+        uint64_t size;
+        uint64_t at;
+        uint32_t poly;
+        uint32_t init;
+        uint32_t xorout;
+        uint32_t (*tables)[256];        // [8][256], for CRCs
+} checksum;
+
+static checksum *checksums = NULL;
+static uint32_t nchecksums = 0;
+
+static const char * const kind_names[] = {
+        [CK_SUM16] = "sum16", [CK_CRC16] = "crc16", [CK_CRC32] = "crc32",
+};
+
+int
+have_checksums(void)
+{
+        return nchecksums > 0;
+}
+
+static int
+hex(const char * const s, uint64_t max, uint64_t *value)
+{
+        char *end = NULL;
+
+        if (!s)
+                return -1;
+        errno = 0;
+        *value = strtoull(s, &end, 16);
+        return errno || !end || *end || end == s || *value > max ? -1 : 0;
+}
+
+static uint32_t
+reflect_bits(uint32_t v, int width)
+{
+        uint32_t r = 0;
+
+        for (int i = 0; i < width; i++, v >>= 1)
+                r = r << 1 | (v & 1);
+        return r;
+}
+
+static uint32_t
+be(const uint8_t * const p, int bytes)
+{
+        uint32_t v = 0;
+
+        for (int i = 0; i < bytes; i++)
+                v = v << 8 | p[i];
+        return v;
+}
+
+/*
+ * Table k is what a byte does to the CRC once k more zero bytes have
+ * gone through after it.
+ */
+static int
+make_tables(checksum *r)
+{
+        uint32_t (*t)[256] = calloc(8, sizeof(*t));
+        uint32_t poly;
+
+        if (!t)
+                return -1;
+        if (r->reflect) {
+                poly = reflect_bits(r->poly, r->width);
+                for (uint32_t i = 0; i < 256; i++) {
+                        uint32_t crc = i;
+
+                        for (int b = 0; b < 8; b++)
+                                crc = crc & 1 ? crc >> 1 ^ poly : crc >> 1;
+                        t[0][i] = crc;
+                }
+                for (int k = 1; k < 8; k++)
+                        for (uint32_t i = 0; i < 256; i++)
+                                t[k][i] = t[k - 1][i] >> 8 ^
+                                          t[0][t[k - 1][i] & 0xff];
+        } else {
+                poly = r->poly << (32 - r->width);
+                for (uint32_t i = 0; i < 256; i++) {
+                        uint32_t crc = i << 24;
+
+                        for (int b = 0; b < 8; b++)
+                                crc = crc & 0x80000000 ? crc << 1 ^ poly
+                                                       : crc << 1;
+                        t[0][i] = crc;
+                }
+                for (int k = 1; k < 8; k++)
+                        for (uint32_t i = 0; i < 256; i++)
+                                t[k][i] = t[k - 1][i] << 8 ^
+                                          t[0][t[k - 1][i] >> 24];
+        }
+        r->tables = t;
+        return 0;
+}
+
+static uint32_t
+crc_reflected(const checksum * const r, const uint8_t *p, size_t n)
+{
+        uint32_t (*t)[256] = r->tables;
+        uint32_t crc = reflect_bits(r->init, r->width);
+
+        for (; n >= 8; n -= 8, p += 8) {
+                uint32_t one = crc ^ (p[0] | p[1] << 8 | p[2] << 16 |
+                                      (uint32_t)p[3] << 24);
+                uint32_t two = p[4] | p[5] << 8 | p[6] << 16 |
+                               (uint32_t)p[7] << 24;
+
+                crc = t[7][one & 0xff] ^ t[6][one >> 8 & 0xff] ^
+                      t[5][one >> 16 & 0xff] ^ t[4][one >> 24] ^
+                      t[3][two & 0xff] ^ t[2][two >> 8 & 0xff] ^
+                      t[1][two >> 16 & 0xff] ^ t[0][two >> 24];
+        }
+        for (; n; n--, p++)
+                crc = crc >> 8 ^ t[0][(crc ^ *p) & 0xff];
+        return crc;
+}
+
+static uint32_t
+crc_normal(const checksum * const r, const uint8_t *p, size_t n)
+{
+        uint32_t (*t)[256] = r->tables;
+        uint32_t crc = r->init << (32 - r->width);
+
+        for (; n >= 8; n -= 8, p += 8) {
+                uint32_t one = crc ^ be(p, 4);
+                uint32_t two = be(p + 4, 4);
+
+                crc = t[7][one >> 24] ^ t[6][one >> 16 & 0xff] ^
+                      t[5][one >> 8 & 0xff] ^ t[4][one & 0xff] ^
+                      t[3][two >> 24] ^ t[2][two >> 16 & 0xff] ^
+                      t[1][two >> 8 & 0xff] ^ t[0][two & 0xff];
+        }
+        for (; n; n--, p++)
+                crc = crc << 8 ^ t[0][(crc >> 24 ^ *p) & 0xff];
+        return crc >> (32 - r->width);
+}
+
+/*
+ * Each 8 bytes add their even bytes (the high halves of the words) into
+ * one set of four 16-bit lanes, and their odd bytes into another.  255
+ * times 0xff still fits in a lane, so we fold them every 255 rounds.
+ */
+static uint32_t
+sum16(const checksum * const r, const uint8_t *p, size_t n)
+{
+        const uint64_t lanes = 0x00ff00ff00ff00ffull;
+        uint64_t hi = 0, lo = 0;
+
+        while (n >= 8) {
+                uint64_t h = 0, l = 0;
+
+                for (int i = 0; i < 255 && n >= 8; i++, n -= 8, p += 8) {
+                        uint64_t x;
+
+                        memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                        l += x & lanes;
+                        h += x >> 8 & lanes;
+#else
+                        h += x & lanes;
+                        l += x >> 8 & lanes;
+#endif
+                }
+                for (int i = 0; i < 4; i++) {
+                        hi += h >> (16 * i) & 0xffff;
+                        lo += l >> (16 * i) & 0xffff;
+                }
+        }
+        for (; n >= 2; n -= 2, p += 2) {
+                hi += p[0];
+                lo += p[1];
+        }
+        return (r->init + (hi << 8) + lo) & 0xffff;
+}
+
+/*
+ * One line.  Returns 0, or -1 if it's wrong, or -2 if we ran out of
+ * memory.
+ */
+static int
+parse_line(char *line)
+{
+        char *save = NULL, *words[MAX_WORDS] = { NULL, };
+        checksum r = { 0, };
+        checksum *new;
+        uint64_t v, max;
+        int n = 0;
+
+        for (char *w = strtok_r(line, " \t\r\n", &save); w;
+             w = strtok_r(NULL, " \t\r\n", &save)) {
+                if (w[0] == '#' && !n)
+                        return 0;
+                if (n == MAX_WORDS)
+                        return -1;
+                words[n++] = w;
+        }
+        if (!n)
+                return 0;
+
+        if (!strcmp(words[0], "sum16")) {
+                r = (checksum){ CK_SUM16, 16, 0 };
+        } else if (!strcmp(words[0], "crc16")) {
+                r = (checksum){ CK_CRC16, 16, 0, .poly = 0x1021,
+                              .init = 0xffff };
+        } else if (!strcmp(words[0], "crc32")) {
+                r = (checksum){ CK_CRC32, 32, 1, .poly = 0x04c11db7,
+                              .init = 0xffffffff, .xorout = 0xffffffff };
+        } else {
+                return -1;
+        }
+        if (n < 4 || hex(words[1], UINT64_MAX, &r.off) < 0 ||
+            hex(words[2], UINT64_MAX - r.off, &r.size) < 0 ||
+            hex(words[3], UINT64_MAX - r.width / 8, &r.at) < 0)
+                return -1;
+        if (r.kind == CK_SUM16 && r.size % 2)
+                return -1;
+
+        max = r.width == 32 ? UINT32_MAX : (1u << r.width) - 1;
+        for (int i = 4; i < n; i++) {
+                const char *eq = strchr(words[i], '=');
+
+                if (r.kind != CK_SUM16 && !strcmp(words[i], "reflect"))
+                        r.reflect = 1;
+                else if (r.kind != CK_SUM16 &&
+                         !strcmp(words[i], "noreflect"))
+                        r.reflect = 0;
+                else if (!eq || hex(eq + 1, max, &v) < 0)
+                        return -1;
+                else if (r.kind != CK_SUM16 &&
+                         !strncmp(words[i], "poly=", 5))
+                        r.poly = v;
+                else if (!strncmp(words[i], "init=", 5))
+                        r.init = v;
+                else if (!strncmp(words[i], "xorout=", 7))
+                        r.xorout = v;
+                else
+                        return -1;
+        }
+
+        if (r.kind != CK_SUM16 && make_tables(&r) < 0)
+                return -2;
+        new = reallocarray(checksums, nchecksums + 1, sizeof(*new));
+        if (!new) {
+                free(r.tables);
+                return -2;
+        }
+        checksums = new;
+        checksums[nchecksums++] = r;
+        return 0;
+}
+
+int
+load_checksums(const char * const path)
+{
+        FILE *f = fopen(path, "r");
+        char *line = NULL;
+        size_t linesize = 0, lineno = 0;
+        int rc = 0;
+
+        if (!f)
+                return -1;
+        while (rc == 0 && getline(&line, &linesize, f) >= 0) {
+                lineno++;
+                rc = parse_line(line);
+                if (rc == -1) {
+                        warnx("%s:%zu: invalid checksum", path, lineno);
+                        errno = EINVAL;
+                }
+        }
+        if (rc == 0 && ferror(f))
+                rc = -1;
+        free(line);
+        fclose(f);
+        return rc < 0 ? -1 : 0;
+}
+
+/*
+ * Check every checksum against buf, and warn about each one that's wrong
+ * or doesn't fit in the image.  Returns how many that was.
+ */
+int
+check_checksums(const char * const filename, const uint8_t * const buf,
+                const size_t size)
+{
+        int bad = 0;
+
+        for (uint32_t i = 0; i < nchecksums; i++) {
+                const checksum *r = &checksums[i];
+                int bytes = r->width / 8;
+                uint32_t want, got;
+
+                if (r->off > size || size - r->off < r->size ||
+                    r->at > size || size - r->at < (uint64_t)bytes) {
+                        warnx("%s: %s at 0x%llx is past the end of the "
+                              "image", filename, kind_names[r->kind],
+                              (unsigned long long)r->at);
+                        bad++;
+                        continue;
+                }
+                if (r->kind == CK_SUM16)
+                        got = sum16(r, buf + r->off, r->size);
+                else if (r->reflect)
+                        got = crc_reflected(r, buf + r->off, r->size);
+                else
+                        got = crc_normal(r, buf + r->off, r->size);
+                got ^= r->xorout;
+                want = be(buf + r->at, bytes);
+                if (got != want) {
+                        warnx("%s: %s of 0x%llx-0x%llx is 0x%0*x, "
+                              "but 0x%0*x is stored at 0x%llx", filename,
+                              kind_names[r->kind],
+                              (unsigned long long)r->off,
+                              (unsigned long long)(r->off + r->size),
+                              bytes * 2, got, bytes * 2, want,
+                              (unsigned long long)r->at);
+                        bad++;
+                }
+        }
+        return bad;
+}
+
+// vim:fenc=utf-8:tw=75:et
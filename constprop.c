@@ -0,0 +1,565 @@
+/*
+ * constprop.c - work out where indexed operands point
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * Indexed operands are relative to XK:IX, YK:IY or ZK:IZ, so the listing
+ * can't say what they touch.  This tracks the registers that get loaded
+ * with constants on the way there: ldx/ldy/ldz #imm, aix/aiy/aiz,
+ * abx/adx and friends, index-to-index transfers and xgdx, and the K
+ * fields through tbxk/tbyk/tbzk from a B we know (and back with txkb and
+ * friends).
+ *
+ * It's a forward dataflow pass over basic blocks with a worklist.  A
+ * register is either known or not, and joins only ever forget things, so
+ * each block is redone at most once per register and the whole thing is
+ * linear in the size of the code.  Entry points (call targets and blocks
+ * nothing branches or falls into) start out knowing nothing, as does
+ * everything after a call.
+ *
+ * Each indexed operand we can resolve gets an xref with FLOW_RESOLVED
+ * set.
+ */
+enum {
+        R_A,
+        R_B,
+        R_X,
+        R_Y,
+        R_Z,
+        R_XK,
+        R_YK,
+        R_ZK,
+        NR_REGS
+};
+
+#define ALL_REGS        ((1u << NR_REGS) - 1)
+#define bit(r)          (1u << (r))
+#define index_reg(n)    (R_X + (n))
+#define k_reg(n)        (R_XK + (n))
+
+typedef struct regs_s {
+        uint16_t value[NR_REGS];
+        uint16_t known;
+} regs;
+
+typedef struct cp_block_s {
+        uint32_t first;
+        uint32_t last;
+        int32_t succ[2];
+        uint8_t nsucc;
+        uint8_t seen;           // in has been set
+        uint8_t queued;
+        uint8_t entry;          // called, or nothing else gets here
+        regs in;
+} cp_block;
+
+static int
+ends_with(const char * const m, char c)
+{
+        size_t len = strlen(m);
+
+        return len && m[len - 1] == c;
+}
+
+static int
+starts_with(const char * const m, const char * const prefix)
+{
+        return !strncmp(m, prefix, strlen(prefix));
+}
+
+/*
+ * Which index register (0-2 for X-Z) an addressing mode uses, or -1.
+ */
+int
+mode_index(uint8_t mode)
+{
+        switch (mode) {
+        case ind8x: case ind16x: case ind20x:
+                return 0;
+        case ind8y: case ind16y: case ind20y:
+                return 1;
+        case ind8z: case ind16z: case ind20z:
+                return 2;
+        default:
+                return -1;
+        }
+}
+
+/*
+ * tsx and friends load all 20 bits of an index register, and the adds
+ * (abx, adx, aex, aix, ...) carry into its K field.
+ */
+static int
+writes_k(const char * const m)
+{
+        return starts_with(m, "ts") ||
+               (m[0] == 'a' && m[1] && strchr("bdei", m[1]) && m[2] &&
+                !m[3]);
+}
+
+/*
+ * What might an instruction we don't model write?  Anything whose
+ * mnemonic ends in a register's name, less stores, compares, and tests,
+ * plus the handful that don't say.
+ */
+static uint16_t
+clobbers(const char * const m, uint8_t mode)
+{
+        static const char * const writes_d[] = {
+                "mul", "emul", "emuls", "fmuls", "idiv", "fdiv", "ediv",
+                "edivs", "xgde", "sxt", NULL
+        };
+        static const char * const writes_xy[] = {
+                "idiv", "fdiv", "ediv", "edivs", "mac", "rmac", NULL
+        };
+        uint16_t regs = 0;
+
+        if (!strcmp(m, "pulm") || !strcmp(m, "rti") || !strcmp(m, "swi"))
+                return ALL_REGS;
+        for (int i = 0; writes_d[i]; i++)
+                if (!strcmp(m, writes_d[i]))
+                        regs |= bit(R_A) | bit(R_B);
+        for (int i = 0; writes_xy[i]; i++)
+                if (!strcmp(m, writes_xy[i]))
+                        regs |= bit(R_X) | bit(R_Y);
+        if (mode == ixp2ext || mode == ext2ixp)
+                regs |= bit(R_X);
+
+        if (starts_with(m, "st") || starts_with(m, "cp") ||
+            starts_with(m, "cmp") || starts_with(m, "tst") ||
+            starts_with(m, "bit") || starts_with(m, "mov"))
+                return regs;
+        if (ends_with(m, 'a') || ends_with(m, 'b') || ends_with(m, 'd'))
+                regs |= bit(R_A) | bit(R_B);
+        if (ends_with(m, 'x'))
+                regs |= bit(R_X) | (writes_k(m) ? bit(R_XK) : 0);
+        if (ends_with(m, 'y'))
+                regs |= bit(R_Y) | (writes_k(m) ? bit(R_YK) : 0);
+        if (ends_with(m, 'z'))
+                regs |= bit(R_Z) | (writes_k(m) ? bit(R_ZK) : 0);
+        return regs;
+}
+
+/*
+ * Might this change index register n?  It doesn't know about anything
+ * transfer() works out exactly, so it's only good for saying no.
+ */
+int
+clobbers_index(const insn * const insn, int n)
+{
+        if (insn_flow(insn) & FLOW_CALL)
+                return 1;
+        return !!(clobbers(packed_mnemonic(insn->packed),
+                           insn->packed.mode) & bit(index_reg(n)));
+}
+
+static void
+set_reg(regs *r, int reg, uint16_t value)
+{
+        r->value[reg] = value;
+        r->known |= bit(reg);
+}
+
+static int
+known(const regs * const r, uint16_t mask)
+{
+        return (r->known & mask) == mask;
+}
+
+/*
+ * Add v to XK:IX (or YK:IY, ZK:IZ); the carry goes into the K field.
+ * If we don't know the index register or v, we know neither half after.
+ */
+static void
+add_index(regs *r, int n, int32_t v, int v_known)
+{
+        int ix = index_reg(n), k = k_reg(n);
+        uint32_t sum;
+
+        if (!v_known || !known(r, bit(ix))) {
+                r->known &= ~(bit(ix) | bit(k));
+                return;
+        }
+        sum = ((uint32_t)r->value[k] << 16) + r->value[ix] + v;
+        r->value[ix] = sum & 0xffff;
+        r->value[k] = (sum >> 16) & 0xf;
+}
+
+/*
+ * The first operand, if there is one.
+ */
+static int32_t
+first_arg(const insn * const insn)
+{
+        const shape *shape = &shapes[insn->packed.shape];
+
+        if (!shape->nargs)
+                return 0;
+        return arg_value(shape, &shape->args[0], insn);
+}
+
+static void
+transfer(regs *r, const insn * const insn)
+{
+        const char *m = packed_mnemonic(insn->packed);
+        uint8_t flow = insn_flow(insn);
+        uint16_t kill;
+        int32_t v;
+        int n;
+
+        if (flow & FLOW_CALL) {
+                r->known = 0;
+                return;
+        }
+        if (flow & FLOW_BRANCH)
+                return;
+
+        v = first_arg(insn);
+        kill = clobbers(m, insn->packed.mode);
+
+        if (insn->packed.mode == imm8 || insn->packed.mode == imm16) {
+                if (!strcmp(m, "ldaa")) {
+                        set_reg(r, R_A, v & 0xff);
+                        return;
+                }
+                if (!strcmp(m, "ldab")) {
+                        set_reg(r, R_B, v & 0xff);
+                        return;
+                }
+                if (!strcmp(m, "ldd")) {
+                        set_reg(r, R_A, (v >> 8) & 0xff);
+                        set_reg(r, R_B, v & 0xff);
+                        return;
+                }
+                if (!strcmp(m, "ldx") || !strcmp(m, "ldy") ||
+                    !strcmp(m, "ldz")) {
+                        set_reg(r, index_reg(m[2] - 'x'), v);
+                        return;
+                }
+                if (!strcmp(m, "aix") || !strcmp(m, "aiy") ||
+                    !strcmp(m, "aiz")) {
+                        if (insn->packed.mode == imm16)
+                                v = (int16_t)v;
+                        add_index(r, m[2] - 'x', v, 1);
+                        return;
+                }
+        }
+
+        /* abx, adx and friends add B, or sign extended D */
+        if (m[0] == 'a' && (m[1] == 'b' || m[1] == 'd') && m[2] >= 'x' &&
+            m[2] <= 'z' && !m[3]) {
+                int d = m[1] == 'd';
+
+                v = d ? (int16_t)(r->value[R_A] << 8 | r->value[R_B])
+                      : r->value[R_B];
+                add_index(r, m[2] - 'x', v,
+                          known(r, bit(R_B) | (d ? bit(R_A) : 0)));
+                return;
+        }
+
+        if (!strcmp(m, "clra") || !strcmp(m, "clrb") ||
+            !strcmp(m, "clrd")) {
+                if (m[3] != 'b')
+                        set_reg(r, R_A, 0);
+                if (m[3] != 'a')
+                        set_reg(r, R_B, 0);
+                return;
+        }
+
+        /* tbxk, tbyk, tbzk */
+        if (m[0] == 't' && m[1] == 'b' && m[2] >= 'x' && m[2] <= 'z' &&
+            m[3] == 'k' && !m[4]) {
+                n = m[2] - 'x';
+                r->known &= ~bit(k_reg(n));
+                if (known(r, bit(R_B)))
+                        set_reg(r, k_reg(n), r->value[R_B] & 0xf);
+                return;
+        }
+
+        /* txkb, tykb, tzkb */
+        if (m[0] == 't' && m[1] >= 'x' && m[1] <= 'z' && m[2] == 'k' &&
+            m[3] == 'b' && !m[4]) {
+                n = m[1] - 'x';
+                r->known &= ~bit(R_B);
+                if (known(r, bit(k_reg(n))))
+                        set_reg(r, R_B, r->value[k_reg(n)]);
+                return;
+        }
+
+        /* txy, tyx, ... copy all 20 bits */
+        if (m[0] == 't' && m[1] >= 'x' && m[1] <= 'z' && m[2] >= 'x' &&
+            m[2] <= 'z' && m[1] != m[2] && !m[3]) {
+                int from = m[1] - 'x', to = m[2] - 'x';
+
+                r->known &= ~(bit(index_reg(to)) | bit(k_reg(to)));
+                r->value[index_reg(to)] = r->value[index_reg(from)];
+                r->value[k_reg(to)] = r->value[k_reg(from)];
+                r->known |= (r->known & bit(index_reg(from))) ?
+                            bit(index_reg(to)) : 0;
+                r->known |= (r->known & bit(k_reg(from))) ?
+                            bit(k_reg(to)) : 0;
+                return;
+        }
+
+        /* xgdx, xgdy, xgdz swap D with the index register */
+        if (starts_with(m, "xgd") && m[3] >= 'x' && m[3] <= 'z' && !m[4]) {
+                int ix = index_reg(m[3] - 'x');
+                int d_known = known(r, bit(R_A) | bit(R_B));
+                int ix_known = known(r, bit(ix));
+                uint16_t d = r->value[R_A] << 8 | r->value[R_B];
+                uint16_t x = r->value[ix];
+
+                r->known &= ~(bit(R_A) | bit(R_B) | bit(ix));
+                if (d_known)
+                        set_reg(r, ix, d);
+                if (ix_known) {
+                        set_reg(r, R_A, x >> 8);
+                        set_reg(r, R_B, x & 0xff);
+                }
+                return;
+        }
+
+        r->known &= ~kill;
+}
+
+/*
+ * Where an indexed operand points, or -1 if we don't know.
+ */
+static int64_t
+effective_address(const regs * const r, const insn * const insn)
+{
+        const shape *shape = &shapes[insn->packed.shape];
+        int n = mode_index(insn->packed.mode);
+
+        if (n < 0 || !known(r, bit(index_reg(n)) | bit(k_reg(n))))
+                return -1;
+
+        for (int i = 0; i < shape->nargs; i++) {
+                const shape_arg *arg = &shape->args[i];
+
+                if (!opkinds[arg->kind].index)
+                        continue;
+                return (((uint32_t)r->value[k_reg(n)] << 16 |
+                         r->value[index_reg(n)]) +
+                        arg_value(shape, arg, insn)) & 0xfffff;
+        }
+        return -1;
+}
+
+static int32_t
+block_at(const image * const img, const int32_t * const block_of,
+         int64_t addr)
+{
+        int64_t i;
+
+        if (addr < 0 || (i = find_insn(img, addr)) < 0)
+                return -1;
+        return block_of[i];
+}
+
+/*
+ * Merge what we know coming out of one block into another's start.
+ * Returns whether that changed anything.
+ */
+static int
+merge(cp_block *b, const regs * const out)
+{
+        uint16_t same = 0;
+
+        if (!b->seen) {
+                b->in = *out;
+                b->seen = 1;
+                return 1;
+        }
+        for (int reg = 0; reg < NR_REGS; reg++)
+                if (b->in.value[reg] == out->value[reg])
+                        same |= bit(reg);
+        same &= b->in.known & out->known;
+        if (same == b->in.known)
+                return 0;
+        b->in.known = same;
+        return 1;
+}
+
+static int
+add_resolved(image *img, uint32_t from, uint32_t to, uint8_t flow)
+{
+        xref *x;
+
+        x = image_insert(img, SEC_XREFS, image_count(img, SEC_XREFS));
+        if (!x)
+                return -1;
+        x->from = from;
+        x->to = to;
+        x->flow = flow | FLOW_RESOLVED;
+        return 0;
+}
+
+int
+resolve_indexed(image *img)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        arena scratch = { NULL, };
+        uint8_t *leader;
+        int32_t *block_of;
+        uint32_t *work, nwork = 0, nblocks = 0;
+        cp_block *blocks;
+        int rc = -1;
+
+        if (!ninsns)
+                return 0;
+
+        leader = arena_alloc(&scratch, ninsns);
+        block_of = arena_alloc(&scratch, ninsns * sizeof(*block_of));
+        if (!leader || !block_of)
+                goto out;
+
+        /* blocks start after anything but a plain instruction */
+        leader[0] = 1;
+        for (uint32_t i = 0; i < ninsns; i++) {
+                insn insn;
+                int64_t to, k;
+
+                if (recs[i].flags & INSN_BYTES) {
+                        leader[i] = 1;
+                        if (i + 1 < ninsns)
+                                leader[i + 1] = 1;
+                        continue;
+                }
+                rec_to_insn(&recs[i], &insn);
+                if (!(insn_flow(&insn) & (FLOW_BRANCH | FLOW_CALL)))
+                        continue;
+                if ((insn_flow(&insn) & FLOW_BRANCH) && i + 1 < ninsns)
+                        leader[i + 1] = 1;
+                to = branch_target(&insn);
+                if (to >= 0 && (k = find_insn(img, to)) >= 0)
+                        leader[k] = 1;
+        }
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                nblocks += leader[i];
+                block_of[i] = nblocks - 1;
+        }
+        blocks = arena_alloc(&scratch, nblocks * sizeof(*blocks));
+        work = arena_alloc(&scratch, nblocks * sizeof(*work));
+        if (!blocks || !work)
+                goto out;
+        for (uint32_t i = 0; i < ninsns; i++) {
+                cp_block *b = &blocks[block_of[i]];
+
+                if (leader[i])
+                        b->first = i;
+                b->last = i;
+        }
+
+        /* edges, and which blocks nothing else gets to */
+        for (uint32_t n = 0; n < nblocks; n++) {
+                cp_block *b = &blocks[n];
+                const insn_rec *rec = &recs[b->last];
+                uint8_t flow = 0;
+                int32_t to = -1;
+                insn insn;
+
+                if (!(rec->flags & INSN_BYTES)) {
+                        rec_to_insn(rec, &insn);
+                        flow = insn_flow(&insn);
+                        to = block_at(img, block_of, branch_target(&insn));
+                }
+                if ((flow & FLOW_BRANCH) && to >= 0)
+                        b->succ[b->nsucc++] = to;
+                if (!(flow & FLOW_STOP) && !(rec->flags & INSN_BYTES) &&
+                    n + 1 < nblocks)
+                        b->succ[b->nsucc++] = n + 1;
+        }
+        for (uint32_t n = 0; n < nblocks; n++)
+                blocks[n].entry = 1;
+        for (uint32_t n = 0; n < nblocks; n++)
+                for (int j = 0; j < blocks[n].nsucc; j++)
+                        blocks[blocks[n].succ[j]].entry = 0;
+        for (uint32_t i = 0; i < ninsns; i++) {
+                insn insn;
+                int32_t to;
+
+                if (recs[i].flags & INSN_BYTES)
+                        continue;
+                rec_to_insn(&recs[i], &insn);
+                if (!(insn_flow(&insn) & FLOW_CALL))
+                        continue;
+                to = block_at(img, block_of, branch_target(&insn));
+                if (to >= 0)
+                        blocks[to].entry = 1;
+        }
+
+        for (uint32_t n = nblocks; n-- > 0; ) {
+                if (!blocks[n].entry)
+                        continue;
+                blocks[n].seen = blocks[n].queued = 1;
+                work[nwork++] = n;
+        }
+
+        while (nwork) {
+                cp_block *b = &blocks[work[--nwork]];
+                regs r = b->in;
+
+                b->queued = 0;
+                for (uint32_t i = b->first; i <= b->last; i++) {
+                        insn insn;
+
+                        if (recs[i].flags & INSN_BYTES) {
+                                r.known = 0;
+                                continue;
+                        }
+                        rec_to_insn(&recs[i], &insn);
+                        transfer(&r, &insn);
+                }
+                for (int j = 0; j < b->nsucc; j++) {
+                        cp_block *s = &blocks[b->succ[j]];
+
+                        if (merge(s, &r) && !s->queued) {
+                                s->queued = 1;
+                                work[nwork++] = b->succ[j];
+                        }
+                }
+        }
+
+        for (uint32_t n = 0; n < nblocks; n++) {
+                regs r = blocks[n].in;
+
+                if (!blocks[n].seen)
+                        continue;
+                for (uint32_t i = blocks[n].first; i <= blocks[n].last;
+                     i++) {
+                        insn insn;
+                        int64_t ea;
+
+                        if (recs[i].flags & INSN_BYTES)
+                                continue;
+                        rec_to_insn(&recs[i], &insn);
+                        ea = effective_address(&r, &insn);
+                        if (ea >= 0 && add_resolved(img, recs[i].addr, ea,
+                                                    insn_flow(&insn)) < 0)
+                                goto out;
+                        transfer(&r, &insn);
+                        /* image_insert() may have moved things */
+                        recs = image_section(img, SEC_INSNS, insn_rec);
+                }
+        }
+        rc = 0;
+out:
+        arena_free(&scratch);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
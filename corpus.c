@@ -0,0 +1,366 @@
+/*
+ * corpus.c - generated instruction corpus and table self-test
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+static const uint8_t prebytes[4] = { 0x00, 0x17, 0x27, 0x37 };
+
+/*
+ * Each defined instruction is emitted once per variant, with every
+ * operand field set to the same pattern: all clear, all set, only the
+ * sign bit set, and alternating bits.  Zero-extension fields are always
+ * clear.  Instructions with no operands are only emitted once.
+ */
+#define NR_VARIANTS 4
+
+static uint32_t
+variant_value(const operand * const operand, int variant)
+{
+        uint32_t mask = (1ull << operand->bits) - 1;
+
+        if (operand->zext)
+                return 0;
+
+        switch (variant) {
+        case 0:
+                return 0;
+        case 1:
+                return mask;
+        case 2:
+                return 1u << (operand->bits - 1);
+        default:
+                return 0xa5a5a5a5 & mask;
+        }
+}
+
+static int
+corpus_insn(int page, int opcode, int variant, insn *insn)
+{
+        op *op = &opcodes[page][opcode];
+        operands *operands = op->operands;
+
+        if (!is_defined(op))
+                return 1;
+        if (variant > 0 && !operands)
+                return 1;
+
+        memset(insn, 0, sizeof(*insn));
+        insn->prefix = prebytes[page];
+        insn->opcode = opcode;
+        insn->op = op;
+        for (int i = 0; operands && i < operands->num; i++)
+                insn->values[i] = variant_value(operands->elements[i],
+                                                variant);
+        return 0;
+}
+
+int
+gen_corpus(FILE *out)
+{
+        for (int page = 0; page < 4; page++) {
+                for (int opcode = 0; opcode < 0x100; opcode++) {
+                        for (int v = 0; v < NR_VARIANTS; v++) {
+                                uint8_t buf[MAX_INSN_LEN];
+                                insn insn;
+                                int len;
+
+                                if (corpus_insn(page, opcode, v, &insn))
+                                        continue;
+
+                                len = encode_insn(&insn, buf, sizeof(buf));
+                                if (len < 0)
+                                        return len;
+                                if (fwrite(buf, 1, len, out) !=
+                                    (size_t)len)
+                                        return -1;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * The offset or address an indexed or extended mode takes.
+ */
+static opkind
+mode_offset_kind(mode mode)
+{
+        switch (mode) {
+        case ind8x: case ind8y: case ind8z:
+                return OPK_OFF8;
+        case ind16x: case ind16y: case ind16z:
+                return OPK_SOFF16;
+        case ind20x: case ind20y: case ind20z:
+                return OPK_SOFF20;
+        case ext:
+        case ext2ext:
+                return OPK_ADDR16;
+        case ext20:
+                return OPK_ADDR20;
+        default:
+                return OPK_NONE;
+        }
+}
+
+static int
+count_kind(const shape * const shape, opkind kind)
+{
+        int n = 0;
+
+        for (int i = 0; i < shape->nargs; i++)
+                if (shape->args[i].kind == kind)
+                        n++;
+        return n;
+}
+
+/*
+ * Check an entry's operands against its addressing mode: an indexed or
+ * extended entry has exactly the offset or address its mode takes (two
+ * for EXT->EXT moves), and none of the others.  Bit instructions also
+ * have a mask, and only brclr and brset have a branch offset.  A wrong
+ * shape here changes the instruction's length, which the round trip
+ * can't see.
+ */
+static int
+lint_shape(int page, int opcode)
+{
+        op *op = &opcodes[page][opcode];
+        operands *operands = op->operands;
+        const shape *shape = &shapes[packed_opcodes[page][opcode].shape];
+        const char *m = op->mnemonic;
+        opkind offset = mode_offset_kind(op->mode);
+        int noffsets = op->mode == ext2ext ? 2 : 1;
+        int failures = 0;
+        int bit, branch, word;
+
+        if (!is_defined(op))
+                return 0;
+
+        if (offset != OPK_NONE) {
+                static const opkind offsets[] = {
+                        OPK_OFF8, OPK_SOFF16, OPK_SOFF20, OPK_ADDR16,
+                        OPK_ADDR20
+                };
+
+                for (unsigned int i = 0;
+                     i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+                        if (count_kind(shape, offsets[i]) ==
+                            (offsets[i] == offset ? noffsets : 0))
+                                continue;
+                        warnx("%02hhx %02x: %s operands \"%s\" don't fit "
+                              "mode %s", prebytes[page], opcode, m,
+                              operands ? operands->name : "",
+                              modenames[op->mode]);
+                        failures++;
+                        break;
+                }
+        }
+
+        word = !strcmp(m, "bclrw") || !strcmp(m, "bsetw");
+        branch = !strcmp(m, "brclr") || !strcmp(m, "brset");
+        bit = branch || !strcmp(m, "bclr") || !strcmp(m, "bset");
+        if (bit || word) {
+                int mask = count_kind(shape, word ? OPK_MASK16
+                                                  : OPK_MASK8);
+                int rel = count_kind(shape, OPK_REL8) +
+                          count_kind(shape, OPK_REL16);
+
+                if (mask != 1 || rel != branch) {
+                        warnx("%02hhx %02x: %s operands \"%s\" need %s",
+                              prebytes[page], opcode, m,
+                              operands ? operands->name : "",
+                              branch ? "a mask and a branch offset"
+                                     : "a mask and no branch offset");
+                        failures++;
+                }
+        }
+
+        return failures;
+}
+
+static int
+lint_entry(int page, int opcode)
+{
+        op *op = &opcodes[page][opcode];
+        packed_op packed = packed_opcodes[page][opcode];
+        operands *operands = op->operands;
+        int failures = 0;
+        int bits = 0;
+
+        if (!op->mnemonic) {
+                warnx("%02hhx %02x: missing table entry", prebytes[page],
+                      opcode);
+                return 1;
+        }
+
+        if (op->opcode != opcode) {
+                warnx("%02hhx %02x: entry claims opcode %02hhx",
+                      prebytes[page], opcode, op->opcode);
+                failures++;
+        }
+
+        if (strcmp(packed_mnemonic(packed), op->mnemonic) ||
+            packed.mode != op->mode ||
+            shapes[packed.shape].operands != op->operands ||
+            packed_is_defined(packed) != is_defined(op)) {
+                warnx("%02hhx %02x: packed entry does not match the table",
+                      prebytes[page], opcode);
+                failures++;
+        }
+
+        if (!strcmp(op->mnemonic, "PREBYTE") &&
+            (page != 0 || !is_prebyte(opcode))) {
+                warnx("%02hhx %02x: PREBYTE outside of page 0",
+                      prebytes[page], opcode);
+                failures++;
+        }
+
+        if (!is_defined(op) && operands) {
+                warnx("%02hhx %02x: \"%s\" has operands \"%s\"",
+                      prebytes[page], opcode, op->mnemonic,
+                      operands->name);
+                failures++;
+        }
+
+        for (int i = 0; operands && i < operands->num; i++) {
+                if (!operands->elements[i]) {
+                        warnx("%02hhx %02x: operands \"%s\" is short",
+                              prebytes[page], opcode, operands->name);
+                        return failures + 1;
+                }
+                bits += operands->elements[i]->bits;
+        }
+
+        failures += lint_shape(page, opcode);
+
+        if ((prebytes[page] ? 2 : 1) + (bits + 7) / 8 > MAX_INSN_LEN) {
+                warnx("%02hhx %02x: operands \"%s\" are too long",
+                      prebytes[page], opcode, operands->name);
+                failures++;
+        }
+
+        return failures;
+}
+
+static int
+text_round_trip(const insn * const insn, const uint8_t * const buf)
+{
+        char text[128] = "";
+        FILE *listing;
+        uint8_t *bin = NULL;
+        size_t binlen = 0;
+        int rc = 0;
+
+        listing = fmemopen(text, sizeof(text), "w");
+        if (!listing)
+                err(4, "Could not allocate memory");
+        print_insn(listing, buf, insn);
+        fclose(listing);
+
+        if (assemble("self-test", text, strlen(text), &bin, &binlen) < 0) {
+                rc = 1;
+        } else if (binlen != insn->len || memcmp(bin, buf, binlen)) {
+                warnx("%02hhx %02hhx: \"%.*s\" assembles to a different "
+                      "form",
+                      insn->prefix, insn->opcode,
+                      (int)strcspn(text, "\n"), text);
+                rc = 1;
+        }
+        free(bin);
+
+        return rc;
+}
+
+static int
+round_trip(const insn * const expected)
+{
+        uint8_t buf[MAX_INSN_LEN];
+        uint8_t buf2[MAX_INSN_LEN];
+        insn insn;
+        int len, len2;
+        operands *operands = expected->op->operands;
+
+        len = encode_insn(expected, buf, sizeof(buf));
+        if (len < 0) {
+                warn("%02hhx %02hhx: could not encode", expected->prefix,
+                     expected->opcode);
+                return 1;
+        }
+
+        if (decode_insn(buf, len, 0, &insn) < 0) {
+                warnx("%02hhx %02hhx: could not decode %d bytes",
+                      expected->prefix, expected->opcode, len);
+                return 1;
+        }
+
+        if (insn.prefix != expected->prefix ||
+            insn.opcode != expected->opcode ||
+            insn.op != expected->op ||
+            insn.len != len) {
+                warnx("%02hhx %02hhx: decoded as %02hhx %02hhx len %d, "
+                      "expected len %d",
+                      expected->prefix, expected->opcode,
+                      insn.prefix, insn.opcode, insn.len, len);
+                return 1;
+        }
+
+        for (int i = 0; operands && i < operands->num; i++) {
+                if (insn.values[i] != expected->values[i]) {
+                        warnx("%02hhx %02hhx: operand %s is 0x%x, "
+                              "expected 0x%x",
+                              expected->prefix, expected->opcode,
+                              operands->elements[i]->name,
+                              insn.values[i], expected->values[i]);
+                        return 1;
+                }
+        }
+
+        len2 = encode_insn(&insn, buf2, sizeof(buf2));
+        if (len2 != len || memcmp(buf, buf2, len)) {
+                warnx("%02hhx %02hhx: re-encoding does not match",
+                      expected->prefix, expected->opcode);
+                return 1;
+        }
+
+        return text_round_trip(&insn, buf);
+}
+
+int
+self_test(void)
+{
+        int failures = 0;
+        int count = 0;
+
+        for (int page = 0; page < 4; page++) {
+                for (int opcode = 0; opcode < 0x100; opcode++) {
+                        failures += lint_entry(page, opcode);
+
+                        for (int v = 0; v < NR_VARIANTS; v++) {
+                                insn insn;
+
+                                if (corpus_insn(page, opcode, v, &insn))
+                                        continue;
+                                failures += round_trip(&insn);
+                                count++;
+                        }
+                }
+        }
+
+        printf("self-test: %d instructions, %d failures\n", count,
+               failures);
+        return failures ? -1 : 0;
+}
+
+// vim:fenc=utf-8:tw=75:et
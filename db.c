@@ -0,0 +1,436 @@
+/*
+ * db.c - on-disk analysis database
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The file is a header followed by each section's array, exactly as
+ * image.sections[] holds them in memory, so opening one is just mmap()
+ * and pointer arithmetic.  Every section has room to grow; annotations
+ * are written in place until one runs out, and then the whole file is
+ * rewritten with more room and renamed over the old one.
+ */
+#define DB_MAGIC "HC16DB\0"
+#define DB_VERSION 3
+#define DB_ALIGN 64
+
+typedef struct db_section_s {
+        uint64_t offset;
+        uint32_t count;
+        uint32_t capacity;
+} db_section;
+
+typedef struct db_header_s {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t image_size;
+        uint64_t image_hash;
+        db_section sections[NR_SECTIONS];
+} db_header;
+
+#define db_base(hdr, id, type) \
+        ((type *)((uint8_t *)(hdr) + (hdr)->sections[id].offset))
+
+struct db_s {
+        char *path;
+        db_header *hdr;
+        size_t maplen;
+};
+
+static uint64_t
+image_hash(const image * const img)
+{
+        uint64_t h = 0xcbf29ce484222325ull;
+
+        for (size_t i = 0; i < img->size; i++)
+                h = (h ^ img->buf[i]) * 0x100000001b3ull;
+        return h;
+}
+
+static uint32_t
+spare(uint32_t n)
+{
+        return n + n / 4 + 64;
+}
+
+static size_t
+align_up(size_t n)
+{
+        return (n + DB_ALIGN - 1) & ~(size_t)(DB_ALIGN - 1);
+}
+
+/*
+ * Write img out as a new database at path, with capacity[] room in each
+ * section.
+ */
+static int
+db_write(const image * const img, const char * const path,
+         const uint32_t capacity[NR_SECTIONS])
+{
+        db_header hdr;
+        char *tmp;
+        size_t off;
+        int fd;
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, DB_MAGIC, sizeof(hdr.magic));
+        hdr.version = DB_VERSION;
+        hdr.header_size = sizeof(hdr);
+        hdr.image_size = img->size;
+        hdr.image_hash = image_hash(img);
+
+        off = align_up(sizeof(hdr));
+        for (int i = 0; i < NR_SECTIONS; i++) {
+                hdr.sections[i].offset = off;
+                hdr.sections[i].count = img->sections[i].count;
+                hdr.sections[i].capacity = capacity[i];
+                off = align_up(off + capacity[i] * section_elem_size[i]);
+        }
+
+        tmp = malloc(strlen(path) + 5);
+        if (!tmp)
+                return -1;
+        sprintf(tmp, "%s.new", path);
+        fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                warn("Could not open \"%s\"", tmp);
+                free(tmp);
+                return -1;
+        }
+
+        if (ftruncate(fd, off) < 0 ||
+            pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+                goto err;
+        for (int i = 0; i < NR_SECTIONS; i++) {
+                size_t len = img->sections[i].count * section_elem_size[i];
+
+                if (len && pwrite(fd, img->sections[i].base, len,
+                                  hdr.sections[i].offset) != (ssize_t)len)
+                        goto err;
+        }
+        if (fsync(fd) < 0 || close(fd) < 0) {
+                fd = -1;
+                goto err;
+        }
+        if (rename(tmp, path) < 0) {
+                fd = -1;
+                goto err;
+        }
+        free(tmp);
+        return 0;
+err:
+        warn("Could not write \"%s\"", tmp);
+        if (fd >= 0)
+                close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+}
+
+/*
+ * The records in a database for this image have to make sense against
+ * it before anything reads the image through them: instructions in
+ * order and inside it, each one what the image holds at its address,
+ * and everything else in order and in range.  The hash only says the
+ * image is the one the database was made from, not that nothing has
+ * happened to the database since.
+ */
+static int
+db_check(const image * const img, const db_header * const hdr)
+{
+        const insn_rec *recs = db_base(hdr, SEC_INSNS, insn_rec);
+        const region *regions = db_base(hdr, SEC_REGIONS, region);
+        const symbol *syms = db_base(hdr, SEC_SYMBOLS, symbol);
+        const xref *xrefs = db_base(hdr, SEC_XREFS, xref);
+        const comment *comments = db_base(hdr, SEC_COMMENTS, comment);
+        uint64_t end = 0;
+
+        for (uint32_t i = 0; i < hdr->sections[SEC_INSNS].count; i++) {
+                const insn_rec *rec = &recs[i];
+                const uint8_t *p = img->buf + rec->addr;
+                packed_op packed;
+                int bytes;
+
+                if (rec->addr < end || rec->len == 0 ||
+                    rec->len > MAX_INSN_LEN ||
+                    (uint64_t)rec->addr + rec->len > img->size)
+                        return -1;
+                end = rec->addr + rec->len;
+                if (rec->flags & INSN_BYTES)
+                        continue;
+
+                bytes = rec->prefix ? 2 : 1;
+                if (rec->prefix ? !is_prebyte(rec->prefix) ||
+                                  p[0] != rec->prefix ||
+                                  p[1] != rec->opcode
+                                : p[0] != rec->opcode || is_prebyte(p[0]))
+                        return -1;
+                packed = packed_opcodes[(rec->prefix >> 4) & 3]
+                                       [rec->opcode];
+                if (rec->len != bytes + shapes[packed.shape].bytes)
+                        return -1;
+        }
+
+        for (uint32_t i = 0; i < hdr->sections[SEC_REGIONS].count; i++)
+                if (regions[i].start > regions[i].end ||
+                    regions[i].end > img->size ||
+                    (regions[i].type != REGION_CODE &&
+                     regions[i].type != REGION_DATA))
+                        return -1;
+
+        for (uint32_t i = 0; i < hdr->sections[SEC_SYMBOLS].count; i++)
+                if (syms[i].addr > 0xfffff ||
+                    (i && syms[i].addr < syms[i - 1].addr))
+                        return -1;
+
+        for (uint32_t i = 0; i < hdr->sections[SEC_XREFS].count; i++)
+                if (xrefs[i].from >= img->size || xrefs[i].to > 0xfffff ||
+                    (i && xrefs[i].to < xrefs[i - 1].to))
+                        return -1;
+
+        for (uint32_t i = 0; i < hdr->sections[SEC_COMMENTS].count; i++)
+                if (comments[i].addr > 0xfffff ||
+                    (i && comments[i].addr < comments[i - 1].addr))
+                        return -1;
+
+        return 0;
+}
+
+/*
+ * Map an existing database.  Returns 1 if it's fine but describes some
+ * other image, -1 if it isn't a database we can use.
+ */
+static int
+db_map(const image * const img, const char * const path, struct db_s *db)
+{
+        struct stat sb;
+        db_header *hdr;
+        const char *strings;
+        const symbol *syms;
+        const comment *comments;
+        uint32_t nstrings;
+        int fd;
+
+        fd = open(path, O_RDWR);
+        if (fd < 0)
+                return -1;
+        if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(*hdr)) {
+                close(fd);
+                errno = EINVAL;
+                return -1;
+        }
+
+        hdr = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+        close(fd);
+        if (hdr == MAP_FAILED)
+                return -1;
+        db->hdr = hdr;
+        db->maplen = sb.st_size;
+
+        if (memcmp(hdr->magic, DB_MAGIC, sizeof(hdr->magic)) ||
+            hdr->version < 1 || hdr->version > DB_VERSION ||
+            hdr->header_size != sizeof(*hdr))
+                goto bad;
+
+        for (int i = 0; i < NR_SECTIONS; i++) {
+                db_section *sec = &hdr->sections[i];
+
+                if (sec->offset % 8 || sec->count > sec->capacity ||
+                    sec->offset > db->maplen ||
+                    (db->maplen - sec->offset) / section_elem_size[i] <
+                    sec->capacity)
+                        goto bad;
+        }
+
+        strings = db_base(hdr, SEC_STRINGS, char);
+        nstrings = hdr->sections[SEC_STRINGS].count;
+        if (nstrings == 0 || strings[nstrings - 1] != '\0')
+                goto bad;
+
+        syms = db_base(hdr, SEC_SYMBOLS, symbol);
+        for (uint32_t i = 0; i < hdr->sections[SEC_SYMBOLS].count; i++)
+                if (syms[i].name >= nstrings)
+                        goto bad;
+        comments = db_base(hdr, SEC_COMMENTS, comment);
+        for (uint32_t i = 0; i < hdr->sections[SEC_COMMENTS].count; i++)
+                if (comments[i].text >= nstrings)
+                        goto bad;
+
+        if (hdr->version != DB_VERSION || hdr->image_size != img->size ||
+            hdr->image_hash != image_hash(img))
+                return 1;
+        if (db_check(img, hdr) < 0)
+                goto bad;
+        return 0;
+bad:
+        munmap(db->hdr, db->maplen);
+        db->hdr = NULL;
+        errno = EINVAL;
+        return -1;
+}
+
+static void
+db_point(image *img, struct db_s *db)
+{
+        for (int i = 0; i < NR_SECTIONS; i++) {
+                img->sections[i].base = db_base(db->hdr, i, uint8_t);
+                img->sections[i].count = db->hdr->sections[i].count;
+                img->sections[i].capacity = db->hdr->sections[i].capacity;
+        }
+        img->db = db;
+}
+
+static int
+db_create(image *img, const char * const path)
+{
+        uint32_t capacity[NR_SECTIONS];
+        int rc;
+
+        for (int i = 0; i < NR_SECTIONS; i++)
+                capacity[i] = spare(img->sections[i].count);
+        rc = db_write(img, path, capacity);
+        free_image(img);
+        return rc;
+}
+
+/*
+ * The image changed under the database.  Analyze it again, and keep
+ * whatever labels and comments a person added, where they still make
+ * sense.
+ */
+static int
+db_rebuild(image *img, const char * const path, struct db_s *old)
+{
+        image fresh = { img->filename, img->buf, img->size };
+        const symbol *syms;
+        const comment *comments;
+
+        db_point(img, old);
+        syms = image_section(img, SEC_SYMBOLS, symbol);
+        comments = image_section(img, SEC_COMMENTS, comment);
+
+        if (analyze_image(&fresh) < 0)
+                return -1;
+        for (uint32_t i = 0; i < image_count(img, SEC_SYMBOLS); i++)
+                if (!(syms[i].flags & SYM_AUTO))
+                        set_label(&fresh, syms[i].addr,
+                                  image_str(img, syms[i].name),
+                                  syms[i].flags);
+        for (uint32_t i = 0; i < image_count(img, SEC_COMMENTS); i++)
+                add_comment(&fresh, comments[i].addr,
+                            image_str(img, comments[i].text));
+
+        munmap(old->hdr, old->maplen);
+        memset(img->sections, 0, sizeof(img->sections));
+        img->db = NULL;
+        return db_create(&fresh, path);
+}
+
+int
+db_open(image *img, const char * const path)
+{
+        struct db_s *db;
+        int rc;
+
+        db = calloc(1, sizeof(*db));
+        if (!db)
+                return -1;
+        db->path = strdup(path);
+        if (!db->path)
+                goto err;
+
+        rc = db_map(img, path, db);
+        if (rc < 0 && errno == ENOENT) {
+                if (analyze_image(img) < 0 || db_create(img, path) < 0)
+                        goto err;
+                rc = db_map(img, path, db);
+        } else if (rc > 0) {
+                warnx("\"%s\" is out of date; rebuilding",
+                      path);
+                if (db_rebuild(img, path, db) < 0)
+                        goto err;
+                rc = db_map(img, path, db);
+        }
+        if (rc != 0) {
+                warn("Could not use \"%s\"", path);
+                goto err;
+        }
+
+        db_point(img, db);
+        return 0;
+err:
+        free(db->path);
+        free(db);
+        return -1;
+}
+
+/*
+ * A section ran out of room.  Rewrite the database with room for at
+ * least needed entries in it, and move the image over to the new file.
+ */
+int
+db_grow(image *img, section_id id, uint32_t needed)
+{
+        struct db_s *db = img->db;
+        struct db_s fresh = { db->path };
+        uint32_t capacity[NR_SECTIONS];
+
+        for (int i = 0; i < NR_SECTIONS; i++)
+                capacity[i] = img->sections[i].capacity;
+        capacity[id] = spare(needed);
+
+        if (db_write(img, db->path, capacity) < 0 ||
+            db_map(img, db->path, &fresh) != 0)
+                return -1;
+
+        munmap(db->hdr, db->maplen);
+        db->hdr = fresh.hdr;
+        db->maplen = fresh.maplen;
+        db_point(img, db);
+        return 0;
+}
+
+int
+db_sync(image *img)
+{
+        struct db_s *db = img->db;
+
+        for (int i = 0; i < NR_SECTIONS; i++)
+                db->hdr->sections[i].count = img->sections[i].count;
+        return msync(db->hdr, db->maplen, MS_SYNC);
+}
+
+void
+db_close(image *img)
+{
+        struct db_s *db = img->db;
+
+        if (!db)
+                return;
+        db_sync(img);
+        munmap(db->hdr, db->maplen);
+        free(db->path);
+        free(db);
+        img->db = NULL;
+        memset(img->sections, 0, sizeof(img->sections));
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,283 @@
+/*
+ * functions.c - function boundaries and per-function statistics
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A function starts at anything that's called, anything the exception
+ * vectors point at, and a stack frame prologue (pshm, or ais with a
+ * negative adjustment) right after an instruction that doesn't fall
+ * through.  It runs until the next one starts, less whatever follows
+ * its last rts, rti, or unconditional jump.
+ *
+ * Like the rest of hc16dis, this assumes the image is loaded at 0, so the
+ * vector table is its first 0x200 bytes.
+ */
+#define NR_VECTORS      0x100
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+        uint32_t ua = *(const uint32_t *)a, ub = *(const uint32_t *)b;
+
+        return ua < ub ? -1 : ua > ub;
+}
+
+static uint32_t
+unique(uint32_t *v, uint32_t n)
+{
+        uint32_t out = 0;
+
+        qsort(v, n, sizeof(*v), cmp_u32);
+        for (uint32_t i = 0; i < n; i++)
+                if (!out || v[out - 1] != v[i])
+                        v[out++] = v[i];
+        return out;
+}
+
+static uint16_t
+be16(const uint8_t * const p)
+{
+        return p[0] << 8 | p[1];
+}
+
+static int
+is_prologue(const insn * const insn)
+{
+        const char *m = packed_mnemonic(insn->packed);
+        const shape *shape = &shapes[insn->packed.shape];
+        const shape_arg *arg = &shape->args[0];
+
+        if (!strcmp(m, "pshm"))
+                return 1;
+        if (strcmp(m, "ais"))
+                return 0;
+        /* ais #-n makes room for locals */
+        return (arg_value(shape, arg, insn) >>
+                (opkinds[arg->kind].bits - 1)) & 1;
+}
+
+/*
+ * Every address a function starts at, sorted.
+ */
+static uint32_t
+function_starts(const image * const img, arena *scratch,
+                uint32_t **startsp)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        const symbol *syms = image_section(img, SEC_SYMBOLS, symbol);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        uint32_t nsyms = image_count(img, SEC_SYMBOLS);
+        uint32_t *starts;
+        uint32_t n = 0, out = 0;
+        int stopped = 1;
+
+        starts = arena_alloc(scratch, (nsyms + NR_VECTORS + ninsns) *
+                                      sizeof(*starts));
+        if (!starts)
+                return 0;
+
+        for (uint32_t i = 0; i < nsyms; i++)
+                if (syms[i].flags & SYM_FUNC)
+                        starts[n++] = syms[i].addr;
+
+        if (img->size >= 4)
+                starts[n++] = (img->buf[1] & 0xf) << 16 |
+                              be16(img->buf + 2);
+        for (uint32_t v = 4; v < NR_VECTORS && 2 * v + 1 < img->size; v++)
+                starts[n++] = be16(img->buf + 2 * v);
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                insn insn;
+
+                if (recs[i].flags & INSN_BYTES) {
+                        stopped = 1;
+                        continue;
+                }
+                rec_to_insn(&recs[i], &insn);
+                if (stopped && is_prologue(&insn))
+                        starts[n++] = recs[i].addr;
+                stopped = !!(insn_flow(&insn) & FLOW_STOP);
+        }
+
+        n = unique(starts, n);
+
+        /* only keep the ones that land on real code */
+        for (uint32_t i = 0; i < n; i++) {
+                int64_t k = find_insn(img, starts[i]);
+
+                if (k >= 0 && !(recs[k].flags & INSN_BYTES))
+                        starts[out++] = starts[i];
+        }
+
+        *startsp = starts;
+        return out;
+}
+
+typedef struct func_acc_s {
+        uint32_t end;
+        uint32_t insns;
+        uint32_t bytes;
+        uint32_t calls;
+        uint32_t ncallees;
+        uint32_t loops;
+} func_acc;
+
+static void
+close_function(const image * const img, func *f, func_acc *acc,
+               func_acc *at_stop, uint32_t *callees)
+{
+        const xref *xrefs = image_section(img, SEC_XREFS, xref);
+        const func_acc *a = at_stop->end ? at_stop : acc;
+        uint32_t first, n;
+
+        f->end = a->end;
+        f->insns = a->insns;
+        f->bytes = a->bytes;
+        f->calls = a->calls;
+        f->fan_out = unique(callees, a->ncallees);
+        f->loops = a->loops;
+
+        n = find_xrefs(img, f->start, &first);
+        for (uint32_t i = first; i < first + n; i++)
+                if (xrefs[i].flow & FLOW_CALL)
+                        f->fan_in++;
+}
+
+/*
+ * One pass over the instruction records, splitting them up at the
+ * function starts.
+ */
+int
+find_functions(const image * const img, arena *scratch, func **funcsp,
+               uint32_t *nfuncsp)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        uint32_t *starts, *callees;
+        uint32_t nstarts, s = 0;
+        func *funcs, *f = NULL;
+        func_acc acc, at_stop;
+
+        nstarts = function_starts(img, scratch, &starts);
+        funcs = arena_alloc(scratch, nstarts * sizeof(*funcs));
+        callees = arena_alloc(scratch, ninsns * sizeof(*callees));
+        if ((nstarts && !starts) || !funcs || !callees)
+                return -1;
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                const insn_rec *rec = &recs[i];
+                insn insn;
+                uint8_t flow;
+                int64_t to;
+
+                if (s < nstarts && rec->addr == starts[s]) {
+                        if (f)
+                                close_function(img, f, &acc, &at_stop,
+                                               callees);
+                        f = &funcs[s++];
+                        memset(f, 0, sizeof(*f));
+                        f->start = rec->addr;
+                        memset(&acc, 0, sizeof(acc));
+                        memset(&at_stop, 0, sizeof(at_stop));
+                }
+                if (!f)
+                        continue;
+
+                acc.insns++;
+                acc.bytes += rec->len;
+                acc.end = rec->addr + rec->len;
+                if (rec->flags & INSN_BYTES)
+                        continue;
+
+                rec_to_insn(rec, &insn);
+                flow = insn_flow(&insn);
+                to = branch_target(&insn);
+                if (flow & FLOW_CALL) {
+                        acc.calls++;
+                        if (to >= 0)
+                                callees[acc.ncallees++] = to;
+                } else if (to >= f->start && to <= rec->addr) {
+                        acc.loops++;
+                }
+                if (flow & FLOW_STOP)
+                        at_stop = acc;
+        }
+        if (f)
+                close_function(img, f, &acc, &at_stop, callees);
+
+        *funcsp = funcs;
+        *nfuncsp = s;
+        return 0;
+}
+
+const char *
+function_name(const image * const img, const func * const f, char *buf,
+              size_t size)
+{
+        const symbol *sym = find_symbol(img, f->start);
+
+        if (sym)
+                return image_str(img, sym->name);
+        snprintf(buf, size, "sub_%05x", f->start);
+        return buf;
+}
+
+int
+print_functions(FILE *out, const image * const img, const char * const fmt)
+{
+        arena scratch = { NULL, };
+        int json = !strcmp(fmt, "json");
+        uint32_t nfuncs;
+        func *funcs;
+
+        if (find_functions(img, &scratch, &funcs, &nfuncs) < 0) {
+                arena_free(&scratch);
+                return -1;
+        }
+
+        if (json)
+                fprintf(out, "[");
+        else
+                fprintf(out, "name,start,end,insns,bytes,calls,fan_in,"
+                        "fan_out,loops\n");
+
+        for (uint32_t i = 0; i < nfuncs; i++) {
+                const func *f = &funcs[i];
+                char buf[16];
+                const char *name = function_name(img, f, buf, sizeof(buf));
+
+                if (json)
+                        fprintf(out, "%s\n  {\"name\": \"%s\", "
+                                "\"start\": %u, \"end\": %u, "
+                                "\"insns\": %u, \"bytes\": %u, "
+                                "\"calls\": %u, \"fan_in\": %u, "
+                                "\"fan_out\": %u, \"loops\": %u}",
+                                i ? "," : "", name, f->start, f->end,
+                                f->insns, f->bytes, f->calls, f->fan_in,
+                                f->fan_out, f->loops);
+                else
+                        fprintf(out, "%s,0x%05x,0x%05x,"
+                                "%u,%u,%u,%u,%u,%u\n",
+                                name, f->start, f->end, f->insns, f->bytes,
+                                f->calls, f->fan_in, f->fan_out, f->loops);
+        }
+
+        if (json)
+                fprintf(out, "\n]\n");
+        arena_free(&scratch);
+        return 0;
+}
+
+// vim:fenc=utf-8:tw=75:et
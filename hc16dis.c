@@ -15,42 +15,69 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "hc16dis.h"
 #include "util.h"
 
 static int dbg = 0;
+static int verify = 0;
+static const char *functions_fmt = NULL;
+static zout *gzip_out = NULL;
 
-typedef struct operand_s {
-        char *name;
-        int bits;
-        int sext;
-        int zext;
-} operand;
-
-operand op_b = { "b", 4};               // 4-bit address extension
-operand op_ff = { "ff", 8};             // off8
-operand op_gggg = { "gggg", 16, 1};     // soff16
-operand op_zg = { "zg", 4, 1};          // soff20 [20:17]
-operand op_hh = { "hh", 8};             // addr imm16 [15:8]
-operand op_ii = { "ii", 8, 1};          // simm8
-operand op_jj = { "jj", 8};             // imm16 [15:8]
-operand op_kk = { "kk", 8};             // imm16 [7:0]
-operand op_ll = { "ll", 8};             // addr imm16 [7:0]
-operand op_mm = { "mm", 8};             // mask8
-operand op_mmmm = { "mmmm", 16};        // mask16
-operand op_rr = { "rr", 8};             // roff8
-operand op_rrrr = { "rrrr", 16, 1};     // sroff16
-operand op_xo = { "xo", 8};             // MAC index X offset
-operand op_yo = { "yo", 8};             // MAC index Y offset
-operand op_z = { "z", 4, 0, 1};         // 4-bit zero extension
-
-typedef struct operands_s {
-        char *name;
-        int num;
-        operand *elements[4];
-} operands;
+/*
+ * --db, --label, --comment, --wcet, --loop-bound, --make-sigs, --trace,
+ * --profile, --top, --ir, --range, --output and --banks apply to the next
+ * image on the command line.  (--top is also how many of each list
+ * --ngrams prints, once every image has been counted.)
+ */
+typedef struct annotation_s {
+        uint32_t addr;
+        int label;
+        const char *text;
+} annotation;
+
+static const char *db_path = NULL;
+static annotation *annotations = NULL;
+static int nannotations = 0;
+static uint32_t *wcet_entries = NULL;
+static uint32_t nwcet_entries = 0;
+static int wcet_all = 0;
+static loop_bound *loop_bounds = NULL;
+static uint32_t nloop_bounds = 0;
+static const char *sigs_out = NULL;
+static const char *trace_path = NULL;
+static const char *profile_path = NULL;
+static uint32_t profile_top = 10;
+static int show_ir = 0;
+static uint32_t range_start = 0;
+static uint32_t range_end = 0;
+static const char *output_path = NULL;
+static const char *banks_path = NULL;
+
+#define per_image_pending() \
+        (db_path || nannotations || nwcet_entries || wcet_all || \
+         nloop_bounds || sigs_out || trace_path || profile_path || \
+         show_ir || range_end || output_path || banks_path)
+
+operand op_b = { "b", 4, 0, 0, OPK_NONE };           // 4-bit addr ext
+operand op_ff = { "ff", 8, 0, 0, OPK_OFF8 };         // off8
+operand op_gggg = { "gggg", 16, 1, 0, OPK_SOFF16 };  // soff16
+operand op_zg = { "zg", 4, 1, 0, OPK_SOFF20 };       // soff20 [20:17]
+operand op_hh = { "hh", 8, 0, 0, OPK_ADDR16 };       // addr imm16 [15:8]
+operand op_ii = { "ii", 8, 1, 0, OPK_SIMM8 };        // simm8
+operand op_jj = { "jj", 8, 0, 0, OPK_IMM16 };        // imm16 [15:8]
+operand op_kk = { "kk", 8, 0, 0, OPK_NONE };         // imm16 [7:0]
+operand op_ll = { "ll", 8, 0, 0, OPK_NONE };         // addr imm16 [7:0]
+operand op_mm = { "mm", 8, 0, 0, OPK_MASK8 };        // mask8
+operand op_mmmm = { "mmmm", 16, 0, 0, OPK_MASK16 };  // mask16
+operand op_rr = { "rr", 8, 1, 0, OPK_REL8 };         // roff8
+operand op_rrrr = { "rrrr", 16, 1, 0, OPK_REL16 };   // sroff16
+operand op_xo = { "xo", 4, 1, 0, OPK_MACOFF };       // MAC index X offset
+operand op_yo = { "yo", 4, 1, 0, OPK_MACOFF };       // MAC index Y offset
+operand op_z = { "z", 4, 0, 1, OPK_ADDR20 };         // 4-bit zero ext
 
 operands ff = { "ff", 1, { &op_ff }};
 operands ii = { "ii", 1, { &op_ii }};
+operands mm = { "mm", 1, { &op_mm }};
 operands rr = { "rr", 1, { &op_rr }};
 operands gggg = { "gggg", 1, { &op_gggg }};
 operands rrrr = { "rrrr", 1, { &op_rrrr }};
@@ -71,65 +98,9 @@ operands mmhhll = { "mm hhll", 3, { &op_mm, &op_hh, &op_ll }};
 
 operands mmhhllrr = { "mm hhll rr", 4, { &op_mm, &op_hh, &op_ll, &op_rr }};
 operands mmhhllrrrr = { "mm hhll rrrr", 4, { &op_mm, &op_hh, &op_ll, &op_rrrr }};
+operands hhllhhll = { "hhll hhll", 4, { &op_hh, &op_ll, &op_hh, &op_ll }};
 operands zbhhll = { "z b hhll", 4, { &op_z, &op_b, &op_hh, &op_ll }};
 
-typedef enum {
-        PAGE0,
-        PAGE1,
-        PAGE2,
-        PAGE3,
-        IND8X,
-        ind8x = 4,
-        IND8Y,
-        ind8y = 5,
-        IND8Z,
-        ind8z = 6,
-        IND16X,
-        ind16x = 7,
-        IND16Y,
-        ind16y = 8,
-        IND16Z,
-        ind16z = 9,
-        IXP_to_EXT,
-        ixp_to_ext = 10,
-        IXP2EXT = 10,
-        ixp2ext = 10,
-        EXT_to_IXP,
-        ext_to_ixp = 11,
-        EXT2IXP = 11,
-        ext2ixp = 11,
-        INH,
-        inh = 12,
-        REL8,
-        rel8 = 13,
-        REL16,
-        rel16 = 14,
-        IMM8,
-        imm8 = 15,
-        IMM16,
-        imm16 = 16,
-        IND20X,
-        ind20x = 17,
-        IND20Y,
-        ind20y = 18,
-        IND20Z,
-        ind20z = 19,
-        EXT,
-        ext = 20,
-        EXT20 = 21,
-        ext20 = 21,
-        EX,
-        ex = 22,
-        EY,
-        ey = 23,
-        EZ,
-        ez = 24,
-        ext2ext,
-        EXT2EXT = 25,
-        ext_to_ext = 25,
-        EXT_to_EXT = 25,
-} mode;
-
 char *modenames[] = {
         [PAGE0] = "PAGE0",
         [PAGE1] = "PAGE1",
@@ -159,12 +130,6 @@ char *modenames[] = {
         [ext2ext] = "EXT->EXT",
 };
 
-typedef struct optable_s {
-        uint8_t opcode;
-        char *mnemonic;
-        mode mode;
-        operands *operands;
-} op;
 
 op opcodes[4][0x100] = {
         { // no prefix
@@ -175,9 +140,9 @@ op opcodes[4][0x100] = {
                 { 0x04, "asl", ind8x, &ff },
                 { 0x05, "clr", ind8x, &ff },
                 { 0x06, "tst", ind8x, &ff },
-                { 0x07, "unrecognized", PAGE0, &ii },
-                { 0x08, "bclr", ind16x, &mmggggrrrr },
-                { 0x09, "bset", ind16x, &mmggggrrrr },
+                { 0x07, "unrecognized", PAGE0 },
+                { 0x08, "bclr", ind16x, &mmgggg },
+                { 0x09, "bset", ind16x, &mmgggg },
                 { 0x0a, "brclr", ind16x, &mmggggrrrr },
                 { 0x0b, "brset", ind16x, &mmggggrrrr },
                 { 0x0c, "rol", ind8x, &ff },
@@ -192,8 +157,8 @@ op opcodes[4][0x100] = {
                 { 0x15, "clr", ind8y, &ff },
                 { 0x16, "tst", ind8y, &ff },
                 { 0x17, "PREBYTE", PAGE1 },
-                { 0x18, "bclr", ind16y, &mmggggrrrr },
-                { 0x19, "bset", ind16y, &mmggggrrrr },
+                { 0x18, "bclr", ind16y, &mmgggg },
+                { 0x19, "bset", ind16y, &mmgggg },
                 { 0x1a, "brclr", ind16y, &mmggggrrrr },
                 { 0x1b, "brset", ind16y, &mmggggrrrr },
                 { 0x1c, "rol", ind8y, &ff },
@@ -208,8 +173,8 @@ op opcodes[4][0x100] = {
                 { 0x25, "clr", ind8z, &ff },
                 { 0x26, "tst", ind8z, &ff },
                 { 0x27, "PREBYTE", PAGE2 },
-                { 0x28, "bclr", ind16z, &mmggggrrrr },
-                { 0x29, "bset", ind16z, &mmggggrrrr },
+                { 0x28, "bclr", ind16z, &mmgggg },
+                { 0x29, "bset", ind16z, &mmgggg },
                 { 0x2a, "brclr", ind16z, &mmggggrrrr },
                 { 0x2b, "brset", ind16z, &mmggggrrrr },
                 { 0x2c, "rol", ind8z, &ff },
@@ -220,8 +185,8 @@ op opcodes[4][0x100] = {
                 { 0x31, "movw", ixp2ext, &ffhhll },
                 { 0x32, "movb", ext2ixp, &ffhhll },
                 { 0x33, "movw", ext2ixp, &ffhhll },
-                { 0x34, "pshm", inh, &ii },
-                { 0x35, "pulm", inh, &ii },
+                { 0x34, "pshm", inh, &mm },
+                { 0x35, "pulm", inh, &mm },
                 { 0x36, "bsr", rel8, &rr },
                 { 0x37, "PREBYTE", PAGE3 },
                 { 0x38, "bclr", ext, &mmhhll },
@@ -290,12 +255,12 @@ op opcodes[4][0x100] = {
                 { 0x77, "oraa", imm8, &ff },
                 { 0x78, "cmpa", imm8, &ff },
                 { 0x79, "bita", imm8, &ff },
-                { 0x7a, "jmp", ext, &zbhhll },
-                { 0x7b, "mac", imm8, &ff },
+                { 0x7a, "jmp", ext20, &zbhhll },
+                { 0x7b, "mac", imm8, &xoyo },
                 { 0x7c, "adde", imm8, &ff },
-                { 0x7d, "unrecognized", imm8, &ii },
-                { 0x7e, "unrecognized", imm8, &ii },
-                { 0x7f, "unrecognized", imm8, &ii },
+                { 0x7d, "unrecognized", imm8 },
+                { 0x7e, "unrecognized", imm8 },
+                { 0x7f, "unrecognized", imm8 },
                 { 0x80, "subd", ind8x, &ff },
                 { 0x81, "addd", ind8x, &ff },
                 { 0x82, "sbcd", ind8x, &ff },
@@ -307,7 +272,7 @@ op opcodes[4][0x100] = {
                 { 0x88, "cmpd", ind8x, &ff },
                 { 0x89, "jsr", ind20x, &zggggg },
                 { 0x8a, "std", ind8x, &ff },
-                { 0x8b, "brset", ind8x, &ff },
+                { 0x8b, "brset", ind8x, &mmffrr },
                 { 0x8c, "stx", ind8x, &ff },
                 { 0x8d, "sty", ind8x, &ff },
                 { 0x8e, "stz", ind8x, &ff },
@@ -321,9 +286,9 @@ op opcodes[4][0x100] = {
                 { 0x96, "andd", ind8y, &ff },
                 { 0x97, "ord", ind8y, &ff },
                 { 0x98, "cmpd", ind8y, &ff },
-                { 0x99, "jsr", ind20x, &zggggg },
+                { 0x99, "jsr", ind20y, &zggggg },
                 { 0x9a, "std", ind8y, &ff },
-                { 0x9b, "brset", ind8y, &ff },
+                { 0x9b, "brset", ind8y, &mmffrr },
                 { 0x9c, "stx", ind8y, &ff },
                 { 0x9d, "sty", ind8y, &ff },
                 { 0x9e, "stz", ind8y, &ff },
@@ -337,9 +302,9 @@ op opcodes[4][0x100] = {
                 { 0xa6, "andd", ind8z, &ff },
                 { 0xa7, "ord", ind8z, &ff },
                 { 0xa8, "cmpd", ind8z, &ff },
-                { 0xa9, "jsr", ind20x, &zggggg },
+                { 0xa9, "jsr", ind20z, &zggggg },
                 { 0xaa, "std", ind8z, &ff },
-                { 0xab, "brset", ind8z, &ff },
+                { 0xab, "brset", ind8z, &mmffrr },
                 { 0xac, "stx", ind8z, &ff },
                 { 0xad, "sty", ind8z, &ff },
                 { 0xae, "stz", ind8z, &ff },
@@ -371,7 +336,7 @@ op opcodes[4][0x100] = {
                 { 0xc8, "cmpb", ind8x, &ff },
                 { 0xc9, "bitb", ind8x, &ff },
                 { 0xca, "stab", ind8x, &ff },
-                { 0xcb, "brclr", ind8x, &ff },
+                { 0xcb, "brclr", ind8x, &mmffrr },
                 { 0xcc, "ldx", ind8x, &ff },
                 { 0xcd, "ldy", ind8x, &ff },
                 { 0xce, "ldz", ind8x, &ff },
@@ -386,8 +351,8 @@ op opcodes[4][0x100] = {
                 { 0xd7, "orab", ind8y, &ff },
                 { 0xd8, "cmpb", ind8y, &ff },
                 { 0xd9, "bitb", ind8y, &ff },
-                { 0xda, "ldab", ind8y, &ff },
-                { 0xdb, "brclr", ind8y, &ff },
+                { 0xda, "stab", ind8y, &ff },
+                { 0xdb, "brclr", ind8y, &mmffrr },
                 { 0xdc, "ldx", ind8y, &ff },
                 { 0xdd, "ldy", ind8y, &ff },
                 { 0xde, "ldz", ind8y, &ff },
@@ -402,8 +367,8 @@ op opcodes[4][0x100] = {
                 { 0xe7, "orab", ind8z, &ff },
                 { 0xe8, "cmpb", ind8z, &ff },
                 { 0xe9, "bitb", ind8z, &ff },
-                { 0xea, "ldab", ind8z, &ff },
-                { 0xeb, "brclr", ind8z, &ff },
+                { 0xea, "stab", ind8z, &ff },
+                { 0xeb, "brclr", ind8z, &mmffrr },
                 { 0xec, "ldx", ind8z, &ff },
                 { 0xed, "ldy", ind8z, &ff },
                 { 0xee, "ldz", ind8z, &ff },
@@ -421,9 +386,9 @@ op opcodes[4][0x100] = {
                 { 0xfa, "jsr", ext20, &zbhhll },
                 { 0xfb, "rmac", imm8, &xoyo },
                 { 0xfc, "addd", imm8, &ii },
-                { 0xfd, "unrecognized", imm8, &ii },
-                { 0xfe, "unrecognized", imm8, &ii },
-                { 0xff, "unrecognized", imm8, &ii },
+                { 0xfd, "unrecognized", imm8 },
+                { 0xfe, "unrecognized", imm8 },
+                { 0xff, "unrecognized", imm8 },
         },
         { // prefix 0x17
                 { 0x00, "com", ind16x, &gggg },
@@ -433,11 +398,11 @@ op opcodes[4][0x100] = {
                 { 0x04, "asl", ind16x, &gggg },
                 { 0x05, "clr", ind16x, &gggg },
                 { 0x06, "tst", ind16x, &gggg },
-                { 0x07, "unrecognized", PAGE1, &ii },
-                { 0x08, "bclr", ind8x, &mmgggg },
-                { 0x09, "bset", ind8x, &mmgggg },
-                { 0x0a, "unrecognized", PAGE1, &ii },
-                { 0x0b, "unrecognized", PAGE1, &ii },
+                { 0x07, "unrecognized", PAGE1 },
+                { 0x08, "bclr", ind8x, &mmff },
+                { 0x09, "bset", ind8x, &mmff },
+                { 0x0a, "unrecognized", PAGE1 },
+                { 0x0b, "unrecognized", PAGE1 },
                 { 0x0c, "rol", ind16x, &gggg },
                 { 0x0d, "asr", ind16x, &gggg },
                 { 0x0e, "ror", ind16x, &gggg },
@@ -449,11 +414,11 @@ op opcodes[4][0x100] = {
                 { 0x14, "asl", ind16y, &gggg },
                 { 0x15, "clr", ind16y, &gggg },
                 { 0x16, "tst", ind16y, &gggg },
-                { 0x17, "unrecognized", PAGE1, &ii },
-                { 0x18, "bclr", ind8x, &mmgggg },
-                { 0x19, "bset", ind8x, &mmgggg },
-                { 0x1a, "unrecognized", PAGE1, &ii },
-                { 0x1b, "unrecognized", PAGE1, &ii },
+                { 0x17, "unrecognized", PAGE1 },
+                { 0x18, "bclr", ind8y, &mmff },
+                { 0x19, "bset", ind8y, &mmff },
+                { 0x1a, "unrecognized", PAGE1 },
+                { 0x1b, "unrecognized", PAGE1 },
                 { 0x1c, "rol", ind16y, &gggg },
                 { 0x1d, "asr", ind16y, &gggg },
                 { 0x1e, "ror", ind16y, &gggg },
@@ -465,11 +430,11 @@ op opcodes[4][0x100] = {
                 { 0x24, "asl", ind16z, &gggg },
                 { 0x25, "clr", ind16z, &gggg },
                 { 0x26, "tst", ind16z, &gggg },
-                { 0x27, "unrecognized", imm8, &ii },
-                { 0x28, "bclr", ind8x, &mmgggg },
-                { 0x29, "bset", ind8x, &mmgggg },
-                { 0x2a, "unrecognized", imm8, &ii },
-                { 0x2b, "unrecognized", imm8, &ii },
+                { 0x27, "unrecognized", imm8 },
+                { 0x28, "bclr", ind8z, &mmff },
+                { 0x29, "bset", ind8z, &mmff },
+                { 0x2a, "unrecognized", imm8 },
+                { 0x2b, "unrecognized", imm8 },
                 { 0x2c, "rol", ind16z, &gggg },
                 { 0x2d, "asr", ind16z, &gggg },
                 { 0x2e, "ror", ind16z, &gggg },
@@ -481,11 +446,11 @@ op opcodes[4][0x100] = {
                 { 0x34, "asl", ext, &hhll },
                 { 0x35, "clr", ext, &hhll },
                 { 0x36, "tst", ext, &hhll },
-                { 0x37, "unrecognized", imm8, &ii },
-                { 0x38, "unrecognized", imm8, &ii },
-                { 0x39, "unrecognized", imm8, &ii },
-                { 0x3a, "unrecognized", imm8, &ii },
-                { 0x3b, "unrecognized", imm8, &ii },
+                { 0x37, "unrecognized", imm8 },
+                { 0x38, "unrecognized", imm8 },
+                { 0x39, "unrecognized", imm8 },
+                { 0x3a, "unrecognized", imm8 },
+                { 0x3b, "unrecognized", imm8 },
                 { 0x3c, "rol", ext, &hhll },
                 { 0x3d, "asr", ext, &hhll },
                 { 0x3e, "ror", ext, &hhll },
@@ -501,7 +466,7 @@ op opcodes[4][0x100] = {
                 { 0x48, "cmpa", ind16x, &gggg },
                 { 0x49, "bita", ind16x, &gggg },
                 { 0x4a, "staa", ind16x, &gggg },
-                { 0x4b, "unrecognized", imm8, &ii },
+                { 0x4b, "unrecognized", imm8 },
                 { 0x4c, "cpx", ind16x, &gggg },
                 { 0x4d, "cpy", ind16x, &gggg },
                 { 0x4e, "cpz", ind16x, &gggg },
@@ -517,7 +482,7 @@ op opcodes[4][0x100] = {
                 { 0x58, "cmpa", ind16y, &gggg },
                 { 0x59, "bita", ind16y, &gggg },
                 { 0x5a, "staa", ind16y, &gggg },
-                { 0x5b, "unrecognized", imm8, &ii },
+                { 0x5b, "unrecognized", imm8 },
                 { 0x5c, "cpx", ind16y, &gggg },
                 { 0x5d, "cpy", ind16y, &gggg },
                 { 0x5e, "cpz", ind16y, &gggg },
@@ -533,7 +498,7 @@ op opcodes[4][0x100] = {
                 { 0x68, "cmpa", ind16z, &gggg },
                 { 0x69, "bita", ind16z, &gggg },
                 { 0x6a, "staa", ind16z, &gggg },
-                { 0x6b, "unrecognized", imm8, &ii },
+                { 0x6b, "unrecognized", imm8 },
                 { 0x6c, "cpx", ind16z, &gggg },
                 { 0x6d, "cpy", ind16z, &gggg },
                 { 0x6e, "cpz", ind16z, &gggg },
@@ -549,71 +514,71 @@ op opcodes[4][0x100] = {
                 { 0x78, "cmpa", ext, &hhll },
                 { 0x79, "bita", ext, &hhll },
                 { 0x7a, "staa", ext, &hhll },
-                { 0x7b, "unrecognized", imm8, &ii },
+                { 0x7b, "unrecognized", imm8 },
                 { 0x7c, "cpx", ext, &hhll },
                 { 0x7d, "cpy", ext, &hhll },
                 { 0x7e, "cpz", ext, &hhll },
                 { 0x7f, "cps", ext, &hhll },
-                { 0x80, "unrecognized", imm8, &ii },
-                { 0x81, "unrecognized", imm8, &ii },
-                { 0x82, "unrecognized", imm8, &ii },
-                { 0x83, "unrecognized", imm8, &ii },
-                { 0x84, "unrecognized", imm8, &ii },
-                { 0x85, "unrecognized", imm8, &ii },
-                { 0x86, "unrecognized", imm8, &ii },
-                { 0x87, "unrecognized", imm8, &ii },
-                { 0x88, "unrecognized", imm8, &ii },
-                { 0x89, "unrecognized", imm8, &ii },
-                { 0x8a, "unrecognized", imm8, &ii },
-                { 0x8b, "unrecognized", imm8, &ii },
+                { 0x80, "unrecognized", imm8 },
+                { 0x81, "unrecognized", imm8 },
+                { 0x82, "unrecognized", imm8 },
+                { 0x83, "unrecognized", imm8 },
+                { 0x84, "unrecognized", imm8 },
+                { 0x85, "unrecognized", imm8 },
+                { 0x86, "unrecognized", imm8 },
+                { 0x87, "unrecognized", imm8 },
+                { 0x88, "unrecognized", imm8 },
+                { 0x89, "unrecognized", imm8 },
+                { 0x8a, "unrecognized", imm8 },
+                { 0x8b, "unrecognized", imm8 },
                 { 0x8c, "stx", ind16x, &gggg },
                 { 0x8d, "sty", ind16x, &gggg },
                 { 0x8e, "stz", ind16x, &gggg },
                 { 0x8f, "sts", ind16x, &gggg },
-                { 0x90, "unrecognized", imm8, &ii },
-                { 0x91, "unrecognized", imm8, &ii },
-                { 0x92, "unrecognized", imm8, &ii },
-                { 0x93, "unrecognized", imm8, &ii },
-                { 0x94, "unrecognized", imm8, &ii },
-                { 0x95, "unrecognized", imm8, &ii },
-                { 0x96, "unrecognized", imm8, &ii },
-                { 0x97, "unrecognized", imm8, &ii },
-                { 0x98, "unrecognized", imm8, &ii },
-                { 0x99, "unrecognized", imm8, &ii },
-                { 0x9a, "unrecognized", imm8, &ii },
-                { 0x9b, "unrecognized", imm8, &ii },
+                { 0x90, "unrecognized", imm8 },
+                { 0x91, "unrecognized", imm8 },
+                { 0x92, "unrecognized", imm8 },
+                { 0x93, "unrecognized", imm8 },
+                { 0x94, "unrecognized", imm8 },
+                { 0x95, "unrecognized", imm8 },
+                { 0x96, "unrecognized", imm8 },
+                { 0x97, "unrecognized", imm8 },
+                { 0x98, "unrecognized", imm8 },
+                { 0x99, "unrecognized", imm8 },
+                { 0x9a, "unrecognized", imm8 },
+                { 0x9b, "unrecognized", imm8 },
                 { 0x9c, "stx", ind16y, &gggg },
                 { 0x9d, "sty", ind16y, &gggg },
                 { 0x9e, "stz", ind16y, &gggg },
                 { 0x9f, "sts", ind16y, &gggg },
-                { 0xa0, "unrecognized", imm8, &ii },
-                { 0xa1, "unrecognized", imm8, &ii },
-                { 0xa2, "unrecognized", imm8, &ii },
-                { 0xa3, "unrecognized", imm8, &ii },
-                { 0xa4, "unrecognized", imm8, &ii },
-                { 0xa5, "unrecognized", imm8, &ii },
-                { 0xa6, "unrecognized", imm8, &ii },
-                { 0xa7, "unrecognized", imm8, &ii },
-                { 0xa8, "unrecognized", imm8, &ii },
-                { 0xa9, "unrecognized", imm8, &ii },
-                { 0xaa, "unrecognized", imm8, &ii },
-                { 0xab, "unrecognized", imm8, &ii },
+                { 0xa0, "unrecognized", imm8 },
+                { 0xa1, "unrecognized", imm8 },
+                { 0xa2, "unrecognized", imm8 },
+                { 0xa3, "unrecognized", imm8 },
+                { 0xa4, "unrecognized", imm8 },
+                { 0xa5, "unrecognized", imm8 },
+                { 0xa6, "unrecognized", imm8 },
+                { 0xa7, "unrecognized", imm8 },
+                { 0xa8, "unrecognized", imm8 },
+                { 0xa9, "unrecognized", imm8 },
+                { 0xaa, "unrecognized", imm8 },
+                { 0xab, "unrecognized", imm8 },
                 { 0xac, "stx", ind16z, &gggg },
                 { 0xad, "sty", ind16z, &gggg },
                 { 0xae, "stz", ind16z, &gggg },
                 { 0xaf, "sts", ind16z, &gggg },
-                { 0xb0, "unrecognized", imm8, &ii },
-                { 0xb1, "unrecognized", imm8, &ii },
-                { 0xb2, "unrecognized", imm8, &ii },
-                { 0xb3, "unrecognized", imm8, &ii },
-                { 0xb4, "unrecognized", imm8, &ii },
-                { 0xb5, "unrecognized", imm8, &ii },
-                { 0xb6, "unrecognized", imm8, &ii },
-                { 0xb7, "unrecognized", imm8, &ii },
-                { 0xb8, "unrecognized", imm8, &ii },
-                { 0xb9, "unrecognized", imm8, &ii },
-                { 0xba, "unrecognized", imm8, &ii },
-                { 0xbb, "unrecognized", imm8, &ii },
+                { 0xb0, "unrecognized", imm8 },
+                { 0xb1, "unrecognized", imm8 },
+                { 0xb2, "unrecognized", imm8 },
+                { 0xb3, "unrecognized", imm8 },
+                { 0xb4, "unrecognized", imm8 },
+                { 0xb5, "unrecognized", imm8 },
+                { 0xb6, "unrecognized", imm8 },
+                { 0xb7, "unrecognized", imm8 },
+                { 0xb8, "unrecognized", imm8 },
+                { 0xb9, "unrecognized", imm8 },
+                { 0xba, "unrecognized", imm8 },
+                { 0xbb, "unrecognized", imm8 },
                 { 0xbc, "stx", ext, &hhll },
                 { 0xbd, "sty", ext, &hhll },
                 { 0xbe, "stz", ext, &hhll },
@@ -629,7 +594,7 @@ op opcodes[4][0x100] = {
                 { 0xc8, "cmpb", ind16x, &gggg },
                 { 0xc9, "bitb", ind16x, &gggg },
                 { 0xca, "stab", ind16x, &gggg },
-                { 0xcb, "unrecognized", imm8, &ii },
+                { 0xcb, "unrecognized", imm8 },
                 { 0xcc, "ldx", ind16x, &gggg },
                 { 0xcd, "ldy", ind16x, &gggg },
                 { 0xce, "ldz", ind16x, &gggg },
@@ -645,7 +610,7 @@ op opcodes[4][0x100] = {
                 { 0xd8, "cmpb", ind16y, &gggg },
                 { 0xd9, "bitb", ind16y, &gggg },
                 { 0xda, "stab", ind16y, &gggg },
-                { 0xdb, "unrecognized", imm8, &ii },
+                { 0xdb, "unrecognized", imm8 },
                 { 0xdc, "ldx", ind16y, &gggg },
                 { 0xdd, "ldy", ind16y, &gggg },
                 { 0xde, "ldz", ind16y, &gggg },
@@ -661,7 +626,7 @@ op opcodes[4][0x100] = {
                 { 0xe8, "cmpb", ind16z, &gggg },
                 { 0xe9, "bitb", ind16z, &gggg },
                 { 0xea, "stab", ind16z, &gggg },
-                { 0xeb, "unrecognized", imm8, &ii },
+                { 0xeb, "unrecognized", imm8 },
                 { 0xec, "ldx", ind16z, &gggg },
                 { 0xed, "ldy", ind16z, &gggg },
                 { 0xee, "ldz", ind16z, &gggg },
@@ -677,7 +642,7 @@ op opcodes[4][0x100] = {
                 { 0xf8, "cmpb", ext, &hhll },
                 { 0xf9, "bitb", ext, &hhll },
                 { 0xfa, "stab", ext, &hhll },
-                { 0xfb, "unrecognized", imm8, &ii },
+                { 0xfb, "unrecognized", imm8 },
                 { 0xfc, "ldx", ext, &hhll },
                 { 0xfd, "ldy", ext, &hhll },
                 { 0xfe, "ldz", ext, &hhll },
@@ -797,9 +762,9 @@ op opcodes[4][0x100] = {
                 { 0x6e, "unrecognized", PAGE2 },
                 { 0x6f, "tsx", ez },
                 { 0x70, "come", inh },
-                { 0x71, "lded", ext },
+                { 0x71, "lded", ext, &hhll },
                 { 0x72, "nege", inh },
-                { 0x73, "sted", ext },
+                { 0x73, "sted", ext, &hhll },
                 { 0x74, "asle", inh },
                 { 0x75, "clre", inh },
                 { 0x76, "tste", inh },
@@ -860,17 +825,18 @@ op opcodes[4][0x100] = {
                 { 0xad, "unrecognized", PAGE2 },
                 { 0xae, "unrecognized", PAGE2 },
                 { 0xaf, "unrecognized", PAGE2 },
-                { 0xb0, "ldhi", ext },
-                { 0xb1, "tedm", ext },
-                { 0xb2, "tem", ext },
-                { 0xb3, "tmxed", ext },
-                { 0xb4, "tmer", ext },
-                { 0xb5, "tmet", ext },
-                { 0xb6, "aslm", ext },
-                { 0xb7, "pshmac", ext },
-                { 0xb8, "pulmac", ext },
-                { 0xb9, "asrm", ext },
-                { 0xba, "tekb", ext },
+                { 0xb0, "ldhi", inh },
+                { 0xb1, "tedm", inh },
+                { 0xb2, "tem", inh },
+                { 0xb3, "tmxed", inh },
+                { 0xb4, "tmer", inh },
+                { 0xb5, "tmet", inh },
+                { 0xb6, "aslm", inh },
+                { 0xb7, "pshmac", inh },
+                { 0xb8, "pulmac", inh },
+                { 0xb9, "asrm", inh },
+                { 0xba, "tekb", inh },
+                { 0xbb, "unrecognized", PAGE2 },
                 { 0xbc, "unrecognized", PAGE2 },
                 { 0xbd, "unrecognized", PAGE2 },
                 { 0xbe, "unrecognized", PAGE2 },
@@ -924,9 +890,9 @@ op opcodes[4][0x100] = {
                 { 0xee, "unrecognized", PAGE2 },
                 { 0xef, "unrecognized", PAGE2 },
                 { 0xf0, "comd", inh },
-                { 0xf1, "ldstop", ext },
+                { 0xf1, "ldstop", inh },
                 { 0xf2, "negd", inh },
-                { 0xf3, "wai", ext },
+                { 0xf3, "wai", inh },
                 { 0xf4, "asld", inh },
                 { 0xf5, "clrd", inh },
                 { 0xf6, "tstd", inh },
@@ -1066,7 +1032,7 @@ op opcodes[4][0x100] = {
                 { 0x7a, "ste", ext, &hhll },
                 { 0x7b, "unrecognized", PAGE3 },
                 { 0x7c, "cpx", imm16, &jjkk },
-                { 0x7d, "cpx", imm16, &jjkk },
+                { 0x7d, "cpy", imm16, &jjkk },
                 { 0x7e, "cpz", imm16, &jjkk },
                 { 0x7f, "cps", imm16, &jjkk },
                 { 0x80, "lbra", rel16, &rrrr },
@@ -1181,190 +1147,757 @@ op opcodes[4][0x100] = {
                 { 0xed, "adz", inh },
                 { 0xee, "unrecognized", PAGE3 },
                 { 0xef, "unrecognized", PAGE3 },
-                { 0xf0, "subd", ext },
-                { 0xf1, "addd", ext },
-                { 0xf2, "sbcd", ext },
-                { 0xf3, "adcd", ext },
-                { 0xf4, "eord", ext },
-                { 0xf5, "ldd", ext },
-                { 0xf6, "andd", ext },
-                { 0xf7, "ord", ext },
-                { 0xf8, "cpd", ext },
+                { 0xf0, "subd", ext, &hhll },
+                { 0xf1, "addd", ext, &hhll },
+                { 0xf2, "sbcd", ext, &hhll },
+                { 0xf3, "adcd", ext, &hhll },
+                { 0xf4, "eord", ext, &hhll },
+                { 0xf5, "ldd", ext, &hhll },
+                { 0xf6, "andd", ext, &hhll },
+                { 0xf7, "ord", ext, &hhll },
+                { 0xf8, "cpd", ext, &hhll },
                 { 0xf9, "unrecognized", PAGE3 },
-                { 0xfa, "std", ext },
+                { 0xfa, "std", ext, &hhll },
                 { 0xfb, "unrecognized", PAGE3 },
                 { 0xfc, "tpa", inh },
                 { 0xfd, "tap", inh },
-                { 0xfe, "movb", ext2ext },
-                { 0xff, "movw", ext2ext },
+                { 0xfe, "movb", ext2ext, &hhllhhll },
+                { 0xff, "movw", ext2ext, &hhllhhll },
 
         }
 };
 
+/*
+ * The decoder doesn't walk opcodes[][] itself; pack_opcodes() boils it
+ * down to four bytes an entry: an offset into one blob of interned
+ * mnemonic strings, the mode, and an index into a small table of operand
+ * shapes that has the field widths already worked out.  That's 4kB of
+ * table plus about 1.5kB of strings, instead of 24kB of entries that
+ * each point somewhere else.
+ */
+_Static_assert(sizeof(packed_op) == 4, "packed_op should be four bytes");
+
+packed_op packed_opcodes[4][0x100];
+uint8_t flows[4][0x100];
+timing timings[4][0x100];
+shape shapes[MAX_SHAPES];
+char mnemonics[MNEMONICS_SIZE];
+uint16_t first_defined_mnemonic;
+static int nshapes = 1;
+static size_t mnemonics_used;
+
+static uint16_t
+intern_mnemonic(const char * const mnemonic)
+{
+        size_t len = strlen(mnemonic) + 1;
+        size_t offset;
+
+        for (offset = 0; offset < mnemonics_used;
+             offset += strlen(&mnemonics[offset]) + 1)
+                if (!strcmp(&mnemonics[offset], mnemonic))
+                        return offset;
+
+        if (mnemonics_used + len > sizeof(mnemonics))
+                errx(8, "Too many mnemonics");
+        memcpy(&mnemonics[offset], mnemonic, len);
+        mnemonics_used += len;
+        return offset;
+}
+
+static uint8_t
+intern_shape(operands * const operands)
+{
+        shape *shape;
+
+        if (!operands)
+                return 0;
+
+        for (int i = 1; i < nshapes; i++)
+                if (shapes[i].operands == operands)
+                        return i;
+
+        if (nshapes == MAX_SHAPES)
+                errx(8, "Too many operand shapes");
+        shape = &shapes[nshapes];
+        shape->operands = operands;
+        shape->nfields = operands->num;
+        for (int i = 0; i < operands->num; i++) {
+                shape->fbits[i] = operands->elements[i]->bits;
+                shape->bits += operands->elements[i]->bits;
+        }
+        shape->bytes = (shape->bits + 7) / 8;
+
+        for (int i = 0; i < operands->num; ) {
+                operand *arg = operands->elements[i];
+                const opkind_info *kind = &opkinds[arg->kind];
+
+                if (arg->kind == OPK_NONE ||
+                    i + kind->fields > operands->num)
+                        errx(8, "Operands \"%s\" don't fit their kinds",
+                             operands->name);
+                for (int j = i; j < i + kind->fields; j++)
+                        if (operands->elements[j]->zext)
+                                shape->zfields |= 1 << j;
+                shape->args[shape->nargs].kind = arg->kind;
+                shape->args[shape->nargs].first = i;
+                shape->args[shape->nargs].nfields = kind->fields;
+                shape->nargs++;
+                i += kind->fields;
+        }
+
+        return nshapes++;
+}
+
+/*
+ * How an instruction affects control flow, going by its name.
+ */
+static uint8_t
+classify_flow(const op * const op)
+{
+        const char *m = op->mnemonic;
+        uint8_t indirect = 0;
+
+        switch (op->mode) {
+        case ind20x:
+        case ind20y:
+        case ind20z:
+                indirect = FLOW_INDIRECT;
+                break;
+        default:
+                break;
+        }
+
+        if (!strcmp(m, "rts") || !strcmp(m, "rti"))
+                return FLOW_RETURN | FLOW_STOP;
+        if (!strcmp(m, "jsr") || !strcmp(m, "bsr") || !strcmp(m, "lbsr"))
+                return FLOW_CALL | indirect;
+        if (!strcmp(m, "jmp") || !strcmp(m, "bra") || !strcmp(m, "lbra"))
+                return FLOW_BRANCH | FLOW_STOP | indirect;
+        if (!strcmp(m, "brn") || !strcmp(m, "lbrn"))
+                return 0;
+        if (!strcmp(m, "brclr") || !strcmp(m, "brset"))
+                return FLOW_BRANCH | FLOW_COND;
+        if ((op->mode == rel8 || op->mode == rel16) &&
+            (m[0] == 'b' || (m[0] == 'l' && m[1] == 'b')))
+                return FLOW_BRANCH | FLOW_COND;
+        return 0;
+}
+
+/*
+ * Execution time in CPU clocks, assuming 16-bit, zero wait state memory
+ * for both program and operands, after the CPU16 Reference Manual's
+ * instruction timing summary.  Most of it follows from the addressing
+ * mode; the rest is per-instruction.  Anything whose time isn't fixed
+ * is marked open, and the WCET estimate won't put a number on it.
+ */
+static const uint8_t mode_cycles[] = {
+        [ind8x] = 6, [ind8y] = 6, [ind8z] = 6,
+        [ind16x] = 6, [ind16y] = 6, [ind16z] = 6,
+        [ixp2ext] = 8, [ext2ixp] = 8,
+        [inh] = 2,
+        [rel8] = 2, [rel16] = 4,
+        [imm8] = 2, [imm16] = 4,
+        [ind20x] = 8, [ind20y] = 8, [ind20z] = 8,
+        [ext] = 6, [ext20] = 6,
+        [ex] = 6, [ey] = 6, [ez] = 6,
+        [ext2ext] = 10,
+};
+
+static const struct {
+        const char *mnemonic;
+        uint8_t cycles;         // 0 to keep the mode's count
+        uint8_t taken;          // when a branch is taken
+        uint8_t per_reg;        // for each register in the mask
+        uint8_t open;
+} cycle_rows[] = {
+        { "rts", 12 },
+        { "rti", 12 },
+        { "bsr", 10 },
+        { "lbsr", 10 },
+        { "jsr", 10 },
+        { "swi", 16 },
+        { "wai", 8, 0, 0, TIME_WAITS },
+        { "ldstop", 4, 0, 0, TIME_WAITS },
+        { "bgnd", 0, 0, 0, TIME_WAITS },
+        { "mul", 10 },
+        { "emul", 8 },
+        { "emuls", 8 },
+        { "fmuls", 8 },
+        { "idiv", 22 },
+        { "fdiv", 22 },
+        { "ediv", 24 },
+        { "edivs", 38 },
+        { "mac", 12 },
+        { "rmac", 6, 0, 0, TIME_REPEATS },
+        { "pshm", 4, 0, 2 },
+        { "pulm", 6, 0, 2 },
+        { "psha", 4 },
+        { "pshb", 4 },
+        { "pula", 6 },
+        { "pulb", 6 },
+        { "pshmac", 14 },
+        { "pulmac", 16 },
+        { "aced", 4 },
+        { "aslm", 4 },
+        { "asrm", 4 },
+        { "tap", 4 },
+        { "tdp", 4 },
+        { "tedm", 4 },
+        { "tem", 4 },
+        { "tmet", 4 },
+        { "tmer", 6 },
+        { "tmxed", 6 },
+        { "ldhi", 8 },
+        { "lded", 8 },
+        { "sted", 8 },
+        { "brclr", 10, 12 },
+        { "brset", 10, 12 },
+        { "bclr", 8 },
+        { "bset", 8 },
+        { "bclrw", 10 },
+        { "bsetw", 10 },
+        /* register transfers, in the E-indexed columns of page 2 */
+        { "nop", 2 },
+        { "nxz", 2 },
+        { "tsx", 2 },
+        { "tsy", 2 },
+        { "txy", 2 },
+        { "tyx", 2 },
+        { "tyz", 2 },
+        { "tzx", 2 },
+        { "tzy", 2 },
+        { NULL, 0 }
+};
+
+/* read-modify-write ops on memory */
+static const char * const rmw[] = {
+        "asl", "aslw", "asr", "asrw", "com", "comw", "dec", "decw", "inc",
+        "incw", "lsr", "lsrw", "neg", "negw", "rol", "rolw", "ror", "rorw",
+        NULL
+};
+
+/* ...and ones that only write, quicker through an 8-bit offset */
+static const char * const stores[] = {
+        "clr", "clrw", "staa", "stab", "std", "ste", "sts", "stx", "sty",
+        "stz", NULL
+};
+
+static timing
+classify_timing(const op * const op, uint8_t flow)
+{
+        timing t = { 2, 0, 0 };
+
+        if (op->mode < sizeof(mode_cycles) && mode_cycles[op->mode])
+                t.cycles = mode_cycles[op->mode];
+
+        for (int i = 0; rmw[i]; i++)
+                if (!strcmp(op->mnemonic, rmw[i]) && op->mode != inh)
+                        t.cycles += 2;
+        for (int i = 0; stores[i]; i++)
+                if (!strcmp(op->mnemonic, stores[i]) &&
+                    (op->mode == ind8x || op->mode == ind8y ||
+                     op->mode == ind8z))
+                        t.cycles = 4;
+
+        if ((flow & FLOW_BRANCH) &&
+            (op->mode == rel8 || op->mode == rel16))
+                t.taken = 6;
+
+        for (int i = 0; cycle_rows[i].mnemonic; i++) {
+                if (strcmp(op->mnemonic, cycle_rows[i].mnemonic))
+                        continue;
+                if (cycle_rows[i].cycles)
+                        t.cycles = cycle_rows[i].cycles;
+                t.taken = cycle_rows[i].taken;
+                t.per_reg = cycle_rows[i].per_reg;
+                t.open = cycle_rows[i].open;
+                /* ...and brclr/brset through a 16-bit offset */
+                if (t.taken && op->mode != ind8x && op->mode != ind8y &&
+                    op->mode != ind8z)
+                        t.taken += 2;
+        }
+
+        /* jmp through an index costs the mode's; jsr takes 2 more */
+        if ((flow & FLOW_INDIRECT) && (flow & FLOW_CALL))
+                t.cycles += 2;
+        return t;
+}
+
+/*
+ * Clocks for one instruction; for a branch, either way it goes.
+ */
+int
+insn_cycles(const insn * const insn, int taken)
+{
+        const timing *t = &insn_timing(insn);
+        int cycles = t->cycles;
+
+        if (taken && t->taken)
+                cycles = t->taken;
+        if (t->per_reg)
+                cycles += t->per_reg *
+                          __builtin_popcount(insn->values[0] & 0x7f);
+        return cycles;
+}
+
+void
+pack_opcodes(void)
+{
+        if (mnemonics_used)
+                return;
+
+        /*
+         * The two names that mean "not an instruction" go first, so
+         * checking for them is one compare.
+         */
+        intern_mnemonic("unrecognized");
+        intern_mnemonic("PREBYTE");
+        first_defined_mnemonic = mnemonics_used;
+
+        for (int page = 0; page < 4; page++) {
+                for (int opcode = 0; opcode < 0x100; opcode++) {
+                        op *op = &opcodes[page][opcode];
+                        packed_op *packed = &packed_opcodes[page][opcode];
+
+                        if (!op->mnemonic)
+                                continue;
+                        packed->mnemonic = intern_mnemonic(op->mnemonic);
+                        packed->mode = op->mode;
+                        packed->shape = intern_shape(op->operands);
+                        if (!packed_is_defined(*packed))
+                                continue;
+                        flows[page][opcode] = classify_flow(op);
+                        timings[page][opcode] =
+                                classify_timing(op, flows[page][opcode]);
+                }
+        }
+}
+
 #define getb(p)                                         \
         ({                                              \
                 uint64_t _p = p;                        \
-                if (_p > size || pos > size - _p) {     \
+                if (_p >= size || pos >= size - _p) {   \
                         warnx("Invalid buffer access"); \
                         errno = EINVAL;                 \
                         return -1;                      \
                 }                                       \
-                in[pos + p];                            \
+                in[pos + _p];                           \
         })
 
-static void
-print_operand(operand *arg, mode mode UNUSED, uint8_t value[4])
+int
+is_prebyte(uint8_t byte)
 {
-        if (arg == &op_b) {
-        } else if (arg == &op_ff) {
-                printf("0x%02hhx", value[0]);
-        } else if (arg == &op_gggg) {
-                printf("0x%04hx%04hx", value[0], value[1]);
-        } else if (arg == &op_hh) {
-        } else if (arg == &op_ii) {
-                printf("0x%02hhx", value[0]);
-        } else if (arg == &op_jj) {
-        } else if (arg == &op_kk) {
-        } else if (arg == &op_ll) {
-        } else if (arg == &op_mm) {
-                printf("(0x%02hhx & ", value[0]);
-        } else if (arg == &op_mmmm) {
-        } else if (arg == &op_rr) {
-        } else if (arg == &op_rrrr) {
-        } else if (arg == &op_xo) {
-        } else if (arg == &op_yo) {
-        } else if (arg == &op_z) {
-        } else {
-                warnx("Unknown operand %p?!?!?", arg);
-                warnx("op_b: %p\n", &op_b);
-                warnx("op_ff: %p\n", &op_ff);
-                warnx("op_zg: %p\n", &op_zg);
-                warnx("op_gggg: %p\n", &op_gggg);
-                warnx("op_hh: %p\n", &op_hh);
-                warnx("op_ii: %p\n", &op_ii);
-                warnx("op_jj: %p\n", &op_jj);
-                warnx("op_kk: %p\n", &op_kk);
-                warnx("op_ll: %p\n", &op_ll);
-                warnx("op_mm: %p\n", &op_mm);
-                warnx("op_mmmm: %p\n", &op_mmmm);
-                warnx("op_rr: %p\n", &op_rr);
-                warnx("op_rrrr: %p\n", &op_rrrr);
-                warnx("op_xo: %p\n", &op_xo);
-                warnx("op_yo: %p\n", &op_yo);
-                warnx("op_z: %p\n", &op_z);
-                exit(6);
-        }
+        return byte == 0x17 || byte == 0x27 || byte == 0x37;
+}
+
+int
+is_defined(const op * const op)
+{
+        return op->mnemonic &&
+               strcmp(op->mnemonic, "unrecognized") &&
+               strcmp(op->mnemonic, "PREBYTE");
 }
 
 static int
-disass(const char * const in, const size_t size)
+operand_bits(const operands * const operands)
 {
-        size_t pos;
+        int bits = 0;
 
-        for (pos = 0; pos < size - 2; ) {
-                uint8_t prefix;
-                uint8_t opcode;
-                op op;
-                operands *operands;
-                int bits;
-                char buf[] = "00000000: 00 00 00 0000 0000 0000 0000 0000\t";
-                char *next;
-                size_t sz;
-                int bytes = 0;
-
-                switch (in[pos]) {
-                case 0x17:
-                case 0x27:
-                case 0x37:
-                        prefix = getb(0);
-                        opcode = getb(1);
-                        break;
-                default:
-                        prefix = 0;
-                        opcode = getb(0);
-                        break;
-                }
+        for (int i = 0; operands && i < operands->num; i++)
+                bits += operands->elements[i]->bits;
+        return bits;
+}
+
+/*
+ * Operand fields are packed MSB first into the bytes following the
+ * opcode; when they don't fill a whole number of bytes, the slack is at
+ * the top of the first byte (e.g. the high nibble of "zg gggg").
+ */
+int
+decode_insn(const uint8_t * const in, const size_t size, const size_t pos,
+            insn *insn)
+{
+        uint8_t prefix = 0;
+        uint8_t opcode;
+        packed_op packed;
+        const shape *shape;
+        uint64_t raw = 0;
+        int bytes, shift;
+
+        opcode = getb(0);
+        if (is_prebyte(opcode)) {
+                prefix = opcode;
+                opcode = getb(1);
+        }
+
+        packed = packed_opcodes[(prefix >> 4) & 3][opcode];
+        shape = &shapes[packed.shape];
+
+        insn->pos = pos;
+        insn->prefix = prefix;
+        insn->opcode = opcode;
+        insn->op = &opcodes[(prefix >> 4) & 3][opcode];
+        insn->packed = packed;
+
+        bytes = prefix ? 2 : 1;
+        for (int i = 0; i < shape->bytes; i++)
+                raw = (raw << 8) | getb(bytes + i);
+        insn->len = bytes + shape->bytes;
+        insn->slack = raw >> shape->bits;
+
+        shift = shape->bits;
+        for (int i = 0; i < shape->nfields; i++) {
+                shift -= shape->fbits[i];
+                insn->values[i] = (raw >> shift) &
+                                  ((1ull << shape->fbits[i]) - 1);
+                if (shape->zfields & (1 << i) && insn->values[i])
+                        insn->slack = 1;
+        }
+
+        return 0;
+}
 
-                op = opcodes[(prefix >> 4) & 3][opcode];
-                bytes = prefix ? 2 : 1;
-
-                bits = 0;
-                operands = op.operands;
-                for (int i = 0; operands && i < operands->num; i++)
-                        bits += operands->elements[i]->bits;
-
-                sz = sizeof(buf);
-                next = spnprintf(buf, sz, "%08zx: %02hhx", pos, prefix ? prefix : opcode);
-                if (prefix)
-                        next = spnprintf(next, sz, "%02hhx", opcode);
-                //printf("prefix:%02hhx bits:%d ", prefix, bits);
-                for (int i = bits / 8 + (bits % 8 ? 1 : 0);
-                     i > 0;
-                     i--) {
-                        uint8_t byte = getb(i);
-                        uint8_t mask = 0xff;
-                        if (i == (prefix ? 2 : 1) && bits % 8)
-                                mask = (1 << bits % 8) - 1;
-                        //printf("i:%d byte:%02hhx mask:%02hhx: ", i, byte, mask);
-                        next = spnprintf(next, sz, "%02hhx", byte & mask);
-                        bytes += 1;
+int
+encode_insn(const insn * const insn, uint8_t *out, const size_t size)
+{
+        operands *operands = insn->op->operands;
+        uint64_t raw = 0;
+        int bits, bytes = 0;
+
+        bits = operand_bits(operands);
+        if ((size_t)(insn->prefix ? 2 : 1) + (bits + 7) / 8 > size) {
+                errno = ENOSPC;
+                return -1;
+        }
+
+        if (insn->prefix)
+                out[bytes++] = insn->prefix;
+        out[bytes++] = insn->opcode;
+
+        for (int i = 0; operands && i < operands->num; i++) {
+                operand *operand = operands->elements[i];
+
+                raw = (raw << operand->bits) |
+                      (insn->values[i] & ((1ull << operand->bits) - 1));
+        }
+        for (int i = (bits + 7) / 8 - 1; i >= 0; i--)
+                out[bytes++] = raw >> (i * 8);
+
+        return bytes;
+}
+
+/*
+ * Everything the listing needs to know about each kind of operand.  The
+ * formatter and the assembler are both driven from this, so adding an
+ * operand kind means adding a row here and nothing else.
+ */
+const opkind_info opkinds[NR_OPKINDS] = {
+        //               fields bits digits sext imm index rel
+        [OPK_OFF8] =   { 1,  8, 2, 0, 0, 1, 0 },
+        [OPK_SOFF16] = { 1, 16, 4, 1, 0, 1, 0 },
+        [OPK_SOFF20] = { 2, 20, 5, 1, 0, 1, 0 },
+        [OPK_SIMM8] =  { 1,  8, 2, 1, 1, 0, 0 },
+        [OPK_IMM16] =  { 2, 16, 4, 0, 1, 0, 0 },
+        [OPK_ADDR16] = { 2, 16, 4, 0, 0, 0, 0 },
+        [OPK_ADDR20] = { 4, 20, 5, 0, 0, 0, 0 },
+        [OPK_MASK8] =  { 1,  8, 2, 0, 1, 0, 0 },
+        [OPK_MASK16] = { 1, 16, 4, 0, 1, 0, 0 },
+        [OPK_REL8] =   { 1,  8, 5, 1, 0, 0, 1 },
+        [OPK_REL16] =  { 1, 16, 5, 1, 0, 0, 1 },
+        [OPK_MACOFF] = { 1,  4, 1, 1, 0, 0, 0 },
+};
+
+/*
+ * What goes in front of an operand in the listing.  Index offsets are
+ * always followed by an explicit sign, so "[%x]+0x0010" and
+ * "[%x]-0x0010" read the way they work.
+ */
+const char *
+arg_prefix(const shape_arg * const arg, const mode mode)
+{
+        const opkind_info *kind = &opkinds[arg->kind];
+
+        if (mode == imm8 || mode == imm16 || kind->imm)
+                return "#";
+        if (!kind->index)
+                return "";
+
+        switch (mode) {
+        case ind8x:
+        case ind16x:
+        case ind20x:
+        case ixp2ext:
+        case ext2ixp:
+                return "[%x]";
+        case ind8y:
+        case ind16y:
+        case ind20y:
+                return "[%y]";
+        case ind8z:
+        case ind16z:
+        case ind20z:
+                return "[%z]";
+        default:
+                return "";
+        }
+}
+
+/*
+ * Which operand goes in position i of the listing.  Operands are listed
+ * in encoding order, except that EXT->IXP moves put the source address
+ * first even though the offset byte is encoded first.
+ */
+int
+arg_order(const mode mode, const shape * const shape, const int i)
+{
+        if (mode == ext2ixp)
+                return (i + 1) % shape->nargs;
+        return i;
+}
+
+const char *
+mode_operand(const mode mode)
+{
+        switch (mode) {
+        case ex:
+                return "[%x]+%e";
+        case ey:
+                return "[%y]+%e";
+        case ez:
+                return "[%z]+%e";
+        default:
+                return NULL;
+        }
+}
+
+/*
+ * The CPU16 prefetches three words ahead, so branch offsets count from
+ * six bytes past the start of the branch.
+ */
+uint32_t
+rel_base(const insn * const insn)
+{
+        return insn->pos + 6;
+}
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static inline char *
+emit_hex(char *p, uint32_t value, int digits)
+{
+        for (int i = digits - 1; i >= 0; i--)
+                *p++ = hexdigits[(value >> (i * 4)) & 0xf];
+        return p;
+}
+
+static inline char *
+emit_str(char *p, const char *s)
+{
+        while (*s)
+                *p++ = *s++;
+        return p;
+}
+
+/*
+ * An operand's value the way the listing shows it: sign extended if its
+ * kind is signed, and branch offsets resolved to their 20-bit target.
+ */
+int32_t
+arg_value(const shape * const shape, const shape_arg * const arg,
+          const insn * const insn)
+{
+        const opkind_info *kind = &opkinds[arg->kind];
+        uint32_t mask = (1u << kind->bits) - 1;
+        uint32_t value = 0;
+
+        for (int i = arg->first; i < arg->first + arg->nfields; i++)
+                value = (value << shape->fbits[i]) | insn->values[i];
+        value &= mask;
+
+        if (kind->sext && value >> (kind->bits - 1))
+                value |= ~mask;
+        if (kind->rel)
+                value = (rel_base(insn) + value) & 0xfffff;
+        return value;
+}
+
+static char *
+format_arg(char *p, const shape * const shape, const shape_arg * const arg,
+           const insn * const insn)
+{
+        const char *prefix = arg_prefix(arg, insn->packed.mode);
+        int32_t value = arg_value(shape, arg, insn);
+
+        p = emit_str(p, prefix);
+        if (value < 0)
+                *p++ = '-';
+        else if (prefix[0] == '[')
+                *p++ = '+';
+        *p++ = '0';
+        *p++ = 'x';
+        return emit_hex(p, value < 0 ? -value : value,
+                        opkinds[arg->kind].digits);
+}
+
+/*
+ * Name any module registers the instruction's addresses land on, as a
+ * note, so the line still assembles.
+ */
+static char *
+format_regs(char *p, const shape * const shape, const insn * const insn)
+{
+        const char *sep = "  ; ";
+
+        for (int i = 0; i < shape->nargs; i++) {
+                const shape_arg *arg = &shape->args[i];
+                const char *name;
+
+                if (arg->kind == OPK_ADDR16)
+                        name = reg_name16(arg_value(shape, arg, insn));
+                else if (arg->kind == OPK_ADDR20)
+                        name = reg_name(arg_value(shape, arg, insn));
+                else
+                        continue;
+                if (!name)
+                        continue;
+                p = emit_str(p, sep);
+                p = emit_str(p, name);
+                sep = ", ";
+        }
+        return p;
+}
+
+/*
+ * One instruction's listing line, without the newline.  Returns its
+ * length, which is always less than INSN_LINE_MAX - 1.
+ */
+size_t
+format_insn(char *line, const uint8_t * const in, const insn * const insn)
+{
+        char *p = line;
+        const shape *shape = &shapes[insn->packed.shape];
+        const char *mode_op;
+
+        p = emit_hex(p, insn->pos, 8);
+        *p++ = ':';
+        *p++ = ' ';
+        for (int i = 0; i < insn->len; i++)
+                p = emit_hex(p, in[insn->pos + i], 2);
+        while (p < line + 30)
+                *p++ = ' ';
+
+        if (!packed_is_defined(insn->packed) || insn->slack) {
+                p = emit_str(p, ".byte");
+                for (int i = 0; i < insn->len; i++) {
+                        p = emit_str(p, i ? ", 0x" : " 0x");
+                        p = emit_hex(p, in[insn->pos + i], 2);
                 }
-                memset(next, ' ', sz);
-                buf[sizeof(buf)-1] = 0;
-                sz = sizeof(buf) + 25;
-                next = buf + 25;
-                next = spnprintf(next, sz, " ");
-                printf("%s ", buf);
-
-                printf("%s%c", op.mnemonic, ' ');
-
-                if (op.operands) {
-                        int localbits = 0;
-                        operands = op.operands;
-                        bytes = prefix ? 2 : 1;
-                        for (int j = 0; j < operands->num; j++) {
-                                uint8_t value[4];
-
-                                operand *operand = operands->elements[j];
-
-                                value[0] = getb(bytes);
-                                localbits = operand->bits;
-                                for (int k = 1; localbits > 8; k++) {
-                                        value[k] = getb(bytes+k);
-                                        localbits -= localbits >= 8 ? 8 : localbits;
-                                }
-                                value[1] = getb(bytes+1);
-                                switch(op.mode) {
-                                case ind8x:
-                                case ind16x:
-                                        printf("[%%x]+");
-                                        break;
-                                case ind8y:
-                                case ind16y:
-                                        printf("[%%y]+");
-                                        break;
-                                case ind8z:
-                                case ind16z:
-                                        printf("[%%z]+");
-                                        break;
-                                default:
-                                        break;
-                                }
-                                print_operand(operand, op.mode, value);
-                                if (j + 1 < operands->num)
-                                        printf(", ");
-                                localbits += operand->bits;
-                                while (localbits > 8) {
-                                        pos += 1;
-                                        localbits -= 8;
-                                }
-                        }
-                        //printf("%s\n", operands->name);
-                        pos += 1;
-                } else {
-                        pos += bytes;
+                return p - line;
+        }
+
+        p = emit_str(p, packed_mnemonic(insn->packed));
+        mode_op = mode_operand(insn->packed.mode);
+        if (mode_op) {
+                *p++ = ' ';
+                p = emit_str(p, mode_op);
+        }
+
+        for (int i = 0; i < shape->nargs; i++) {
+                const shape_arg *arg;
+
+                arg = &shape->args[arg_order(insn->packed.mode, shape, i)];
+                p = emit_str(p, i ? ", " : " ");
+                p = format_arg(p, shape, arg, insn);
+        }
+        return format_regs(p, shape, insn) - line;
+}
+
+/*
+ * How long format_insn()'s line would be, without formatting it.
+ */
+size_t
+insn_line_len(const insn * const insn)
+{
+        const shape *shape = &shapes[insn->packed.shape];
+        const char *mode_op;
+        char regs[INSN_LINE_MAX];
+        size_t len = 30;
+
+        if (!packed_is_defined(insn->packed) || insn->slack)
+                return len + 5 + 5 + 6 * (insn->len - 1);
+
+        len += strlen(packed_mnemonic(insn->packed));
+        mode_op = mode_operand(insn->packed.mode);
+        if (mode_op)
+                len += 1 + strlen(mode_op);
+
+        for (int i = 0; i < shape->nargs; i++) {
+                const shape_arg *arg = &shape->args[i];
+                const char *prefix = arg_prefix(arg, insn->packed.mode);
+
+                len += (i ? 2 : 1) + strlen(prefix) + 2 +
+                       opkinds[arg->kind].digits;
+                if (prefix[0] == '[' || arg_value(shape, arg, insn) < 0)
+                        len++;
+        }
+        return len + (format_regs(regs, shape, insn) - regs);
+}
+
+/*
+ * Print one instruction, with an optional "; note" after it.
+ */
+void
+print_insn_note(FILE *out, const uint8_t * const in,
+                const insn * const insn, const char * const note)
+{
+        char line[INSN_LINE_MAX];
+        size_t len = format_insn(line, in, insn);
+
+        if (!note)
+                line[len++] = '\n';
+        fwrite(line, 1, len, out);
+        /* there may be register names there already */
+        if (note)
+                fprintf(out, "%s%s\n",
+                        memchr(line, ';', len) ? ", " : "  ; ", note);
+}
+
+void
+print_insn(FILE *out, const uint8_t * const in, const insn * const insn)
+{
+        print_insn_note(out, in, insn, NULL);
+}
+
+/*
+ * Whatever is left when the last instruction would run off the end of
+ * the image is listed as raw bytes, so the listing still covers (and
+ * reassembles to) the whole file.
+ */
+static void
+print_bytes(FILE *out, const uint8_t * const in, size_t pos, size_t size)
+{
+        for (; pos < size; pos++)
+                fprintf(out, "%08zx: %02hhx%18s.byte 0x%02hhx\n",
+                        pos, in[pos], "", in[pos]);
+}
+
+int
+disass(FILE *out, const uint8_t * const in, const size_t size)
+{
+        size_t pos;
+
+        for (pos = 0; pos < size; ) {
+                insn insn;
+                int rc;
+
+                rc = decode_insn(in, size, pos, &insn);
+                if (rc < 0) {
+                        print_bytes(out, in, pos, size);
+                        return rc;
                 }
-                puts("\n");
+
+                print_insn(out, in, &insn);
+                pos += insn.len;
         }
 
         return 0;
@@ -1375,51 +1908,488 @@ usage(int status)
 {
         FILE *out = status == 0 ? stdout : stderr;
 
-        putsf(out, "usage: hc16 <INFILE>\n");
+        putsf(out, "usage: hc16 [--huge-pages] [--gzip <OUTFILE>] "
+                   "[--regs <PART>|<FILE>] [--checksums <FILE>] "
+                   "<INFILE> [<INFILE> ...]\n");
+        putsf(out, "       hc16 --verify <INFILE> [<INFILE> ...]\n");
+        putsf(out, "       hc16 --db <DBFILE> [--label <ADDR> <NAME>] "
+                   "[--comment <ADDR> <TEXT>] <INFILE>\n");
+        putsf(out, "       hc16 --functions csv|json <INFILE> "
+                   "[<INFILE> ...]\n");
+        putsf(out, "       hc16 --db <DBFILE> --make-sigs <OUTFILE> "
+                   "<INFILE>\n");
+        putsf(out, "       hc16 --sigs <FILE> [--functions csv|json] "
+                   "<INFILE> [<INFILE> ...]\n");
+        putsf(out, "       hc16 --search <PATTERN> | --patterns <FILE> "
+                   "<INFILE> [<INFILE> ...]\n");
+        putsf(out, "       hc16 --wcet <ADDR>|all "
+                   "[--loop-bound <ADDR> <N>] <INFILE>\n");
+        putsf(out, "       hc16 [--db <DBFILE>] --trace <TRACEFILE> "
+                   "<INFILE>\n");
+        putsf(out, "       hc16 [--db <DBFILE>] --profile <HISTFILE> "
+                   "[--top <N>] <INFILE>\n");
+        putsf(out, "       hc16 [--db <DBFILE>] --ir <INFILE>\n");
+        putsf(out, "       hc16 --ngrams <N> [--top <K>] <INFILE> "
+                   "[<INFILE> ...]\n");
+        putsf(out, "       hc16 [--keep-sync] --range <START>:<END> "
+                   "<INFILE>\n");
+        putsf(out, "       hc16 --banks <MODELFILE> <INFILE>\n");
+        putsf(out, "       hc16 [--keep-sync] --output <OUTFILE> "
+                   "<INFILE>\n");
+        putsf(out, "       hc16 --asm <INFILE> <OUTFILE>\n");
+        putsf(out, "       hc16 --serve <SOCKET> [--db <DBFILE>] <INFILE> "
+                   "[[--db <DBFILE>] <INFILE> ...]\n");
+        putsf(out, "       hc16 --query <SOCKET> <QUERY> [<QUERY> ...]\n");
+        putsf(out, "       hc16 [--regs <PART>|<FILE>] "
+                   "[--checksums <FILE>] --watch <DIR>\n");
+        putsf(out, "       hc16 --self-test\n");
+        putsf(out, "       hc16 --gen-corpus <OUTFILE>\n");
         exit(1);
 }
 
-static void
-process_file(const char * const filename)
+/*
+ * Disassemble the image, assemble the listing again, and make sure we
+ * get back exactly what we started with.  Returns 0, or 7 if we don't.
+ */
+static int
+verify_buf(FILE *out, const char * const filename,
+           const uint8_t * const buf, const size_t size)
+{
+        FILE *listing;
+        char *text = NULL;
+        size_t textlen = 0;
+        uint8_t *bin = NULL;
+        size_t binlen = 0;
+        size_t pos;
+
+        listing = open_memstream(&text, &textlen);
+        if (!listing)
+                err(4, "Could not allocate memory");
+        disass(listing, buf, size);
+        if (fclose(listing) == EOF)
+                err(4, "Could not allocate memory");
+
+        if (assemble(filename, text, textlen, &bin, &binlen) < 0) {
+                warnx("%s: listing does not assemble", filename);
+                free(text);
+                return 7;
+        }
+        free(text);
+
+        for (pos = 0; pos < size && pos < binlen; pos++)
+                if (buf[pos] != bin[pos])
+                        break;
+        free(bin);
+        if (pos < size || binlen != size) {
+                warnx("%s: round trip differs at 0x%08zx", filename, pos);
+                return 7;
+        }
+
+        if (dbg)
+                fprintf(out, "%s: round trip ok\n", filename);
+        return 0;
+}
+
+/*
+ * Read a whole image into memory.  On failure this returns the exit
+ * status that goes with what went wrong, with errno set.
+ */
+int
+read_image(const char * const filename, uint8_t **bufp, size_t *sizep)
 {
         FILE *in = NULL;
         struct stat sb;
         int rc;
-        char *buf;
+        uint8_t *buf;
         size_t sz, bufsize;
 
         in = fopen(filename, "r");
-        if (!filename)
-                err(2, "Could not open \"%s\"", filename);
+        if (!in)
+                return 2;
 
         rc = fstat(fileno(in), &sb);
-        if (rc < 0)
-                err(3, "Could not stat input");
+        if (rc < 0) {
+                fclose(in);
+                return 3;
+        }
 
         bufsize = sb.st_size;
         bufsize += bufsize % 4 ? bufsize % 4 : 0;
 
-        buf = calloc(1, bufsize);
-        if (!buf)
-                err(4, "Could not allocate memory");
+        buf = calloc(1, bufsize ? bufsize : 1);
+        if (!buf) {
+                fclose(in);
+                return 4;
+        }
 
         sz = fread(buf, 1, sb.st_size, in);
-        errno = ferror(in);
-        if (sz <= 0 || sz != (uint64_t)sb.st_size)
-                err(5, "Could not read file");
+        errno = ferror(in) ? errno : EIO;
+        if (sz <= 0 || sz != (uint64_t)sb.st_size) {
+                fclose(in);
+                free(buf);
+                return 5;
+        }
 
         fclose(in);
+        *bufp = buf;
+        *sizep = sz;
+        return 0;
+}
+
+/*
+ * Exit with one of the per-image statuses.  Analysis and verification
+ * failures have already said what went wrong, so those don't use errno.
+ */
+void NORETURN
+image_error(int rc, const char * const filename)
+{
+        static const char * const why[] = {
+                [2] = "Could not open",
+                [3] = "Could not stat",
+                [4] = "Could not allocate memory for",
+                [5] = "Could not read",
+                [6] = "Could not analyze",
+                [7] = "Could not verify",
+        };
+
+        if (rc >= 6)
+                errx(rc, "%s \"%s\"", why[rc], filename);
+        err(rc, "%s \"%s\"", why[rc], filename);
+}
+
+/*
+ * Whatever we were asked to print about an analyzed image.  Returns 0,
+ * or the exit status for an analysis or verification failure.
+ */
+static int
+report_image(FILE *out, image *img)
+{
+        if (trace_path) {
+                FILE *in = fopen(trace_path, "r");
+
+                if (!in)
+                        err(2, "Could not open \"%s\"", trace_path);
+                if (print_trace(out, img, in) < 0)
+                        err(5, "Could not trace \"%s\"", trace_path);
+                fclose(in);
+        } else if (profile_path) {
+                FILE *in = fopen(profile_path, "r");
+
+                if (!in)
+                        err(2, "Could not open \"%s\"", profile_path);
+                if (print_profile(out, img, in, profile_path,
+                                  profile_top) < 0)
+                        err(5, "Could not profile with \"%s\"",
+                            profile_path);
+                fclose(in);
+        } else if (nwcet_entries || wcet_all) {
+                if (print_wcet(out, img, wcet_entries, nwcet_entries,
+                               loop_bounds, nloop_bounds) < 0) {
+                        warnx("%s: could not estimate execution time",
+                              img->filename);
+                        return 6;
+                }
+        } else if (verify) {
+                return verify_buf(out, img->filename, img->buf, img->size);
+        } else if (functions_fmt) {
+                if (print_functions(out, img, functions_fmt) < 0) {
+                        warnx("%s: could not find functions",
+                              img->filename);
+                        return 6;
+                }
+        } else if (have_patterns()) {
+                if (search_image(out, img) < 0) {
+                        warnx("%s: could not search image", img->filename);
+                        return 6;
+                }
+        } else if (show_ir) {
+                if (print_ir(out, img) < 0) {
+                        warnx("%s: could not lift image", img->filename);
+                        return 6;
+                }
+        } else {
+                print_listing(out, img);
+        }
+        return 0;
+}
+
+static void
+make_sigs(const image * const img)
+{
+        FILE *out = fopen(sigs_out, "w");
+        int n;
+
+        if (!out)
+                err(2, "Could not open \"%s\"", sigs_out);
+        n = write_signatures(out, img);
+        if (n < 0 || fclose(out) == EOF)
+                err(5, "Could not write \"%s\"", sigs_out);
+        if (!n)
+                warnx("%s: no named functions to make signatures from",
+                      img->filename);
+}
+
+/*
+ * An image whose checksums don't match doesn't get listed; this returns
+ * 7 for one of those, and 0 otherwise.
+ */
+int
+check_image(const char * const filename, const uint8_t * const buf,
+            const size_t size)
+{
+        if (have_checksums() && check_checksums(filename, buf, size) > 0) {
+                warnx("%s: checksums do not match", filename);
+                return 7;
+        }
+        return 0;
+}
+
+/*
+ * An image_fn, so it runs on the decode workers: nothing here exits, it
+ * returns the status for image_error() instead.
+ */
+static int
+list_image(FILE *out, const char * const filename,
+           const uint8_t * const buf, const size_t size)
+{
+        int rc;
 
-        disass(buf, sb.st_size);
+        rc = check_image(filename, buf, size);
+        if (rc)
+                return rc;
+        if (have_ngrams())
+                return count_ngrams(out, filename, buf, size);
+        if (functions_fmt || have_patterns() || have_signatures()) {
+                image img = { filename, buf, size };
+
+                if (analyze_image(&img) < 0) {
+                        warnx("%s: could not analyze image", filename);
+                        return 6;
+                }
+                if (match_signatures(&img) < 0) {
+                        warnx("%s: could not match signatures", filename);
+                        rc = 6;
+                } else {
+                        rc = report_image(out, &img);
+                }
+                free_image(&img);
+                return rc;
+        } else if (verify) {
+                return verify_buf(out, filename, buf, size);
+        }
+        disass(out, buf, size);
+        return 0;
+}
+
+static void
+list_file(FILE *out, const char * const filename)
+{
+        size_t size;
+        uint8_t *buf;
+        int rc;
+
+        rc = read_image(filename, &buf, &size);
+        if (rc)
+                image_error(rc, filename);
+
+        if (per_image_pending()) {
+                image img = { filename, buf, size };
+
+                rc = check_image(filename, buf, size);
+                if (rc)
+                        image_error(rc, filename);
+                if (db_path)
+                        rc = db_open(&img, db_path);
+                else
+                        rc = analyze_image(&img);
+                if (rc < 0)
+                        errx(6, "%s: could not analyze image", filename);
+
+                for (int i = 0; i < nannotations; i++) {
+                        annotation *a = &annotations[i];
+
+                        if (a->label)
+                                rc = set_label(&img, a->addr, a->text, 0);
+                        else
+                                rc = add_comment(&img, a->addr, a->text);
+                        if (rc < 0)
+                                errx(6, "%s: could not annotate 0x%05x",
+                                     filename, a->addr);
+                }
+                if (match_signatures(&img) < 0)
+                        errx(6, "%s: could not match signatures",
+                             filename);
+
+                if (sigs_out) {
+                        make_sigs(&img);
+                } else {
+                        rc = report_image(out, &img);
+                        if (rc)
+                                image_error(rc, filename);
+                }
+                free_image(&img);
+
+                db_path = NULL;
+                nannotations = 0;
+                nwcet_entries = 0;
+                wcet_all = 0;
+                nloop_bounds = 0;
+                sigs_out = NULL;
+                trace_path = NULL;
+                profile_path = NULL;
+                profile_top = 10;
+                show_ir = 0;
+        } else {
+                rc = list_image(out, filename, buf, size);
+                if (rc)
+                        image_error(rc, filename);
+        }
 
         free(buf);
 }
 
+static void
+process_file(const char * const filename)
+{
+        char *text = NULL;
+        size_t textlen = 0;
+        FILE *out = stdout;
+        int rc;
+
+        if (gzip_out) {
+                out = open_memstream(&text, &textlen);
+                if (!out)
+                        err(4, "Could not allocate memory");
+        }
+
+        if (output_path) {
+                rc = write_listing(filename, output_path);
+                if (rc < 0)
+                        err(5, "Could not write \"%s\"", output_path);
+                if (rc)
+                        image_error(rc, filename);
+                output_path = NULL;
+        } else if (banks_path) {
+                rc = print_banked(out, filename, banks_path);
+                if (rc < 0)
+                        err(8, "Could not load memory model \"%s\"",
+                            banks_path);
+                if (rc)
+                        image_error(rc, filename);
+                banks_path = NULL;
+        } else if (range_end) {
+                rc = print_range(out, filename, range_start, range_end);
+                if (rc)
+                        image_error(rc, filename);
+                range_start = range_end = 0;
+        } else {
+                list_file(out, filename);
+        }
+
+        if (gzip_out) {
+                if (fclose(out) == EOF)
+                        err(4, "Could not allocate memory");
+                if (zout_write(gzip_out, filename, text, textlen) < 0)
+                        err(5, "Could not write compressed listing");
+                free(text);
+        }
+}
+
+static uint32_t
+parse_addr(const char * const addr)
+{
+        char *end = NULL;
+        unsigned long value;
+
+        errno = 0;
+        value = strtoul(addr, &end, 16);
+        if (errno || !end || *end || end == addr || value > 0xfffff)
+                errx(1, "Invalid address \"%s\"", addr);
+        return value;
+}
+
+/*
+ * START:END, in hex, with END not included.
+ */
+static void
+parse_range(const char * const range)
+{
+        char *end = NULL, *colon;
+        unsigned long start, stop = 0;
+
+        errno = 0;
+        start = strtoul(range, &colon, 16);
+        if (!errno && colon != range && *colon == ':')
+                stop = strtoul(colon + 1, &end, 16);
+        if (errno || !end || end == colon + 1 || *end || stop <= start ||
+            stop > UINT32_MAX)
+                errx(1, "Invalid range \"%s\"", range);
+        range_start = start;
+        range_end = stop;
+}
+
+static void
+queue_annotation(const char * const addr, int label, const char *text)
+{
+        uint32_t value = parse_addr(addr);
+        annotation *new;
+
+        new = reallocarray(annotations, nannotations + 1, sizeof(*new));
+        if (!new)
+                err(4, "Could not allocate memory");
+        annotations = new;
+        annotations[nannotations].addr = value;
+        annotations[nannotations].label = label;
+        annotations[nannotations].text = text;
+        nannotations++;
+}
+
+static void
+queue_wcet(const char * const addr)
+{
+        uint32_t *new;
+
+        if (!strcmp(addr, "all")) {
+                wcet_all = 1;
+                return;
+        }
+
+        new = reallocarray(wcet_entries, nwcet_entries + 1, sizeof(*new));
+        if (!new)
+                err(4, "Could not allocate memory");
+        wcet_entries = new;
+        wcet_entries[nwcet_entries++] = parse_addr(addr);
+}
+
+static void
+queue_loop_bound(const char * const addr, const char * const count)
+{
+        loop_bound *new;
+        char *end = NULL;
+        unsigned long value;
+
+        errno = 0;
+        value = strtoul(count, &end, 10);
+        if (errno || !end || *end || end == count || !value ||
+            value > UINT32_MAX)
+                errx(1, "Invalid loop bound \"%s\"", count);
+
+        new = reallocarray(loop_bounds, nloop_bounds + 1, sizeof(*new));
+        if (!new)
+                err(4, "Could not allocate memory");
+        loop_bounds = new;
+        loop_bounds[nloop_bounds].addr = parse_addr(addr);
+        loop_bounds[nloop_bounds].count = value;
+        nloop_bounds++;
+}
+
 int main(int argc, char *argv[])
 {
         if (argc < 2)
                 usage(1);
 
+        pack_opcodes();
+
         for (int i = 1; i < argc; i++) {
                 if (!strcmp(argv[i], "--help") ||
                     !strcmp(argv[i], "-h") ||
@@ -1433,9 +2403,276 @@ int main(int argc, char *argv[])
                         continue;
                 }
 
+                if (!strcmp(argv[i], "--verify")) {
+                        verify = 1;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--gzip")) {
+                        if (i + 1 >= argc || gzip_out)
+                                usage(1);
+                        gzip_out = zout_open(argv[++i]);
+                        if (!gzip_out)
+                                err(2, "Could not open \"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--functions")) {
+                        if (i + 1 >= argc ||
+                            (strcmp(argv[i + 1], "csv") &&
+                             strcmp(argv[i + 1], "json")))
+                                usage(1);
+                        functions_fmt = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--search")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        if (add_pattern(argv[++i]) < 0)
+                                errx(1, "Invalid pattern \"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--patterns")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        if (load_patterns(argv[++i]) < 0)
+                                err(2, "Could not load patterns from "
+                                    "\"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--regs")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        if (load_regmap(argv[++i]) < 0)
+                                err(8, "Could not load registers from "
+                                    "\"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--checksums")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        if (load_checksums(argv[++i]) < 0)
+                                err(8, "Could not load checksums from "
+                                    "\"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--sigs")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        if (load_signatures(argv[++i]) < 0)
+                                err(2, "Could not load signatures from "
+                                    "\"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--make-sigs")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        sigs_out = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--trace")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        trace_path = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--profile")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        profile_path = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--ir")) {
+                        show_ir = 1;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--banks")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        banks_path = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--output")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        output_path = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--range")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        parse_range(argv[++i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--ngrams")) {
+                        char *end = NULL;
+                        long value;
+
+                        if (i + 1 >= argc)
+                                usage(1);
+                        errno = 0;
+                        value = strtol(argv[++i], &end, 10);
+                        if (errno || !end || *end || end == argv[i] ||
+                            set_ngrams(value) < 0)
+                                errx(1, "Invalid sequence length \"%s\"",
+                                     argv[i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--top")) {
+                        char *end = NULL;
+                        unsigned long value;
+
+                        if (i + 1 >= argc)
+                                usage(1);
+                        errno = 0;
+                        value = strtoul(argv[++i], &end, 10);
+                        if (errno || !end || *end || end == argv[i] ||
+                            value > UINT32_MAX)
+                                errx(1, "Invalid --top count \"%s\"",
+                                     argv[i]);
+                        profile_top = value;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--huge-pages")) {
+                        arena_huge_pages = 1;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--keep-sync")) {
+                        sync_keep = 1;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--db")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        db_path = argv[++i];
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--label") ||
+                    !strcmp(argv[i], "--comment")) {
+                        if (i + 2 >= argc)
+                                usage(1);
+                        queue_annotation(argv[i + 1],
+                                         !strcmp(argv[i], "--label"),
+                                         argv[i + 2]);
+                        i += 2;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--wcet")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        queue_wcet(argv[++i]);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--loop-bound")) {
+                        if (i + 2 >= argc)
+                                usage(1);
+                        queue_loop_bound(argv[i + 1], argv[i + 2]);
+                        i += 2;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--serve")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        serve(argv[i + 1], argc - i - 2, argv + i + 2);
+                        err(2, "Could not serve on \"%s\"", argv[i + 1]);
+                }
+
+                if (!strcmp(argv[i], "--query")) {
+                        if (i + 2 >= argc)
+                                usage(1);
+                        if (query(argv[i + 1], argc - i - 2,
+                                  argv + i + 2) < 0)
+                                err(2, "Could not query \"%s\"",
+                                    argv[i + 1]);
+                        exit(0);
+                }
+
+                if (!strcmp(argv[i], "--watch")) {
+                        if (i + 1 >= argc)
+                                usage(1);
+                        if (watch_dir(argv[i + 1]) < 0)
+                                err(2, "Could not watch \"%s\"",
+                                    argv[i + 1]);
+                        exit(0);
+                }
+
+                if (!strcmp(argv[i], "--asm")) {
+                        if (i + 2 >= argc)
+                                usage(1);
+                        if (asm_file(argv[i + 1], argv[i + 2]) < 0)
+                                exit(7);
+                        i += 2;
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--self-test")) {
+                        if (self_test() != 0)
+                                exit(7);
+                        continue;
+                }
+
+                if (!strcmp(argv[i], "--gen-corpus")) {
+                        FILE *out;
+
+                        if (i + 1 >= argc)
+                                usage(1);
+                        out = fopen(argv[++i], "w");
+                        if (!out)
+                                err(2, "Could not open \"%s\"", argv[i]);
+                        if (gen_corpus(out) < 0 || fclose(out) == EOF)
+                                err(5, "Could not write \"%s\"", argv[i]);
+                        continue;
+                }
+
+                if (have_patterns() && compile_patterns() < 0)
+                        errx(6, "Could not compile search patterns");
+
+                /*
+                 * A run of images with nothing else to do to them can be
+                 * read and listed in parallel.
+                 */
+                if (!per_image_pending()) {
+                        int n;
+
+                        for (n = 1; i + n < argc && argv[i + n][0] != '-';
+                             n++)
+                                ;
+                        if (n > 1) {
+                                load_images(argv + i, n, list_image,
+                                            gzip_out);
+                                i += n - 1;
+                                continue;
+                        }
+                }
+
                 process_file(argv[i]);
         }
 
+        if (have_ngrams() && print_ngrams(stdout, profile_top) < 0)
+                err(4, "Could not allocate memory");
+        if (gzip_out && zout_close(gzip_out) < 0)
+                err(5, "Could not write compressed listing");
         exit(0);
 }
 
@@ -0,0 +1,679 @@
+/*
+ * hc16dis.h
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+#ifndef HC16DIS_H_
+#define HC16DIS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "util.h"
+
+/*
+ * How an operand is rendered.  Some operands span several fields (hh and
+ * ll are one address); the first field carries the kind and the rest are
+ * OPK_NONE.
+ */
+typedef enum {
+        OPK_NONE,
+        OPK_OFF8,
+        OPK_SOFF16,
+        OPK_SOFF20,
+        OPK_SIMM8,
+        OPK_IMM16,
+        OPK_ADDR16,
+        OPK_ADDR20,
+        OPK_MASK8,
+        OPK_MASK16,
+        OPK_REL8,
+        OPK_REL16,
+        OPK_MACOFF,
+        NR_OPKINDS
+} opkind;
+
+typedef struct opkind_info_s {
+        uint8_t fields;         // how many operand fields it spans
+        uint8_t bits;           // width of the value
+        uint8_t digits;         // hex digits in the listing
+        uint8_t sext;           // value is signed
+        uint8_t imm;            // listed with '#'
+        uint8_t index;          // listed after the index register
+        uint8_t rel;            // branch offset, listed as its target
+} opkind_info;
+
+extern const opkind_info opkinds[NR_OPKINDS];
+
+typedef struct operand_s {
+        char *name;
+        int bits;
+        int sext;
+        int zext;
+        opkind kind;
+} operand;
+
+typedef struct operands_s {
+        char *name;
+        int num;
+        operand *elements[4];
+} operands;
+
+typedef enum {
+        PAGE0,
+        PAGE1,
+        PAGE2,
+        PAGE3,
+        IND8X,
+        ind8x = 4,
+        IND8Y,
+        ind8y = 5,
+        IND8Z,
+        ind8z = 6,
+        IND16X,
+        ind16x = 7,
+        IND16Y,
+        ind16y = 8,
+        IND16Z,
+        ind16z = 9,
+        IXP_to_EXT,
+        ixp_to_ext = 10,
+        IXP2EXT = 10,
+        ixp2ext = 10,
+        EXT_to_IXP,
+        ext_to_ixp = 11,
+        EXT2IXP = 11,
+        ext2ixp = 11,
+        INH,
+        inh = 12,
+        REL8,
+        rel8 = 13,
+        REL16,
+        rel16 = 14,
+        IMM8,
+        imm8 = 15,
+        IMM16,
+        imm16 = 16,
+        IND20X,
+        ind20x = 17,
+        IND20Y,
+        ind20y = 18,
+        IND20Z,
+        ind20z = 19,
+        EXT,
+        ext = 20,
+        EXT20 = 21,
+        ext20 = 21,
+        EX,
+        ex = 22,
+        EY,
+        ey = 23,
+        EZ,
+        ez = 24,
+        ext2ext,
+        EXT2EXT = 25,
+        ext_to_ext = 25,
+        EXT_to_EXT = 25,
+} mode;
+
+typedef struct optable_s {
+        uint8_t opcode;
+        char *mnemonic;
+        mode mode;
+        operands *operands;
+} op;
+
+extern operand op_b, op_ff, op_gggg, op_zg, op_hh, op_ii, op_jj, op_kk,
+               op_ll, op_mm, op_mmmm, op_rr, op_rrrr, op_xo, op_yo, op_z;
+
+extern char *modenames[];
+extern op opcodes[4][0x100];
+
+/*
+ * opcodes[][] as the decoder sees it; see pack_opcodes().
+ */
+typedef struct packed_op_s {
+        uint16_t mnemonic;
+        uint8_t mode;
+        uint8_t shape;
+} packed_op;
+
+typedef struct shape_arg_s {
+        uint8_t kind;
+        uint8_t first;
+        uint8_t nfields;
+} shape_arg;
+
+typedef struct shape_s {
+        operands *operands;
+        uint8_t bits;
+        uint8_t bytes;
+        uint8_t nfields;
+        uint8_t zfields;        // bitmask of fields that must be zero
+        uint8_t fbits[4];
+        uint8_t nargs;
+        shape_arg args[4];
+} shape;
+
+#define MAX_SHAPES 32
+#define MNEMONICS_SIZE 2048
+
+/*
+ * flows[][] says what each instruction does to control flow.
+ */
+#define FLOW_BRANCH     0x01    // may transfer control
+#define FLOW_COND       0x02    // ... or may fall through
+#define FLOW_CALL       0x04    // subroutine call
+#define FLOW_RETURN     0x08    // rts/rti
+#define FLOW_INDIRECT   0x10    // target depends on an index register
+#define FLOW_STOP       0x20    // never falls through
+#define FLOW_RESOLVED   0x40    // (xrefs only) worked out from registers
+
+/*
+ * timings[][] is how many clocks each instruction takes; see
+ * insn_cycles().
+ */
+typedef struct timing_s {
+        uint8_t cycles;
+        uint8_t taken;          // if it's a branch and it's taken
+        uint8_t per_reg;        // more for each register pshm/pulm move
+        uint8_t open;           // TIME_*: cycles is just the least
+} timing;
+
+#define TIME_REPEATS    1       // once more for each count in E (rmac)
+#define TIME_WAITS      2       // until an interrupt or the debugger
+
+extern packed_op packed_opcodes[4][0x100];
+extern uint8_t flows[4][0x100];
+extern timing timings[4][0x100];
+extern shape shapes[MAX_SHAPES];
+extern char mnemonics[MNEMONICS_SIZE];
+extern uint16_t first_defined_mnemonic;
+extern void pack_opcodes(void);
+
+#define packed_mnemonic(packed) (&mnemonics[(packed).mnemonic])
+#define packed_is_defined(packed) \
+        ((packed).mnemonic >= first_defined_mnemonic)
+
+/*
+ * One decoded instruction.  values[] holds each operand field from
+ * op->operands, in order, right-justified and not yet sign extended.
+ * slack is set when bits that should be zero (above the first field, or
+ * a zero-extension field) aren't; the listing shows those as raw bytes.
+ */
+typedef struct insn_s {
+        size_t pos;
+        uint8_t prefix;
+        uint8_t opcode;
+        uint8_t len;
+        uint8_t slack;
+        packed_op packed;
+        op *op;
+        uint32_t values[4];
+} insn;
+
+#define MAX_INSN_LEN 7
+
+extern int is_prebyte(uint8_t byte);
+extern int is_defined(const op * const op);
+extern int decode_insn(const uint8_t * const in, const size_t size,
+                       const size_t pos, insn *insn);
+extern int encode_insn(const insn * const insn, uint8_t *out,
+                       const size_t size);
+extern int arg_order(const mode mode, const shape * const shape,
+                     const int i);
+extern const char *arg_prefix(const shape_arg * const arg,
+                              const mode mode);
+extern const char *mode_operand(const mode mode);
+extern uint32_t rel_base(const insn * const insn);
+extern int32_t arg_value(const shape * const shape,
+                         const shape_arg * const arg,
+                         const insn * const insn);
+
+#define insn_flow(insn) (flows[((insn)->prefix >> 4) & 3][(insn)->opcode])
+#define insn_timing(insn) \
+        (timings[((insn)->prefix >> 4) & 3][(insn)->opcode])
+extern int insn_cycles(const insn * const insn, int taken);
+#define INSN_LINE_MAX   160
+extern size_t format_insn(char *line, const uint8_t * const in,
+                          const insn * const insn);
+extern size_t insn_line_len(const insn * const insn);
+extern void print_insn_note(FILE *out, const uint8_t * const in,
+                            const insn * const insn,
+                            const char * const note);
+extern void print_insn(FILE *out, const uint8_t * const in,
+                       const insn * const insn);
+extern int disass(FILE *out, const uint8_t * const in, const size_t size);
+extern int read_image(const char * const filename, uint8_t **bufp,
+                      size_t *sizep);
+extern void NORETURN image_error(int rc, const char * const filename);
+extern int check_image(const char * const filename,
+                        const uint8_t * const buf, const size_t size);
+
+/* zout.c */
+typedef struct zout_s zout;
+extern zout *zout_open(const char * const path);
+extern int zout_write(zout *z, const char * const name, const char *text,
+                      size_t len);
+extern int zout_close(zout *z);
+
+/* loader.c */
+typedef int (*image_fn)(FILE *out, const char * const filename,
+                        const uint8_t * const buf, const size_t size);
+extern int load_images(char * const files[], size_t nfiles, image_fn fn,
+                       zout *z);
+
+/* asm.c */
+extern int assemble(const char *filename, const char *text, size_t size,
+                    uint8_t **outp, size_t *outlen);
+extern int asm_file(const char * const infile, const char * const outfile);
+
+/* arena.c */
+typedef struct arena_chunk_s arena_chunk;
+
+typedef struct arena_s {
+        arena_chunk *chunks;
+        arena_chunk *spare;
+} arena;
+
+typedef struct arena_pos_s {
+        arena_chunk *chunk;
+        size_t used;
+} arena_pos;
+
+extern int arena_huge_pages;
+extern void *arena_alloc(arena *a, size_t size);
+extern void *arena_realloc(arena *a, void *old, size_t oldsize,
+                           size_t newsize);
+extern void arena_mark(const arena * const a, arena_pos *pos);
+extern void arena_reset(arena *a, const arena_pos * const pos);
+extern void arena_free(arena *a);
+
+/* analysis.c */
+
+/*
+ * These are stored in the database exactly as they are laid out here, so
+ * only ever add to the end of them, and bump DB_VERSION when you do.
+ */
+#define INSN_BYTES      0x01    // listed as .byte
+typedef struct insn_rec_s {
+        uint32_t addr;
+        uint8_t len;
+        uint8_t prefix;
+        uint8_t opcode;
+        uint8_t flags;
+        uint16_t values[4];
+} insn_rec;
+
+#define REGION_CODE     0
+#define REGION_DATA     1
+typedef struct region_s {
+        uint32_t start;
+        uint32_t end;
+        uint32_t type;
+} region;
+
+#define SYM_AUTO        0x01    // named by analysis, not by a person
+#define SYM_FUNC        0x02    // something calls it
+#define SYM_LIB         0x04    // matched a library signature
+typedef struct symbol_s {
+        uint32_t addr;
+        uint32_t name;          // offset in SEC_STRINGS
+        uint32_t flags;
+} symbol;
+
+typedef struct xref_s {
+        uint32_t from;
+        uint32_t to;
+        uint32_t flow;          // FLOW_* of the instruction at from
+} xref;
+
+typedef struct comment_s {
+        uint32_t addr;
+        uint32_t text;          // offset in SEC_STRINGS
+} comment;
+
+typedef enum {
+        SEC_INSNS,
+        SEC_REGIONS,
+        SEC_SYMBOLS,    // sorted by addr
+        SEC_XREFS,      // sorted by to
+        SEC_COMMENTS,   // sorted by addr
+        SEC_STRINGS,
+        NR_SECTIONS
+} section_id;
+
+extern const size_t section_elem_size[NR_SECTIONS];
+
+typedef struct section_s {
+        void *base;
+        uint32_t count;
+        uint32_t capacity;
+} section;
+
+struct db_s;
+
+/*
+ * Everything we know about one image.  The sections either live in the
+ * image's arena or point straight into a database mapping, in which case
+ * db is set.  Anything else that's only good for as long as the image is
+ * should come from the arena too; free_image() releases it all at once.
+ */
+typedef struct image_s {
+        const char *filename;
+        const uint8_t *buf;
+        size_t size;
+        section sections[NR_SECTIONS];
+        struct db_s *db;
+        arena arena;
+} image;
+
+#define image_section(img, id, type) ((type *)(img)->sections[id].base)
+#define image_count(img, id) ((img)->sections[id].count)
+#define image_str(img, off) (image_section(img, SEC_STRINGS, char) + (off))
+
+extern int analyze_image(image *img);
+extern void free_image(image *img);
+extern void *image_insert(image *img, section_id id, uint32_t index);
+extern int64_t image_string(image *img, const char * const s);
+extern int64_t find_insn(const image * const img, uint32_t addr);
+extern int64_t find_insn_containing(const image * const img,
+                                    uint32_t addr);
+extern symbol *find_symbol(const image * const img, uint32_t addr);
+extern int valid_label(const char * const name);
+extern int set_label(image *img, uint32_t addr, const char * const name,
+                     uint32_t flags);
+extern int add_comment(image *img, uint32_t addr, const char * const text);
+extern symbol *nearest_symbol(const image * const img, uint32_t addr);
+extern symbol *find_symbol_name(const image * const img,
+                                const char * const name);
+extern uint32_t find_xrefs(const image * const img, uint32_t addr,
+                           uint32_t *first);
+
+typedef struct block_s {
+        uint32_t start;
+        uint32_t end;
+        uint32_t *succ;         // more than two after a jump table
+        uint32_t nsucc;
+        uint8_t open;           // ends somewhere we can't follow
+} block;
+
+extern int function_blocks(const image * const img, uint32_t entry,
+                           arena *scratch, block **blocksp,
+                           uint32_t *nblocksp);
+extern int64_t branch_target(const insn * const insn);
+extern void rec_to_insn(const insn_rec * const rec, insn *insn);
+typedef void (*listing_fn)(FILE *out, void *data, uint32_t i,
+                           const insn * const insn, char *note,
+                           size_t size);
+extern void print_listing_notes(FILE *out, image *img, listing_fn fn,
+                                void *data);
+extern void print_listing(FILE *out, image *img);
+
+/* functions.c */
+typedef struct func_s {
+        uint32_t start;
+        uint32_t end;
+        uint32_t insns;
+        uint32_t bytes;
+        uint32_t calls;         // call sites in it
+        uint32_t fan_in;        // call sites that call it
+        uint32_t fan_out;       // distinct functions it calls
+        uint32_t loops;         // backward branches within it
+} func;
+
+extern int find_functions(const image * const img, arena *scratch,
+                          func **funcsp, uint32_t *nfuncsp);
+extern const char *function_name(const image * const img,
+                                 const func * const f, char *buf,
+                                 size_t size);
+extern int print_functions(FILE *out, const image * const img,
+                           const char * const fmt);
+
+/* wcet.c */
+typedef struct loop_bound_s {
+        uint32_t addr;          // the loop's header
+        uint32_t count;         // most times around it
+} loop_bound;
+
+#define WCET_UNKNOWN    (INT64_MAX - 1)
+#define WCET_UNBOUNDED  INT64_MAX
+
+extern int print_wcet(FILE *out, const image * const img,
+                      const uint32_t * const entries, uint32_t nentries,
+                      const loop_bound * const bounds, uint32_t nbounds);
+
+/* constprop.c */
+extern int mode_index(uint8_t mode);
+extern int clobbers_index(const insn * const insn, int n);
+extern int resolve_indexed(image *img);
+
+/* jumptab.c */
+#define JUMP_TABLE_MAX  256
+typedef struct jump_table_s {
+        uint32_t load;          // the instruction that reads the table
+        uint32_t base;          // its first entry
+        uint32_t count;
+        uint32_t bank;          // what the 16-bit entries are relative to
+        int32_t offset;         // the jump's own displacement
+} jump_table;
+
+extern int find_jump_table(const image * const img, uint32_t i,
+                           jump_table *t);
+extern uint32_t jump_table_target(const image * const img,
+                                  const jump_table * const t, uint32_t k);
+
+/* ir.c */
+
+/*
+ * The registers the IR keeps in SSA form.  A and B are the two halves of
+ * D, and the K fields are the top four bits of X, Y, Z and SP, which are
+ * all 20 bits wide.
+ */
+enum {
+        IR_D,
+        IR_E,
+        IR_X,
+        IR_Y,
+        IR_Z,
+        IR_SP,
+        IR_EK,
+        IR_CCR,
+        NR_IR_REGS
+};
+
+typedef enum {
+        IR_ENTRY,       // the state on the way into an entry block
+        IR_UNKNOWN,     // a register after an entry, call or opaque op
+        IR_PHI,
+        IR_CONST,
+        IR_ADD,
+        IR_SUB,
+        IR_ADC,         // a + b + C from CCR c
+        IR_SBC,
+        IR_AND,
+        IR_OR,
+        IR_XOR,
+        IR_NOT,
+        IR_NEG,
+        IR_SHL,         // all shifts are by one bit
+        IR_SHR,
+        IR_ASR,
+        IR_ROL,         // through C from CCR b
+        IR_ROR,
+        IR_MUL,
+        IR_SMUL,
+        IR_DIV,
+        IR_SDIV,
+        IR_REM,
+        IR_SREM,
+        IR_ZEXT,
+        IR_SEXT,
+        IR_EXTRACT,     // width bits of a from bit aux up
+        IR_INSERT,      // a with b put in at bit aux
+        IR_CONCAT,      // a above b
+        IR_LOAD,        // width bits from address a
+        IR_STORE,       // b to address a
+        IR_FLAGS,       // CCR a updated the way aux says; see ir.c
+        IR_BRANCH,      // to imm if condition aux holds for a
+        IR_JUMP,        // to a
+        IR_CALL,        // imm, or a if there's an arg
+        IR_TRAP,
+        IR_RETURN,      // aux is set for rti
+        IR_OPAQUE,      // something the IR doesn't describe
+        NR_IR_CODES
+} ir_code;
+
+typedef enum {
+        FK_MOVE,        // N, Z from a result, V clear
+        FK_TEST,        // ... and C clear too
+        FK_COM,         // ... and C set
+        FK_ADD,         // H, N, Z, V, C of a + b
+        FK_ADC,
+        FK_SUB,
+        FK_SBC,
+        FK_NEG,         // of 0 - a
+        FK_INC,         // N, Z, V of a + 1, C left alone
+        FK_DEC,
+        FK_ASL,         // N, Z, V, C of shifting a
+        FK_ASR,
+        FK_LSR,
+        FK_ROL,
+        FK_ROR,
+        FK_ZERO,        // just Z, from a result
+        FK_MUL,         // from a product
+        FK_DIV,         // from a quotient
+        NR_FLAG_KINDS
+} flag_kind;
+
+typedef enum {
+        IRC_ALWAYS,
+        IRC_HI,
+        IRC_LS,
+        IRC_CC,
+        IRC_CS,
+        IRC_NE,
+        IRC_EQ,
+        IRC_VC,
+        IRC_VS,
+        IRC_PL,
+        IRC_MI,
+        IRC_GE,
+        IRC_LT,
+        IRC_GT,
+        IRC_LE,
+        IRC_EV,
+        IRC_MV,
+        IRC_ZERO,       // a itself is zero, rather than a CCR
+        NR_IR_CONDS
+} ir_cond;
+
+/*
+ * One SSA value, or an operation that doesn't make one.  Values are
+ * named by their index in ir.ops.  A phi's arguments are ir.phi_args
+ * [args[0]] on, one for each of its block's predecessors, in order.
+ */
+typedef struct ir_op_s {
+        uint8_t code;
+        uint8_t width;          // bits in the result, or stored
+        uint8_t aux;
+        uint8_t nargs;
+        uint32_t args[3];
+        int32_t imm;
+        uint32_t insn;          // index in SEC_INSNS it came from
+} ir_op;
+
+typedef struct ir_block_s {
+        uint32_t first;         // insns
+        uint32_t last;
+        uint32_t ops;
+        uint32_t nops;
+        uint32_t preds;         // index in ir.preds
+        uint32_t npreds;
+        int32_t succ[2];
+        uint8_t nsucc;
+        uint8_t entry;          // called, or nothing else gets here
+} ir_block;
+
+typedef struct ir_s {
+        ir_op *ops;
+        uint32_t nops;
+        ir_block *blocks;
+        uint32_t nblocks;
+        uint32_t *preds;
+        uint32_t *phi_args;
+} ir;
+
+extern int lift_image(const image * const img, arena *a, ir *ir);
+extern int print_ir(FILE *out, image *img);
+
+/* trace.c */
+extern int print_trace(FILE *out, const image * const img, FILE *in);
+
+/* profile.c */
+extern int print_profile(FILE *out, image *img, FILE *in,
+                         const char * const path, uint32_t top);
+
+/* regs.c */
+extern int load_regmap(const char * const name);
+extern const char *reg_name(uint32_t addr);
+extern const char *reg_name16(uint16_t addr);
+
+/* checksum.c */
+extern int load_checksums(const char * const path);
+extern int have_checksums(void);
+extern int check_checksums(const char * const filename,
+                           const uint8_t * const buf, const size_t size);
+
+/* sync.c */
+extern int sync_keep;
+extern int print_range(FILE *out, const char * const filename,
+                       uint32_t start, uint32_t end);
+extern int write_listing(const char * const filename,
+                         const char * const path);
+
+/* ngrams.c */
+#define MAX_NGRAM       4
+extern int set_ngrams(int n);
+extern int have_ngrams(void);
+extern int count_ngrams(FILE *out, const char * const filename,
+                        const uint8_t * const buf, const size_t size);
+extern int print_ngrams(FILE *out, uint32_t top);
+
+/* banks.c */
+extern int print_banked(FILE *out, const char * const filename,
+                        const char * const path);
+
+/* search.c */
+extern int add_pattern(const char * const text);
+extern int load_patterns(const char * const path);
+extern int compile_patterns(void);
+extern int have_patterns(void);
+extern int search_image(FILE *out, const image * const img);
+
+/* sigs.c */
+extern int load_signatures(const char * const path);
+extern int have_signatures(void);
+extern int match_signatures(image *img);
+extern int write_signatures(FILE *out, const image * const img);
+
+/* db.c */
+extern int db_open(image *img, const char * const path);
+extern int db_grow(image *img, section_id id, uint32_t needed);
+extern int db_sync(image *img);
+extern void db_close(image *img);
+
+/* server.c */
+extern int serve(const char * const path, int nargs, char *args[]);
+extern int query(const char * const path, int nqueries, char *queries[]);
+
+/* watch.c */
+extern int watch_dir(const char * const dir);
+
+/* corpus.c */
+extern int gen_corpus(FILE *out);
+extern int self_test(void);
+
+#endif /* !HC16DIS_H_ */
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,1844 @@
+/*
+ * ir.c - lift instructions into SSA form
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * Each instruction becomes a handful of ops on SSA values: what it reads
+ * from registers and memory, what it computes, and what it writes back,
+ * including every change to CCR as an explicit IR_FLAGS op.  Byte
+ * accumulators are pieces of D, so "adda" is an extract, an add, an
+ * insert and a flags op, and the K fields are pieces of X, Y, Z and SP.
+ * Memory isn't renamed; loads and stores stay in order within a block.
+ *
+ * Blocks are cut the same way constprop.c cuts them, and the same ones
+ * are entries: anything that's called, and anything nothing else gets
+ * to.  An entry starts with IR_ENTRY, and every register in it starts
+ * out as an IR_UNKNOWN of that.  So does every register after a call
+ * (except SP, since callees put it back) or after an instruction we
+ * don't describe.  Those are only made when something reads them.
+ *
+ * Any other block gets a phi for every register, unless it has just the
+ * one predecessor and we've already been through that; afterwards phis
+ * that only ever see one value are replaced by it, and phis nothing
+ * reads are dropped, which leaves the IR pruned and very nearly minimal.
+ * The whole thing is linear in the size of the image, less the passes
+ * over the phis.
+ *
+ * IR_FLAGS ops take the old CCR and, for FK_MOVE, FK_TEST, FK_COM,
+ * FK_ZERO, FK_MUL and FK_DIV, the result; for the rest, the operands
+ * the result was made from.  The widths of those say how wide the
+ * arithmetic was.
+ */
+#define MARK            0x80000000u
+#define MAX_OPS         (1u << 28)
+#define NO_VALUE        (MARK - 1)
+#define CACHE_SIZE      64
+#define NOFK            NR_FLAG_KINDS
+
+/* an IR_UNKNOWN of anchor we haven't made yet */
+#define mark(anchor, reg)       (MARK | (anchor) << 3 | (reg))
+#define marked(v)               ((v) & MARK)
+#define mark_anchor(v)          (((v) & ~MARK) >> 3)
+#define mark_reg(v)             ((v) & 7)
+#define bit(r)                  (1u << (r))
+
+#define ALL_REGS        ((1u << NR_IR_REGS) - 1)
+#define CALL_CLOBBERS   (ALL_REGS & ~bit(IR_SP))
+
+/*
+ * What an instruction's operands name: registers, and the pieces of them
+ * that are registers in their own right.
+ */
+enum {
+        RA, RB, RD, RE,
+        RX, RY, RZ, RS,                 // the low 16 bits
+        RX20, RY20, RZ20, RS20,
+        RXK, RYK, RZK, RSK,
+        REK,
+        RCCR, RCCRH,
+        NR_PARTS,
+        RNONE = NR_PARTS
+};
+
+static const struct {
+        uint8_t reg;
+        uint8_t lsb;
+        uint8_t width;
+} parts[NR_PARTS] = {
+        [RA] = { IR_D, 8, 8 },          [RB] = { IR_D, 0, 8 },
+        [RD] = { IR_D, 0, 16 },         [RE] = { IR_E, 0, 16 },
+        [RX] = { IR_X, 0, 16 },         [RY] = { IR_Y, 0, 16 },
+        [RZ] = { IR_Z, 0, 16 },         [RS] = { IR_SP, 0, 16 },
+        [RX20] = { IR_X, 0, 20 },       [RY20] = { IR_Y, 0, 20 },
+        [RZ20] = { IR_Z, 0, 20 },       [RS20] = { IR_SP, 0, 20 },
+        [RXK] = { IR_X, 16, 4 },        [RYK] = { IR_Y, 16, 4 },
+        [RZK] = { IR_Z, 16, 4 },        [RSK] = { IR_SP, 16, 4 },
+        [REK] = { IR_EK, 0, 4 },
+        [RCCR] = { IR_CCR, 0, 16 },     [RCCRH] = { IR_CCR, 8, 8 },
+};
+
+static const uint8_t reg_widths[NR_IR_REGS] = {
+        [IR_D] = 16, [IR_E] = 16, [IR_X] = 20, [IR_Y] = 20, [IR_Z] = 20,
+        [IR_SP] = 20, [IR_EK] = 4, [IR_CCR] = 16,
+};
+
+static const char * const reg_names[NR_IR_REGS] = {
+        [IR_D] = "d", [IR_E] = "e", [IR_X] = "x", [IR_Y] = "y",
+        [IR_Z] = "z", [IR_SP] = "sp", [IR_EK] = "ek", [IR_CCR] = "ccr",
+};
+
+/*
+ * How each mnemonic works.  dst is what it writes (or reads, for stores
+ * and compares), src is the other register if there is one, and aux is
+ * the branch condition, the registers an opaque op writes, or for
+ * transfers and register adds, whether src is sign extended.
+ */
+enum {
+        S_OPAQUE,
+        S_LOAD,         // dst = operand
+        S_STORE,        // operand = dst
+        S_ALU,          // dst = dst code operand
+        S_CMP,          // flags of dst code operand
+        S_UNARY,        // dst (or a memory operand) = code dst
+        S_REG2,         // dst = dst code src
+        S_ADDI,         // dst += immediate
+        S_XFER,         // dst = src + adjust
+        S_TDP,
+        S_XCHG,
+        S_PUSH,
+        S_PULL,
+        S_PSHM,
+        S_PULM,
+        S_MOVE,
+        S_BIT,          // operand = operand code mask
+        S_BRBIT,
+        S_BRANCH,
+        S_JUMP,
+        S_CALL,
+        S_TRAP,
+        S_RETURN,
+        S_CCROP,
+        S_MUL,
+        S_DIV,
+        S_NOP,
+};
+
+typedef struct sem_s {
+        const char *mnemonic;
+        uint8_t kind;
+        uint8_t dst;
+        uint8_t src;
+        uint8_t code;
+        uint8_t fk;
+        uint8_t width;          // of a memory operand that isn't dst
+        uint8_t aux;
+        int8_t adjust;
+} sem;
+
+static const sem sems[] = {
+        { "ldaa", S_LOAD, RA, RNONE, 0, FK_MOVE },
+        { "ldab", S_LOAD, RB, RNONE, 0, FK_MOVE },
+        { "ldd", S_LOAD, RD, RNONE, 0, FK_MOVE },
+        { "lde", S_LOAD, RE, RNONE, 0, FK_MOVE },
+        { "ldx", S_LOAD, RX, RNONE, 0, FK_MOVE },
+        { "ldy", S_LOAD, RY, RNONE, 0, FK_MOVE },
+        { "ldz", S_LOAD, RZ, RNONE, 0, FK_MOVE },
+        { "lds", S_LOAD, RS, RNONE, 0, FK_MOVE },
+
+        { "staa", S_STORE, RA, RNONE, 0, FK_MOVE },
+        { "stab", S_STORE, RB, RNONE, 0, FK_MOVE },
+        { "std", S_STORE, RD, RNONE, 0, FK_MOVE },
+        { "ste", S_STORE, RE, RNONE, 0, FK_MOVE },
+        { "stx", S_STORE, RX, RNONE, 0, FK_MOVE },
+        { "sty", S_STORE, RY, RNONE, 0, FK_MOVE },
+        { "stz", S_STORE, RZ, RNONE, 0, FK_MOVE },
+        { "sts", S_STORE, RS, RNONE, 0, FK_MOVE },
+
+        { "adda", S_ALU, RA, RNONE, IR_ADD, FK_ADD },
+        { "addb", S_ALU, RB, RNONE, IR_ADD, FK_ADD },
+        { "addd", S_ALU, RD, RNONE, IR_ADD, FK_ADD },
+        { "adde", S_ALU, RE, RNONE, IR_ADD, FK_ADD },
+        { "adca", S_ALU, RA, RNONE, IR_ADC, FK_ADC },
+        { "adcb", S_ALU, RB, RNONE, IR_ADC, FK_ADC },
+        { "adcd", S_ALU, RD, RNONE, IR_ADC, FK_ADC },
+        { "adce", S_ALU, RE, RNONE, IR_ADC, FK_ADC },
+        { "suba", S_ALU, RA, RNONE, IR_SUB, FK_SUB },
+        { "subb", S_ALU, RB, RNONE, IR_SUB, FK_SUB },
+        { "subd", S_ALU, RD, RNONE, IR_SUB, FK_SUB },
+        { "sube", S_ALU, RE, RNONE, IR_SUB, FK_SUB },
+        { "sbca", S_ALU, RA, RNONE, IR_SBC, FK_SBC },
+        { "sbcb", S_ALU, RB, RNONE, IR_SBC, FK_SBC },
+        { "sbcd", S_ALU, RD, RNONE, IR_SBC, FK_SBC },
+        { "sbce", S_ALU, RE, RNONE, IR_SBC, FK_SBC },
+        { "anda", S_ALU, RA, RNONE, IR_AND, FK_MOVE },
+        { "andb", S_ALU, RB, RNONE, IR_AND, FK_MOVE },
+        { "andd", S_ALU, RD, RNONE, IR_AND, FK_MOVE },
+        { "ande", S_ALU, RE, RNONE, IR_AND, FK_MOVE },
+        { "oraa", S_ALU, RA, RNONE, IR_OR, FK_MOVE },
+        { "orab", S_ALU, RB, RNONE, IR_OR, FK_MOVE },
+        { "ord", S_ALU, RD, RNONE, IR_OR, FK_MOVE },
+        { "ore", S_ALU, RE, RNONE, IR_OR, FK_MOVE },
+        { "eora", S_ALU, RA, RNONE, IR_XOR, FK_MOVE },
+        { "eorb", S_ALU, RB, RNONE, IR_XOR, FK_MOVE },
+        { "eord", S_ALU, RD, RNONE, IR_XOR, FK_MOVE },
+        { "eore", S_ALU, RE, RNONE, IR_XOR, FK_MOVE },
+
+        { "cmpa", S_CMP, RA, RNONE, IR_SUB, FK_SUB },
+        { "cmpb", S_CMP, RB, RNONE, IR_SUB, FK_SUB },
+        { "cmpd", S_CMP, RD, RNONE, IR_SUB, FK_SUB },
+        { "cpd", S_CMP, RD, RNONE, IR_SUB, FK_SUB },
+        { "cpe", S_CMP, RE, RNONE, IR_SUB, FK_SUB },
+        { "cpx", S_CMP, RX, RNONE, IR_SUB, FK_SUB },
+        { "cpy", S_CMP, RY, RNONE, IR_SUB, FK_SUB },
+        { "cpz", S_CMP, RZ, RNONE, IR_SUB, FK_SUB },
+        { "cps", S_CMP, RS, RNONE, IR_SUB, FK_SUB },
+        { "bita", S_CMP, RA, RNONE, IR_AND, FK_MOVE },
+        { "bitb", S_CMP, RB, RNONE, IR_AND, FK_MOVE },
+
+        { "clr", S_UNARY, RNONE, RNONE, IR_CONST, FK_TEST, 8 },
+        { "clrw", S_UNARY, RNONE, RNONE, IR_CONST, FK_TEST, 16 },
+        { "clra", S_UNARY, RA, RNONE, IR_CONST, FK_TEST },
+        { "clrb", S_UNARY, RB, RNONE, IR_CONST, FK_TEST },
+        { "clrd", S_UNARY, RD, RNONE, IR_CONST, FK_TEST },
+        { "clre", S_UNARY, RE, RNONE, IR_CONST, FK_TEST },
+        { "com", S_UNARY, RNONE, RNONE, IR_NOT, FK_COM, 8 },
+        { "comw", S_UNARY, RNONE, RNONE, IR_NOT, FK_COM, 16 },
+        { "coma", S_UNARY, RA, RNONE, IR_NOT, FK_COM },
+        { "comb", S_UNARY, RB, RNONE, IR_NOT, FK_COM },
+        { "comd", S_UNARY, RD, RNONE, IR_NOT, FK_COM },
+        { "come", S_UNARY, RE, RNONE, IR_NOT, FK_COM },
+        { "neg", S_UNARY, RNONE, RNONE, IR_NEG, FK_NEG, 8 },
+        { "negw", S_UNARY, RNONE, RNONE, IR_NEG, FK_NEG, 16 },
+        { "nega", S_UNARY, RA, RNONE, IR_NEG, FK_NEG },
+        { "negb", S_UNARY, RB, RNONE, IR_NEG, FK_NEG },
+        { "negd", S_UNARY, RD, RNONE, IR_NEG, FK_NEG },
+        { "nege", S_UNARY, RE, RNONE, IR_NEG, FK_NEG },
+        { "inc", S_UNARY, RNONE, RNONE, IR_ADD, FK_INC, 8 },
+        { "incw", S_UNARY, RNONE, RNONE, IR_ADD, FK_INC, 16 },
+        { "inca", S_UNARY, RA, RNONE, IR_ADD, FK_INC },
+        { "incb", S_UNARY, RB, RNONE, IR_ADD, FK_INC },
+        { "dec", S_UNARY, RNONE, RNONE, IR_SUB, FK_DEC, 8 },
+        { "decw", S_UNARY, RNONE, RNONE, IR_SUB, FK_DEC, 16 },
+        { "deca", S_UNARY, RA, RNONE, IR_SUB, FK_DEC },
+        { "decb", S_UNARY, RB, RNONE, IR_SUB, FK_DEC },
+        { "tst", S_UNARY, RNONE, RNONE, 0, FK_TEST, 8 },
+        { "tstw", S_UNARY, RNONE, RNONE, 0, FK_TEST, 16 },
+        { "tsta", S_UNARY, RA, RNONE, 0, FK_TEST },
+        { "tstb", S_UNARY, RB, RNONE, 0, FK_TEST },
+        { "tstd", S_UNARY, RD, RNONE, 0, FK_TEST },
+        { "tste", S_UNARY, RE, RNONE, 0, FK_TEST },
+        { "asl", S_UNARY, RNONE, RNONE, IR_SHL, FK_ASL, 8 },
+        { "aslw", S_UNARY, RNONE, RNONE, IR_SHL, FK_ASL, 16 },
+        { "asla", S_UNARY, RA, RNONE, IR_SHL, FK_ASL },
+        { "aslb", S_UNARY, RB, RNONE, IR_SHL, FK_ASL },
+        { "asld", S_UNARY, RD, RNONE, IR_SHL, FK_ASL },
+        { "asle", S_UNARY, RE, RNONE, IR_SHL, FK_ASL },
+        { "asr", S_UNARY, RNONE, RNONE, IR_ASR, FK_ASR, 8 },
+        { "asrw", S_UNARY, RNONE, RNONE, IR_ASR, FK_ASR, 16 },
+        { "asra", S_UNARY, RA, RNONE, IR_ASR, FK_ASR },
+        { "asrb", S_UNARY, RB, RNONE, IR_ASR, FK_ASR },
+        { "asrd", S_UNARY, RD, RNONE, IR_ASR, FK_ASR },
+        { "asre", S_UNARY, RE, RNONE, IR_ASR, FK_ASR },
+        { "lsr", S_UNARY, RNONE, RNONE, IR_SHR, FK_LSR, 8 },
+        { "lsrw", S_UNARY, RNONE, RNONE, IR_SHR, FK_LSR, 16 },
+        { "lsra", S_UNARY, RA, RNONE, IR_SHR, FK_LSR },
+        { "lsrb", S_UNARY, RB, RNONE, IR_SHR, FK_LSR },
+        { "lsrd", S_UNARY, RD, RNONE, IR_SHR, FK_LSR },
+        { "lsre", S_UNARY, RE, RNONE, IR_SHR, FK_LSR },
+        { "rol", S_UNARY, RNONE, RNONE, IR_ROL, FK_ROL, 8 },
+        { "rolw", S_UNARY, RNONE, RNONE, IR_ROL, FK_ROL, 16 },
+        { "rola", S_UNARY, RA, RNONE, IR_ROL, FK_ROL },
+        { "rolb", S_UNARY, RB, RNONE, IR_ROL, FK_ROL },
+        { "rold", S_UNARY, RD, RNONE, IR_ROL, FK_ROL },
+        { "role", S_UNARY, RE, RNONE, IR_ROL, FK_ROL },
+        { "ror", S_UNARY, RNONE, RNONE, IR_ROR, FK_ROR, 8 },
+        { "rorw", S_UNARY, RNONE, RNONE, IR_ROR, FK_ROR, 16 },
+        { "rora", S_UNARY, RA, RNONE, IR_ROR, FK_ROR },
+        { "rorb", S_UNARY, RB, RNONE, IR_ROR, FK_ROR },
+        { "rord", S_UNARY, RD, RNONE, IR_ROR, FK_ROR },
+        { "rore", S_UNARY, RE, RNONE, IR_ROR, FK_ROR },
+
+        /* ADE and SDE leave their result in E, like ABA does in A */
+        { "aba", S_REG2, RA, RB, IR_ADD, FK_ADD },
+        { "sba", S_REG2, RA, RB, IR_SUB, FK_SUB },
+        { "ade", S_REG2, RE, RD, IR_ADD, FK_ADD },
+        { "sde", S_REG2, RE, RD, IR_SUB, FK_SUB },
+        { "abx", S_REG2, RX20, RB, IR_ADD, NOFK },
+        { "aby", S_REG2, RY20, RB, IR_ADD, NOFK },
+        { "abz", S_REG2, RZ20, RB, IR_ADD, NOFK },
+        { "adx", S_REG2, RX20, RD, IR_ADD, NOFK, 0, 1 },
+        { "ady", S_REG2, RY20, RD, IR_ADD, NOFK, 0, 1 },
+        { "adz", S_REG2, RZ20, RD, IR_ADD, NOFK, 0, 1 },
+        { "aex", S_REG2, RX20, RE, IR_ADD, NOFK, 0, 1 },
+        { "aey", S_REG2, RY20, RE, IR_ADD, NOFK, 0, 1 },
+        { "aez", S_REG2, RZ20, RE, IR_ADD, NOFK, 0, 1 },
+
+        { "aix", S_ADDI, RX20, RNONE, IR_ADD, FK_ZERO },
+        { "aiy", S_ADDI, RY20, RNONE, IR_ADD, FK_ZERO },
+        { "aiz", S_ADDI, RZ20, RNONE, IR_ADD, FK_ZERO },
+        { "ais", S_ADDI, RS20, RNONE, IR_ADD, NOFK },
+
+        { "tba", S_XFER, RA, RB, 0, FK_MOVE },
+        { "tde", S_XFER, RE, RD, 0, FK_MOVE },
+        { "ted", S_XFER, RD, RE, 0, FK_MOVE },
+        { "sxt", S_XFER, RD, RB, 0, NOFK, 0, 1 },
+        { "tpa", S_XFER, RA, RCCRH, 0, NOFK },
+        { "tap", S_XFER, RCCRH, RA, 0, NOFK },
+        { "tpd", S_XFER, RD, RCCR, 0, NOFK },
+        { "tdp", S_TDP, RCCR, RD, 0, NOFK },
+        { "tbek", S_XFER, REK, RB, 0, NOFK },
+        { "tbsk", S_XFER, RSK, RB, 0, NOFK },
+        { "tbxk", S_XFER, RXK, RB, 0, NOFK },
+        { "tbyk", S_XFER, RYK, RB, 0, NOFK },
+        { "tbzk", S_XFER, RZK, RB, 0, NOFK },
+        { "tekb", S_XFER, RB, REK, 0, NOFK },
+        { "tskb", S_XFER, RB, RSK, 0, NOFK },
+        { "txkb", S_XFER, RB, RXK, 0, NOFK },
+        { "tykb", S_XFER, RB, RYK, 0, NOFK },
+        { "tzkb", S_XFER, RB, RZK, 0, NOFK },
+        { "txy", S_XFER, RY20, RX20, 0, NOFK },
+        { "tyx", S_XFER, RX20, RY20, 0, NOFK },
+        { "tyz", S_XFER, RZ20, RY20, 0, NOFK },
+        { "tzx", S_XFER, RX20, RZ20, 0, NOFK },
+        { "tzy", S_XFER, RY20, RZ20, 0, NOFK },
+        /* SP points at the next free word, so what's on top is 2 above */
+        { "tsx", S_XFER, RX20, RS20, 0, NOFK, 0, 0, 2 },
+        { "tsy", S_XFER, RY20, RS20, 0, NOFK, 0, 0, 2 },
+        { "txs", S_XFER, RS20, RX20, 0, NOFK, 0, 0, -2 },
+        { "tys", S_XFER, RS20, RY20, 0, NOFK, 0, 0, -2 },
+        { "tzs", S_XFER, RS20, RZ20, 0, NOFK, 0, 0, -2 },
+
+        { "xgde", S_XCHG, RD, RE },
+        { "xgdx", S_XCHG, RD, RX },
+        { "xgdy", S_XCHG, RD, RY },
+        { "xgdz", S_XCHG, RD, RZ },
+        { "xgex", S_XCHG, RE, RX },
+        { "xgey", S_XCHG, RE, RY },
+        { "xgez", S_XCHG, RE, RZ },
+
+        { "psha", S_PUSH, RA },
+        { "pshb", S_PUSH, RB },
+        { "pula", S_PULL, RA },
+        { "pulb", S_PULL, RB },
+        { "pshm", S_PSHM },
+        { "pulm", S_PULM },
+
+        { "movb", S_MOVE, RNONE, RNONE, 0, FK_MOVE, 8 },
+        { "movw", S_MOVE, RNONE, RNONE, 0, FK_MOVE, 16 },
+        { "bset", S_BIT, RNONE, RNONE, IR_OR, FK_MOVE, 8 },
+        { "bsetw", S_BIT, RNONE, RNONE, IR_OR, FK_MOVE, 16 },
+        { "bclr", S_BIT, RNONE, RNONE, IR_AND, FK_MOVE, 8 },
+        { "bclrw", S_BIT, RNONE, RNONE, IR_AND, FK_MOVE, 16 },
+        { "brset", S_BRBIT, RNONE, RNONE, 0, NOFK, 8, 1 },
+        { "brclr", S_BRBIT, RNONE, RNONE, 0, NOFK, 8, 0 },
+
+        { "bra", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_ALWAYS },
+        { "bhi", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_HI },
+        { "bls", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_LS },
+        { "bcc", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_CC },
+        { "bcs", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_CS },
+        { "bne", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_NE },
+        { "beq", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_EQ },
+        { "bvc", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_VC },
+        { "bvs", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_VS },
+        { "bpl", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_PL },
+        { "bmi", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_MI },
+        { "bge", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_GE },
+        { "blt", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_LT },
+        { "bgt", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_GT },
+        { "ble", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_LE },
+        { "lbra", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_ALWAYS },
+        { "lbhi", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_HI },
+        { "lbls", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_LS },
+        { "lbcc", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_CC },
+        { "lbcs", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_CS },
+        { "lbne", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_NE },
+        { "lbeq", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_EQ },
+        { "lbvc", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_VC },
+        { "lbvs", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_VS },
+        { "lbpl", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_PL },
+        { "lbmi", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_MI },
+        { "lbge", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_GE },
+        { "lblt", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_LT },
+        { "lbgt", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_GT },
+        { "lble", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_LE },
+        { "lbev", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_EV },
+        { "lbmv", S_BRANCH, RNONE, RNONE, 0, NOFK, 0, IRC_MV },
+        { "brn", S_NOP },
+        { "lbrn", S_NOP },
+        { "jmp", S_JUMP },
+        { "bsr", S_CALL },
+        { "lbsr", S_CALL },
+        { "jsr", S_CALL },
+        { "swi", S_TRAP },
+        { "rts", S_RETURN, RNONE, RNONE, 0, NOFK, 0, 0 },
+        { "rti", S_RETURN, RNONE, RNONE, 0, NOFK, 0, 1 },
+
+        { "andp", S_CCROP, RCCR, RNONE, IR_AND },
+        { "orp", S_CCROP, RCCR, RNONE, IR_OR },
+
+        { "mul", S_MUL, RD, RNONE, IR_MUL, FK_MUL, 16 },
+        { "emul", S_MUL, RD, RNONE, IR_MUL, FK_MUL, 32 },
+        { "emuls", S_MUL, RD, RNONE, IR_SMUL, FK_MUL, 32 },
+        { "fmuls", S_MUL, RD, RNONE, IR_SMUL, FK_MUL, 32, 1 },
+        { "idiv", S_DIV, RD, RNONE, IR_DIV, FK_DIV, 16 },
+        { "fdiv", S_DIV, RD, RNONE, IR_DIV, FK_DIV, 16, 1 },
+        { "ediv", S_DIV, RD, RNONE, IR_DIV, FK_DIV, 32 },
+        { "edivs", S_DIV, RD, RNONE, IR_SDIV, FK_DIV, 32 },
+
+        { "nop", S_NOP },
+        { "wai", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, 0 },
+        { "bgnd", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, 0 },
+        { "ldstop", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, 0 },
+        { "daa", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_D) | bit(IR_CCR) },
+        { "abb", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_D) | bit(IR_CCR) },
+        { "sbb", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_D) | bit(IR_CCR) },
+        { "tbb", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_D) | bit(IR_CCR) },
+        { "nxz", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, ALL_REGS },
+        { "lded", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_D) | bit(IR_E) },
+        { "sted", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, 0 },
+
+        /* the MAC unit's own registers aren't in the IR */
+        { "mac", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_X) | bit(IR_Y) | bit(IR_CCR) },
+        { "rmac", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_X) | bit(IR_Y) | bit(IR_CCR) },
+        { "tmer", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_E) | bit(IR_CCR) },
+        { "tmet", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_E) | bit(IR_CCR) },
+        { "tmxed", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_D) | bit(IR_E) | bit(IR_CCR) },
+        { "pshmac", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_SP) },
+        { "pulmac", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0,
+          bit(IR_SP) | bit(IR_CCR) },
+        { "ace", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "aced", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "aslm", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "asrm", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "ldhi", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "tedm", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "tem", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, bit(IR_CCR) },
+        { "tdmsk", S_OPAQUE, RNONE, RNONE, 0, NOFK, 0, 0 },
+        { NULL, }
+};
+
+/* the sems[] entry for each mnemonic, by its offset in mnemonics[] */
+static int16_t sem_of[MNEMONICS_SIZE];
+static pthread_once_t sems_once = PTHREAD_ONCE_INIT;
+
+static void
+index_sems(void)
+{
+        size_t off = first_defined_mnemonic;
+
+        for (size_t i = 0; i < MNEMONICS_SIZE; i++)
+                sem_of[i] = -1;
+        while (off < MNEMONICS_SIZE && mnemonics[off]) {
+                for (int i = 0; sems[i].mnemonic; i++) {
+                        if (!strcmp(&mnemonics[off], sems[i].mnemonic)) {
+                                sem_of[off] = i;
+                                break;
+                        }
+                }
+                off += strlen(&mnemonics[off]) + 1;
+        }
+}
+
+typedef struct cached_s {
+        uint32_t block;         // + 1, so a zeroed cache is empty
+        uint8_t code;
+        uint8_t width;
+        uint8_t aux;
+        uint32_t arg;
+        int32_t imm;
+        uint32_t value;
+} cached;
+
+typedef struct lifter_s {
+        arena *scratch;
+        ir_op *ops;
+        uint32_t nops;
+        uint32_t size;
+        int failed;
+        uint32_t insn;
+        uint32_t block;
+        uint32_t cur[NR_IR_REGS];
+        cached cache[CACHE_SIZE];
+} lifter;
+
+/*
+ * Allocation failures are noted here and checked after each block, so
+ * the ops don't all have to.
+ */
+static uint32_t
+emit(lifter *l, uint8_t code, uint8_t width, uint8_t aux, uint8_t nargs,
+     uint32_t a, uint32_t b, uint32_t c, int32_t imm)
+{
+        ir_op *op;
+
+        if (l->nops == l->size) {
+                uint32_t size = l->size * 2;
+                ir_op *ops;
+
+                if (size > MAX_OPS ||
+                    !(ops = arena_realloc(l->scratch, l->ops,
+                                          l->size * sizeof(*ops),
+                                          size * sizeof(*ops)))) {
+                        l->failed = 1;
+                        return 0;
+                }
+                l->ops = ops;
+                l->size = size;
+        }
+        op = &l->ops[l->nops];
+        op->code = code;
+        op->width = width;
+        op->aux = aux;
+        op->nargs = nargs;
+        op->args[0] = a;
+        op->args[1] = b;
+        op->args[2] = c;
+        op->imm = imm;
+        op->insn = l->insn;
+        return l->nops++;
+}
+
+static uint32_t
+emit1(lifter *l, uint8_t code, uint8_t width, uint32_t a)
+{
+        return emit(l, code, width, 0, 1, a, 0, 0, 0);
+}
+
+static uint32_t
+emit2(lifter *l, uint8_t code, uint8_t width, uint32_t a, uint32_t b)
+{
+        return emit(l, code, width, 0, 2, a, b, 0, 0);
+}
+
+static uint8_t
+width_of(const lifter * const l, uint32_t v)
+{
+        return l->ops[v].width;
+}
+
+static uint32_t
+mask_of(uint8_t width)
+{
+        return width >= 32 ? UINT32_MAX : (1u << width) - 1;
+}
+
+/*
+ * Constants and pieces of values are made once per block.
+ */
+static uint32_t
+cse(lifter *l, uint8_t code, uint8_t width, uint8_t aux, uint32_t arg,
+    int32_t imm)
+{
+        uint32_t h = (code * 31 + width * 7 + aux + arg * 131 +
+                      (uint32_t)imm * 257) & (CACHE_SIZE - 1);
+        cached *c = &l->cache[h];
+
+        if (c->block == l->block + 1 && c->code == code &&
+            c->width == width && c->aux == aux && c->arg == arg &&
+            c->imm == imm)
+                return c->value;
+        c->block = l->block + 1;
+        c->code = code;
+        c->width = width;
+        c->aux = aux;
+        c->arg = arg;
+        c->imm = imm;
+        c->value = emit(l, code, width, aux, code == IR_CONST ? 0 : 1,
+                        code == IR_CONST ? 0 : arg, 0, 0, imm);
+        return c->value;
+}
+
+static uint32_t
+konst(lifter *l, uint8_t width, uint32_t value)
+{
+        return cse(l, IR_CONST, width, 0, 0, value & mask_of(width));
+}
+
+static int
+is_const(const lifter * const l, uint32_t v)
+{
+        return l->ops[v].code == IR_CONST;
+}
+
+/*
+ * width bits of v from lsb up, looking through inserts and concats for
+ * where they came from.
+ */
+static uint32_t
+extract(lifter *l, uint32_t v, uint8_t lsb, uint8_t width)
+{
+        for (;;) {
+                const ir_op *op = &l->ops[v];
+                uint8_t pos, w;
+
+                if (lsb == 0 && width == op->width)
+                        return v;
+                if (op->code == IR_CONST)
+                        return konst(l, width, (uint32_t)op->imm >> lsb);
+                if (op->code == IR_INSERT) {
+                        pos = op->aux;
+                        w = width_of(l, op->args[1]);
+                        if (lsb >= pos && lsb + width <= pos + w) {
+                                v = op->args[1];
+                                lsb -= pos;
+                                continue;
+                        }
+                        if (lsb + width <= pos || lsb >= pos + w) {
+                                v = op->args[0];
+                                continue;
+                        }
+                } else if (op->code == IR_CONCAT) {
+                        w = width_of(l, op->args[1]);
+                        if (lsb + width <= w) {
+                                v = op->args[1];
+                                continue;
+                        }
+                        if (lsb >= w) {
+                                v = op->args[0];
+                                lsb -= w;
+                                continue;
+                        }
+                }
+                break;
+        }
+        return cse(l, IR_EXTRACT, width, lsb, v, 0);
+}
+
+static uint32_t
+insert(lifter *l, uint32_t v, uint32_t part, uint8_t lsb)
+{
+        uint8_t width = width_of(l, v);
+        uint8_t w = width_of(l, part);
+
+        if (lsb == 0 && w == width)
+                return part;
+        if (is_const(l, v) && is_const(l, part)) {
+                uint32_t m = mask_of(w) << lsb;
+
+                return konst(l, width, ((uint32_t)l->ops[v].imm & ~m) |
+                                       (uint32_t)l->ops[part].imm << lsb);
+        }
+        return emit(l, IR_INSERT, width, lsb, 2, v, part, 0, 0);
+}
+
+static uint32_t
+concat(lifter *l, uint32_t hi, uint32_t lo)
+{
+        uint8_t w = width_of(l, lo);
+
+        if (is_const(l, hi) && is_const(l, lo))
+                return konst(l, width_of(l, hi) + w,
+                             (uint32_t)l->ops[hi].imm << w |
+                             (uint32_t)l->ops[lo].imm);
+        return emit2(l, IR_CONCAT, width_of(l, hi) + w, hi, lo);
+}
+
+/*
+ * v made width bits wide: truncated, or zero or sign extended.
+ */
+static uint32_t
+fit(lifter *l, uint32_t v, uint8_t width, int sext)
+{
+        uint8_t w = width_of(l, v);
+        uint32_t value;
+
+        if (w >= width)
+                return extract(l, v, 0, width);
+        if (is_const(l, v)) {
+                value = l->ops[v].imm;
+                if (sext && (value >> (w - 1)) & 1)
+                        value |= ~mask_of(w);
+                return konst(l, width, value);
+        }
+        return cse(l, sext ? IR_SEXT : IR_ZEXT, width, 0, v, 0);
+}
+
+static uint32_t
+read_reg(lifter *l, int reg)
+{
+        uint32_t v = l->cur[reg];
+
+        if (marked(v)) {
+                v = emit(l, IR_UNKNOWN, reg_widths[reg], reg, 1,
+                         mark_anchor(v), 0, 0, 0);
+                l->cur[reg] = v;
+        }
+        return v;
+}
+
+static uint32_t
+get(lifter *l, int part)
+{
+        return extract(l, read_reg(l, parts[part].reg), parts[part].lsb,
+                       parts[part].width);
+}
+
+static void
+put(lifter *l, int part, uint32_t v)
+{
+        int reg = parts[part].reg;
+
+        if (parts[part].width == reg_widths[reg])
+                l->cur[reg] = v;
+        else
+                l->cur[reg] = insert(l, read_reg(l, reg), v,
+                                     parts[part].lsb);
+}
+
+static void
+clobber(lifter *l, uint32_t anchor, uint32_t regs)
+{
+        for (int reg = 0; reg < NR_IR_REGS; reg++)
+                if (regs & bit(reg))
+                        l->cur[reg] = mark(anchor, reg);
+}
+
+static int
+uses_result(uint8_t fk)
+{
+        return fk == FK_MOVE || fk == FK_TEST || fk == FK_COM ||
+               fk == FK_ZERO || fk == FK_MUL || fk == FK_DIV;
+}
+
+static void
+flags(lifter *l, uint8_t fk, uint32_t a, uint32_t b)
+{
+        uint32_t ccr;
+
+        if (fk == NOFK)
+                return;
+        ccr = read_reg(l, IR_CCR);
+        l->cur[IR_CCR] = emit(l, IR_FLAGS, 16, fk, b == NO_VALUE ? 2 : 3,
+                              ccr, a, b == NO_VALUE ? 0 : b, 0);
+}
+
+/*
+ * The operands an instruction's shape has, by what they're for.
+ */
+typedef struct fields_s {
+        uint8_t has_index;
+        uint8_t has_addr16;
+        uint8_t has_addr20;
+        uint8_t has_imm;
+        uint8_t has_mask;
+        uint8_t has_target;
+        int32_t index;
+        int32_t addr16;
+        int32_t addr20;
+        int32_t imm;
+        int32_t mask;
+        int32_t target;
+} fields;
+
+static void
+get_fields(const insn * const insn, fields *f)
+{
+        const shape *shape = &shapes[insn->packed.shape];
+        int imm_mode = insn->packed.mode == imm8 ||
+                       insn->packed.mode == imm16;
+
+        memset(f, 0, sizeof(*f));
+        for (int i = 0; i < shape->nargs; i++) {
+                const shape_arg *arg = &shape->args[i];
+                const opkind_info *kind = &opkinds[arg->kind];
+                int32_t v = arg_value(shape, arg, insn);
+
+                /* the A immediates are ff, which is otherwise an offset */
+                if (kind->index && !imm_mode) {
+                        f->has_index = 1;
+                        f->index = v;
+                } else if (kind->rel) {
+                        f->has_target = 1;
+                        f->target = v;
+                } else if (arg->kind == OPK_ADDR16) {
+                        f->has_addr16 = 1;
+                        f->addr16 = v;
+                } else if (arg->kind == OPK_ADDR20) {
+                        f->has_addr20 = 1;
+                        f->addr20 = v;
+                } else if (arg->kind == OPK_MASK8 ||
+                           arg->kind == OPK_MASK16) {
+                        f->has_mask = 1;
+                        f->mask = v;
+                } else if (kind->imm || kind->index) {
+                        f->has_imm = 1;
+                        f->imm = v;
+                }
+        }
+}
+
+static uint32_t
+indexed(lifter *l, int n, int32_t offset)
+{
+        uint32_t base = get(l, RX20 + n);
+
+        if (!offset)
+                return base;
+        return emit2(l, IR_ADD, 20, base, konst(l, 20, offset));
+}
+
+static uint32_t
+extended(lifter *l, uint16_t addr)
+{
+        return concat(l, read_reg(l, IR_EK), konst(l, 16, addr));
+}
+
+/*
+ * The 20-bit address of a memory operand, or NO_VALUE if there isn't one
+ * we can say.
+ */
+static uint32_t
+mem_addr(lifter *l, const insn * const insn, const fields * const f)
+{
+        uint8_t mode = insn->packed.mode;
+        int n = mode_index(mode);
+
+        if (n >= 0 && f->has_index)
+                return indexed(l, n, f->index);
+        switch (mode) {
+        case ex:
+        case ey:
+        case ez:
+                return emit2(l, IR_ADD, 20, get(l, RX20 + (mode - ex)),
+                             fit(l, get(l, RE), 20, 1));
+        case ext:
+                if (f->has_addr16)
+                        return extended(l, f->addr16);
+                break;
+        case ext20:
+                if (f->has_addr20)
+                        return konst(l, 20, f->addr20);
+                break;
+        }
+        return NO_VALUE;
+}
+
+/*
+ * The value of a source operand, width bits wide.
+ */
+static uint32_t
+source(lifter *l, const insn * const insn, const fields * const f,
+       uint8_t width)
+{
+        uint32_t addr;
+
+        if (insn->packed.mode == imm8 || insn->packed.mode == imm16)
+                return f->has_imm ? konst(l, width, f->imm) : NO_VALUE;
+        addr = mem_addr(l, insn, f);
+        if (addr == NO_VALUE)
+                return NO_VALUE;
+        return emit1(l, IR_LOAD, width, addr);
+}
+
+static void
+opaque(lifter *l, uint32_t regs)
+{
+        clobber(l, emit(l, IR_OPAQUE, 0, 0, 0, 0, 0, 0, 0), regs);
+}
+
+/*
+ * What an instruction we can't follow might have written.
+ */
+static uint32_t
+writes(const sem * const s)
+{
+        uint32_t regs = bit(IR_CCR);
+
+        if (s->dst != RNONE)
+                regs |= bit(parts[s->dst].reg);
+        if (s->kind == S_MUL || s->kind == S_DIV)
+                regs |= bit(IR_D) | bit(IR_E) | bit(IR_X);
+        return regs;
+}
+
+static uint32_t
+push_word(lifter *l, uint32_t sp, uint32_t v)
+{
+        emit2(l, IR_STORE, 16, sp, v);
+        return emit2(l, IR_ADD, 20, sp, konst(l, 20, -2));
+}
+
+static uint32_t
+k_value(lifter *l)
+{
+        uint32_t k = get(l, REK);
+
+        k = concat(l, k, get(l, RXK));
+        k = concat(l, k, get(l, RYK));
+        return concat(l, k, get(l, RZK));
+}
+
+/*
+ * PSHM stacks D, E, IX, IY, IZ, K and CCR, for mask bits 0 to 6, in that
+ * order; PULM takes them off again the other way round, so its mask
+ * bits run from CCR at bit 0 up to D at bit 6.
+ */
+static void
+pshm(lifter *l, uint8_t mask)
+{
+        static const uint8_t order[] = { RD, RE, RX, RY, RZ, RNONE, RCCR };
+        uint32_t sp = get(l, RS20);
+
+        for (int i = 0; i < 7; i++) {
+                if (!(mask & (1u << i)))
+                        continue;
+                sp = push_word(l, sp, order[i] == RNONE ?
+                                      k_value(l) : get(l, order[i]));
+        }
+        put(l, RS20, sp);
+}
+
+static void
+pulm(lifter *l, uint8_t mask)
+{
+        static const uint8_t order[] = { RCCR, RNONE, RZ, RY, RX, RE, RD };
+        uint32_t sp = get(l, RS20);
+
+        for (int i = 0; i < 7; i++) {
+                uint32_t v;
+
+                if (!(mask & (1u << i)))
+                        continue;
+                sp = emit2(l, IR_ADD, 20, sp, konst(l, 20, 2));
+                v = emit1(l, IR_LOAD, 16, sp);
+                if (order[i] == RCCR) {
+                        /* the PK field stays put */
+                        l->cur[IR_CCR] = insert(l, read_reg(l, IR_CCR),
+                                                extract(l, v, 4, 12), 4);
+                } else if (order[i] == RNONE) {
+                        put(l, REK, extract(l, v, 12, 4));
+                        put(l, RXK, extract(l, v, 8, 4));
+                        put(l, RYK, extract(l, v, 4, 4));
+                        put(l, RZK, extract(l, v, 0, 4));
+                } else {
+                        put(l, order[i], v);
+                }
+        }
+        put(l, RS20, sp);
+}
+
+/*
+ * Returns -1 if the instruction doesn't have the operands its mnemonic
+ * needs, so the caller can make it opaque instead.
+ */
+static int
+lift_sem(lifter *l, const insn * const insn, const sem * const s)
+{
+        uint8_t w = s->dst == RNONE ? s->width : parts[s->dst].width;
+        uint32_t a, b, r = NO_VALUE, addr = NO_VALUE;
+        fields f;
+
+        get_fields(insn, &f);
+        switch (s->kind) {
+        case S_LOAD:
+                if ((a = source(l, insn, &f, w)) == NO_VALUE)
+                        return -1;
+                put(l, s->dst, a);
+                flags(l, s->fk, a, NO_VALUE);
+                return 0;
+
+        case S_STORE:
+                if ((addr = mem_addr(l, insn, &f)) == NO_VALUE)
+                        return -1;
+                a = get(l, s->dst);
+                emit2(l, IR_STORE, w, addr, a);
+                flags(l, s->fk, a, NO_VALUE);
+                return 0;
+
+        case S_ALU:
+        case S_CMP:
+                if ((b = source(l, insn, &f, w)) == NO_VALUE)
+                        return -1;
+                a = get(l, s->dst);
+                if (s->code == IR_ADC || s->code == IR_SBC)
+                        r = emit(l, s->code, w, 0, 3, a, b,
+                                 read_reg(l, IR_CCR), 0);
+                else if (s->kind == S_ALU || s->code == IR_AND)
+                        r = emit2(l, s->code, w, a, b);
+                if (s->kind == S_ALU)
+                        put(l, s->dst, r);
+                if (uses_result(s->fk))
+                        flags(l, s->fk, r, NO_VALUE);
+                else
+                        flags(l, s->fk, a, b);
+                return 0;
+
+        case S_UNARY:
+                a = NO_VALUE;
+                if (s->dst == RNONE) {
+                        if ((addr = mem_addr(l, insn, &f)) == NO_VALUE)
+                                return -1;
+                        if (s->code != IR_CONST)
+                                a = emit1(l, IR_LOAD, w, addr);
+                } else if (s->code != IR_CONST) {
+                        a = get(l, s->dst);
+                }
+                switch (s->code) {
+                case IR_CONST:
+                        r = konst(l, w, 0);
+                        break;
+                case IR_ADD:
+                case IR_SUB:
+                        r = emit2(l, s->code, w, a, konst(l, w, 1));
+                        break;
+                case IR_ROL:
+                case IR_ROR:
+                        r = emit2(l, s->code, w, a, read_reg(l, IR_CCR));
+                        break;
+                case 0:
+                        break;
+                default:
+                        r = emit1(l, s->code, w, a);
+                        break;
+                }
+                if (r != NO_VALUE && s->dst == RNONE)
+                        emit2(l, IR_STORE, w, addr, r);
+                else if (r != NO_VALUE)
+                        put(l, s->dst, r);
+                flags(l, s->fk,
+                      uses_result(s->fk) && r != NO_VALUE ? r : a,
+                      NO_VALUE);
+                return 0;
+
+        case S_REG2:
+                a = get(l, s->dst);
+                b = fit(l, get(l, s->src), w, s->aux);
+                put(l, s->dst, emit2(l, s->code, w, a, b));
+                flags(l, s->fk, a, b);
+                return 0;
+
+        case S_ADDI:
+                if (!f.has_imm)
+                        return -1;
+                if (insn->packed.mode == imm16)
+                        f.imm = (int16_t)f.imm;
+                r = emit2(l, IR_ADD, w, get(l, s->dst),
+                          konst(l, w, f.imm));
+                put(l, s->dst, r);
+                flags(l, s->fk, r, NO_VALUE);
+                return 0;
+
+        case S_XFER:
+                r = fit(l, get(l, s->src), w, s->aux);
+                if (s->adjust)
+                        r = emit2(l, IR_ADD, w, r, konst(l, w, s->adjust));
+                put(l, s->dst, r);
+                flags(l, s->fk, r, NO_VALUE);
+                return 0;
+
+        case S_TDP:
+                /* D's bits 15-4 go to CCR; the PK field stays put */
+                l->cur[IR_CCR] = insert(l, read_reg(l, IR_CCR),
+                                        extract(l, get(l, RD), 4, 12), 4);
+                return 0;
+
+        case S_XCHG:
+                a = get(l, s->dst);
+                b = get(l, s->src);
+                put(l, s->dst, b);
+                put(l, s->src, a);
+                return 0;
+
+        case S_PUSH:
+                a = get(l, RS20);
+                emit2(l, IR_STORE, 8,
+                      emit2(l, IR_ADD, 20, a, konst(l, 20, 1)),
+                      get(l, s->dst));
+                put(l, RS20, emit2(l, IR_ADD, 20, a, konst(l, 20, -2)));
+                return 0;
+
+        case S_PULL:
+                a = emit2(l, IR_ADD, 20, get(l, RS20), konst(l, 20, 2));
+                put(l, RS20, a);
+                put(l, s->dst, emit1(l, IR_LOAD, 8,
+                                     emit2(l, IR_ADD, 20, a,
+                                           konst(l, 20, 1))));
+                return 0;
+
+        case S_PSHM:
+        case S_PULM:
+                if (!f.has_mask)
+                        return -1;
+                if (s->kind == S_PSHM)
+                        pshm(l, f.mask);
+                else
+                        pulm(l, f.mask);
+                return 0;
+
+        case S_MOVE:
+                if (!f.has_index || !f.has_addr16)
+                        return -1;
+                a = indexed(l, 0, f.index);
+                b = extended(l, f.addr16);
+                if (insn->packed.mode == ext2ixp) {
+                        uint32_t t = a;
+
+                        a = b;
+                        b = t;
+                }
+                r = emit1(l, IR_LOAD, w, a);
+                emit2(l, IR_STORE, w, b, r);
+                flags(l, s->fk, r, NO_VALUE);
+                return 0;
+
+        case S_BIT:
+                if (!f.has_mask ||
+                    (addr = mem_addr(l, insn, &f)) == NO_VALUE)
+                        return -1;
+                a = emit1(l, IR_LOAD, w, addr);
+                b = konst(l, w, s->code == IR_AND ? ~f.mask : f.mask);
+                r = emit2(l, s->code, w, a, b);
+                emit2(l, IR_STORE, w, addr, r);
+                flags(l, s->fk, r, NO_VALUE);
+                return 0;
+
+        case S_BRBIT:
+                /* brset goes if all of the mask's bits are set */
+                if (!f.has_mask || !f.has_target ||
+                    (addr = mem_addr(l, insn, &f)) == NO_VALUE)
+                        return -1;
+                a = emit1(l, IR_LOAD, w, addr);
+                if (s->aux)
+                        a = emit1(l, IR_NOT, w, a);
+                r = emit2(l, IR_AND, w, a, konst(l, w, f.mask));
+                emit(l, IR_BRANCH, 0, IRC_ZERO, 1, r, 0, 0, f.target);
+                return 0;
+
+        case S_BRANCH:
+                if (!f.has_target)
+                        return -1;
+                if (s->aux == IRC_ALWAYS)
+                        emit(l, IR_BRANCH, 0, IRC_ALWAYS, 0, 0, 0, 0,
+                             f.target);
+                else
+                        emit(l, IR_BRANCH, 0, s->aux, 1,
+                             read_reg(l, IR_CCR), 0, 0, f.target);
+                return 0;
+
+        case S_JUMP:
+                if (f.has_addr20) {
+                        emit(l, IR_BRANCH, 0, IRC_ALWAYS, 0, 0, 0, 0,
+                             f.addr20);
+                        return 0;
+                }
+                if ((addr = mem_addr(l, insn, &f)) == NO_VALUE)
+                        return -1;
+                emit(l, IR_JUMP, 0, 0, 1, addr, 0, 0, 0);
+                return 0;
+
+        case S_CALL:
+                if (f.has_target || f.has_addr20) {
+                        a = emit(l, IR_CALL, 0, 0, 0, 0, 0, 0,
+                                 f.has_target ? f.target : f.addr20);
+                } else {
+                        if ((addr = mem_addr(l, insn, &f)) == NO_VALUE)
+                                return -1;
+                        a = emit(l, IR_CALL, 0, 0, 1, addr, 0, 0, 0);
+                }
+                clobber(l, a, CALL_CLOBBERS);
+                return 0;
+
+        case S_TRAP:
+                clobber(l, emit(l, IR_TRAP, 0, 0, 0, 0, 0, 0, 0),
+                        CALL_CLOBBERS);
+                return 0;
+
+        case S_RETURN:
+                emit(l, IR_RETURN, 0, s->aux, 0, 0, 0, 0, 0);
+                return 0;
+
+        case S_CCROP:
+                if (!f.has_imm)
+                        return -1;
+                /* the PK field stays put */
+                b = konst(l, 16, s->code == IR_AND ? f.imm | 0xf :
+                                                     f.imm & ~0xf);
+                put(l, RCCR, emit2(l, s->code, 16, get(l, RCCR), b));
+                return 0;
+
+        case S_MUL:
+                if (s->width == 16) {
+                        r = emit2(l, s->code, 16, get(l, RA), get(l, RB));
+                        put(l, RD, r);
+                } else {
+                        r = emit2(l, s->code, 32, get(l, RE), get(l, RD));
+                        if (s->aux)
+                                r = emit1(l, IR_SHL, 32, r);
+                        put(l, RE, extract(l, r, 16, 16));
+                        put(l, RD, extract(l, r, 0, 16));
+                }
+                flags(l, s->fk, r, NO_VALUE);
+                return 0;
+
+        case S_DIV:
+                /*
+                 * idiv is D / IX, fdiv is D:0 / IX, and ediv and edivs
+                 * are E:D / IX; the quotient goes in IX and the
+                 * remainder in D.
+                 */
+                if (s->width == 32)
+                        a = concat(l, get(l, RE), get(l, RD));
+                else if (s->aux)
+                        a = concat(l, get(l, RD), konst(l, 16, 0));
+                else
+                        a = get(l, RD);
+                b = get(l, RX);
+                r = emit2(l, s->code, 16, a, b);
+                put(l, RD, emit2(l, s->code == IR_SDIV ? IR_SREM : IR_REM,
+                                 16, a, b));
+                put(l, RX, r);
+                flags(l, s->fk, r, NO_VALUE);
+                return 0;
+
+        case S_NOP:
+                return 0;
+
+        case S_OPAQUE:
+        default:
+                opaque(l, s->aux);
+                return 0;
+        }
+}
+
+static void
+lift_insn(lifter *l, const insn * const insn)
+{
+        int i = sem_of[insn->packed.mnemonic];
+
+        if (i < 0)
+                opaque(l, ALL_REGS);
+        else if (lift_sem(l, insn, &sems[i]) < 0)
+                opaque(l, writes(&sems[i]));
+}
+
+static int32_t
+block_at(const image * const img, const int32_t * const block_of,
+         int64_t addr)
+{
+        int64_t i;
+
+        if (addr < 0 || (i = find_insn(img, addr)) < 0)
+                return -1;
+        return block_of[i];
+}
+
+/*
+ * Cut the image into blocks and link them up; see resolve_indexed().
+ * Anything that stops control from falling through ends a block here,
+ * too.
+ */
+static int
+make_blocks(const image * const img, arena *a, arena *scratch, ir *ir)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        uint8_t *leader = arena_alloc(scratch, ninsns);
+        int32_t *block_of = arena_alloc(scratch,
+                                        ninsns * sizeof(*block_of));
+        uint32_t nblocks = 0, npreds = 0, *fill;
+        ir_block *blocks;
+
+        if (!leader || !block_of)
+                return -1;
+
+        leader[0] = 1;
+        for (uint32_t i = 0; i < ninsns; i++) {
+                insn insn;
+                int64_t to, k;
+                uint8_t flow;
+
+                if (recs[i].flags & INSN_BYTES) {
+                        leader[i] = 1;
+                        if (i + 1 < ninsns)
+                                leader[i + 1] = 1;
+                        continue;
+                }
+                rec_to_insn(&recs[i], &insn);
+                flow = insn_flow(&insn);
+                if ((flow & (FLOW_BRANCH | FLOW_STOP)) && i + 1 < ninsns)
+                        leader[i + 1] = 1;
+                to = branch_target(&insn);
+                if (to >= 0 && (k = find_insn(img, to)) >= 0)
+                        leader[k] = 1;
+        }
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                nblocks += leader[i];
+                block_of[i] = nblocks - 1;
+        }
+        blocks = arena_alloc(a, nblocks * sizeof(*blocks));
+        if (!blocks)
+                return -1;
+        for (uint32_t i = 0; i < ninsns; i++) {
+                ir_block *b = &blocks[block_of[i]];
+
+                if (leader[i])
+                        b->first = i;
+                b->last = i;
+        }
+
+        for (uint32_t n = 0; n < nblocks; n++) {
+                ir_block *b = &blocks[n];
+                const insn_rec *rec = &recs[b->last];
+                uint8_t flow = 0;
+                int32_t to = -1;
+                insn insn;
+
+                b->entry = 1;
+                if (rec->flags & INSN_BYTES)
+                        continue;
+                rec_to_insn(rec, &insn);
+                flow = insn_flow(&insn);
+                to = block_at(img, block_of, branch_target(&insn));
+                if ((flow & FLOW_BRANCH) && to >= 0)
+                        b->succ[b->nsucc++] = to;
+                if (!(flow & FLOW_STOP) && n + 1 < nblocks &&
+                    (b->nsucc == 0 || b->succ[0] != (int32_t)n + 1))
+                        b->succ[b->nsucc++] = n + 1;
+        }
+        for (uint32_t n = 0; n < nblocks; n++) {
+                for (int j = 0; j < blocks[n].nsucc; j++) {
+                        blocks[blocks[n].succ[j]].entry = 0;
+                        blocks[blocks[n].succ[j]].npreds++;
+                        npreds++;
+                }
+        }
+        for (uint32_t i = 0; i < ninsns; i++) {
+                insn insn;
+                int32_t to;
+
+                if (recs[i].flags & INSN_BYTES)
+                        continue;
+                rec_to_insn(&recs[i], &insn);
+                if (!(insn_flow(&insn) & FLOW_CALL))
+                        continue;
+                to = block_at(img, block_of, branch_target(&insn));
+                if (to >= 0)
+                        blocks[to].entry = 1;
+        }
+
+        ir->preds = arena_alloc(a, npreds * sizeof(*ir->preds));
+        fill = arena_alloc(scratch, nblocks * sizeof(*fill));
+        if (!ir->preds || !fill)
+                return -1;
+        npreds = 0;
+        for (uint32_t n = 0; n < nblocks; n++) {
+                blocks[n].preds = fill[n] = npreds;
+                npreds += blocks[n].npreds;
+        }
+        for (uint32_t n = 0; n < nblocks; n++)
+                for (int j = 0; j < blocks[n].nsucc; j++)
+                        ir->preds[fill[blocks[n].succ[j]]++] = n;
+
+        ir->blocks = blocks;
+        ir->nblocks = nblocks;
+        return 0;
+}
+
+/*
+ * IR_UNKNOWNs that phis need from blocks that never read them themselves
+ * get made after everything's been lifted, and go right after their
+ * anchor.  This maps each mark to the op made for it.
+ */
+typedef struct late_map_s {
+        uint32_t *keys;
+        uint32_t *values;
+        uint32_t size;
+        uint32_t used;
+} late_map;
+
+static uint32_t
+late_slot(const late_map * const m, uint32_t key)
+{
+        uint32_t s = (key * 0x9e3779b1u) & (m->size - 1);
+
+        while (m->keys[s] && m->keys[s] != key)
+                s = (s + 1) & (m->size - 1);
+        return s;
+}
+
+static uint32_t
+materialize(lifter *l, late_map *m, uint32_t v)
+{
+        uint32_t s;
+
+        if (m->used * 2 >= m->size) {
+                late_map new = { .size = m->size ? m->size * 2 : 1024 };
+
+                new.keys = arena_alloc(l->scratch,
+                                       new.size * sizeof(*new.keys));
+                new.values = arena_alloc(l->scratch,
+                                         new.size * sizeof(*new.values));
+                if (!new.keys || !new.values) {
+                        l->failed = 1;
+                        return 0;
+                }
+                for (uint32_t i = 0; i < m->size; i++) {
+                        if (!m->keys[i])
+                                continue;
+                        s = late_slot(&new, m->keys[i]);
+                        new.keys[s] = m->keys[i];
+                        new.values[s] = m->values[i];
+                }
+                new.used = m->used;
+                *m = new;
+        }
+        s = late_slot(m, v);
+        if (!m->keys[s]) {
+                uint32_t anchor = mark_anchor(v);
+
+                m->keys[s] = v;
+                m->used++;
+                l->insn = l->ops[anchor].insn;
+                m->values[s] = emit(l, IR_UNKNOWN, reg_widths[mark_reg(v)],
+                                    mark_reg(v), 1, anchor, 0, 0, 0);
+        }
+        return m->values[s];
+}
+
+static uint32_t
+find(const uint32_t * const repl, uint32_t v)
+{
+        while (!marked(v) && repl[v] != v)
+                v = repl[v];
+        return v;
+}
+
+/* late unknowns sort by anchor, which is the top half */
+static int
+cmp_late(const void *a, const void *b)
+{
+        uint64_t ua = *(const uint64_t *)a, ub = *(const uint64_t *)b;
+
+        return ua < ub ? -1 : ua > ub;
+}
+
+/*
+ * Drop phis that are trivial or that nothing reads, make the unknowns
+ * the rest need, and lay everything out again block by block.
+ */
+static int
+finish(lifter *l, arena *a, ir *ir, uint32_t *phi_args, uint32_t *phis,
+       uint32_t nphis)
+{
+        uint32_t nops = l->nops, n = 0, nlate, nargs = 0, next_late;
+        uint32_t *repl, *newidx, *work, nwork = 0;
+        uint64_t *late;
+        uint8_t *live;
+        late_map m = { NULL, };
+        int changed, rc = -1;
+
+        repl = arena_alloc(l->scratch, nops * sizeof(*repl));
+        live = arena_alloc(l->scratch, nops);
+        work = arena_alloc(l->scratch, (nphis + 1) * sizeof(*work));
+        if (!repl || !live || !work)
+                goto out;
+        for (uint32_t i = 0; i < nops; i++)
+                repl[i] = i;
+
+        do {
+                changed = 0;
+                for (uint32_t k = 0; k < nphis; k++) {
+                        uint32_t p = phis[k], same = NO_VALUE;
+                        const ir_op *op = &l->ops[p];
+                        int trivial = 1;
+
+                        if (repl[p] != p)
+                                continue;
+                        for (uint32_t j = 0; j < op->args[1]; j++) {
+                                uint32_t arg = phi_args[op->args[0] + j];
+                                uint32_t v = find(repl, arg);
+
+                                if (v == p || v == same)
+                                        continue;
+                                if (same != NO_VALUE) {
+                                        trivial = 0;
+                                        break;
+                                }
+                                same = v;
+                        }
+                        if (trivial && same != NO_VALUE) {
+                                repl[p] = same;
+                                changed = 1;
+                        }
+                }
+        } while (changed);
+
+        /* what everything else reads is live, and so is what that reads */
+        for (uint32_t i = 0; i < nops; i++) {
+                ir_op *op = &l->ops[i];
+
+                if (op->code == IR_PHI)
+                        continue;
+                for (int j = 0; j < op->nargs; j++) {
+                        uint32_t v = find(repl, op->args[j]);
+
+                        if (marked(v))
+                                v = materialize(l, &m, v);
+                        op = &l->ops[i];
+                        op->args[j] = v;
+                        if (l->ops[v].code == IR_PHI && !live[v]) {
+                                live[v] = 1;
+                                work[nwork++] = v;
+                        }
+                }
+        }
+        while (nwork) {
+                const ir_op *op = &l->ops[work[--nwork]];
+
+                for (uint32_t j = 0; j < op->args[1]; j++) {
+                        uint32_t *arg = &phi_args[op->args[0] + j];
+                        uint32_t v = find(repl, *arg);
+
+                        if (marked(v)) {
+                                uint32_t p = op - l->ops;
+
+                                v = materialize(l, &m, v);
+                                op = &l->ops[p];
+                        }
+                        *arg = v;
+                        if (l->ops[v].code == IR_PHI && !live[v]) {
+                                live[v] = 1;
+                                work[nwork++] = v;
+                        }
+                }
+        }
+        if (l->failed)
+                goto out;
+
+        /* lay it out again, with late unknowns after their anchors */
+        nlate = l->nops - nops;
+        late = arena_alloc(l->scratch, (nlate + 1) * sizeof(*late));
+        newidx = arena_alloc(l->scratch, l->nops * sizeof(*newidx));
+        if (!late || !newidx)
+                goto out;
+        for (uint32_t i = 0; i < nlate; i++)
+                late[i] = (uint64_t)l->ops[nops + i].args[0] << 32 |
+                          (nops + i);
+        qsort(late, nlate, sizeof(*late), cmp_late);
+
+        next_late = 0;
+        for (uint32_t bn = 0; bn < ir->nblocks; bn++) {
+                ir_block *b = &ir->blocks[bn];
+                uint32_t first = b->ops, end = b->ops + b->nops;
+
+                b->ops = n;
+                for (uint32_t i = first; i < end; i++) {
+                        const ir_op *op = &l->ops[i];
+
+                        newidx[i] = NO_VALUE;
+                        if (op->code == IR_PHI) {
+                                if (repl[i] != i || !live[i])
+                                        continue;
+                                nargs += op->args[1];
+                        }
+                        newidx[i] = n++;
+                        while (next_late < nlate &&
+                               late[next_late] >> 32 == i)
+                                newidx[(uint32_t)late[next_late++]] = n++;
+                }
+                b->nops = n - b->ops;
+        }
+
+        ir->ops = arena_alloc(a, n * sizeof(*ir->ops));
+        ir->phi_args = arena_alloc(a, nargs * sizeof(*ir->phi_args));
+        if (!ir->ops || !ir->phi_args)
+                goto out;
+        nargs = 0;
+        for (uint32_t i = 0; i < l->nops; i++) {
+                ir_op *op;
+
+                if (newidx[i] == NO_VALUE)
+                        continue;
+                op = &ir->ops[newidx[i]];
+                *op = l->ops[i];
+                if (op->code == IR_PHI) {
+                        for (uint32_t j = 0; j < op->args[1]; j++)
+                                ir->phi_args[nargs + j] =
+                                        newidx[phi_args[op->args[0] + j]];
+                        op->args[0] = nargs;
+                        nargs += op->args[1];
+                        continue;
+                }
+                for (int j = 0; j < op->nargs; j++)
+                        op->args[j] = newidx[op->args[j]];
+        }
+        ir->nops = n;
+        rc = 0;
+out:
+        if (rc < 0)
+                errno = ENOMEM;
+        return rc;
+}
+
+/*
+ * Lift an analyzed image.  Everything in *ir comes from a.
+ */
+int
+lift_image(const image * const img, arena *a, ir *ir)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        arena scratch = { NULL, };
+        lifter l = { NULL, };
+        uint32_t (*out)[NR_IR_REGS];
+        uint32_t *phi_args, *phis, nphis = 0, npreds;
+        int rc = -1;
+
+        pthread_once(&sems_once, index_sems);
+        memset(ir, 0, sizeof(*ir));
+        if (!ninsns)
+                return 0;
+        if (make_blocks(img, a, &scratch, ir) < 0)
+                goto out;
+
+        npreds = ir->blocks[ir->nblocks - 1].preds +
+                 ir->blocks[ir->nblocks - 1].npreds;
+        out = arena_alloc(&scratch, ir->nblocks * sizeof(*out));
+        phi_args = arena_alloc(&scratch,
+                               ((size_t)npreds * NR_IR_REGS + 1) *
+                               sizeof(*phi_args));
+        phis = arena_alloc(&scratch, (size_t)ir->nblocks * NR_IR_REGS *
+                                     sizeof(*phis));
+        l.scratch = &scratch;
+        l.size = ninsns * 4 + 64;
+        l.ops = arena_alloc(&scratch, l.size * sizeof(*l.ops));
+        if (!out || !phi_args || !phis || !l.ops)
+                goto out;
+
+        for (uint32_t bn = 0; bn < ir->nblocks; bn++) {
+                ir_block *b = &ir->blocks[bn];
+
+                l.block = bn;
+                l.insn = b->first;
+                b->ops = l.nops;
+                if (recs[b->first].flags & INSN_BYTES) {
+                        b->nops = 0;
+                        continue;
+                }
+
+                if (b->entry) {
+                        clobber(&l,
+                                emit(&l, IR_ENTRY, 0, 0, 0, 0, 0, 0, 0),
+                                ALL_REGS);
+                } else if (b->npreds == 1 && ir->preds[b->preds] < bn) {
+                        memcpy(l.cur, out[ir->preds[b->preds]],
+                               sizeof(l.cur));
+                } else {
+                        for (int reg = 0; reg < NR_IR_REGS; reg++) {
+                                uint32_t args = b->preds * NR_IR_REGS +
+                                                reg * b->npreds;
+
+                                l.cur[reg] = emit(&l, IR_PHI,
+                                                  reg_widths[reg], reg, 0,
+                                                  args, b->npreds, 0, 0);
+                                phis[nphis++] = l.cur[reg];
+                        }
+                }
+
+                for (uint32_t i = b->first; i <= b->last; i++) {
+                        insn insn;
+
+                        l.insn = i;
+                        rec_to_insn(&recs[i], &insn);
+                        lift_insn(&l, &insn);
+                }
+                if (l.failed)
+                        goto out;
+                memcpy(out[bn], l.cur, sizeof(l.cur));
+                b->nops = l.nops - b->ops;
+        }
+
+        /* each phi's arguments are what its predecessors ended up with */
+        for (uint32_t bn = 0; bn < ir->nblocks; bn++) {
+                const ir_block *b = &ir->blocks[bn];
+
+                for (uint32_t i = b->ops; i < b->ops + b->nops; i++) {
+                        const ir_op *op = &l.ops[i];
+
+                        if (op->code != IR_PHI)
+                                break;
+                        for (uint32_t j = 0; j < op->args[1]; j++) {
+                                uint32_t pred = ir->preds[b->preds + j];
+
+                                phi_args[op->args[0] + j] =
+                                        out[pred][op->aux];
+                        }
+                }
+        }
+        rc = finish(&l, a, ir, phi_args, phis, nphis);
+out:
+        if (rc < 0)
+                errno = ENOMEM;
+        arena_free(&scratch);
+        return rc;
+}
+
+static const char * const code_names[NR_IR_CODES] = {
+        [IR_ENTRY] = "entry", [IR_UNKNOWN] = "unknown", [IR_PHI] = "phi",
+        [IR_CONST] = "const", [IR_ADD] = "add", [IR_SUB] = "sub",
+        [IR_ADC] = "adc", [IR_SBC] = "sbc", [IR_AND] = "and",
+        [IR_OR] = "or", [IR_XOR] = "xor", [IR_NOT] = "not",
+        [IR_NEG] = "neg", [IR_SHL] = "shl", [IR_SHR] = "shr",
+        [IR_ASR] = "asr", [IR_ROL] = "rol", [IR_ROR] = "ror",
+        [IR_MUL] = "mul", [IR_SMUL] = "smul", [IR_DIV] = "div",
+        [IR_SDIV] = "sdiv", [IR_REM] = "rem", [IR_SREM] = "srem",
+        [IR_ZEXT] = "zext", [IR_SEXT] = "sext", [IR_EXTRACT] = "extract",
+        [IR_INSERT] = "insert", [IR_CONCAT] = "concat", [IR_LOAD] = "load",
+        [IR_STORE] = "store", [IR_FLAGS] = "flags", [IR_BRANCH] = "branch",
+        [IR_JUMP] = "jump", [IR_CALL] = "call", [IR_TRAP] = "trap",
+        [IR_RETURN] = "return", [IR_OPAQUE] = "opaque",
+};
+
+static const char * const fk_names[NR_FLAG_KINDS] = {
+        [FK_MOVE] = "move", [FK_TEST] = "test", [FK_COM] = "com",
+        [FK_ADD] = "add", [FK_ADC] = "adc", [FK_SUB] = "sub",
+        [FK_SBC] = "sbc", [FK_NEG] = "neg", [FK_INC] = "inc",
+        [FK_DEC] = "dec", [FK_ASL] = "asl", [FK_ASR] = "asr",
+        [FK_LSR] = "lsr", [FK_ROL] = "rol", [FK_ROR] = "ror",
+        [FK_ZERO] = "zero", [FK_MUL] = "mul", [FK_DIV] = "div",
+};
+
+static const char * const cond_names[NR_IR_CONDS] = {
+        [IRC_ALWAYS] = "always", [IRC_HI] = "hi", [IRC_LS] = "ls",
+        [IRC_CC] = "cc", [IRC_CS] = "cs", [IRC_NE] = "ne", [IRC_EQ] = "eq",
+        [IRC_VC] = "vc", [IRC_VS] = "vs", [IRC_PL] = "pl", [IRC_MI] = "mi",
+        [IRC_GE] = "ge", [IRC_LT] = "lt", [IRC_GT] = "gt", [IRC_LE] = "le",
+        [IRC_EV] = "ev", [IRC_MV] = "mv", [IRC_ZERO] = "zero",
+};
+
+static int
+makes_value(uint8_t code)
+{
+        return code != IR_ENTRY && code != IR_STORE && code != IR_BRANCH &&
+               code != IR_JUMP && code != IR_CALL && code != IR_TRAP &&
+               code != IR_RETURN && code != IR_OPAQUE;
+}
+
+static void
+print_op(FILE *out, const image * const img, const ir * const ir,
+         uint32_t i)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        const ir_op *op = &ir->ops[i];
+
+        if (makes_value(op->code))
+                fprintf(out, "        %%%u = %s.%u", i,
+                        code_names[op->code], op->width);
+        else
+                fprintf(out, "        %%%u: %s", i, code_names[op->code]);
+
+        switch (op->code) {
+        case IR_UNKNOWN:
+                fprintf(out, " %s after %%%u", reg_names[op->aux],
+                        op->args[0]);
+                break;
+        case IR_PHI:
+                for (uint32_t j = 0; j < op->args[1]; j++)
+                        fprintf(out, "%s%%%u", j ? ", " : " ",
+                                ir->phi_args[op->args[0] + j]);
+                fprintf(out, "  ; %s", reg_names[op->aux]);
+                break;
+        case IR_CONST:
+                fprintf(out, " 0x%x", (uint32_t)op->imm);
+                break;
+        case IR_FLAGS:
+                fprintf(out, " %s", fk_names[op->aux]);
+                break;
+        case IR_BRANCH:
+                fprintf(out, " %s", cond_names[op->aux]);
+                break;
+        case IR_RETURN:
+                if (op->aux)
+                        fprintf(out, " from interrupt");
+                break;
+        case IR_OPAQUE: {
+                insn insn;
+
+                rec_to_insn(&recs[op->insn], &insn);
+                fprintf(out, " %s", packed_mnemonic(insn.packed));
+                break;
+        }
+        }
+        for (int j = 0; j < op->nargs && op->code != IR_UNKNOWN; j++)
+                fprintf(out, "%s%%%u",
+                        j || op->code == IR_BRANCH ||
+                        op->code == IR_FLAGS ? ", " : " ", op->args[j]);
+        if (op->code == IR_EXTRACT || op->code == IR_INSERT)
+                fprintf(out, ", %u", op->aux);
+        if (op->code == IR_BRANCH || (op->code == IR_CALL && !op->nargs))
+                fprintf(out, "%s0x%05x", op->nargs ? ", " : " ",
+                        (uint32_t)op->imm);
+        fputc('\n', out);
+}
+
+/*
+ * Print the IR for an image, a block at a time, with the address of each
+ * instruction above the ops it became.  The IR is only kept while it's
+ * printed, in the image's arena.
+ */
+int
+print_ir(FILE *out, image *img)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        arena_pos pos;
+        ir ir;
+
+        arena_mark(&img->arena, &pos);
+        if (lift_image(img, &img->arena, &ir) < 0) {
+                arena_reset(&img->arena, &pos);
+                return -1;
+        }
+        for (uint32_t bn = 0; bn < ir.nblocks; bn++) {
+                const ir_block *b = &ir.blocks[bn];
+                uint32_t insn = UINT32_MAX;
+
+                if (recs[b->first].flags & INSN_BYTES)
+                        continue;
+                fprintf(out, "%sb%u:", bn ? "\n" : "", bn);
+                fprintf(out, "%*s; 0x%05x", bn < 10 ? 6 : bn < 100 ? 5 : 4,
+                        "", recs[b->first].addr);
+                if (b->npreds)
+                        fprintf(out, ", from");
+                for (uint32_t j = 0; j < b->npreds; j++)
+                        fprintf(out, " b%u", ir.preds[b->preds + j]);
+                fputc('\n', out);
+                for (uint32_t i = b->ops; i < b->ops + b->nops; i++) {
+                        if (ir.ops[i].insn != insn) {
+                                insn = ir.ops[i].insn;
+                                fprintf(out, "%08x:\n", recs[insn].addr);
+                        }
+                        print_op(out, img, &ir, i);
+                }
+        }
+        fprintf(out, "; %u instructions, %u blocks, %u ops\n",
+                image_count(img, SEC_INSNS), ir.nblocks, ir.nops);
+        arena_reset(&img->arena, &pos);
+        return 0;
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,175 @@
+/*
+ * jumptab.c - find dispatch through tables of addresses
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * What the compiler emits for a switch, or a state machine's dispatch,
+ * looks like this:
+ *
+ *      cmpb #N                 ; bound check
+ *      bhi default             ; (or bcc, with one fewer entry)
+ *      ...                     ; scale the index into X
+ *      ldx [%x]+table          ; fetch the entry
+ *      jmp [%x]+0              ; (or jsr)
+ *
+ * The index register the table is read through may be loaded with the
+ * table's address (ldx #table, then abx) instead of carrying it in the
+ * offset; either works.  Entries are 16 bits, relative to the bank the
+ * dispatch is in, since nothing in the idiom says what XK holds.
+ *
+ * We only look a few instructions back from the jump, and we throw the
+ * whole table out if any entry points outside the image, into the table,
+ * or into the middle of the idiom itself, which keeps us from finding
+ * these in data.
+ */
+#define WINDOW  8
+
+static int
+index_offset(const insn * const insn, int32_t *offset)
+{
+        const shape *shape = &shapes[insn->packed.shape];
+
+        for (int i = 0; i < shape->nargs; i++) {
+                if (!opkinds[shape->args[i].kind].index)
+                        continue;
+                *offset = arg_value(shape, &shape->args[i], insn);
+                return 0;
+        }
+        return -1;
+}
+
+static uint16_t
+be16(const uint8_t * const p)
+{
+        return p[0] << 8 | p[1];
+}
+
+/*
+ * ldx, ldy, or ldz of index register n.
+ */
+static int
+is_load(const insn * const insn, int n)
+{
+        const char *m = packed_mnemonic(insn->packed);
+
+        return m[0] == 'l' && m[1] == 'd' && m[2] == 'x' + n && !m[3];
+}
+
+uint32_t
+jump_table_target(const image * const img, const jump_table * const t,
+                  uint32_t k)
+{
+        return ((t->bank | be16(img->buf + t->base + 2 * k)) + t->offset) &
+               0xfffff;
+}
+
+/*
+ * Is the instruction at index i the jump at the end of the idiom above?
+ * If so, fill in t.  Only looks at instructions before i, so it works
+ * while they're still being decoded.
+ */
+int
+find_jump_table(const image * const img, uint32_t i, jump_table *t)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t first = i > WINDOW ? i - WINDOW : 0;
+        int64_t load = -1, check = -1;
+        uint32_t table = 0, end;
+        int r, n = -1, have_table = 0;
+        int32_t offset;
+        const char *m;
+        insn insn;
+
+        if (recs[i].flags & INSN_BYTES)
+                return 0;
+        rec_to_insn(&recs[i], &insn);
+        if ((insn_flow(&insn) & (FLOW_INDIRECT | FLOW_RETURN)) !=
+            FLOW_INDIRECT || (r = mode_index(insn.packed.mode)) < 0 ||
+            index_offset(&insn, &t->offset) < 0)
+                return 0;
+
+        /* the load of the jump's index register, nothing in between */
+        for (int64_t k = (int64_t)i - 1; k >= first && load < 0; k--) {
+                if (recs[k].flags & INSN_BYTES)
+                        return 0;
+                rec_to_insn(&recs[k], &insn);
+                if (insn_flow(&insn))
+                        return 0;
+                if (!clobbers_index(&insn, r))
+                        continue;
+                if (!is_load(&insn, r) ||
+                    (n = mode_index(insn.packed.mode)) < 0 ||
+                    index_offset(&insn, &offset) < 0)
+                        return 0;
+                load = k;
+        }
+        if (load < 0)
+                return 0;
+
+        /* the bound check, and maybe where the table is */
+        for (int64_t k = load - 1; k >= first && check < 0; k--) {
+                if (recs[k].flags & INSN_BYTES)
+                        return 0;
+                rec_to_insn(&recs[k], &insn);
+                m = packed_mnemonic(insn.packed);
+                if (insn_flow(&insn)) {
+                        if (strcmp(m, "bhi") && strcmp(m, "bcc"))
+                                return 0;
+                        check = k;
+                } else if (!have_table && is_load(&insn, n)) {
+                        if (insn.packed.mode != imm16)
+                                return 0;
+                        table = arg_value(&shapes[insn.packed.shape],
+                                          shapes[insn.packed.shape].args,
+                                          &insn) & 0xffff;
+                        have_table = 1;
+                }
+        }
+        if (check <= 0 || (recs[check - 1].flags & INSN_BYTES))
+                return 0;
+
+        /* bhi skips the table when index > N, bcc when index >= N */
+        rec_to_insn(&recs[check], &insn);
+        t->count = !strcmp(packed_mnemonic(insn.packed), "bhi");
+        rec_to_insn(&recs[check - 1], &insn);
+        m = packed_mnemonic(insn.packed);
+        if ((insn.packed.mode != imm8 && insn.packed.mode != imm16) ||
+            (strncmp(m, "cp", 2) && strncmp(m, "cmp", 3)))
+                return 0;
+        t->count += arg_value(&shapes[insn.packed.shape],
+                              &shapes[insn.packed.shape].args[0], &insn) &
+                    (insn.packed.mode == imm8 ? 0xff : 0xffff);
+        if (!t->count || t->count > JUMP_TABLE_MAX)
+                return 0;
+
+        t->load = recs[load].addr;
+        t->bank = recs[i].addr & 0xf0000;
+        t->base = ((t->bank | table) + offset) & 0xfffff;
+        end = t->base + 2 * t->count;
+        if (end > img->size)
+                return 0;
+        for (uint32_t k = 0; k < t->count; k++) {
+                uint32_t to = jump_table_target(img, t, k);
+
+                if (to >= img->size || (to >= t->base && to < end))
+                        return 0;
+                for (int64_t j = check - 1; j <= i; j++)
+                        if (to > recs[j].addr &&
+                            to < recs[j].addr + recs[j].len)
+                                return 0;
+        }
+        return 1;
+}
+
+// vim:fenc=utf-8:tw=75:et
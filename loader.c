@@ -0,0 +1,585 @@
+/*
+ * loader.c - read many images at once and decode them in parallel
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The main thread opens files and keeps a few reads per worker in flight
+ * through io_uring; if the kernel won't give us a ring, a few reader
+ * threads do blocking reads instead.  Either way, a finished read goes
+ * onto the ready queue for the decode workers, and once a worker is done
+ * with it, the job (and its buffer) goes back on the free queue to be
+ * used for the next file.  Listings are printed in command line order no
+ * matter what order they finish in.
+ */
+#define DEPTH_PER_WORKER 4
+#define READERS 8
+#define MAX_READ (1u << 30)
+
+typedef struct job_s {
+        const char *filename;
+        size_t seq;
+        int fd;
+        uint8_t *buf;
+        size_t bufsize;
+        size_t size;
+        size_t done;
+        int rc;         // read_image()'s exit status, 0 if it worked
+        int error;
+} job;
+
+/*
+ * A bounded multi-producer, multi-consumer queue (Vyukov's).  It's sized
+ * so it can hold every job at once and never fills up; the semaphore
+ * only exists so consumers can sleep when it's empty.
+ */
+typedef struct cell_s {
+        atomic_size_t seq;
+        job *job;
+} cell;
+
+typedef struct queue_s {
+        cell *cells;
+        size_t mask;
+        atomic_size_t head;
+        atomic_size_t tail;
+        sem_t items;
+} queue;
+
+typedef struct result_s {
+        char *text;
+        size_t len;
+        int rc;
+        int error;
+        int ready;
+} result;
+
+typedef struct loader_s {
+        char * const *files;
+        size_t nfiles;
+        image_fn fn;
+        zout *z;
+        queue ready;
+        queue free;
+        job *jobs;
+        size_t njobs;
+        atomic_size_t next_file;
+
+        pthread_mutex_t lock;
+        result *results;
+        size_t next_result;
+} loader;
+
+static int
+queue_init(queue *q, size_t n)
+{
+        size_t size = 1;
+
+        while (size < n)
+                size <<= 1;
+        q->cells = calloc(size, sizeof(*q->cells));
+        if (!q->cells)
+                return -1;
+        for (size_t i = 0; i < size; i++)
+                atomic_init(&q->cells[i].seq, i);
+        q->mask = size - 1;
+        atomic_init(&q->head, 0);
+        atomic_init(&q->tail, 0);
+        return sem_init(&q->items, 0, 0);
+}
+
+static void
+queue_fini(queue *q)
+{
+        sem_destroy(&q->items);
+        free(q->cells);
+}
+
+static void
+queue_push(queue *q, job *j)
+{
+        size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        cell *c;
+
+        for (;;) {
+                size_t seq;
+
+                c = &q->cells[pos & q->mask];
+                seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+                if (seq == pos) {
+                        if (atomic_compare_exchange_weak_explicit(
+                                        &q->tail, &pos, pos + 1,
+                                        memory_order_relaxed,
+                                        memory_order_relaxed))
+                                break;
+                } else {
+                        pos = atomic_load_explicit(&q->tail,
+                                                   memory_order_relaxed);
+                }
+        }
+
+        c->job = j;
+        atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+        sem_post(&q->items);
+}
+
+static job *
+queue_take(queue *q)
+{
+        size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        cell *c;
+        job *j;
+
+        for (;;) {
+                size_t seq;
+
+                c = &q->cells[pos & q->mask];
+                seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+                if (seq == pos + 1) {
+                        if (atomic_compare_exchange_weak_explicit(
+                                        &q->head, &pos, pos + 1,
+                                        memory_order_relaxed,
+                                        memory_order_relaxed))
+                                break;
+                } else {
+                        pos = atomic_load_explicit(&q->head,
+                                                   memory_order_relaxed);
+                }
+        }
+
+        j = c->job;
+        atomic_store_explicit(&c->seq, pos + q->mask + 1,
+                              memory_order_release);
+        return j;
+}
+
+static job *
+queue_pop(queue *q)
+{
+        while (sem_wait(&q->items) < 0)
+                ;
+        return queue_take(q);
+}
+
+static job *
+queue_trypop(queue *q)
+{
+        if (sem_trywait(&q->items) < 0)
+                return NULL;
+        return queue_take(q);
+}
+
+/*
+ * Open the next file and get its buffer ready.  Returns 0 if there's
+ * something to read, and -1 if the job already failed.
+ */
+static int
+start_job(loader *l, job *j, size_t seq)
+{
+        struct stat sb;
+
+        j->filename = l->files[seq];
+        j->seq = seq;
+        j->size = j->done = 0;
+        j->rc = j->error = 0;
+
+        j->fd = open(j->filename, O_RDONLY | O_CLOEXEC);
+        if (j->fd < 0) {
+                j->rc = 2;
+                goto err;
+        }
+        if (fstat(j->fd, &sb) < 0) {
+                j->rc = 3;
+                goto err;
+        }
+        if (sb.st_size == 0) {
+                errno = EIO;
+                j->rc = 5;
+                goto err;
+        }
+
+        j->size = sb.st_size;
+        if (j->bufsize < j->size) {
+                free(j->buf);
+                j->buf = malloc(j->size);
+                j->bufsize = j->buf ? j->size : 0;
+                if (!j->buf) {
+                        j->rc = 4;
+                        goto err;
+                }
+        }
+        return 0;
+err:
+        j->error = errno;
+        if (j->fd >= 0)
+                close(j->fd);
+        j->fd = -1;
+        return -1;
+}
+
+/*
+ * Account for res bytes (or -errno) of a read.  Returns 1 when the job
+ * is finished one way or the other.
+ */
+static int
+read_done(job *j, ssize_t res)
+{
+        if (res > 0)
+                j->done += res;
+        if (res > 0 && j->done < j->size)
+                return 0;
+
+        if (res <= 0) {
+                j->rc = 5;
+                j->error = res < 0 ? -res : EIO;
+        }
+        close(j->fd);
+        j->fd = -1;
+        return 1;
+}
+
+/*
+ * Just enough io_uring to issue reads without liburing.
+ */
+typedef struct ring_s {
+        int fd;
+        unsigned entries;
+        void *sq_ring;
+        void *cq_ring;
+        size_t sq_len;
+        size_t cq_len;
+        struct io_uring_sqe *sqes;
+        unsigned *sq_tail;
+        unsigned *sq_mask;
+        unsigned *sq_array;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned *cq_mask;
+        struct io_uring_cqe *cqes;
+        unsigned to_submit;
+} ring;
+
+static int
+ring_init(ring *r, unsigned entries)
+{
+        struct io_uring_params p;
+
+        memset(r, 0, sizeof(*r));
+        memset(&p, 0, sizeof(p));
+        r->fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (r->fd < 0)
+                return -1;
+        r->entries = p.sq_entries;
+
+        r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        r->cq_len = p.cq_off.cqes +
+                    p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                if (r->cq_len > r->sq_len)
+                        r->sq_len = r->cq_len;
+                r->cq_len = 0;
+        }
+
+        r->sq_ring = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd,
+                          IORING_OFF_SQ_RING);
+        if (r->sq_ring == MAP_FAILED)
+                goto err;
+        r->cq_ring = r->sq_ring;
+        if (r->cq_len) {
+                r->cq_ring = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, r->fd,
+                                  IORING_OFF_CQ_RING);
+                if (r->cq_ring == MAP_FAILED)
+                        goto err;
+        }
+        r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       r->fd, IORING_OFF_SQES);
+        if (r->sqes == MAP_FAILED)
+                goto err;
+
+        r->sq_tail = (unsigned *)((char *)r->sq_ring + p.sq_off.tail);
+        r->sq_mask = (unsigned *)((char *)r->sq_ring + p.sq_off.ring_mask);
+        r->sq_array = (unsigned *)((char *)r->sq_ring + p.sq_off.array);
+        r->cq_head = (unsigned *)((char *)r->cq_ring + p.cq_off.head);
+        r->cq_tail = (unsigned *)((char *)r->cq_ring + p.cq_off.tail);
+        r->cq_mask = (unsigned *)((char *)r->cq_ring + p.cq_off.ring_mask);
+        r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring +
+                                          p.cq_off.cqes);
+        return 0;
+err:
+        close(r->fd);
+        return -1;
+}
+
+static void
+ring_fini(ring *r)
+{
+        munmap(r->sqes, r->entries * sizeof(struct io_uring_sqe));
+        if (r->cq_len)
+                munmap(r->cq_ring, r->cq_len);
+        munmap(r->sq_ring, r->sq_len);
+        close(r->fd);
+}
+
+static void
+ring_read(ring *r, job *j)
+{
+        unsigned tail = *r->sq_tail;
+        unsigned idx = tail & *r->sq_mask;
+        struct io_uring_sqe *sqe = &r->sqes[idx];
+        size_t len = j->size - j->done;
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = j->fd;
+        sqe->addr = (uintptr_t)(j->buf + j->done);
+        sqe->len = len > MAX_READ ? MAX_READ : len;
+        sqe->off = j->done;
+        sqe->user_data = (uintptr_t)j;
+        r->sq_array[idx] = idx;
+        __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        r->to_submit++;
+}
+
+/*
+ * Submit whatever's queued, wait for at least one completion, and hand
+ * every finished job to the workers.  Returns how many finished.
+ */
+static size_t
+ring_reap(loader *l, ring *r)
+{
+        unsigned head, tail;
+        size_t finished = 0;
+        int rc;
+
+        rc = syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1,
+                     IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno != EINTR)
+                err(5, "Could not read images");
+        if (rc > 0)
+                r->to_submit -= rc;
+
+        head = *r->cq_head;
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+                struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+                job *j = (job *)(uintptr_t)cqe->user_data;
+
+                if (read_done(j, cqe->res)) {
+                        queue_push(&l->ready, j);
+                        finished++;
+                } else {
+                        ring_read(r, j);
+                }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        return finished;
+}
+
+static void
+load_with_ring(loader *l, ring *r)
+{
+        size_t next = 0, inflight = 0;
+
+        while (next < l->nfiles || inflight) {
+                job *j;
+
+                while (next < l->nfiles &&
+                       (j = inflight ? queue_trypop(&l->free)
+                                     : queue_pop(&l->free))) {
+                        if (start_job(l, j, next++) < 0) {
+                                queue_push(&l->ready, j);
+                                continue;
+                        }
+                        ring_read(r, j);
+                        inflight++;
+                        if (inflight == r->entries)
+                                break;
+                }
+                if (!inflight)
+                        continue;
+
+                inflight -= ring_reap(l, r);
+        }
+}
+
+static void *
+reader(void *data)
+{
+        loader *l = data;
+        size_t seq;
+
+        while ((seq = atomic_fetch_add(&l->next_file, 1)) < l->nfiles) {
+                job *j = queue_pop(&l->free);
+
+                if (start_job(l, j, seq) == 0) {
+                        ssize_t res;
+
+                        do {
+                                size_t len = j->size - j->done;
+
+                                if (len > MAX_READ)
+                                        len = MAX_READ;
+                                res = pread(j->fd, j->buf + j->done, len,
+                                            j->done);
+                                if (res < 0 && errno == EINTR)
+                                        continue;
+                        } while (!read_done(j, res < 0 ? -errno : res));
+                }
+                queue_push(&l->ready, j);
+        }
+        return NULL;
+}
+
+static int
+load_with_threads(loader *l)
+{
+        pthread_t readers[READERS];
+        int n;
+
+        for (n = 0; n < READERS; n++)
+                if (pthread_create(&readers[n], NULL, reader, l))
+                        break;
+        if (n == 0)
+                return -1;
+        while (n--)
+                pthread_join(readers[n], NULL);
+        return 0;
+}
+
+/*
+ * Print every result we have, in order, or hand it to the compressor if
+ * we have one.  Called with l->lock held.
+ */
+static void
+flush_results(loader *l)
+{
+        while (l->next_result < l->nfiles &&
+               l->results[l->next_result].ready) {
+                result *res = &l->results[l->next_result];
+
+                if (res->rc) {
+                        fflush(stdout);
+                        errno = res->error;
+                        image_error(res->rc, l->files[l->next_result]);
+                }
+                if (!l->z)
+                        fwrite(res->text, 1, res->len, stdout);
+                else if (zout_write(l->z, l->files[l->next_result],
+                                    res->text, res->len) < 0)
+                        err(5, "Could not write compressed listing");
+                free(res->text);
+                res->text = NULL;
+                l->next_result++;
+        }
+}
+
+static void *
+worker(void *data)
+{
+        loader *l = data;
+        job *j;
+
+        while ((j = queue_pop(&l->ready))) {
+                result res = { NULL, 0, j->rc, j->error, 1 };
+                FILE *out;
+
+                if (!j->rc) {
+                        out = open_memstream(&res.text, &res.len);
+                        if (!out)
+                                err(4, "Could not allocate memory");
+                        res.rc = l->fn(out, j->filename, j->buf, j->size);
+                        if (fclose(out) == EOF)
+                                err(4, "Could not allocate memory");
+                }
+
+                pthread_mutex_lock(&l->lock);
+                l->results[j->seq] = res;
+                queue_push(&l->free, j);
+                flush_results(l);
+                pthread_mutex_unlock(&l->lock);
+        }
+        return NULL;
+}
+
+int
+load_images(char * const files[], size_t nfiles, image_fn fn, zout *z)
+{
+        loader l = { files, nfiles, fn, z };
+        long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+        pthread_t *workers;
+        ring r;
+        int rc = 0;
+        long n;
+
+        if (nworkers < 1)
+                nworkers = 1;
+        l.njobs = nworkers * DEPTH_PER_WORKER;
+        if (l.njobs < READERS)
+                l.njobs = READERS;
+
+        l.jobs = calloc(l.njobs, sizeof(*l.jobs));
+        l.results = calloc(nfiles, sizeof(*l.results));
+        workers = calloc(nworkers, sizeof(*workers));
+        if (!l.jobs || !l.results || !workers ||
+            queue_init(&l.ready, l.njobs + nworkers) < 0 ||
+            queue_init(&l.free, l.njobs) < 0)
+                err(4, "Could not allocate memory");
+        pthread_mutex_init(&l.lock, NULL);
+        atomic_init(&l.next_file, 0);
+        for (size_t i = 0; i < l.njobs; i++) {
+                l.jobs[i].fd = -1;
+                queue_push(&l.free, &l.jobs[i]);
+        }
+
+        for (n = 0; n < nworkers; n++)
+                if (pthread_create(&workers[n], NULL, worker, &l))
+                        err(4, "Could not start decode workers");
+
+        if (ring_init(&r, l.njobs) == 0) {
+                load_with_ring(&l, &r);
+                ring_fini(&r);
+        } else {
+                rc = load_with_threads(&l);
+        }
+
+        for (n = 0; n < nworkers; n++)
+                queue_push(&l.ready, NULL);
+        for (n = 0; n < nworkers; n++)
+                pthread_join(workers[n], NULL);
+
+        for (size_t i = 0; i < l.njobs; i++)
+                free(l.jobs[i].buf);
+        free(l.jobs);
+        free(l.results);
+        free(workers);
+        queue_fini(&l.ready);
+        queue_fini(&l.free);
+        pthread_mutex_destroy(&l.lock);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
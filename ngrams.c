@@ -0,0 +1,306 @@
+/*
+ * ngrams.c - count which instruction sequences a corpus is made of
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * Every instruction is its opcode page and byte, ten bits, which also
+ * says what its mnemonic and addressing mode are.  A run of up to
+ * MAX_NGRAM of them packs into one 64-bit key, with n above them so keys
+ * for different n never collide and are never 0.  Runs follow the
+ * listing, and stop at anything listed as .byte.
+ *
+ * Each thread that lists images counts into its own tables, so nothing is
+ * shared while we go; single instructions and modes are plain arrays, and
+ * longer runs go in an open-addressed hash table that doubles when it's
+ * half full.  print_ngrams() adds all the threads' tables together and
+ * prints the top of each.
+ */
+#define OP_BITS         10
+#define NR_OPS          (1 << OP_BITS)
+#define NR_MODES        (ext2ext + 1)
+#define MIN_SLOTS       4096
+
+typedef struct gram_s {
+        uint64_t key;
+        uint64_t count;
+} gram;
+
+typedef struct counts_s {
+        struct counts_s *next;
+        uint64_t images;
+        uint64_t total[MAX_NGRAM + 1];  // how many runs of each length
+        uint64_t modes[NR_MODES];
+        uint64_t ops[NR_OPS];
+        gram *slots;                    // runs of 2 or more
+        size_t nslots;
+        size_t used;
+} counts;
+
+static int max_ngram = 0;
+static counts *all_counts = NULL;
+static pthread_mutex_t counts_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local counts *my_counts = NULL;
+
+static const char * const mode_labels[NR_MODES] = {
+        [ind8x] = "ind8,x", [ind8y] = "ind8,y", [ind8z] = "ind8,z",
+        [ind16x] = "ind16,x", [ind16y] = "ind16,y", [ind16z] = "ind16,z",
+        [ixp2ext] = "ixp,ext", [ext2ixp] = "ext,ixp", [inh] = "inh",
+        [rel8] = "rel8", [rel16] = "rel16", [imm8] = "imm8",
+        [imm16] = "imm16", [ind20x] = "ind20,x", [ind20y] = "ind20,y",
+        [ind20z] = "ind20,z", [ext] = "ext", [ext20] = "ext20",
+        [ex] = "e,x", [ey] = "e,y", [ez] = "e,z", [ext2ext] = "ext,ext",
+};
+
+int
+set_ngrams(int n)
+{
+        if (n < 1 || n > MAX_NGRAM) {
+                errno = EINVAL;
+                return -1;
+        }
+        max_ngram = n;
+        return 0;
+}
+
+int
+have_ngrams(void)
+{
+        return max_ngram > 0;
+}
+
+static size_t
+slot_of(uint64_t key, size_t nslots)
+{
+        return (key * 0x9e3779b97f4a7c15ull) >> 32 & (nslots - 1);
+}
+
+static int
+grow(counts *c)
+{
+        size_t nslots = c->nslots ? c->nslots * 2 : MIN_SLOTS;
+        gram *slots = calloc(nslots, sizeof(*slots));
+
+        if (!slots)
+                return -1;
+        for (size_t i = 0; i < c->nslots; i++) {
+                size_t s;
+
+                if (!c->slots[i].key)
+                        continue;
+                for (s = slot_of(c->slots[i].key, nslots); slots[s].key;
+                     s = (s + 1) & (nslots - 1))
+                        ;
+                slots[s] = c->slots[i];
+        }
+        free(c->slots);
+        c->slots = slots;
+        c->nslots = nslots;
+        return 0;
+}
+
+static int
+add_gram(counts *c, uint64_t key, uint64_t count)
+{
+        size_t s;
+
+        if (c->used * 2 >= c->nslots && grow(c) < 0)
+                return -1;
+        for (s = slot_of(key, c->nslots); c->slots[s].key != key;
+             s = (s + 1) & (c->nslots - 1)) {
+                if (!c->slots[s].key) {
+                        c->slots[s].key = key;
+                        c->used++;
+                        break;
+                }
+        }
+        c->slots[s].count += count;
+        return 0;
+}
+
+static counts *
+thread_counts(void)
+{
+        if (my_counts)
+                return my_counts;
+        my_counts = calloc(1, sizeof(*my_counts));
+        if (!my_counts)
+                return NULL;
+        pthread_mutex_lock(&counts_lock);
+        my_counts->next = all_counts;
+        all_counts = my_counts;
+        pthread_mutex_unlock(&counts_lock);
+        return my_counts;
+}
+
+/*
+ * An image_fn: count what's in the listing of one image.
+ */
+int
+count_ngrams(FILE *out UNUSED, const char * const filename,
+             const uint8_t * const buf, const size_t size)
+{
+        counts *c = thread_counts();
+        uint64_t run = 0;
+        int len = 0;
+
+        if (!c)
+                err(4, "Could not allocate memory");
+        c->images++;
+        for (size_t pos = 0; pos < size; ) {
+                uint32_t op;
+                insn insn;
+
+                if (decode_insn(buf, size, pos, &insn) < 0)
+                        break;
+                pos += insn.len;
+                if (!packed_is_defined(insn.packed) || insn.slack) {
+                        len = 0;
+                        continue;
+                }
+
+                op = ((insn.prefix >> 4) & 3) << 8 | insn.opcode;
+                c->ops[op]++;
+                c->modes[insn.packed.mode]++;
+                c->total[1]++;
+
+                run = (run << OP_BITS | op) &
+                      ((1ull << (OP_BITS * MAX_NGRAM)) - 1);
+                if (len < MAX_NGRAM)
+                        len++;
+                for (int n = 2; n <= len && n <= max_ngram; n++) {
+                        uint64_t mask = (1ull << (OP_BITS * n)) - 1;
+                        uint64_t key = run & mask;
+
+                        key |= (uint64_t)n << (OP_BITS * MAX_NGRAM);
+                        c->total[n]++;
+                        if (add_gram(c, key, 1) < 0)
+                                err(4, "%s: Could not allocate memory",
+                                    filename);
+                }
+        }
+        return 0;
+}
+
+static int
+cmp_gram(const void *a, const void *b)
+{
+        const gram *ga = a, *gb = b;
+
+        if (ga->count != gb->count)
+                return ga->count > gb->count ? -1 : 1;
+        return ga->key < gb->key ? -1 : ga->key > gb->key;
+}
+
+static void
+print_op(FILE *out, uint32_t op)
+{
+        packed_op packed = packed_opcodes[op >> 8][op & 0xff];
+
+        fprintf(out, "%s", packed_mnemonic(packed));
+        if (packed.mode != inh)
+                fprintf(out, " %s", mode_labels[packed.mode]);
+}
+
+static double
+percent(uint64_t count, uint64_t total)
+{
+        return total ? 100.0 * count / total : 0.0;
+}
+
+/*
+ * Put every thread's counts together, and print the top of each list.
+ */
+int
+print_ngrams(FILE *out, uint32_t top)
+{
+        counts *sum = all_counts;
+        gram *grams = NULL;
+        size_t ngrams = 0;
+        int rc = -1;
+
+        if (!sum) {
+                fprintf(out, "no images\n");
+                return 0;
+        }
+        for (counts *c = sum->next; c; c = c->next) {
+                sum->images += c->images;
+                for (int n = 1; n <= MAX_NGRAM; n++)
+                        sum->total[n] += c->total[n];
+                for (int m = 0; m < NR_MODES; m++)
+                        sum->modes[m] += c->modes[m];
+                for (int op = 0; op < NR_OPS; op++)
+                        sum->ops[op] += c->ops[op];
+                for (size_t i = 0; i < c->nslots; i++)
+                        if (c->slots[i].key &&
+                            add_gram(sum, c->slots[i].key,
+                                     c->slots[i].count) < 0)
+                                goto out;
+        }
+
+        fprintf(out, "%" PRIu64 " instructions in %" PRIu64 " images\n",
+                sum->total[1], sum->images);
+
+        fprintf(out, "\naddressing modes:\n");
+        grams = calloc(sum->used > NR_OPS ? sum->used : NR_OPS,
+                       sizeof(*grams));
+        if (!grams)
+                goto out;
+        for (int m = 0; m < NR_MODES; m++)
+                if (sum->modes[m])
+                        grams[ngrams++] = (gram){ m, sum->modes[m] };
+        qsort(grams, ngrams, sizeof(*grams), cmp_gram);
+        for (size_t i = 0; i < ngrams; i++)
+                fprintf(out, "%14" PRIu64 " %6.2f%%  %s\n", grams[i].count,
+                        percent(grams[i].count, sum->total[1]),
+                        mode_labels[grams[i].key]);
+
+        for (int n = 1; n <= max_ngram; n++) {
+                fprintf(out, "\n%d-instruction sequences:\n", n);
+                ngrams = 0;
+                if (n == 1) {
+                        for (int op = 0; op < NR_OPS; op++)
+                                if (sum->ops[op])
+                                        grams[ngrams++] =
+                                                (gram){ op, sum->ops[op] };
+                } else {
+                        for (size_t i = 0; i < sum->nslots; i++)
+                                if (sum->slots[i].key >>
+                                    (OP_BITS * MAX_NGRAM) == (uint64_t)n)
+                                        grams[ngrams++] = sum->slots[i];
+                }
+                qsort(grams, ngrams, sizeof(*grams), cmp_gram);
+
+                for (size_t i = 0; i < ngrams && i < top; i++) {
+                        fprintf(out, "%14" PRIu64 " %6.2f%% ",
+                                grams[i].count,
+                                percent(grams[i].count, sum->total[n]));
+                        for (int k = n - 1; k >= 0; k--) {
+                                fprintf(out, k == n - 1 ? " " : "; ");
+                                print_op(out, (grams[i].key >>
+                                               (OP_BITS * k)) &
+                                              (NR_OPS - 1));
+                        }
+                        fputc('\n', out);
+                }
+        }
+        rc = 0;
+out:
+        free(grams);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,375 @@
+/*
+ * profile.c - overlay PC sample counts on the listing
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A histogram is lines of "ADDR COUNT [TAKEN]": ADDR in hex, and how
+ * many samples landed there.  TAKEN, for branch coverage, is how many of
+ * those times the branch at ADDR went to its target.  Blank lines and
+ * lines starting with '#' are skipped, and the same address may turn up
+ * more than once.
+ *
+ * Counts go in arrays indexed by address.  One pass over the records
+ * then adds them up per instruction, per basic block, and per function,
+ * and everything after that just reads the totals back.  All of it is
+ * printed after a ';', so the listing still assembles.
+ */
+#define HEAT_WIDTH      8
+
+typedef struct hot_block_s {
+        uint32_t first;         // record indices
+        uint32_t last;
+        uint64_t hits;
+} hot_block;
+
+typedef struct profile_s {
+        const image *img;
+        uint64_t *hits;         // by address
+        uint64_t *taken;        // by address, if we have any
+        uint64_t outside;       // samples past the end of the image
+        uint64_t total;
+        uint64_t *insn_hits;    // by record
+        uint64_t hottest;       // most any one instruction got
+        hot_block *blocks;
+        uint32_t nblocks;
+        int32_t *block_of;      // by record, -1 for data
+        func *funcs;
+        uint32_t nfuncs;
+        uint64_t *func_hits;
+        uint32_t f;             // where annotate() is up to
+} profile;
+
+static int
+number(char **s, int base, unsigned long long *value)
+{
+        char *end;
+
+        while (isspace((unsigned char)**s))
+                (*s)++;
+        if (!isxdigit((unsigned char)**s))
+                return -1;
+        errno = 0;
+        *value = strtoull(*s, &end, base);
+        if (errno || end == *s || (*end && !isspace((unsigned char)*end)))
+                return -1;
+        *s = end;
+        return 0;
+}
+
+static int
+parse_sample(char *s, unsigned long long *addr, unsigned long long *count,
+             unsigned long long *taken)
+{
+        *taken = 0;
+        if (number(&s, 16, addr) < 0 || number(&s, 10, count) < 0)
+                return -1;
+        while (isspace((unsigned char)*s))
+                s++;
+        if (*s && number(&s, 10, taken) < 0)
+                return -1;
+        while (isspace((unsigned char)*s))
+                s++;
+        return *s || *taken > *count ? -1 : 0;
+}
+
+/*
+ * Whether there's a conditional branch at addr, for a TAKEN count to
+ * mean anything.
+ */
+static int
+is_branch(const image * const img, uint32_t addr)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        int64_t i = find_insn(img, addr);
+        insn insn;
+
+        if (i < 0 || (recs[i].flags & INSN_BYTES))
+                return 0;
+        rec_to_insn(&recs[i], &insn);
+        return !!(insn_flow(&insn) & FLOW_COND);
+}
+
+static int
+load_histogram(profile *p, arena *scratch, FILE *in,
+               const char * const path)
+{
+        char *line = NULL;
+        size_t size = 0, lineno = 0;
+        ssize_t len;
+        int rc = 0;
+
+        while (rc == 0 && (len = getline(&line, &size, in)) >= 0) {
+                unsigned long long addr, count, taken;
+                char *s = line;
+
+                lineno++;
+                while (isspace((unsigned char)*s))
+                        s++;
+                if (!*s || *s == '#')
+                        continue;
+
+                if (parse_sample(s, &addr, &count, &taken) < 0) {
+                        warnx("%s:%zu: invalid sample count", path,
+                              lineno);
+                        errno = EINVAL;
+                        rc = -1;
+                        break;
+                }
+
+                if (addr >= p->img->size) {
+                        p->outside += count;
+                        continue;
+                }
+                p->hits[addr] += count;
+                if (!taken)
+                        continue;
+                if (!is_branch(p->img, addr)) {
+                        warnx("%s:%zu: 0x%05llx is not a conditional "
+                              "branch; ignoring its taken count",
+                              path, lineno, addr);
+                        continue;
+                }
+                if (!p->taken) {
+                        p->taken = arena_alloc(scratch, p->img->size *
+                                                        sizeof(*p->taken));
+                        if (!p->taken) {
+                                rc = -1;
+                                break;
+                        }
+                }
+                p->taken[addr] += taken;
+        }
+        if (rc == 0 && ferror(in))
+                rc = -1;
+        free(line);
+        return rc;
+}
+
+/*
+ * Does a basic block start at record i?  Anything control can get to
+ * from elsewhere does, and so does whatever follows a branch or return.
+ */
+static int
+starts_block(const image * const img, uint32_t i, uint8_t prev_flow)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        const xref *xrefs = image_section(img, SEC_XREFS, xref);
+        uint32_t first, n;
+
+        if (!i || (recs[i - 1].flags & INSN_BYTES) ||
+            (prev_flow & (FLOW_BRANCH | FLOW_RETURN | FLOW_STOP)))
+                return 1;
+        n = find_xrefs(img, recs[i].addr, &first);
+        for (uint32_t x = first; x < first + n; x++)
+                if (xrefs[x].flow & (FLOW_BRANCH | FLOW_CALL))
+                        return 1;
+        return 0;
+}
+
+/*
+ * The one pass: instruction, block, and function totals.
+ */
+static int
+aggregate(profile *p, arena *scratch)
+{
+        const image *img = p->img;
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        hot_block *b = NULL;
+        uint8_t flow = 0;
+        uint32_t f = 0;
+
+        if (find_functions(img, scratch, &p->funcs, &p->nfuncs) < 0)
+                return -1;
+        p->insn_hits = arena_alloc(scratch,
+                                   ninsns * sizeof(*p->insn_hits));
+        p->block_of = arena_alloc(scratch, ninsns * sizeof(*p->block_of));
+        p->blocks = arena_alloc(scratch, ninsns * sizeof(*p->blocks));
+        p->func_hits = arena_alloc(scratch,
+                                   p->nfuncs * sizeof(*p->func_hits));
+        if (!p->insn_hits || !p->block_of || !p->blocks || !p->func_hits)
+                return -1;
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                const insn_rec *rec = &recs[i];
+                uint64_t hits = 0;
+                insn insn;
+
+                for (uint32_t a = rec->addr; a < rec->addr + rec->len; a++)
+                        hits += p->hits[a];
+                p->insn_hits[i] = hits;
+                p->total += hits;
+                if (hits > p->hottest)
+                        p->hottest = hits;
+
+                while (f < p->nfuncs && p->funcs[f].end <= rec->addr)
+                        f++;
+                if (f < p->nfuncs && p->funcs[f].start <= rec->addr)
+                        p->func_hits[f] += hits;
+
+                if (rec->flags & INSN_BYTES) {
+                        p->block_of[i] = -1;
+                        b = NULL;
+                        continue;
+                }
+                if (!b || starts_block(img, i, flow)) {
+                        b = &p->blocks[p->nblocks++];
+                        b->first = i;
+                }
+                b->last = i;
+                b->hits += hits;
+                p->block_of[i] = b - p->blocks;
+
+                rec_to_insn(rec, &insn);
+                flow = insn_flow(&insn);
+        }
+        return 0;
+}
+
+static double
+percent(const profile * const p, uint64_t hits)
+{
+        return p->total ? 100.0 * hits / p->total : 0.0;
+}
+
+static void
+print_note(char *note, size_t size, const profile * const p, uint32_t i,
+           const insn * const insn)
+{
+        uint64_t hits = p->insn_hits[i];
+        int heat = (hits * HEAT_WIDTH + p->hottest - 1) / p->hottest;
+        int n;
+
+        n = snprintf(note, size, "%" PRIu64 " %.2f%% %.*s", hits,
+                     percent(p, hits), heat, "########");
+        if (p->taken && (insn_flow(insn) & FLOW_COND) && n > 0 &&
+            (size_t)n < size)
+                snprintf(note + n, size - n, ", taken %" PRIu64,
+                         p->taken[insn->pos]);
+}
+
+static void
+print_block(FILE *out, const profile * const p, const hot_block * const b,
+            const char * const prefix)
+{
+        const image *img = p->img;
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        const insn_rec *last = &recs[b->last];
+        uint32_t start = recs[b->first].addr;
+        const symbol *sym = nearest_symbol(img, start);
+
+        fprintf(out, "%sblock 0x%05x-0x%05x", prefix, start,
+                last->addr + last->len);
+        if (sym)
+                fprintf(out, " (%s+0x%x)", image_str(img, sym->name),
+                        start - sym->addr);
+        fprintf(out, ": %" PRIu64 " samples, %.2f%%\n", b->hits,
+                percent(p, b->hits));
+}
+
+/*
+ * What print_listing_notes() puts above and after record i: function and
+ * block totals before its labels, and its own count in the note.
+ */
+static void
+annotate(FILE *out, void *data, uint32_t i, const insn * const insn,
+         char *note, size_t size)
+{
+        profile *p = data;
+        const image *img = p->img;
+        uint32_t addr = insn->pos;
+        int32_t b = p->block_of[i];
+
+        while (p->f < p->nfuncs && p->funcs[p->f].start < addr)
+                p->f++;
+        if (p->f < p->nfuncs && p->funcs[p->f].start == addr &&
+            p->func_hits[p->f]) {
+                char buf[16];
+                uint64_t hits = p->func_hits[p->f];
+
+                fprintf(out, "; function %s: %" PRIu64
+                        " samples, %.2f%%\n",
+                        function_name(img, &p->funcs[p->f], buf,
+                                      sizeof(buf)),
+                        hits, percent(p, hits));
+        }
+        if (b >= 0 && p->blocks[b].first == i && p->blocks[b].hits)
+                print_block(out, p, &p->blocks[b], "; ");
+
+        if (p->insn_hits[i])
+                print_note(note, size, p, i, insn);
+}
+
+static int
+cmp_hot(const void *a, const void *b)
+{
+        const hot_block *ba = *(const hot_block * const *)a;
+        const hot_block *bb = *(const hot_block * const *)b;
+
+        if (ba->hits != bb->hits)
+                return ba->hits > bb->hits ? -1 : 1;
+        return ba->first < bb->first ? -1 : ba->first > bb->first;
+}
+
+static int
+print_hottest(FILE *out, const profile * const p, arena *scratch,
+              uint32_t top)
+{
+        const hot_block **order;
+
+        order = arena_alloc(scratch, p->nblocks * sizeof(*order));
+        if (!order)
+                return -1;
+        for (uint32_t b = 0; b < p->nblocks; b++)
+                order[b] = &p->blocks[b];
+        qsort(order, p->nblocks, sizeof(*order), cmp_hot);
+
+        fprintf(out, "; %" PRIu64 " samples", p->total);
+        if (p->outside)
+                fprintf(out, ", and %" PRIu64 " outside the image",
+                        p->outside);
+        fprintf(out, "\n; hottest blocks:\n");
+        for (uint32_t b = 0; b < p->nblocks && b < top; b++) {
+                if (!order[b]->hits)
+                        break;
+                print_block(out, p, order[b], ";   ");
+        }
+        return 0;
+}
+
+int
+print_profile(FILE *out, image *img, FILE *in,
+              const char * const path, uint32_t top)
+{
+        arena scratch = { NULL, };
+        profile p = { img, };
+        int rc = -1;
+
+        p.hits = arena_alloc(&scratch, (img->size ? img->size : 1) *
+                                       sizeof(*p.hits));
+        if (!p.hits || load_histogram(&p, &scratch, in, path) < 0 ||
+            aggregate(&p, &scratch) < 0)
+                goto out;
+
+        print_listing_notes(out, img, annotate, &p);
+        rc = print_hottest(out, &p, &scratch, top);
+out:
+        arena_free(&scratch);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
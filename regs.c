@@ -0,0 +1,273 @@
+/*
+ * regs.c - names for the on-chip module registers
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The SIM, GPT, QSM, ADC and the rest of the modules are all mapped into
+ * one 4 KiB window at the top of bank 0xf (or bank 7, with the SIM's MM
+ * bit clear).  A register map names the registers in it, and gets turned
+ * into a table with a name for every byte of the window, so naming an
+ * operand is a subtraction, a compare, and a load.
+ *
+ * A map file has one register per line:
+ *
+ *      ADDR NAME
+ *
+ * with ADDR as a 20-bit hex address; lines starting with '#' are
+ * comments.  Registers are words unless the byte after them has a name
+ * of its own, and the second byte of a word is listed as NAME+1.  Every
+ * register in a map has to be in the same window.
+ *
+ * 16-bit addresses are taken to be in the window's bank, since that's
+ * what EK is set to everywhere the registers get touched.
+ */
+#define REG_WINDOW      0x1000
+#define REG_NAME_MAX    24
+
+typedef struct reg_def_s {
+        uint32_t addr;
+        const char *name;
+} reg_def;
+
+/* MC68HC16Z1: SIM, SRAM, ADC, GPT and QSM */
+static const reg_def hc16z1[] = {
+        { 0xff700, "ADCMCR" }, { 0xff702, "ADTEST" },
+        { 0xff706, "PORTADA" }, { 0xff70a, "ADCTL0" },
+        { 0xff70c, "ADCTL1" }, { 0xff70e, "ADSTAT" },
+        { 0xff710, "RJURR0" }, { 0xff712, "RJURR1" },
+        { 0xff714, "RJURR2" }, { 0xff716, "RJURR3" },
+        { 0xff718, "RJURR4" }, { 0xff71a, "RJURR5" },
+        { 0xff71c, "RJURR6" }, { 0xff71e, "RJURR7" },
+        { 0xff720, "RJSRR0" }, { 0xff722, "RJSRR1" },
+        { 0xff724, "RJSRR2" }, { 0xff726, "RJSRR3" },
+        { 0xff728, "RJSRR4" }, { 0xff72a, "RJSRR5" },
+        { 0xff72c, "RJSRR6" }, { 0xff72e, "RJSRR7" },
+        { 0xff730, "LJURR0" }, { 0xff732, "LJURR1" },
+        { 0xff734, "LJURR2" }, { 0xff736, "LJURR3" },
+        { 0xff738, "LJURR4" }, { 0xff73a, "LJURR5" },
+        { 0xff73c, "LJURR6" }, { 0xff73e, "LJURR7" },
+
+        { 0xff900, "GPTMCR" }, { 0xff902, "GPTMTR" }, { 0xff904, "ICR" },
+        { 0xff906, "DDRGP" }, { 0xff907, "PORTGP" },
+        { 0xff908, "OC1M" }, { 0xff909, "OC1D" }, { 0xff90a, "TCNT" },
+        { 0xff90c, "PACTL" }, { 0xff90d, "PACNT" },
+        { 0xff90e, "TIC1" }, { 0xff910, "TIC2" }, { 0xff912, "TIC3" },
+        { 0xff914, "TOC1" }, { 0xff916, "TOC2" }, { 0xff918, "TOC3" },
+        { 0xff91a, "TOC4" }, { 0xff91c, "TI4O5" },
+        { 0xff91e, "TCTL1" }, { 0xff91f, "TCTL2" },
+        { 0xff920, "TMSK1" }, { 0xff921, "TMSK2" },
+        { 0xff922, "TFLG1" }, { 0xff923, "TFLG2" },
+        { 0xff924, "CFORC" }, { 0xff925, "PWMC" },
+        { 0xff926, "PWMA" }, { 0xff927, "PWMB" },
+        { 0xff928, "PWMCNT" }, { 0xff92a, "PWMBUFA" },
+        { 0xff92b, "PWMBUFB" }, { 0xff92c, "PRESCL" },
+
+        { 0xffa00, "SIMCR" }, { 0xffa02, "SIMTR" }, { 0xffa04, "SYNCR" },
+        { 0xffa07, "RSR" }, { 0xffa08, "SIMTRE" },
+        { 0xffa11, "PORTE0" }, { 0xffa13, "PORTE1" }, { 0xffa15, "DDRE" },
+        { 0xffa17, "PEPAR" }, { 0xffa19, "PORTF0" }, { 0xffa1b, "PORTF1" },
+        { 0xffa1d, "DDRF" }, { 0xffa1f, "PFPAR" },
+        { 0xffa21, "SYPCR" }, { 0xffa22, "PICR" }, { 0xffa24, "PITR" },
+        { 0xffa27, "SWSR" },
+        { 0xffa30, "TSTMSRA" }, { 0xffa32, "TSTMSRB" },
+        { 0xffa34, "TSTSC" }, { 0xffa36, "TSTRC" },
+        { 0xffa38, "CREG" }, { 0xffa3a, "DREG" },
+        { 0xffa41, "PORTC" }, { 0xffa44, "CSPAR0" }, { 0xffa46, "CSPAR1" },
+        { 0xffa48, "CSBARBT" }, { 0xffa4a, "CSORBT" },
+        { 0xffa4c, "CSBAR0" }, { 0xffa4e, "CSOR0" },
+        { 0xffa50, "CSBAR1" }, { 0xffa52, "CSOR1" },
+        { 0xffa54, "CSBAR2" }, { 0xffa56, "CSOR2" },
+        { 0xffa58, "CSBAR3" }, { 0xffa5a, "CSOR3" },
+        { 0xffa5c, "CSBAR4" }, { 0xffa5e, "CSOR4" },
+        { 0xffa60, "CSBAR5" }, { 0xffa62, "CSOR5" },
+        { 0xffa64, "CSBAR6" }, { 0xffa66, "CSOR6" },
+        { 0xffa68, "CSBAR7" }, { 0xffa6a, "CSOR7" },
+        { 0xffa6c, "CSBAR8" }, { 0xffa6e, "CSOR8" },
+        { 0xffa70, "CSBAR9" }, { 0xffa72, "CSOR9" },
+        { 0xffa74, "CSBAR10" }, { 0xffa76, "CSOR10" },
+
+        { 0xffb00, "RAMMCR" }, { 0xffb02, "RAMTST" },
+        { 0xffb04, "RAMBAH" }, { 0xffb06, "RAMBAL" },
+
+        { 0xffc00, "QSMCR" }, { 0xffc02, "QTEST" },
+        { 0xffc04, "QILR" }, { 0xffc05, "QIVR" },
+        { 0xffc08, "SCCR0" }, { 0xffc0a, "SCCR1" }, { 0xffc0c, "SCSR" },
+        { 0xffc0e, "SCDR" }, { 0xffc15, "PORTQS" },
+        { 0xffc16, "PQSPAR" }, { 0xffc17, "DDRQS" },
+        { 0xffc18, "SPCR0" }, { 0xffc1a, "SPCR1" }, { 0xffc1c, "SPCR2" },
+        { 0xffc1e, "SPCR3" }, { 0xffc1f, "SPSR" },
+        { 0, NULL }
+};
+
+/* MC68HC16Z2 and Z3: the Z1's modules, plus the masked ROM */
+static const reg_def hc16z2_mrm[] = {
+        { 0xff820, "MRMCR" }, { 0xff824, "ROMBAH" }, { 0xff826, "ROMBAL" },
+        { 0xff828, "SIGHI" }, { 0xff82a, "SIGLO" },
+        { 0xff830, "ROMBS0" }, { 0xff832, "ROMBS1" },
+        { 0xff834, "ROMBS2" }, { 0xff836, "ROMBS3" },
+        { 0, NULL }
+};
+
+static const struct {
+        const char *part;
+        const reg_def *defs[2];
+} builtin_maps[] = {
+        { "hc16z1", { hc16z1, NULL } },
+        { "hc16z2", { hc16z1, hc16z2_mrm } },
+        { "hc16z3", { hc16z1, hc16z2_mrm } },
+        { NULL, }
+};
+
+static const char *reg_names[REG_WINDOW];
+static uint32_t reg_base = 0;
+static int have_map = 0;
+
+static int
+add_reg(uint32_t addr, const char * const name)
+{
+        if (addr > 0xfffff ||
+            (have_map && (addr & ~(REG_WINDOW - 1)) != reg_base))
+                return -1;
+        if (!have_map) {
+                reg_base = addr & ~(REG_WINDOW - 1);
+                have_map = 1;
+        }
+        reg_names[addr - reg_base] = name;
+        return 0;
+}
+
+/*
+ * Every word register's second byte gets "NAME+1".
+ */
+static int
+fill_words(void)
+{
+        for (uint32_t a = 0; a < REG_WINDOW; a += 2) {
+                char *name;
+                size_t len;
+
+                if (!reg_names[a] || reg_names[a + 1])
+                        continue;
+                len = strlen(reg_names[a]) + 3;
+                name = malloc(len);
+                if (!name)
+                        return -1;
+                snprintf(name, len, "%s+1", reg_names[a]);
+                reg_names[a + 1] = name;
+        }
+        return 0;
+}
+
+static int
+valid_name(const char * const name)
+{
+        size_t len = strlen(name);
+
+        if (!len || len > REG_NAME_MAX || isdigit((unsigned char)name[0]))
+                return 0;
+        for (size_t i = 0; i < len; i++)
+                if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+                        return 0;
+        return 1;
+}
+
+static int
+load_map_file(const char * const path)
+{
+        FILE *f = fopen(path, "r");
+        char *line = NULL;
+        size_t size = 0, lineno = 0;
+        ssize_t len;
+        int rc = 0;
+
+        if (!f)
+                return -1;
+        while (rc == 0 && (len = getline(&line, &size, f)) >= 0) {
+                char *addr, *name, *end, *save = NULL;
+                unsigned long value;
+
+                lineno++;
+                addr = strtok_r(line, " \t\r\n", &save);
+                if (!addr || addr[0] == '#')
+                        continue;
+                name = strtok_r(NULL, " \t\r\n", &save);
+
+                errno = 0;
+                value = strtoul(addr, &end, 16);
+                if (errno || *end || !name || !valid_name(name) ||
+                    strtok_r(NULL, " \t\r\n", &save) ||
+                    !(name = strdup(name)) || add_reg(value, name) < 0) {
+                        warnx("%s:%zu: invalid register", path, lineno);
+                        errno = EINVAL;
+                        rc = -1;
+                }
+        }
+        if (rc == 0 && ferror(f))
+                rc = -1;
+        free(line);
+        fclose(f);
+        return rc;
+}
+
+/*
+ * Load one of the built-in maps by part name, or else a map file.
+ */
+int
+load_regmap(const char * const name)
+{
+        int rc = 0;
+
+        if (have_map) {
+                warnx("only one register map can be used");
+                errno = EINVAL;
+                return -1;
+        }
+        for (int i = 0; builtin_maps[i].part; i++) {
+                if (strcmp(name, builtin_maps[i].part))
+                        continue;
+                for (int j = 0; j < 2 && builtin_maps[i].defs[j]; j++) {
+                        const reg_def *d = builtin_maps[i].defs[j];
+
+                        for (; d->name && rc == 0; d++)
+                                rc = add_reg(d->addr, d->name);
+                }
+                return rc < 0 ? rc : fill_words();
+        }
+        if (load_map_file(name) < 0)
+                return -1;
+        return fill_words();
+}
+
+/*
+ * The register at a 20-bit address, or NULL.
+ */
+const char *
+reg_name(uint32_t addr)
+{
+        addr -= reg_base;
+        return addr < REG_WINDOW ? reg_names[addr] : NULL;
+}
+
+/*
+ * The same, for a 16-bit address used with EK pointing at the registers.
+ */
+const char *
+reg_name16(uint16_t addr)
+{
+        return reg_name((reg_base & 0xf0000) | addr);
+}
+
+// vim:fenc=utf-8:tw=75:et
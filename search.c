@@ -0,0 +1,581 @@
+/*
+ * search.c - find instruction patterns in analyzed images
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A pattern is a run of instructions, separated by ';', optionally named:
+ *
+ *      [NAME=]INSN; INSN; ...
+ *
+ * where INSN is '*' for any instruction, or a mnemonic, optionally
+ * followed by '.' and the addressing mode, and then any operands, in
+ * listing order and separated by ','.  An operand is '*', a value, or
+ * value/mask; a missing one matches anything.  Mnemonics and modes may
+ * end in '*' to match anything that starts the same way:
+ *
+ *      clear=clrd; std.ind8*; rts
+ *      bit=brclr.ind16* 0x80/0x80, *, *
+ *
+ * Which instruction it is (its page and opcode, or .byte) is all the
+ * automaton sees.  All the patterns are compiled into one DFA over those,
+ * which is Aho-Corasick with each step of a pattern allowed to be a set
+ * of opcodes.  Opcodes no step tells apart share an input class, so the
+ * transition table stays small.  Operands are only checked once the
+ * automaton says the opcodes match.
+ */
+#define NR_SYMS         (4 * 0x100 + 1)
+#define SYM_BYTES       (4 * 0x100)
+#define MAX_STEPS       64
+#define MAX_STATES      (1u << 16)
+
+static const char * const mode_names[] = {
+        [ind8x] = "ind8x", [ind8y] = "ind8y", [ind8z] = "ind8z",
+        [ind16x] = "ind16x", [ind16y] = "ind16y", [ind16z] = "ind16z",
+        [ixp2ext] = "ixp2ext", [ext2ixp] = "ext2ixp",
+        [inh] = "inh",
+        [rel8] = "rel8", [rel16] = "rel16",
+        [imm8] = "imm8", [imm16] = "imm16",
+        [ind20x] = "ind20x", [ind20y] = "ind20y", [ind20z] = "ind20z",
+        [ext] = "ext", [ext20] = "ext20",
+        [ex] = "ex", [ey] = "ey", [ez] = "ez",
+        [ext2ext] = "ext2ext",
+};
+
+typedef struct arg_match_s {
+        uint32_t value;
+        uint32_t mask;          // 0 matches anything
+} arg_match;
+
+typedef struct step_s {
+        uint8_t syms[NR_SYMS];
+        uint8_t nargs;
+        arg_match args[4];
+} step;
+
+typedef struct pattern_s {
+        char *name;
+        uint32_t first;         // in steps[]
+        uint32_t len;
+} pattern;
+
+static step *steps = NULL;
+static uint32_t nsteps = 0;
+static pattern *patterns = NULL;
+static uint32_t npatterns = 0;
+static int compiled = 0;
+
+/*
+ * The compiled automaton.  State 0 is the start; delta is indexed by
+ * state * nclasses + class, and accepts[accept_first[s]] up to
+ * accept_first[s + 1] are the patterns that end in state s.  Once it's
+ * built, delta holds the next state already multiplied by nclasses, with
+ * STATE_ACCEPTS set if any pattern ends there, so a step is one lookup.
+ */
+#define STATE_ACCEPTS   0x80000000u
+static uint16_t classes[NR_SYMS];
+static uint32_t nclasses;
+static uint32_t *delta = NULL;
+static uint32_t *accept_first = NULL;
+static uint32_t *accepts = NULL;
+static uint32_t nstates;
+
+static int
+glob_match(const char *glob, size_t len, const char *s)
+{
+        if (len && glob[len - 1] == '*')
+                return !strncmp(glob, s, len - 1);
+        return strlen(s) == len && !strncmp(glob, s, len);
+}
+
+static int
+mode_match(const char *glob, size_t len, unsigned int mode)
+{
+        if (!glob)
+                return 1;
+        if (mode >= sizeof(mode_names) / sizeof(mode_names[0]) ||
+            !mode_names[mode])
+                return 0;
+        return glob_match(glob, len, mode_names[mode]);
+}
+
+static int
+parse_arg(const char *s, const char *end, arg_match *arg)
+{
+        char *p;
+
+        while (s < end && isspace((unsigned char)*s))
+                s++;
+        while (end > s && isspace((unsigned char)end[-1]))
+                end--;
+        if (end - s == 1 && *s == '*') {
+                arg->mask = 0;
+                return 0;
+        }
+        if (s < end && *s == '#')
+                s++;
+
+        errno = 0;
+        arg->value = strtoll(s, &p, 0);
+        arg->mask = 0xffffffff;
+        if (!errno && p < end && *p == '/')
+                arg->mask = strtoull(p + 1, &p, 0);
+        if (errno || p != end || s == end)
+                return -1;
+        return 0;
+}
+
+static int
+parse_step(const char *s, const char *end, step *st)
+{
+        const char *name, *mode = NULL, *args;
+        size_t namelen, modelen = 0;
+        int n = 0;
+
+        memset(st, 0, sizeof(*st));
+        while (s < end && isspace((unsigned char)*s))
+                s++;
+        name = s;
+        while (s < end && !isspace((unsigned char)*s) && *s != '.')
+                s++;
+        namelen = s - name;
+        if (s < end && *s == '.') {
+                mode = ++s;
+                while (s < end && !isspace((unsigned char)*s))
+                        s++;
+                modelen = s - mode;
+        }
+        if (!namelen)
+                return -1;
+
+        for (int page = 0; page < 4; page++) {
+                for (int opcode = 0; opcode < 0x100; opcode++) {
+                        const packed_op *packed =
+                                &packed_opcodes[page][opcode];
+
+                        if (!packed_is_defined(*packed) ||
+                            !glob_match(name, namelen,
+                                        packed_mnemonic(*packed)) ||
+                            !mode_match(mode, modelen, packed->mode))
+                                continue;
+                        st->syms[page << 8 | opcode] = 1;
+                        n++;
+                }
+        }
+        if (!n)
+                return -1;
+
+        for (args = s; args < end; args = s + 1) {
+                for (s = args; s < end && *s != ','; s++)
+                        ;
+                if (st->nargs == 4 ||
+                    parse_arg(args, s, &st->args[st->nargs++]) < 0)
+                        return -1;
+        }
+        return 0;
+}
+
+/*
+ * Add a pattern; they're all compiled the next time compile_patterns()
+ * is called.
+ */
+int
+add_pattern(const char * const text)
+{
+        const char *s = text, *eq = strchr(text, '=');
+        pattern *newp;
+        step *news;
+        uint32_t first = nsteps;
+
+        newp = reallocarray(patterns, npatterns + 1, sizeof(*newp));
+        if (!newp)
+                return -1;
+        patterns = newp;
+
+        if (eq) {
+                for (s = text; s < eq; s++)
+                        if (!isalnum((unsigned char)*s) && *s != '_' &&
+                            *s != '.')
+                                break;
+                if (s < eq || eq == text)
+                        eq = NULL;
+                s = eq ? eq + 1 : text;
+        }
+
+        while (*s) {
+                const char *end = strchr(s, ';');
+
+                if (!end)
+                        end = s + strlen(s);
+                if (nsteps - first == MAX_STEPS) {
+                        warnx("\"%s\" is too long", text);
+                        goto fail;
+                }
+                news = reallocarray(steps, nsteps + 1, sizeof(*news));
+                if (!news)
+                        goto fail;
+                steps = news;
+                if (parse_step(s, end, &steps[nsteps]) < 0) {
+                        warnx("\"%.*s\" does not match any instruction",
+                              (int)(end - s), s);
+                        goto fail;
+                }
+                nsteps++;
+                s = *end ? end + 1 : end;
+        }
+        if (nsteps == first) {
+                warnx("\"%s\" is empty", text);
+                goto fail;
+        }
+
+        patterns[npatterns].name = eq ? strndup(text, eq - text)
+                                      : strdup(text);
+        if (!patterns[npatterns].name)
+                goto fail;
+        patterns[npatterns].first = first;
+        patterns[npatterns].len = nsteps - first;
+        npatterns++;
+        compiled = 0;
+        return 0;
+fail:
+        nsteps = first;
+        return -1;
+}
+
+/*
+ * One pattern per line; blank lines and lines starting with '#' are
+ * skipped.
+ */
+int
+load_patterns(const char * const path)
+{
+        FILE *f = fopen(path, "r");
+        char *line = NULL;
+        size_t size = 0;
+        ssize_t len;
+        int rc = 0;
+
+        if (!f)
+                return -1;
+        while (rc == 0 && (len = getline(&line, &size, f)) >= 0) {
+                while (len && isspace((unsigned char)line[len - 1]))
+                        line[--len] = '\0';
+                if (len && line[0] != '#')
+                        rc = add_pattern(line);
+        }
+        free(line);
+        fclose(f);
+        return rc;
+}
+
+/*
+ * Split the symbols into classes no step tells apart.
+ */
+static void
+find_classes(void)
+{
+        uint16_t remap[2 * NR_SYMS];
+
+        memset(classes, 0, sizeof(classes));
+        nclasses = 1;
+        for (uint32_t i = 0; i < nsteps; i++) {
+                uint32_t n = 0;
+
+                memset(remap, 0xff, 2 * nclasses * sizeof(remap[0]));
+                for (int s = 0; s < NR_SYMS; s++) {
+                        uint32_t key = classes[s] * 2 + steps[i].syms[s];
+
+                        if (remap[key] == 0xffff)
+                                remap[key] = n++;
+                        classes[s] = remap[key];
+                }
+                nclasses = n;
+        }
+}
+
+/*
+ * A DFA state is the set of positions it stands for, where position
+ * first + j means a pattern's steps up to j have matched.  Sets are kept
+ * sorted in pool[] and found again through a hash table.
+ */
+typedef struct builder_s {
+        uint32_t *pool;
+        size_t npool, poolsize;
+        uint32_t *set_first;    // by state, into pool, plus one past
+        uint32_t *hash;         // state + 1, 0 if empty
+        uint32_t hashsize;
+        uint16_t *rep;          // a symbol in each class
+} builder;
+
+static uint32_t
+hash_set(const uint32_t *set, uint32_t n)
+{
+        uint32_t h = 2166136261u;
+
+        for (uint32_t i = 0; i < n; i++)
+                h = (h ^ set[i]) * 16777619u;
+        return h;
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+        uint32_t ua = *(const uint32_t *)a, ub = *(const uint32_t *)b;
+
+        return ua < ub ? -1 : ua > ub;
+}
+
+static int64_t
+find_state(builder *b, uint32_t *set, uint32_t n)
+{
+        uint32_t h = hash_set(set, n) & (b->hashsize - 1);
+        uint32_t *p;
+
+        for (;; h = (h + 1) & (b->hashsize - 1)) {
+                uint32_t s = b->hash[h];
+
+                if (!s)
+                        break;
+                s--;
+                if (b->set_first[s + 1] - b->set_first[s] == n &&
+                    (!n || !memcmp(b->pool + b->set_first[s], set,
+                                   n * sizeof(*set))))
+                        return s;
+        }
+
+        if (nstates == MAX_STATES) {
+                warnx("patterns are too general to compile");
+                return -1;
+        }
+        if (b->npool + n > b->poolsize) {
+                size_t size = (b->poolsize + n) * 2;
+
+                p = reallocarray(b->pool, size, sizeof(*p));
+                if (!p)
+                        return -1;
+                b->pool = p;
+                b->poolsize = size;
+        }
+        p = reallocarray(b->set_first, nstates + 2, sizeof(*p));
+        if (!p)
+                return -1;
+        b->set_first = p;
+        if (n)
+                memcpy(b->pool + b->npool, set, n * sizeof(*set));
+        b->npool += n;
+        b->set_first[nstates + 1] = b->npool;
+        b->hash[h] = nstates + 1;
+        return nstates++;
+}
+
+static int
+build_dfa(builder *b)
+{
+        uint32_t *set = NULL, *pat = NULL, *p;
+        uint32_t npositions = nsteps;
+        uint32_t naccepts = 0;
+        int rc = -1;
+
+        set = calloc(npositions + npatterns + 1, sizeof(*set));
+        pat = calloc(npositions, sizeof(*pat));
+        if (!set || !pat)
+                goto out;
+        for (uint32_t i = 0; i < npatterns; i++)
+                for (uint32_t j = 0; j < patterns[i].len; j++)
+                        pat[patterns[i].first + j] = i;
+
+        b->set_first[0] = 0;
+        if (find_state(b, set, 0) < 0)
+                goto out;
+
+        for (uint32_t q = 0; q < nstates; q++) {
+                p = reallocarray(delta, (size_t)(q + 1) * nclasses,
+                                 sizeof(*delta));
+                if (!p)
+                        goto out;
+                delta = p;
+
+                for (uint32_t c = 0; c < nclasses; c++) {
+                        uint16_t sym = b->rep[c];
+                        uint32_t n = 0;
+                        int64_t to;
+
+                        for (uint32_t i = 0; i < npatterns; i++)
+                                if (steps[patterns[i].first].syms[sym])
+                                        set[n++] = patterns[i].first;
+                        for (uint32_t k = b->set_first[q];
+                             k < b->set_first[q + 1]; k++) {
+                                uint32_t pos = b->pool[k];
+                                const pattern *pt = &patterns[pat[pos]];
+
+                                if (pos + 1 < pt->first + pt->len &&
+                                    steps[pos + 1].syms[sym])
+                                        set[n++] = pos + 1;
+                        }
+                        qsort(set, n, sizeof(*set), cmp_u32);
+                        if ((to = find_state(b, set, n)) < 0)
+                                goto out;
+                        delta[(size_t)q * nclasses + c] = to;
+                }
+        }
+
+        accept_first = calloc(nstates + 1, sizeof(*accept_first));
+        if (!accept_first)
+                goto out;
+        for (uint32_t q = 0; q < nstates; q++) {
+                accept_first[q] = naccepts;
+                for (uint32_t k = b->set_first[q]; k < b->set_first[q + 1];
+                     k++) {
+                        const pattern *pt = &patterns[pat[b->pool[k]]];
+
+                        if (b->pool[k] != pt->first + pt->len - 1)
+                                continue;
+                        p = reallocarray(accepts, naccepts + 1,
+                                         sizeof(*accepts));
+                        if (!p)
+                                goto out;
+                        accepts = p;
+                        accepts[naccepts++] = pat[b->pool[k]];
+                }
+        }
+        accept_first[nstates] = naccepts;
+
+        for (size_t i = 0; i < (size_t)nstates * nclasses; i++) {
+                uint32_t to = delta[i];
+
+                delta[i] = to * nclasses;
+                if (accept_first[to] != accept_first[to + 1])
+                        delta[i] |= STATE_ACCEPTS;
+        }
+        rc = 0;
+out:
+        free(set);
+        free(pat);
+        return rc;
+}
+
+/*
+ * Build the automaton for every pattern added so far, if it isn't
+ * already.  Searching only reads it, so images can be searched in
+ * parallel once this is done.
+ */
+int
+compile_patterns(void)
+{
+        uint16_t rep[NR_SYMS];
+        builder b = { NULL, };
+        int rc;
+
+        if (compiled)
+                return 0;
+
+        free(delta);
+        free(accept_first);
+        free(accepts);
+        delta = NULL;
+        accept_first = accepts = NULL;
+        nstates = 0;
+
+        find_classes();
+        for (int s = NR_SYMS - 1; s >= 0; s--)
+                rep[classes[s]] = s;
+
+        b.rep = rep;
+        b.hashsize = MAX_STATES * 2;
+        b.hash = calloc(b.hashsize, sizeof(*b.hash));
+        b.set_first = calloc(1, sizeof(*b.set_first));
+        rc = b.hash && b.set_first ? build_dfa(&b) : -1;
+        free(b.hash);
+        free(b.set_first);
+        free(b.pool);
+
+        compiled = rc == 0;
+        return rc;
+}
+
+int
+have_patterns(void)
+{
+        return npatterns > 0;
+}
+
+static int
+args_match(const step * const st, const insn_rec * const rec)
+{
+        const shape *shape;
+        insn insn;
+
+        if (!st->nargs)
+                return 1;
+        rec_to_insn(rec, &insn);
+        shape = &shapes[insn.packed.shape];
+        for (int i = 0; i < st->nargs; i++) {
+                const shape_arg *arg;
+
+                if (!st->args[i].mask)
+                        continue;
+                if (i >= shape->nargs)
+                        return 0;
+                arg = &shape->args[arg_order(insn.packed.mode, shape, i)];
+                if (((uint32_t)arg_value(shape, arg, &insn) ^
+                     st->args[i].value) & st->args[i].mask)
+                        return 0;
+        }
+        return 1;
+}
+
+/*
+ * Print where each pattern matches in img, one line per match.
+ */
+int
+search_image(FILE *out, const image * const img)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        uint32_t row = 0, state;
+
+        if (!compiled)
+                return -1;
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                const insn_rec *rec = &recs[i];
+                uint32_t sym = rec->flags & INSN_BYTES ? SYM_BYTES :
+                               ((rec->prefix >> 4) & 3) << 8 | rec->opcode;
+
+                row = delta[(row & ~STATE_ACCEPTS) + classes[sym]];
+                if (!(row & STATE_ACCEPTS))
+                        continue;
+
+                state = (row & ~STATE_ACCEPTS) / nclasses;
+                for (uint32_t a = accept_first[state];
+                     a < accept_first[state + 1]; a++) {
+                        const pattern *pt = &patterns[accepts[a]];
+                        uint32_t start = i + 1 - pt->len;
+                        uint32_t j;
+
+                        for (j = 0; j < pt->len; j++)
+                                if (!args_match(&steps[pt->first + j],
+                                                &recs[start + j]))
+                                        break;
+                        if (j == pt->len)
+                                fprintf(out, "%s: 0x%05x: %s\n",
+                                        img->filename, recs[start].addr,
+                                        pt->name);
+                }
+        }
+        return 0;
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,642 @@
+/*
+ * server.c - answer queries about resident images over a Unix socket
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The images to serve are loaded up front, from the command line, so a
+ * client can only ever look at those, and nothing it asks for has to
+ * wait on a load.
+ *
+ * Requests and replies are both a 4-byte big-endian length followed by
+ * that much text.  A request is any number of queries, one per line:
+ *
+ *   image FILE            make FILE, one of the served images, current
+ *   decode ADDR [COUNT]   list COUNT instructions, from the one at ADDR
+ *   xrefs ADDR            who branches to or calls ADDR
+ *   symbol NAME           where NAME is
+ *   addr ADDR             which symbol ADDR is in
+ *   cfg ADDR              basic blocks of the function at ADDR
+ *
+ * The reply has each query's answer in order, each ending with a line
+ * holding just ".".  Errors are a line starting with "!".  A reply is
+ * never more than MAX_FRAME bytes; the first answer that won't fit is
+ * replaced with an error saying so, and the queries after it aren't run.
+ *
+ * Clients are non-blocking, and a client's reply waits in its out buffer
+ * until poll() says it can take more, so one that stops reading only
+ * holds itself up.  Nothing more is read from a client while it has a
+ * reply waiting.
+ */
+#define MAX_FRAME       (1 << 20)
+#define MAX_CLIENTS     64
+#define MAX_DECODE      4096
+
+typedef struct resident_s {
+        char *filename;
+        uint8_t *buf;
+        image img;
+        struct resident_s *next;
+} resident;
+
+typedef struct client_s {
+        int fd;
+        uint8_t *buf;           // requests read so far
+        size_t len;
+        uint8_t *out;           // the reply being sent
+        size_t outlen;
+        size_t sent;
+        resident *current;
+} client;
+
+static resident *residents;
+
+/* for whatever a query needs while it runs; reset after every request */
+static arena scratch;
+
+static resident *
+find_resident(const char * const filename)
+{
+        for (resident *r = residents; r; r = r->next)
+                if (!strcmp(r->filename, filename))
+                        return r;
+        return NULL;
+}
+
+static int
+load_resident(const char * const filename, const char * const dbpath)
+{
+        resident *r;
+        size_t size;
+        int rc;
+
+        if (find_resident(filename))
+                return 0;
+
+        r = calloc(1, sizeof(*r));
+        if (!r || !(r->filename = strdup(filename))) {
+                free(r);
+                return -1;
+        }
+
+        rc = read_image(filename, &r->buf, &size);
+        if (rc) {
+                warn("Could not read \"%s\"", filename);
+                goto err;
+        }
+
+        r->img.filename = r->filename;
+        r->img.buf = r->buf;
+        r->img.size = size;
+        rc = dbpath ? db_open(&r->img, dbpath) : analyze_image(&r->img);
+        if (rc < 0) {
+                warnx("%s: could not analyze image", filename);
+                free_image(&r->img);
+                free(r->buf);
+                goto err;
+        }
+
+        r->next = residents;
+        residents = r;
+        return 0;
+err:
+        free(r->filename);
+        free(r);
+        return -1;
+}
+
+/*
+ * Load the images named on the command line: "[--db DBFILE] FILE ...".
+ */
+static int
+load_residents(int nargs, char *args[])
+{
+        const char *dbpath = NULL;
+
+        for (int i = 0; i < nargs; i++) {
+                if (!strcmp(args[i], "--db")) {
+                        if (i + 1 >= nargs) {
+                                warnx("--db needs a database file");
+                                return -1;
+                        }
+                        dbpath = args[++i];
+                        continue;
+                }
+                if (load_resident(args[i], dbpath) < 0)
+                        return -1;
+                dbpath = NULL;
+        }
+        if (!residents) {
+                warnx("No images to serve");
+                return -1;
+        }
+        return 0;
+}
+
+static int
+parse_addr(const char * const s, uint32_t *addr)
+{
+        char *end = NULL;
+        unsigned long value;
+
+        if (!s)
+                return -1;
+        errno = 0;
+        value = strtoul(s, &end, 16);
+        if (errno || end == s || *end || value > 0xfffff)
+                return -1;
+        *addr = value;
+        return 0;
+}
+
+static int
+parse_count(const char * const s, uint32_t *count)
+{
+        char *end = NULL;
+        unsigned long value;
+
+        errno = 0;
+        value = strtoul(s, &end, 10);
+        if (errno || end == s || *end || *s == '-' || value == 0 ||
+            value > MAX_DECODE)
+                return -1;
+        *count = value;
+        return 0;
+}
+
+static void
+print_symbol(FILE *out, const image * const img, uint32_t addr)
+{
+        const symbol *sym = nearest_symbol(img, addr);
+
+        if (!sym)
+                fprintf(out, "%05x\n", addr);
+        else if (sym->addr == addr)
+                fprintf(out, "%05x %s\n", addr, image_str(img, sym->name));
+        else
+                fprintf(out, "%05x %s+0x%x\n", addr,
+                        image_str(img, sym->name), addr - sym->addr);
+}
+
+static void
+query_decode(FILE *out, const image * const img, uint32_t addr,
+             uint32_t count)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t n = image_count(img, SEC_INSNS);
+        int64_t i = find_insn_containing(img, addr);
+
+        if (i < 0) {
+                fprintf(out, "! %05x is past the end of the image\n",
+                        addr);
+                return;
+        }
+
+        for (; count && i < n; count--, i++) {
+                insn insn;
+
+                rec_to_insn(&recs[i], &insn);
+                print_insn(out, img->buf, &insn);
+        }
+}
+
+static void
+query_cfg(FILE *out, const image * const img, uint32_t addr)
+{
+        block *blocks;
+        uint32_t nblocks;
+
+        if (function_blocks(img, addr, &scratch, &blocks, &nblocks) < 0) {
+                fprintf(out, "! no instruction at %05x\n", addr);
+                return;
+        }
+
+        for (uint32_t i = 0; i < nblocks; i++) {
+                fprintf(out, "%05x-%05x", blocks[i].start, blocks[i].end);
+                for (uint32_t j = 0; j < blocks[i].nsucc; j++)
+                        fprintf(out, " %05x", blocks[i].succ[j]);
+                if (blocks[i].open)
+                        fprintf(out, " ?");
+                fputc('\n', out);
+        }
+}
+
+static void
+run_query(client *c, char *line, FILE *out)
+{
+        char *words[4] = { NULL, };
+        const image *img = c->current ? &c->current->img : NULL;
+        char *save = NULL;
+        uint32_t addr, count = 1;
+        int n = 0;
+
+        for (char *w = strtok_r(line, " \t\r", &save); w && n < 4;
+             w = strtok_r(NULL, " \t\r", &save))
+                words[n++] = w;
+
+        if (n == 0) {
+                fprintf(out, "! empty query\n");
+        } else if (!strcmp(words[0], "image") && n == 2) {
+                resident *r = find_resident(words[1]);
+
+                if (r) {
+                        c->current = r;
+                        fprintf(out, "%s %zu bytes %u insns %u symbols\n",
+                                r->filename, r->img.size,
+                                image_count(&r->img, SEC_INSNS),
+                                image_count(&r->img, SEC_SYMBOLS));
+                } else {
+                        fprintf(out, "! \"%s\" is not being served\n",
+                                words[1]);
+                }
+        } else if (!img) {
+                fprintf(out, "! no image loaded\n");
+        } else if (!strcmp(words[0], "symbol") && n == 2) {
+                const symbol *sym = find_symbol_name(img, words[1]);
+
+                if (sym)
+                        fprintf(out, "%05x %s\n", sym->addr, words[1]);
+                else
+                        fprintf(out, "! no symbol \"%s\"\n", words[1]);
+        } else if (parse_addr(words[1], &addr) < 0) {
+                fprintf(out, "! bad query \"%s\"\n", words[0]);
+        } else if (!strcmp(words[0], "decode") && n <= 3) {
+                if (n == 3 && parse_count(words[2], &count) < 0)
+                        fprintf(out, "! bad count \"%s\" (1 to %d)\n",
+                                words[2], MAX_DECODE);
+                else
+                        query_decode(out, img, addr, count);
+        } else if (!strcmp(words[0], "addr") && n == 2) {
+                print_symbol(out, img, addr);
+        } else if (!strcmp(words[0], "xrefs") && n == 2) {
+                const xref *xrefs = image_section(img, SEC_XREFS, xref);
+                uint32_t first, nxrefs = find_xrefs(img, addr, &first);
+
+                for (uint32_t i = first; i < first + nxrefs; i++) {
+                        fprintf(out, "%s ", xrefs[i].flow & FLOW_CALL ?
+                                            "call" : "jump");
+                        print_symbol(out, img, xrefs[i].from);
+                }
+        } else if (!strcmp(words[0], "cfg") && n == 2) {
+                query_cfg(out, img, addr);
+        } else {
+                fprintf(out, "! bad query \"%s\"\n", words[0]);
+        }
+        fputs(".\n", out);
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+        const uint8_t *p = buf;
+
+        while (len) {
+                ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n <= 0)
+                        return -1;
+                p += n;
+                len -= n;
+        }
+        return 0;
+}
+
+static int
+send_frame(int fd, const char * const text, size_t len)
+{
+        uint8_t hdr[4] = { len >> 24, len >> 16, len >> 8, len };
+
+        if (write_all(fd, hdr, sizeof(hdr)) < 0)
+                return -1;
+        return write_all(fd, text, len);
+}
+
+/*
+ * Run one query and add its answer to the reply at c->out, if there's
+ * room.  Returns 1 if there wasn't, 0 if there was, and -1 if we ran out
+ * of memory.
+ */
+static int
+add_answer(client *c, char *line, size_t *used)
+{
+        static const char full[] = "! reply is full\n.\n";
+        char *text = NULL;
+        size_t len = 0;
+        FILE *out;
+
+        out = open_memstream(&text, &len);
+        if (!out)
+                return -1;
+        run_query(c, line, out);
+        if (fclose(out) == EOF) {
+                free(text);
+                return -1;
+        }
+
+        if (*used + len + sizeof(full) - 1 > MAX_FRAME + 4) {
+                memcpy(c->out + *used, full, sizeof(full) - 1);
+                *used += sizeof(full) - 1;
+                free(text);
+                return 1;
+        }
+        memcpy(c->out + *used, text, len);
+        *used += len;
+        free(text);
+        return 0;
+}
+
+/*
+ * Answer a request into c->out, with its length in front.
+ */
+static int
+handle_frame(client *c, char *text, size_t len)
+{
+        char *line, *end = text + len;
+        size_t used = 4;
+        arena_pos pos;
+        int rc = 0;
+
+        if (!c->out && !(c->out = malloc(MAX_FRAME + 4)))
+                return -1;
+
+        arena_mark(&scratch, &pos);
+        for (line = text; rc == 0 && line < end; ) {
+                char *nl = memchr(line, '\n', end - line);
+
+                if (!nl)
+                        nl = end;
+                *nl = '\0';
+                if (nl > line)
+                        rc = add_answer(c, line, &used);
+                line = nl + 1;
+        }
+        arena_reset(&scratch, &pos);
+        if (rc < 0)
+                return -1;
+
+        len = used - 4;
+        c->out[0] = len >> 24;
+        c->out[1] = len >> 16;
+        c->out[2] = len >> 8;
+        c->out[3] = len;
+        c->outlen = used;
+        c->sent = 0;
+        return 0;
+}
+
+/*
+ * Answer complete requests until one of them leaves a reply waiting.
+ */
+static int
+answer(client *c)
+{
+        while (c->sent == c->outlen && c->len >= 4) {
+                size_t flen = (size_t)c->buf[0] << 24 | c->buf[1] << 16 |
+                              c->buf[2] << 8 | c->buf[3];
+
+                if (flen > MAX_FRAME)
+                        return -1;
+                if (c->len < flen + 4)
+                        break;
+                if (handle_frame(c, (char *)c->buf + 4, flen) < 0)
+                        return -1;
+                memmove(c->buf, c->buf + 4 + flen, c->len - 4 - flen);
+                c->len -= 4 + flen;
+        }
+        return 0;
+}
+
+/*
+ * Send as much of the waiting reply as the client will take, and once
+ * it's all gone, answer whatever else it asked for.
+ */
+static int
+flush_out(client *c)
+{
+        while (c->sent < c->outlen) {
+                ssize_t n = send(c->fd, c->out + c->sent,
+                                 c->outlen - c->sent, MSG_NOSIGNAL);
+
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return 0;
+                if (n <= 0)
+                        return -1;
+                c->sent += n;
+        }
+        c->outlen = c->sent = 0;
+        return answer(c);
+}
+
+/*
+ * Read what's there, and answer the requests in it.
+ */
+static int
+service(client *c)
+{
+        ssize_t n;
+
+        if (!c->buf && !(c->buf = malloc(MAX_FRAME + 4)))
+                return -1;
+        if (c->len == MAX_FRAME + 4)
+                return -1;
+
+        n = read(c->fd, c->buf + c->len, MAX_FRAME + 4 - c->len);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN ||
+                      errno == EWOULDBLOCK))
+                return 0;
+        if (n <= 0)
+                return -1;
+        c->len += n;
+        return answer(c);
+}
+
+static int
+unix_socket(const char * const path, struct sockaddr_un *sun)
+{
+        int fd;
+
+        if (strlen(path) >= sizeof(sun->sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+        memset(sun, 0, sizeof(*sun));
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        return fd;
+}
+
+int
+serve(const char * const path, int nargs, char *args[])
+{
+        struct pollfd pfds[MAX_CLIENTS + 1];
+        client clients[MAX_CLIENTS + 1];
+        struct sockaddr_un sun;
+        struct stat sb;
+        int nclients = 0;
+        mode_t mask;
+        int fd, rc;
+
+        if (load_residents(nargs, args) < 0) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        /* a stale socket can go, but nothing else that's in the way */
+        if (lstat(path, &sb) == 0) {
+                if (!S_ISSOCK(sb.st_mode)) {
+                        errno = EEXIST;
+                        return -1;
+                }
+                unlink(path);
+        }
+
+        fd = unix_socket(path, &sun);
+        if (fd < 0)
+                return -1;
+        /* only the user running the server gets to talk to it */
+        mask = umask(0077);
+        rc = bind(fd, (struct sockaddr *)&sun, sizeof(sun));
+        umask(mask);
+        if (rc < 0 || listen(fd, 16) < 0) {
+                close(fd);
+                return -1;
+        }
+
+        for (;;) {
+                pfds[0].fd = fd;
+                pfds[0].events = POLLIN;
+                for (int i = 0; i < nclients; i++) {
+                        pfds[i + 1].fd = clients[i].fd;
+                        pfds[i + 1].events = clients[i].sent <
+                                             clients[i].outlen ?
+                                             POLLOUT : POLLIN;
+                }
+
+                if (poll(pfds, nclients + 1, -1) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -1;
+                }
+
+                for (int i = nclients - 1; i >= 0; i--) {
+                        client *c = &clients[i];
+
+                        if (!pfds[i + 1].revents)
+                                continue;
+                        if (pfds[i + 1].events & POLLOUT)
+                                rc = flush_out(c);
+                        else
+                                rc = service(c);
+                        if (rc < 0) {
+                                close(c->fd);
+                                free(c->buf);
+                                free(c->out);
+                                *c = clients[--nclients];
+                        }
+                }
+
+                if (pfds[0].revents & POLLIN) {
+                        int cfd = accept(fd, NULL, NULL);
+
+                        if (cfd < 0)
+                                continue;
+                        if (nclients == MAX_CLIENTS ||
+                            fcntl(cfd, F_SETFL, O_NONBLOCK) < 0) {
+                                close(cfd);
+                                continue;
+                        }
+                        memset(&clients[nclients], 0, sizeof(*clients));
+                        clients[nclients++].fd = cfd;
+                }
+        }
+}
+
+static int
+read_all(int fd, void *buf, size_t len)
+{
+        uint8_t *p = buf;
+
+        while (len) {
+                ssize_t n = read(fd, p, len);
+
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n <= 0)
+                        return -1;
+                p += n;
+                len -= n;
+        }
+        return 0;
+}
+
+/*
+ * A small client: send the queries as one request and print the reply.
+ */
+int
+query(const char * const path, int nqueries, char *queries[])
+{
+        struct sockaddr_un sun;
+        FILE *req;
+        char *text = NULL;
+        size_t len = 0;
+        uint8_t hdr[4];
+        char *reply;
+        int fd;
+
+        req = open_memstream(&text, &len);
+        if (!req)
+                return -1;
+        for (int i = 0; i < nqueries; i++)
+                fprintf(req, "%s\n", queries[i]);
+        if (fclose(req) == EOF)
+                return -1;
+
+        fd = unix_socket(path, &sun);
+        if (fd < 0 ||
+            connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+            send_frame(fd, text, len) < 0 ||
+            read_all(fd, hdr, sizeof(hdr)) < 0) {
+                free(text);
+                return -1;
+        }
+        free(text);
+
+        len = (size_t)hdr[0] << 24 | hdr[1] << 16 | hdr[2] << 8 | hdr[3];
+        reply = malloc(len ? len : 1);
+        if (!reply || read_all(fd, reply, len) < 0) {
+                free(reply);
+                close(fd);
+                return -1;
+        }
+        close(fd);
+
+        fwrite(reply, 1, len, stdout);
+        free(reply);
+        return 0;
+}
+
+// vim:fenc=utf-8:tw=75:et
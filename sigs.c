@@ -0,0 +1,431 @@
+/*
+ * sigs.c - recognize library routines by their bytes
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A signature file has one routine per line:
+ *
+ *      PATTERN LENGTH HASH NAME
+ *
+ * PATTERN is the routine's first bytes in hex, with ".." for each byte of
+ * an address or an indexed offset (hh ll, gggg, and their 20-bit forms),
+ * since those change wherever the routine gets linked.  HASH is FNV-1a
+ * over all LENGTH bytes, masked the same way.  Lines starting with '#'
+ * are comments.  --make-sigs writes one from the named functions in an
+ * image.
+ *
+ * Patterns go in a prefix trie.  An image is matched by walking the trie
+ * from each instruction and checking the hash of whatever signatures it
+ * reaches, so a miss usually costs a byte or two.  A routine that
+ * matches is named after the signature, unless someone's already named
+ * it, and is otherwise left alone: the labels and xrefs for branches
+ * inside it are dropped.
+ */
+#define SIG_PREFIX      32
+#define MIN_SIG_LEN     8
+#define MASKED          0x100   // a byte that doesn't count
+
+typedef struct sig_s {
+        char *name;
+        uint32_t len;
+        uint64_t hash;
+        uint32_t next;          // next signature in the same trie node
+} sig;
+
+/*
+ * Each node's children are a list, except the root's, which are a table;
+ * nearly every lookup is at the root.
+ */
+typedef struct trie_node_s {
+        uint32_t child;
+        uint32_t sibling;
+        uint32_t sigs;          // 1 + first in sigs[], or 0
+        uint16_t sym;
+} trie_node;
+
+static sig *sigs = NULL;
+static uint32_t nsigs = 0;
+static trie_node *nodes = NULL;
+static uint32_t nnodes = 0;
+static uint32_t root[MASKED + 1];
+
+static uint8_t shape_masks[MAX_SHAPES];
+static pthread_once_t masks_once = PTHREAD_ONCE_INIT;
+
+static int
+maskable(uint8_t kind)
+{
+        return kind == OPK_ADDR16 || kind == OPK_ADDR20 ||
+               kind == OPK_SOFF16 || kind == OPK_SOFF20;
+}
+
+/*
+ * Which of the operand bytes of each shape hold an address, one bit per
+ * byte from the first.
+ */
+static void
+build_masks(void)
+{
+        for (int s = 0; s < MAX_SHAPES; s++) {
+                const shape *shape = &shapes[s];
+                int shift = shape->bits;
+                int lo[4], hi[4];
+
+                for (int i = 0; i < shape->nfields; i++) {
+                        shift -= shape->fbits[i];
+                        /* the operand bytes it's in, first one 0 */
+                        lo[i] = shape->bytes - 1 -
+                                (shift + shape->fbits[i] - 1) / 8;
+                        hi[i] = shape->bytes - 1 - shift / 8;
+                }
+                for (int a = 0; a < shape->nargs; a++) {
+                        const shape_arg *arg = &shape->args[a];
+
+                        if (!maskable(arg->kind))
+                                continue;
+                        for (int f = arg->first;
+                             f < arg->first + arg->nfields; f++)
+                                for (int b = lo[f]; b <= hi[f]; b++)
+                                        shape_masks[s] |= 1 << b;
+                }
+        }
+}
+
+/*
+ * The image as the trie sees it: each byte, or MASKED.
+ */
+static uint16_t *
+masked_bytes(const image * const img, arena *scratch)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        uint16_t *syms;
+
+        pthread_once(&masks_once, build_masks);
+
+        syms = arena_alloc(scratch, (img->size + 1) * sizeof(*syms));
+        if (!syms)
+                return NULL;
+        for (size_t pos = 0; pos < img->size; pos++)
+                syms[pos] = img->buf[pos];
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                const insn_rec *rec = &recs[i];
+                int page = (rec->prefix >> 4) & 3;
+                const packed_op *packed =
+                        &packed_opcodes[page][rec->opcode];
+                uint32_t ops = rec->addr + (rec->prefix ? 2 : 1);
+                uint8_t mask;
+
+                if (rec->flags & INSN_BYTES)
+                        continue;
+                mask = shape_masks[packed->shape];
+                for (int b = 0; mask; b++, mask >>= 1)
+                        if ((mask & 1) && ops + b < img->size)
+                                syms[ops + b] = MASKED;
+        }
+        return syms;
+}
+
+static uint64_t
+hash_syms(const uint16_t *syms, uint32_t len)
+{
+        uint64_t h = 0xcbf29ce484222325ull;
+
+        for (uint32_t i = 0; i < len; i++)
+                h = (h ^ syms[i]) * 0x100000001b3ull;
+        return h;
+}
+
+static uint32_t
+find_child(uint32_t parent, uint16_t sym)
+{
+        if (!parent)
+                return root[sym];
+        for (uint32_t n = nodes[parent].child; n; n = nodes[n].sibling)
+                if (nodes[n].sym == sym)
+                        return n;
+        return 0;
+}
+
+static uint32_t
+add_child(uint32_t parent, uint16_t sym)
+{
+        uint32_t n = find_child(parent, sym);
+        trie_node *new;
+
+        if (n)
+                return n;
+        new = reallocarray(nodes, nnodes + 1, sizeof(*new));
+        if (!new)
+                return 0;
+        nodes = new;
+        n = nnodes++;
+        memset(&nodes[n], 0, sizeof(nodes[n]));
+        nodes[n].sym = sym;
+        if (!parent) {
+                root[sym] = n;
+        } else {
+                nodes[n].sibling = nodes[parent].child;
+                nodes[parent].child = n;
+        }
+        return n;
+}
+
+static int
+parse_sig(char *line, uint16_t *pattern, uint32_t *npattern, sig *s)
+{
+        char *words[4], *save = NULL, *end;
+        int n = 0;
+
+        for (char *w = strtok_r(line, " \t", &save); w && n < 4;
+             w = strtok_r(NULL, " \t", &save))
+                words[n++] = w;
+        if (n != 4 || !words[0][0] || strlen(words[0]) % 2 ||
+            strlen(words[0]) / 2 > SIG_PREFIX || !valid_label(words[3]))
+                return -1;
+
+        *npattern = strlen(words[0]) / 2;
+        for (uint32_t i = 0; i < *npattern; i++) {
+                char byte[3] = { words[0][2 * i], words[0][2 * i + 1], 0 };
+
+                if (!strcmp(byte, "..")) {
+                        pattern[i] = MASKED;
+                        continue;
+                }
+                if (!isxdigit((unsigned char)byte[0]) ||
+                    !isxdigit((unsigned char)byte[1]))
+                        return -1;
+                pattern[i] = strtoul(byte, NULL, 16);
+        }
+
+        errno = 0;
+        s->len = strtoul(words[1], &end, 10);
+        if (errno || *end || s->len < *npattern || !s->len)
+                return -1;
+        s->hash = strtoull(words[2], &end, 16);
+        if (errno || *end || strlen(words[2]) != 16)
+                return -1;
+        s->name = strdup(words[3]);
+        return s->name ? 0 : -1;
+}
+
+/*
+ * Add every signature in path to the trie.
+ */
+int
+load_signatures(const char * const path)
+{
+        FILE *f = fopen(path, "r");
+        char *line = NULL;
+        size_t size = 0, lineno = 0;
+        ssize_t len;
+        int rc = 0;
+
+        if (!f)
+                return -1;
+        if (!nodes) {
+                /* node 0 is the root */
+                nodes = calloc(1, sizeof(*nodes));
+                if (!nodes) {
+                        fclose(f);
+                        return -1;
+                }
+                nnodes = 1;
+        }
+
+        while (rc == 0 && (len = getline(&line, &size, f)) >= 0) {
+                uint16_t pattern[SIG_PREFIX];
+                uint32_t npattern, node = 0;
+                sig s, *new;
+
+                lineno++;
+                while (len && isspace((unsigned char)line[len - 1]))
+                        line[--len] = '\0';
+                if (!len || line[0] == '#')
+                        continue;
+
+                if (parse_sig(line, pattern, &npattern, &s) < 0) {
+                        warnx("%s:%zu: invalid signature", path, lineno);
+                        errno = EINVAL;
+                        rc = -1;
+                        break;
+                }
+                for (uint32_t i = 0; i < npattern && rc == 0; i++)
+                        if (!(node = add_child(node, pattern[i])))
+                                rc = -1;
+                new = reallocarray(sigs, nsigs + 1, sizeof(*new));
+                if (rc < 0 || !new) {
+                        free(s.name);
+                        rc = -1;
+                        break;
+                }
+                sigs = new;
+                s.next = nodes[node].sigs;
+                sigs[nsigs++] = s;
+                nodes[node].sigs = nsigs;
+        }
+
+        free(line);
+        fclose(f);
+        return rc;
+}
+
+int
+have_signatures(void)
+{
+        return nsigs > 0;
+}
+
+/*
+ * Drop what we found inside a library routine: labels we made up and
+ * branches that stay inside it.
+ */
+static void
+skip_routine(image *img, uint32_t start, uint32_t end)
+{
+        symbol *syms = image_section(img, SEC_SYMBOLS, symbol);
+        xref *xrefs = image_section(img, SEC_XREFS, xref);
+        uint32_t n = 0;
+
+        for (uint32_t i = 0; i < image_count(img, SEC_SYMBOLS); i++)
+                if (!(syms[i].addr > start && syms[i].addr < end &&
+                      (syms[i].flags & SYM_AUTO)))
+                        syms[n++] = syms[i];
+        image_count(img, SEC_SYMBOLS) = n;
+
+        n = 0;
+        for (uint32_t i = 0; i < image_count(img, SEC_XREFS); i++)
+                if (!(xrefs[i].from >= start && xrefs[i].from < end &&
+                      xrefs[i].to >= start && xrefs[i].to < end))
+                        xrefs[n++] = xrefs[i];
+        image_count(img, SEC_XREFS) = n;
+}
+
+/*
+ * Name every library routine in img that we have a signature for.
+ * Returns how many there were.
+ */
+int
+match_signatures(image *img)
+{
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        uint32_t ninsns = image_count(img, SEC_INSNS);
+        arena scratch = { NULL, };
+        uint16_t *syms;
+        int found = 0;
+
+        if (!nsigs)
+                return 0;
+        syms = masked_bytes(img, &scratch);
+        if (!syms)
+                return -1;
+
+        for (uint32_t i = 0; i < ninsns; i++) {
+                uint32_t start = recs[i].addr;
+                const sig *best = NULL;
+                uint32_t node = 0;
+                symbol *sym;
+
+                if (recs[i].flags & INSN_BYTES)
+                        continue;
+
+                for (uint32_t d = 0;
+                     d < SIG_PREFIX && start + d < img->size; d++) {
+                        node = find_child(node, syms[start + d]);
+                        if (!node)
+                                break;
+                        for (uint32_t s = nodes[node].sigs; s;
+                             s = sigs[s - 1].next) {
+                                const sig *sg = &sigs[s - 1];
+
+                                if (sg->len > img->size - start ||
+                                    (best && best->len >= sg->len) ||
+                                    hash_syms(syms + start, sg->len) !=
+                                    sg->hash)
+                                        continue;
+                                best = sg;
+                        }
+                }
+                if (!best)
+                        continue;
+
+                sym = find_symbol(img, start);
+                if (sym && !(sym->flags & SYM_AUTO))
+                        sym->flags |= SYM_FUNC | SYM_LIB;
+                else if (set_label(img, start, best->name,
+                                   SYM_FUNC | SYM_LIB) < 0)
+                        goto fail;
+                skip_routine(img, start, start + best->len);
+                found++;
+
+                while (i + 1 < ninsns &&
+                       recs[i + 1].addr < start + best->len)
+                        i++;
+        }
+
+        arena_free(&scratch);
+        return found;
+fail:
+        arena_free(&scratch);
+        return -1;
+}
+
+/*
+ * A signature for every function in img with a name someone gave it.
+ */
+int
+write_signatures(FILE *out, const image * const img)
+{
+        arena scratch = { NULL, };
+        uint16_t *syms;
+        uint32_t nfuncs;
+        func *funcs;
+        int n = 0;
+
+        syms = masked_bytes(img, &scratch);
+        if (!syms || find_functions(img, &scratch, &funcs, &nfuncs) < 0) {
+                arena_free(&scratch);
+                return -1;
+        }
+
+        for (uint32_t i = 0; i < nfuncs; i++) {
+                const func *f = &funcs[i];
+                const symbol *sym = find_symbol(img, f->start);
+                uint32_t len = f->end - f->start;
+                uint64_t hash;
+
+                if (!sym || (sym->flags & SYM_AUTO) || len < MIN_SIG_LEN)
+                        continue;
+
+                for (uint32_t b = 0; b < len && b < SIG_PREFIX; b++)
+                        if (syms[f->start + b] == MASKED)
+                                fprintf(out, "..");
+                        else
+                                fprintf(out, "%02x", syms[f->start + b]);
+                hash = hash_syms(syms + f->start, len);
+                fprintf(out, " %u %016llx %s\n", len,
+                        (unsigned long long)hash,
+                        image_str(img, sym->name));
+                n++;
+        }
+
+        arena_free(&scratch);
+        return n;
+}
+
+// vim:fenc=utf-8:tw=75:et
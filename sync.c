@@ -0,0 +1,468 @@
+/*
+ * sync.c - list an image from anywhere, not just the start
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The listing is one sweep forward from offset 0, so where an instruction
+ * starts depends on everything before it.  IMAGE.sync remembers, for
+ * every SYNC_INTERVAL bytes of the image, the last instruction boundary
+ * the sweep hits at or before it, and where the sweep gave up decoding
+ * and went to raw bytes.  Listing a range starts from the boundary just
+ * before it, and comes out exactly as those lines of the full listing.
+ *
+ * The index is built whenever it's needed, and only kept in memory
+ * unless --keep-sync asks for it to be written out; a kept one is used
+ * until the image's size or modification time don't match what it was
+ * built from.  If it can't be written, we just use it from memory.
+ */
+#define SYNC_MAGIC "HC16SYN"
+#define SYNC_VERSION 1
+#define SYNC_INTERVAL 4096
+
+int sync_keep = 0;
+
+typedef struct sync_header_s {
+        char magic[8];
+        uint32_t version;
+        uint32_t interval;
+        uint64_t image_size;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        uint64_t stop;          // where we stopped decoding
+        uint64_t count;
+        uint32_t points[];
+} sync_header;
+
+static uint64_t
+npoints(uint64_t size)
+{
+        return (size + SYNC_INTERVAL - 1) / SYNC_INTERVAL;
+}
+
+static size_t
+sync_size(uint64_t size)
+{
+        return sizeof(sync_header) + npoints(size) * sizeof(uint32_t);
+}
+
+static int
+sync_valid(const sync_header * const hdr, size_t len,
+           const struct stat * const sb)
+{
+        return len >= sizeof(*hdr) &&
+               !memcmp(hdr->magic, SYNC_MAGIC, sizeof(hdr->magic)) &&
+               hdr->version == SYNC_VERSION &&
+               hdr->interval == SYNC_INTERVAL &&
+               hdr->image_size == (uint64_t)sb->st_size &&
+               hdr->mtime_sec == sb->st_mtim.tv_sec &&
+               hdr->mtime_nsec == sb->st_mtim.tv_nsec &&
+               hdr->count == npoints(sb->st_size) &&
+               len == sync_size(sb->st_size) &&
+               hdr->stop <= hdr->image_size;
+}
+
+/*
+ * The same sweep disass() does, writing down where it is every
+ * SYNC_INTERVAL bytes.
+ */
+static sync_header *
+sync_build(const uint8_t * const buf, const struct stat * const sb)
+{
+        size_t size = sb->st_size;
+        sync_header *hdr = calloc(1, sync_size(size));
+        size_t pos = 0;
+        uint64_t k = 0;
+
+        if (!hdr)
+                return NULL;
+        memcpy(hdr->magic, SYNC_MAGIC, sizeof(hdr->magic));
+        hdr->version = SYNC_VERSION;
+        hdr->interval = SYNC_INTERVAL;
+        hdr->image_size = size;
+        hdr->mtime_sec = sb->st_mtim.tv_sec;
+        hdr->mtime_nsec = sb->st_mtim.tv_nsec;
+        hdr->count = npoints(size);
+
+        while (pos < size) {
+                insn insn;
+
+                if (decode_insn(buf, size, pos, &insn) < 0)
+                        break;
+                for (; k < hdr->count &&
+                       k * SYNC_INTERVAL < pos + insn.len; k++)
+                        hdr->points[k] = pos;
+                pos += insn.len;
+        }
+        hdr->stop = pos;
+        /* past there, every byte is listed by itself */
+        for (; k < hdr->count; k++)
+                hdr->points[k] = k * SYNC_INTERVAL;
+        return hdr;
+}
+
+static void
+sync_write(const sync_header * const hdr, const char * const path)
+{
+        size_t len = sync_size(hdr->image_size);
+        char *tmp = malloc(strlen(path) + 5);
+        int fd;
+
+        if (!tmp)
+                return;
+        sprintf(tmp, "%s.new", path);
+        fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                free(tmp);
+                return;
+        }
+        if (write(fd, hdr, len) != (ssize_t)len || close(fd) < 0 ||
+            rename(tmp, path) < 0) {
+                warn("Could not write \"%s\"", path);
+                unlink(tmp);
+        }
+        free(tmp);
+}
+
+/*
+ * Map IMAGE.sync if it's good, or build it, and with --keep-sync try to
+ * write it out.  Sets *maplen if it's mapped, and leaves it 0 if it's
+ * malloced.
+ */
+static sync_header *
+sync_open(const char * const filename, const uint8_t * const buf,
+          const struct stat * const sb, size_t *maplen)
+{
+        char *path = malloc(strlen(filename) + 6);
+        sync_header *hdr = NULL;
+        struct stat ssb;
+        int fd;
+
+        *maplen = 0;
+        if (!path)
+                return NULL;
+        sprintf(path, "%s.sync", filename);
+
+        fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+                if (fstat(fd, &ssb) == 0 && ssb.st_size > 0) {
+                        hdr = mmap(NULL, ssb.st_size, PROT_READ,
+                                   MAP_SHARED, fd, 0);
+                        if (hdr == MAP_FAILED) {
+                                hdr = NULL;
+                        } else if (!sync_valid(hdr, ssb.st_size, sb)) {
+                                munmap(hdr, ssb.st_size);
+                                hdr = NULL;
+                        } else {
+                                *maplen = ssb.st_size;
+                        }
+                }
+                close(fd);
+        }
+
+        if (!hdr) {
+                hdr = sync_build(buf, sb);
+                if (hdr && sync_keep)
+                        sync_write(hdr, path);
+        }
+        free(path);
+        return hdr;
+}
+
+typedef struct listed_s {
+        const uint8_t *buf;
+        size_t size;
+        sync_header *hdr;
+        size_t maplen;
+} listed;
+
+/*
+ * Map the image and its index.  Returns 0, or one of read_image()'s
+ * status codes with errno set, or 7 if its checksums don't match.
+ */
+static int
+open_listed(listed *l, const char * const filename)
+{
+        struct stat sb;
+        int fd, rc;
+
+        memset(l, 0, sizeof(*l));
+        fd = open(filename, O_RDONLY);
+        if (fd < 0)
+                return 2;
+        if (fstat(fd, &sb) < 0) {
+                close(fd);
+                return 3;
+        }
+        l->size = sb.st_size;
+        if (!l->size) {
+                close(fd);
+                return check_image(filename, NULL, 0);
+        }
+        l->buf = mmap(NULL, l->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (l->buf == MAP_FAILED) {
+                l->buf = NULL;
+                return 5;
+        }
+        rc = check_image(filename, l->buf, l->size);
+        if (rc) {
+                munmap((void *)l->buf, l->size);
+                l->buf = NULL;
+                return rc;
+        }
+
+        l->hdr = sync_open(filename, l->buf, &sb, &l->maplen);
+        if (!l->hdr) {
+                munmap((void *)l->buf, l->size);
+                l->buf = NULL;
+                return 4;
+        }
+        return 0;
+}
+
+static void
+close_listed(listed *l)
+{
+        if (!l->buf)
+                return;
+        if (l->maplen)
+                munmap(l->hdr, l->maplen);
+        else
+                free(l->hdr);
+        munmap((void *)l->buf, l->size);
+}
+
+/*
+ * The listing of everything that starts at from or after it and before
+ * end, leaving out whatever ends before start; from has to be somewhere
+ * the sweep stops.  It goes to dst if that isn't NULL, or else to out if
+ * that isn't, and if neither, we just work out how long it would be.
+ * Returns its length, or -1 if the image doesn't decode the way the
+ * index says it does.
+ */
+static ssize_t
+list_lines(const listed * const l, size_t from, size_t start, size_t end,
+           FILE *out, char *dst)
+{
+        char line[INSN_LINE_MAX];
+        size_t pos, next, len, total = 0;
+
+        for (pos = from; pos < end; pos = next) {
+                insn insn;
+
+                if (pos >= l->hdr->stop) {
+                        next = pos + 1;
+                        if (next <= start)
+                                continue;
+                        len = snprintf(line, sizeof(line),
+                                       "%08zx: %02hhx%18s.byte 0x%02hhx",
+                                       pos, l->buf[pos], "", l->buf[pos]);
+                } else {
+                        if (decode_insn(l->buf, l->size, pos, &insn) < 0) {
+                                errno = EINVAL;
+                                return -1;
+                        }
+                        next = pos + insn.len;
+                        if (next <= start)
+                                continue;
+                        if (!dst && !out) {
+                                total += insn_line_len(&insn) + 1;
+                                continue;
+                        }
+                        len = format_insn(line, l->buf, &insn);
+                }
+
+                line[len++] = '\n';
+                if (dst)
+                        memcpy(dst + total, line, len);
+                else if (out)
+                        fwrite(line, 1, len, out);
+                total += len;
+        }
+        return total;
+}
+
+/*
+ * List what disass() would for the bytes from start up to end.  Returns
+ * 0, or one of read_image()'s status codes with errno set.
+ */
+int
+print_range(FILE *out, const char * const filename, uint32_t start,
+            uint32_t end)
+{
+        listed l;
+        int rc;
+
+        rc = open_listed(&l, filename);
+        if (rc || start >= l.size) {
+                close_listed(&l);
+                return rc;
+        }
+        if (end > l.size)
+                end = l.size;
+        if (list_lines(&l, l.hdr->points[start / SYNC_INTERVAL], start,
+                       end, out, NULL) < 0)
+                rc = 5;
+        close_listed(&l);
+        return rc;
+}
+
+/*
+ * Writing a whole listing to a file, the index also splits the image
+ * into chunks of CHUNK_POINTS intervals that can be formatted without
+ * each other.  Every chunk gets decoded twice: once to add up how long
+ * its lines are, so we know where in the file each one goes, and then to
+ * format it straight into a shared mapping of the file at that spot.
+ * Nothing funnels through one thread, and the result is the same bytes
+ * disass() would have written.
+ */
+#define CHUNK_POINTS 16
+
+typedef struct writer_s {
+        const listed *l;
+        size_t nchunks;
+        size_t *offsets;        // lengths at first, then where each goes
+        char *map;              // NULL the first time through
+        atomic_size_t next;
+        atomic_int error;
+} writer;
+
+static size_t
+chunk_start(const listed * const l, size_t c)
+{
+        uint64_t k = c * CHUNK_POINTS;
+
+        return k < l->hdr->count ? l->hdr->points[k] : l->size;
+}
+
+static void *
+write_chunks(void *data)
+{
+        writer *w = data;
+        size_t c;
+
+        while ((c = atomic_fetch_add(&w->next, 1)) < w->nchunks) {
+                size_t from = chunk_start(w->l, c);
+                ssize_t len;
+
+                len = list_lines(w->l, from, from,
+                                 chunk_start(w->l, c + 1), NULL,
+                                 w->map ? w->map + w->offsets[c] : NULL);
+                if (len < 0)
+                        atomic_store(&w->error, errno);
+                else if (!w->map)
+                        w->offsets[c] = len;
+                else if ((size_t)len != w->offsets[c + 1] - w->offsets[c])
+                        atomic_store(&w->error, EIO);
+        }
+        return NULL;
+}
+
+static int
+run_writers(writer *w)
+{
+        long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        pthread_t *threads;
+        long n;
+
+        if (nthreads < 1)
+                nthreads = 1;
+        threads = calloc(nthreads, sizeof(*threads));
+        if (!threads)
+                return -1;
+        atomic_store(&w->next, 0);
+        for (n = 0; n < nthreads; n++)
+                if (pthread_create(&threads[n], NULL, write_chunks, w))
+                        break;
+        if (n == 0)
+                write_chunks(w);
+        while (n--)
+                pthread_join(threads[n], NULL);
+        free(threads);
+        if (atomic_load(&w->error)) {
+                errno = atomic_load(&w->error);
+                return -1;
+        }
+        return 0;
+}
+
+/*
+ * Write the listing of filename to path.  Returns 0, -1 with errno set if
+ * path couldn't be written, or one of read_image()'s status codes if
+ * filename couldn't be read.
+ */
+int
+write_listing(const char * const filename, const char * const path)
+{
+        writer w = { NULL, };
+        size_t total = 0;
+        listed l;
+        int fd, rc;
+
+        rc = open_listed(&l, filename);
+        if (rc)
+                return rc;
+        w.l = &l;
+        atomic_init(&w.error, 0);
+        if (l.size)
+                w.nchunks = (l.hdr->count + CHUNK_POINTS - 1) /
+                            CHUNK_POINTS;
+        w.offsets = calloc(w.nchunks + 1, sizeof(*w.offsets));
+        if (!w.offsets) {
+                close_listed(&l);
+                return 4;
+        }
+
+        rc = -1;
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || run_writers(&w) < 0)
+                goto out;
+        for (size_t c = 0; c <= w.nchunks; c++) {
+                size_t len = w.offsets[c];
+
+                w.offsets[c] = total;
+                total += len;
+        }
+        if (ftruncate(fd, total) < 0)
+                goto out;
+        if (total) {
+                w.map = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+                if (w.map == MAP_FAILED) {
+                        w.map = NULL;
+                        goto out;
+                }
+                if (run_writers(&w) < 0)
+                        goto out;
+        }
+        rc = 0;
+out:
+        if (w.map && munmap(w.map, total) < 0)
+                rc = -1;
+        if (fd >= 0 && close(fd) < 0)
+                rc = -1;
+        free(w.offsets);
+        close_listed(&l);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
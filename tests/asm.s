@@ -0,0 +1,19 @@
+; Hand-written operands, with fewer digits than the listing uses.  Each
+; should come out as the form that takes the value, and the narrowest
+; one when several do.
+        ldab #0x4
+        jsr 0x8
+        ldaa [%x]+0x4
+        ldaa [%x]+0x0004
+        ldaa [%x]-0x4
+        ldaa [%x]+0x123
+        aix #0x1
+        aix #-0x1
+        aix #0x80
+        addd #0x7f
+        addd #0xff
+        ldx #0x0
+        bne 0x0
+        lbne 0x0
+        brclr #0x1, [%y]+0x2, 0x0
+        movw 0x1, 0x2
@@ -0,0 +1,1385 @@
+; Two banks for a 0x1008-byte window at 0x10000.  The first 4 KiB page
+; is the same in both, so the second bank's copy of it is shared; the
+; last 8 bytes differ.  Common code at 0 calls in through a stub and
+; straight into the window.
+        jsr 0x00008
+        jsr 0x10000
+        rts
+        rts
+        rts
+        rts
+; bank a
+        movw 0x0000, 0x1000
+        movw 0x0002, 0x1002
+        movw 0x0004, 0x1004
+        movw 0x0006, 0x1006
+        movw 0x0008, 0x1008
+        movw 0x000a, 0x100a
+        movw 0x000c, 0x100c
+        movw 0x000e, 0x100e
+        movw 0x0010, 0x1010
+        movw 0x0012, 0x1012
+        movw 0x0014, 0x1014
+        movw 0x0016, 0x1016
+        movw 0x0018, 0x1018
+        movw 0x001a, 0x101a
+        movw 0x001c, 0x101c
+        movw 0x001e, 0x101e
+        movw 0x0020, 0x1020
+        movw 0x0022, 0x1022
+        movw 0x0024, 0x1024
+        movw 0x0026, 0x1026
+        movw 0x0028, 0x1028
+        movw 0x002a, 0x102a
+        movw 0x002c, 0x102c
+        movw 0x002e, 0x102e
+        movw 0x0030, 0x1030
+        movw 0x0032, 0x1032
+        movw 0x0034, 0x1034
+        movw 0x0036, 0x1036
+        movw 0x0038, 0x1038
+        movw 0x003a, 0x103a
+        movw 0x003c, 0x103c
+        movw 0x003e, 0x103e
+        movw 0x0040, 0x1040
+        movw 0x0042, 0x1042
+        movw 0x0044, 0x1044
+        movw 0x0046, 0x1046
+        movw 0x0048, 0x1048
+        movw 0x004a, 0x104a
+        movw 0x004c, 0x104c
+        movw 0x004e, 0x104e
+        movw 0x0050, 0x1050
+        movw 0x0052, 0x1052
+        movw 0x0054, 0x1054
+        movw 0x0056, 0x1056
+        movw 0x0058, 0x1058
+        movw 0x005a, 0x105a
+        movw 0x005c, 0x105c
+        movw 0x005e, 0x105e
+        movw 0x0060, 0x1060
+        movw 0x0062, 0x1062
+        movw 0x0064, 0x1064
+        movw 0x0066, 0x1066
+        movw 0x0068, 0x1068
+        movw 0x006a, 0x106a
+        movw 0x006c, 0x106c
+        movw 0x006e, 0x106e
+        movw 0x0070, 0x1070
+        movw 0x0072, 0x1072
+        movw 0x0074, 0x1074
+        movw 0x0076, 0x1076
+        movw 0x0078, 0x1078
+        movw 0x007a, 0x107a
+        movw 0x007c, 0x107c
+        movw 0x007e, 0x107e
+        movw 0x0080, 0x1080
+        movw 0x0082, 0x1082
+        movw 0x0084, 0x1084
+        movw 0x0086, 0x1086
+        movw 0x0088, 0x1088
+        movw 0x008a, 0x108a
+        movw 0x008c, 0x108c
+        movw 0x008e, 0x108e
+        movw 0x0090, 0x1090
+        movw 0x0092, 0x1092
+        movw 0x0094, 0x1094
+        movw 0x0096, 0x1096
+        movw 0x0098, 0x1098
+        movw 0x009a, 0x109a
+        movw 0x009c, 0x109c
+        movw 0x009e, 0x109e
+        movw 0x00a0, 0x10a0
+        movw 0x00a2, 0x10a2
+        movw 0x00a4, 0x10a4
+        movw 0x00a6, 0x10a6
+        movw 0x00a8, 0x10a8
+        movw 0x00aa, 0x10aa
+        movw 0x00ac, 0x10ac
+        movw 0x00ae, 0x10ae
+        movw 0x00b0, 0x10b0
+        movw 0x00b2, 0x10b2
+        movw 0x00b4, 0x10b4
+        movw 0x00b6, 0x10b6
+        movw 0x00b8, 0x10b8
+        movw 0x00ba, 0x10ba
+        movw 0x00bc, 0x10bc
+        movw 0x00be, 0x10be
+        movw 0x00c0, 0x10c0
+        movw 0x00c2, 0x10c2
+        movw 0x00c4, 0x10c4
+        movw 0x00c6, 0x10c6
+        movw 0x00c8, 0x10c8
+        movw 0x00ca, 0x10ca
+        movw 0x00cc, 0x10cc
+        movw 0x00ce, 0x10ce
+        movw 0x00d0, 0x10d0
+        movw 0x00d2, 0x10d2
+        movw 0x00d4, 0x10d4
+        movw 0x00d6, 0x10d6
+        movw 0x00d8, 0x10d8
+        movw 0x00da, 0x10da
+        movw 0x00dc, 0x10dc
+        movw 0x00de, 0x10de
+        movw 0x00e0, 0x10e0
+        movw 0x00e2, 0x10e2
+        movw 0x00e4, 0x10e4
+        movw 0x00e6, 0x10e6
+        movw 0x00e8, 0x10e8
+        movw 0x00ea, 0x10ea
+        movw 0x00ec, 0x10ec
+        movw 0x00ee, 0x10ee
+        movw 0x00f0, 0x10f0
+        movw 0x00f2, 0x10f2
+        movw 0x00f4, 0x10f4
+        movw 0x00f6, 0x10f6
+        movw 0x00f8, 0x10f8
+        movw 0x00fa, 0x10fa
+        movw 0x00fc, 0x10fc
+        movw 0x00fe, 0x10fe
+        movw 0x0100, 0x1100
+        movw 0x0102, 0x1102
+        movw 0x0104, 0x1104
+        movw 0x0106, 0x1106
+        movw 0x0108, 0x1108
+        movw 0x010a, 0x110a
+        movw 0x010c, 0x110c
+        movw 0x010e, 0x110e
+        movw 0x0110, 0x1110
+        movw 0x0112, 0x1112
+        movw 0x0114, 0x1114
+        movw 0x0116, 0x1116
+        movw 0x0118, 0x1118
+        movw 0x011a, 0x111a
+        movw 0x011c, 0x111c
+        movw 0x011e, 0x111e
+        movw 0x0120, 0x1120
+        movw 0x0122, 0x1122
+        movw 0x0124, 0x1124
+        movw 0x0126, 0x1126
+        movw 0x0128, 0x1128
+        movw 0x012a, 0x112a
+        movw 0x012c, 0x112c
+        movw 0x012e, 0x112e
+        movw 0x0130, 0x1130
+        movw 0x0132, 0x1132
+        movw 0x0134, 0x1134
+        movw 0x0136, 0x1136
+        movw 0x0138, 0x1138
+        movw 0x013a, 0x113a
+        movw 0x013c, 0x113c
+        movw 0x013e, 0x113e
+        movw 0x0140, 0x1140
+        movw 0x0142, 0x1142
+        movw 0x0144, 0x1144
+        movw 0x0146, 0x1146
+        movw 0x0148, 0x1148
+        movw 0x014a, 0x114a
+        movw 0x014c, 0x114c
+        movw 0x014e, 0x114e
+        movw 0x0150, 0x1150
+        movw 0x0152, 0x1152
+        movw 0x0154, 0x1154
+        movw 0x0156, 0x1156
+        movw 0x0158, 0x1158
+        movw 0x015a, 0x115a
+        movw 0x015c, 0x115c
+        movw 0x015e, 0x115e
+        movw 0x0160, 0x1160
+        movw 0x0162, 0x1162
+        movw 0x0164, 0x1164
+        movw 0x0166, 0x1166
+        movw 0x0168, 0x1168
+        movw 0x016a, 0x116a
+        movw 0x016c, 0x116c
+        movw 0x016e, 0x116e
+        movw 0x0170, 0x1170
+        movw 0x0172, 0x1172
+        movw 0x0174, 0x1174
+        movw 0x0176, 0x1176
+        movw 0x0178, 0x1178
+        movw 0x017a, 0x117a
+        movw 0x017c, 0x117c
+        movw 0x017e, 0x117e
+        movw 0x0180, 0x1180
+        movw 0x0182, 0x1182
+        movw 0x0184, 0x1184
+        movw 0x0186, 0x1186
+        movw 0x0188, 0x1188
+        movw 0x018a, 0x118a
+        movw 0x018c, 0x118c
+        movw 0x018e, 0x118e
+        movw 0x0190, 0x1190
+        movw 0x0192, 0x1192
+        movw 0x0194, 0x1194
+        movw 0x0196, 0x1196
+        movw 0x0198, 0x1198
+        movw 0x019a, 0x119a
+        movw 0x019c, 0x119c
+        movw 0x019e, 0x119e
+        movw 0x01a0, 0x11a0
+        movw 0x01a2, 0x11a2
+        movw 0x01a4, 0x11a4
+        movw 0x01a6, 0x11a6
+        movw 0x01a8, 0x11a8
+        movw 0x01aa, 0x11aa
+        movw 0x01ac, 0x11ac
+        movw 0x01ae, 0x11ae
+        movw 0x01b0, 0x11b0
+        movw 0x01b2, 0x11b2
+        movw 0x01b4, 0x11b4
+        movw 0x01b6, 0x11b6
+        movw 0x01b8, 0x11b8
+        movw 0x01ba, 0x11ba
+        movw 0x01bc, 0x11bc
+        movw 0x01be, 0x11be
+        movw 0x01c0, 0x11c0
+        movw 0x01c2, 0x11c2
+        movw 0x01c4, 0x11c4
+        movw 0x01c6, 0x11c6
+        movw 0x01c8, 0x11c8
+        movw 0x01ca, 0x11ca
+        movw 0x01cc, 0x11cc
+        movw 0x01ce, 0x11ce
+        movw 0x01d0, 0x11d0
+        movw 0x01d2, 0x11d2
+        movw 0x01d4, 0x11d4
+        movw 0x01d6, 0x11d6
+        movw 0x01d8, 0x11d8
+        movw 0x01da, 0x11da
+        movw 0x01dc, 0x11dc
+        movw 0x01de, 0x11de
+        movw 0x01e0, 0x11e0
+        movw 0x01e2, 0x11e2
+        movw 0x01e4, 0x11e4
+        movw 0x01e6, 0x11e6
+        movw 0x01e8, 0x11e8
+        movw 0x01ea, 0x11ea
+        movw 0x01ec, 0x11ec
+        movw 0x01ee, 0x11ee
+        movw 0x01f0, 0x11f0
+        movw 0x01f2, 0x11f2
+        movw 0x01f4, 0x11f4
+        movw 0x01f6, 0x11f6
+        movw 0x01f8, 0x11f8
+        movw 0x01fa, 0x11fa
+        movw 0x01fc, 0x11fc
+        movw 0x01fe, 0x11fe
+        movw 0x0200, 0x1200
+        movw 0x0202, 0x1202
+        movw 0x0204, 0x1204
+        movw 0x0206, 0x1206
+        movw 0x0208, 0x1208
+        movw 0x020a, 0x120a
+        movw 0x020c, 0x120c
+        movw 0x020e, 0x120e
+        movw 0x0210, 0x1210
+        movw 0x0212, 0x1212
+        movw 0x0214, 0x1214
+        movw 0x0216, 0x1216
+        movw 0x0218, 0x1218
+        movw 0x021a, 0x121a
+        movw 0x021c, 0x121c
+        movw 0x021e, 0x121e
+        movw 0x0220, 0x1220
+        movw 0x0222, 0x1222
+        movw 0x0224, 0x1224
+        movw 0x0226, 0x1226
+        movw 0x0228, 0x1228
+        movw 0x022a, 0x122a
+        movw 0x022c, 0x122c
+        movw 0x022e, 0x122e
+        movw 0x0230, 0x1230
+        movw 0x0232, 0x1232
+        movw 0x0234, 0x1234
+        movw 0x0236, 0x1236
+        movw 0x0238, 0x1238
+        movw 0x023a, 0x123a
+        movw 0x023c, 0x123c
+        movw 0x023e, 0x123e
+        movw 0x0240, 0x1240
+        movw 0x0242, 0x1242
+        movw 0x0244, 0x1244
+        movw 0x0246, 0x1246
+        movw 0x0248, 0x1248
+        movw 0x024a, 0x124a
+        movw 0x024c, 0x124c
+        movw 0x024e, 0x124e
+        movw 0x0250, 0x1250
+        movw 0x0252, 0x1252
+        movw 0x0254, 0x1254
+        movw 0x0256, 0x1256
+        movw 0x0258, 0x1258
+        movw 0x025a, 0x125a
+        movw 0x025c, 0x125c
+        movw 0x025e, 0x125e
+        movw 0x0260, 0x1260
+        movw 0x0262, 0x1262
+        movw 0x0264, 0x1264
+        movw 0x0266, 0x1266
+        movw 0x0268, 0x1268
+        movw 0x026a, 0x126a
+        movw 0x026c, 0x126c
+        movw 0x026e, 0x126e
+        movw 0x0270, 0x1270
+        movw 0x0272, 0x1272
+        movw 0x0274, 0x1274
+        movw 0x0276, 0x1276
+        movw 0x0278, 0x1278
+        movw 0x027a, 0x127a
+        movw 0x027c, 0x127c
+        movw 0x027e, 0x127e
+        movw 0x0280, 0x1280
+        movw 0x0282, 0x1282
+        movw 0x0284, 0x1284
+        movw 0x0286, 0x1286
+        movw 0x0288, 0x1288
+        movw 0x028a, 0x128a
+        movw 0x028c, 0x128c
+        movw 0x028e, 0x128e
+        movw 0x0290, 0x1290
+        movw 0x0292, 0x1292
+        movw 0x0294, 0x1294
+        movw 0x0296, 0x1296
+        movw 0x0298, 0x1298
+        movw 0x029a, 0x129a
+        movw 0x029c, 0x129c
+        movw 0x029e, 0x129e
+        movw 0x02a0, 0x12a0
+        movw 0x02a2, 0x12a2
+        movw 0x02a4, 0x12a4
+        movw 0x02a6, 0x12a6
+        movw 0x02a8, 0x12a8
+        movw 0x02aa, 0x12aa
+        movw 0x02ac, 0x12ac
+        movw 0x02ae, 0x12ae
+        movw 0x02b0, 0x12b0
+        movw 0x02b2, 0x12b2
+        movw 0x02b4, 0x12b4
+        movw 0x02b6, 0x12b6
+        movw 0x02b8, 0x12b8
+        movw 0x02ba, 0x12ba
+        movw 0x02bc, 0x12bc
+        movw 0x02be, 0x12be
+        movw 0x02c0, 0x12c0
+        movw 0x02c2, 0x12c2
+        movw 0x02c4, 0x12c4
+        movw 0x02c6, 0x12c6
+        movw 0x02c8, 0x12c8
+        movw 0x02ca, 0x12ca
+        movw 0x02cc, 0x12cc
+        movw 0x02ce, 0x12ce
+        movw 0x02d0, 0x12d0
+        movw 0x02d2, 0x12d2
+        movw 0x02d4, 0x12d4
+        movw 0x02d6, 0x12d6
+        movw 0x02d8, 0x12d8
+        movw 0x02da, 0x12da
+        movw 0x02dc, 0x12dc
+        movw 0x02de, 0x12de
+        movw 0x02e0, 0x12e0
+        movw 0x02e2, 0x12e2
+        movw 0x02e4, 0x12e4
+        movw 0x02e6, 0x12e6
+        movw 0x02e8, 0x12e8
+        movw 0x02ea, 0x12ea
+        movw 0x02ec, 0x12ec
+        movw 0x02ee, 0x12ee
+        movw 0x02f0, 0x12f0
+        movw 0x02f2, 0x12f2
+        movw 0x02f4, 0x12f4
+        movw 0x02f6, 0x12f6
+        movw 0x02f8, 0x12f8
+        movw 0x02fa, 0x12fa
+        movw 0x02fc, 0x12fc
+        movw 0x02fe, 0x12fe
+        movw 0x0300, 0x1300
+        movw 0x0302, 0x1302
+        movw 0x0304, 0x1304
+        movw 0x0306, 0x1306
+        movw 0x0308, 0x1308
+        movw 0x030a, 0x130a
+        movw 0x030c, 0x130c
+        movw 0x030e, 0x130e
+        movw 0x0310, 0x1310
+        movw 0x0312, 0x1312
+        movw 0x0314, 0x1314
+        movw 0x0316, 0x1316
+        movw 0x0318, 0x1318
+        movw 0x031a, 0x131a
+        movw 0x031c, 0x131c
+        movw 0x031e, 0x131e
+        movw 0x0320, 0x1320
+        movw 0x0322, 0x1322
+        movw 0x0324, 0x1324
+        movw 0x0326, 0x1326
+        movw 0x0328, 0x1328
+        movw 0x032a, 0x132a
+        movw 0x032c, 0x132c
+        movw 0x032e, 0x132e
+        movw 0x0330, 0x1330
+        movw 0x0332, 0x1332
+        movw 0x0334, 0x1334
+        movw 0x0336, 0x1336
+        movw 0x0338, 0x1338
+        movw 0x033a, 0x133a
+        movw 0x033c, 0x133c
+        movw 0x033e, 0x133e
+        movw 0x0340, 0x1340
+        movw 0x0342, 0x1342
+        movw 0x0344, 0x1344
+        movw 0x0346, 0x1346
+        movw 0x0348, 0x1348
+        movw 0x034a, 0x134a
+        movw 0x034c, 0x134c
+        movw 0x034e, 0x134e
+        movw 0x0350, 0x1350
+        movw 0x0352, 0x1352
+        movw 0x0354, 0x1354
+        movw 0x0356, 0x1356
+        movw 0x0358, 0x1358
+        movw 0x035a, 0x135a
+        movw 0x035c, 0x135c
+        movw 0x035e, 0x135e
+        movw 0x0360, 0x1360
+        movw 0x0362, 0x1362
+        movw 0x0364, 0x1364
+        movw 0x0366, 0x1366
+        movw 0x0368, 0x1368
+        movw 0x036a, 0x136a
+        movw 0x036c, 0x136c
+        movw 0x036e, 0x136e
+        movw 0x0370, 0x1370
+        movw 0x0372, 0x1372
+        movw 0x0374, 0x1374
+        movw 0x0376, 0x1376
+        movw 0x0378, 0x1378
+        movw 0x037a, 0x137a
+        movw 0x037c, 0x137c
+        movw 0x037e, 0x137e
+        movw 0x0380, 0x1380
+        movw 0x0382, 0x1382
+        movw 0x0384, 0x1384
+        movw 0x0386, 0x1386
+        movw 0x0388, 0x1388
+        movw 0x038a, 0x138a
+        movw 0x038c, 0x138c
+        movw 0x038e, 0x138e
+        movw 0x0390, 0x1390
+        movw 0x0392, 0x1392
+        movw 0x0394, 0x1394
+        movw 0x0396, 0x1396
+        movw 0x0398, 0x1398
+        movw 0x039a, 0x139a
+        movw 0x039c, 0x139c
+        movw 0x039e, 0x139e
+        movw 0x03a0, 0x13a0
+        movw 0x03a2, 0x13a2
+        movw 0x03a4, 0x13a4
+        movw 0x03a6, 0x13a6
+        movw 0x03a8, 0x13a8
+        movw 0x03aa, 0x13aa
+        movw 0x03ac, 0x13ac
+        movw 0x03ae, 0x13ae
+        movw 0x03b0, 0x13b0
+        movw 0x03b2, 0x13b2
+        movw 0x03b4, 0x13b4
+        movw 0x03b6, 0x13b6
+        movw 0x03b8, 0x13b8
+        movw 0x03ba, 0x13ba
+        movw 0x03bc, 0x13bc
+        movw 0x03be, 0x13be
+        movw 0x03c0, 0x13c0
+        movw 0x03c2, 0x13c2
+        movw 0x03c4, 0x13c4
+        movw 0x03c6, 0x13c6
+        movw 0x03c8, 0x13c8
+        movw 0x03ca, 0x13ca
+        movw 0x03cc, 0x13cc
+        movw 0x03ce, 0x13ce
+        movw 0x03d0, 0x13d0
+        movw 0x03d2, 0x13d2
+        movw 0x03d4, 0x13d4
+        movw 0x03d6, 0x13d6
+        movw 0x03d8, 0x13d8
+        movw 0x03da, 0x13da
+        movw 0x03dc, 0x13dc
+        movw 0x03de, 0x13de
+        movw 0x03e0, 0x13e0
+        movw 0x03e2, 0x13e2
+        movw 0x03e4, 0x13e4
+        movw 0x03e6, 0x13e6
+        movw 0x03e8, 0x13e8
+        movw 0x03ea, 0x13ea
+        movw 0x03ec, 0x13ec
+        movw 0x03ee, 0x13ee
+        movw 0x03f0, 0x13f0
+        movw 0x03f2, 0x13f2
+        movw 0x03f4, 0x13f4
+        movw 0x03f6, 0x13f6
+        movw 0x03f8, 0x13f8
+        movw 0x03fa, 0x13fa
+        movw 0x03fc, 0x13fc
+        movw 0x03fe, 0x13fe
+        movw 0x0400, 0x1400
+        movw 0x0402, 0x1402
+        movw 0x0404, 0x1404
+        movw 0x0406, 0x1406
+        movw 0x0408, 0x1408
+        movw 0x040a, 0x140a
+        movw 0x040c, 0x140c
+        movw 0x040e, 0x140e
+        movw 0x0410, 0x1410
+        movw 0x0412, 0x1412
+        movw 0x0414, 0x1414
+        movw 0x0416, 0x1416
+        movw 0x0418, 0x1418
+        movw 0x041a, 0x141a
+        movw 0x041c, 0x141c
+        movw 0x041e, 0x141e
+        movw 0x0420, 0x1420
+        movw 0x0422, 0x1422
+        movw 0x0424, 0x1424
+        movw 0x0426, 0x1426
+        movw 0x0428, 0x1428
+        movw 0x042a, 0x142a
+        movw 0x042c, 0x142c
+        movw 0x042e, 0x142e
+        movw 0x0430, 0x1430
+        movw 0x0432, 0x1432
+        movw 0x0434, 0x1434
+        movw 0x0436, 0x1436
+        movw 0x0438, 0x1438
+        movw 0x043a, 0x143a
+        movw 0x043c, 0x143c
+        movw 0x043e, 0x143e
+        movw 0x0440, 0x1440
+        movw 0x0442, 0x1442
+        movw 0x0444, 0x1444
+        movw 0x0446, 0x1446
+        movw 0x0448, 0x1448
+        movw 0x044a, 0x144a
+        movw 0x044c, 0x144c
+        movw 0x044e, 0x144e
+        movw 0x0450, 0x1450
+        movw 0x0452, 0x1452
+        movw 0x0454, 0x1454
+        movw 0x0456, 0x1456
+        movw 0x0458, 0x1458
+        movw 0x045a, 0x145a
+        movw 0x045c, 0x145c
+        movw 0x045e, 0x145e
+        movw 0x0460, 0x1460
+        movw 0x0462, 0x1462
+        movw 0x0464, 0x1464
+        movw 0x0466, 0x1466
+        movw 0x0468, 0x1468
+        movw 0x046a, 0x146a
+        movw 0x046c, 0x146c
+        movw 0x046e, 0x146e
+        movw 0x0470, 0x1470
+        movw 0x0472, 0x1472
+        movw 0x0474, 0x1474
+        movw 0x0476, 0x1476
+        movw 0x0478, 0x1478
+        movw 0x047a, 0x147a
+        movw 0x047c, 0x147c
+        movw 0x047e, 0x147e
+        movw 0x0480, 0x1480
+        movw 0x0482, 0x1482
+        movw 0x0484, 0x1484
+        movw 0x0486, 0x1486
+        movw 0x0488, 0x1488
+        movw 0x048a, 0x148a
+        movw 0x048c, 0x148c
+        movw 0x048e, 0x148e
+        movw 0x0490, 0x1490
+        movw 0x0492, 0x1492
+        movw 0x0494, 0x1494
+        movw 0x0496, 0x1496
+        movw 0x0498, 0x1498
+        movw 0x049a, 0x149a
+        movw 0x049c, 0x149c
+        movw 0x049e, 0x149e
+        movw 0x04a0, 0x14a0
+        movw 0x04a2, 0x14a2
+        movw 0x04a4, 0x14a4
+        movw 0x04a6, 0x14a6
+        movw 0x04a8, 0x14a8
+        movw 0x04aa, 0x14aa
+        movw 0x04ac, 0x14ac
+        movw 0x04ae, 0x14ae
+        movw 0x04b0, 0x14b0
+        movw 0x04b2, 0x14b2
+        movw 0x04b4, 0x14b4
+        movw 0x04b6, 0x14b6
+        movw 0x04b8, 0x14b8
+        movw 0x04ba, 0x14ba
+        movw 0x04bc, 0x14bc
+        movw 0x04be, 0x14be
+        movw 0x04c0, 0x14c0
+        movw 0x04c2, 0x14c2
+        movw 0x04c4, 0x14c4
+        movw 0x04c6, 0x14c6
+        movw 0x04c8, 0x14c8
+        movw 0x04ca, 0x14ca
+        movw 0x04cc, 0x14cc
+        movw 0x04ce, 0x14ce
+        movw 0x04d0, 0x14d0
+        movw 0x04d2, 0x14d2
+        movw 0x04d4, 0x14d4
+        movw 0x04d6, 0x14d6
+        movw 0x04d8, 0x14d8
+        movw 0x04da, 0x14da
+        movw 0x04dc, 0x14dc
+        movw 0x04de, 0x14de
+        movw 0x04e0, 0x14e0
+        movw 0x04e2, 0x14e2
+        movw 0x04e4, 0x14e4
+        movw 0x04e6, 0x14e6
+        movw 0x04e8, 0x14e8
+        movw 0x04ea, 0x14ea
+        movw 0x04ec, 0x14ec
+        movw 0x04ee, 0x14ee
+        movw 0x04f0, 0x14f0
+        movw 0x04f2, 0x14f2
+        movw 0x04f4, 0x14f4
+        movw 0x04f6, 0x14f6
+        movw 0x04f8, 0x14f8
+        movw 0x04fa, 0x14fa
+        movw 0x04fc, 0x14fc
+        movw 0x04fe, 0x14fe
+        movw 0x0500, 0x1500
+        movw 0x0502, 0x1502
+        movw 0x0504, 0x1504
+        movw 0x0506, 0x1506
+        movw 0x0508, 0x1508
+        movw 0x050a, 0x150a
+        movw 0x050c, 0x150c
+        movw 0x050e, 0x150e
+        movw 0x0510, 0x1510
+        movw 0x0512, 0x1512
+        movw 0x0514, 0x1514
+        movw 0x0516, 0x1516
+        movw 0x0518, 0x1518
+        movw 0x051a, 0x151a
+        movw 0x051c, 0x151c
+        movw 0x051e, 0x151e
+        movw 0x0520, 0x1520
+        movw 0x0522, 0x1522
+        movw 0x0524, 0x1524
+        movw 0x0526, 0x1526
+        movw 0x0528, 0x1528
+        movw 0x052a, 0x152a
+        movw 0x052c, 0x152c
+        movw 0x052e, 0x152e
+        movw 0x0530, 0x1530
+        movw 0x0532, 0x1532
+        movw 0x0534, 0x1534
+        movw 0x0536, 0x1536
+        movw 0x0538, 0x1538
+        movw 0x053a, 0x153a
+        movw 0x053c, 0x153c
+        movw 0x053e, 0x153e
+        movw 0x0540, 0x1540
+        movw 0x0542, 0x1542
+        movw 0x0544, 0x1544
+        movw 0x0546, 0x1546
+        movw 0x0548, 0x1548
+        movw 0x054a, 0x154a
+        movw 0x054c, 0x154c
+        movw 0x054e, 0x154e
+        movw 0x0550, 0x1550
+        movw 0x0552, 0x1552
+        ldx #0x1234
+        ldaa #0x01
+        rts
+        rts
+        rts
+; bank b
+        movw 0x0000, 0x1000
+        movw 0x0002, 0x1002
+        movw 0x0004, 0x1004
+        movw 0x0006, 0x1006
+        movw 0x0008, 0x1008
+        movw 0x000a, 0x100a
+        movw 0x000c, 0x100c
+        movw 0x000e, 0x100e
+        movw 0x0010, 0x1010
+        movw 0x0012, 0x1012
+        movw 0x0014, 0x1014
+        movw 0x0016, 0x1016
+        movw 0x0018, 0x1018
+        movw 0x001a, 0x101a
+        movw 0x001c, 0x101c
+        movw 0x001e, 0x101e
+        movw 0x0020, 0x1020
+        movw 0x0022, 0x1022
+        movw 0x0024, 0x1024
+        movw 0x0026, 0x1026
+        movw 0x0028, 0x1028
+        movw 0x002a, 0x102a
+        movw 0x002c, 0x102c
+        movw 0x002e, 0x102e
+        movw 0x0030, 0x1030
+        movw 0x0032, 0x1032
+        movw 0x0034, 0x1034
+        movw 0x0036, 0x1036
+        movw 0x0038, 0x1038
+        movw 0x003a, 0x103a
+        movw 0x003c, 0x103c
+        movw 0x003e, 0x103e
+        movw 0x0040, 0x1040
+        movw 0x0042, 0x1042
+        movw 0x0044, 0x1044
+        movw 0x0046, 0x1046
+        movw 0x0048, 0x1048
+        movw 0x004a, 0x104a
+        movw 0x004c, 0x104c
+        movw 0x004e, 0x104e
+        movw 0x0050, 0x1050
+        movw 0x0052, 0x1052
+        movw 0x0054, 0x1054
+        movw 0x0056, 0x1056
+        movw 0x0058, 0x1058
+        movw 0x005a, 0x105a
+        movw 0x005c, 0x105c
+        movw 0x005e, 0x105e
+        movw 0x0060, 0x1060
+        movw 0x0062, 0x1062
+        movw 0x0064, 0x1064
+        movw 0x0066, 0x1066
+        movw 0x0068, 0x1068
+        movw 0x006a, 0x106a
+        movw 0x006c, 0x106c
+        movw 0x006e, 0x106e
+        movw 0x0070, 0x1070
+        movw 0x0072, 0x1072
+        movw 0x0074, 0x1074
+        movw 0x0076, 0x1076
+        movw 0x0078, 0x1078
+        movw 0x007a, 0x107a
+        movw 0x007c, 0x107c
+        movw 0x007e, 0x107e
+        movw 0x0080, 0x1080
+        movw 0x0082, 0x1082
+        movw 0x0084, 0x1084
+        movw 0x0086, 0x1086
+        movw 0x0088, 0x1088
+        movw 0x008a, 0x108a
+        movw 0x008c, 0x108c
+        movw 0x008e, 0x108e
+        movw 0x0090, 0x1090
+        movw 0x0092, 0x1092
+        movw 0x0094, 0x1094
+        movw 0x0096, 0x1096
+        movw 0x0098, 0x1098
+        movw 0x009a, 0x109a
+        movw 0x009c, 0x109c
+        movw 0x009e, 0x109e
+        movw 0x00a0, 0x10a0
+        movw 0x00a2, 0x10a2
+        movw 0x00a4, 0x10a4
+        movw 0x00a6, 0x10a6
+        movw 0x00a8, 0x10a8
+        movw 0x00aa, 0x10aa
+        movw 0x00ac, 0x10ac
+        movw 0x00ae, 0x10ae
+        movw 0x00b0, 0x10b0
+        movw 0x00b2, 0x10b2
+        movw 0x00b4, 0x10b4
+        movw 0x00b6, 0x10b6
+        movw 0x00b8, 0x10b8
+        movw 0x00ba, 0x10ba
+        movw 0x00bc, 0x10bc
+        movw 0x00be, 0x10be
+        movw 0x00c0, 0x10c0
+        movw 0x00c2, 0x10c2
+        movw 0x00c4, 0x10c4
+        movw 0x00c6, 0x10c6
+        movw 0x00c8, 0x10c8
+        movw 0x00ca, 0x10ca
+        movw 0x00cc, 0x10cc
+        movw 0x00ce, 0x10ce
+        movw 0x00d0, 0x10d0
+        movw 0x00d2, 0x10d2
+        movw 0x00d4, 0x10d4
+        movw 0x00d6, 0x10d6
+        movw 0x00d8, 0x10d8
+        movw 0x00da, 0x10da
+        movw 0x00dc, 0x10dc
+        movw 0x00de, 0x10de
+        movw 0x00e0, 0x10e0
+        movw 0x00e2, 0x10e2
+        movw 0x00e4, 0x10e4
+        movw 0x00e6, 0x10e6
+        movw 0x00e8, 0x10e8
+        movw 0x00ea, 0x10ea
+        movw 0x00ec, 0x10ec
+        movw 0x00ee, 0x10ee
+        movw 0x00f0, 0x10f0
+        movw 0x00f2, 0x10f2
+        movw 0x00f4, 0x10f4
+        movw 0x00f6, 0x10f6
+        movw 0x00f8, 0x10f8
+        movw 0x00fa, 0x10fa
+        movw 0x00fc, 0x10fc
+        movw 0x00fe, 0x10fe
+        movw 0x0100, 0x1100
+        movw 0x0102, 0x1102
+        movw 0x0104, 0x1104
+        movw 0x0106, 0x1106
+        movw 0x0108, 0x1108
+        movw 0x010a, 0x110a
+        movw 0x010c, 0x110c
+        movw 0x010e, 0x110e
+        movw 0x0110, 0x1110
+        movw 0x0112, 0x1112
+        movw 0x0114, 0x1114
+        movw 0x0116, 0x1116
+        movw 0x0118, 0x1118
+        movw 0x011a, 0x111a
+        movw 0x011c, 0x111c
+        movw 0x011e, 0x111e
+        movw 0x0120, 0x1120
+        movw 0x0122, 0x1122
+        movw 0x0124, 0x1124
+        movw 0x0126, 0x1126
+        movw 0x0128, 0x1128
+        movw 0x012a, 0x112a
+        movw 0x012c, 0x112c
+        movw 0x012e, 0x112e
+        movw 0x0130, 0x1130
+        movw 0x0132, 0x1132
+        movw 0x0134, 0x1134
+        movw 0x0136, 0x1136
+        movw 0x0138, 0x1138
+        movw 0x013a, 0x113a
+        movw 0x013c, 0x113c
+        movw 0x013e, 0x113e
+        movw 0x0140, 0x1140
+        movw 0x0142, 0x1142
+        movw 0x0144, 0x1144
+        movw 0x0146, 0x1146
+        movw 0x0148, 0x1148
+        movw 0x014a, 0x114a
+        movw 0x014c, 0x114c
+        movw 0x014e, 0x114e
+        movw 0x0150, 0x1150
+        movw 0x0152, 0x1152
+        movw 0x0154, 0x1154
+        movw 0x0156, 0x1156
+        movw 0x0158, 0x1158
+        movw 0x015a, 0x115a
+        movw 0x015c, 0x115c
+        movw 0x015e, 0x115e
+        movw 0x0160, 0x1160
+        movw 0x0162, 0x1162
+        movw 0x0164, 0x1164
+        movw 0x0166, 0x1166
+        movw 0x0168, 0x1168
+        movw 0x016a, 0x116a
+        movw 0x016c, 0x116c
+        movw 0x016e, 0x116e
+        movw 0x0170, 0x1170
+        movw 0x0172, 0x1172
+        movw 0x0174, 0x1174
+        movw 0x0176, 0x1176
+        movw 0x0178, 0x1178
+        movw 0x017a, 0x117a
+        movw 0x017c, 0x117c
+        movw 0x017e, 0x117e
+        movw 0x0180, 0x1180
+        movw 0x0182, 0x1182
+        movw 0x0184, 0x1184
+        movw 0x0186, 0x1186
+        movw 0x0188, 0x1188
+        movw 0x018a, 0x118a
+        movw 0x018c, 0x118c
+        movw 0x018e, 0x118e
+        movw 0x0190, 0x1190
+        movw 0x0192, 0x1192
+        movw 0x0194, 0x1194
+        movw 0x0196, 0x1196
+        movw 0x0198, 0x1198
+        movw 0x019a, 0x119a
+        movw 0x019c, 0x119c
+        movw 0x019e, 0x119e
+        movw 0x01a0, 0x11a0
+        movw 0x01a2, 0x11a2
+        movw 0x01a4, 0x11a4
+        movw 0x01a6, 0x11a6
+        movw 0x01a8, 0x11a8
+        movw 0x01aa, 0x11aa
+        movw 0x01ac, 0x11ac
+        movw 0x01ae, 0x11ae
+        movw 0x01b0, 0x11b0
+        movw 0x01b2, 0x11b2
+        movw 0x01b4, 0x11b4
+        movw 0x01b6, 0x11b6
+        movw 0x01b8, 0x11b8
+        movw 0x01ba, 0x11ba
+        movw 0x01bc, 0x11bc
+        movw 0x01be, 0x11be
+        movw 0x01c0, 0x11c0
+        movw 0x01c2, 0x11c2
+        movw 0x01c4, 0x11c4
+        movw 0x01c6, 0x11c6
+        movw 0x01c8, 0x11c8
+        movw 0x01ca, 0x11ca
+        movw 0x01cc, 0x11cc
+        movw 0x01ce, 0x11ce
+        movw 0x01d0, 0x11d0
+        movw 0x01d2, 0x11d2
+        movw 0x01d4, 0x11d4
+        movw 0x01d6, 0x11d6
+        movw 0x01d8, 0x11d8
+        movw 0x01da, 0x11da
+        movw 0x01dc, 0x11dc
+        movw 0x01de, 0x11de
+        movw 0x01e0, 0x11e0
+        movw 0x01e2, 0x11e2
+        movw 0x01e4, 0x11e4
+        movw 0x01e6, 0x11e6
+        movw 0x01e8, 0x11e8
+        movw 0x01ea, 0x11ea
+        movw 0x01ec, 0x11ec
+        movw 0x01ee, 0x11ee
+        movw 0x01f0, 0x11f0
+        movw 0x01f2, 0x11f2
+        movw 0x01f4, 0x11f4
+        movw 0x01f6, 0x11f6
+        movw 0x01f8, 0x11f8
+        movw 0x01fa, 0x11fa
+        movw 0x01fc, 0x11fc
+        movw 0x01fe, 0x11fe
+        movw 0x0200, 0x1200
+        movw 0x0202, 0x1202
+        movw 0x0204, 0x1204
+        movw 0x0206, 0x1206
+        movw 0x0208, 0x1208
+        movw 0x020a, 0x120a
+        movw 0x020c, 0x120c
+        movw 0x020e, 0x120e
+        movw 0x0210, 0x1210
+        movw 0x0212, 0x1212
+        movw 0x0214, 0x1214
+        movw 0x0216, 0x1216
+        movw 0x0218, 0x1218
+        movw 0x021a, 0x121a
+        movw 0x021c, 0x121c
+        movw 0x021e, 0x121e
+        movw 0x0220, 0x1220
+        movw 0x0222, 0x1222
+        movw 0x0224, 0x1224
+        movw 0x0226, 0x1226
+        movw 0x0228, 0x1228
+        movw 0x022a, 0x122a
+        movw 0x022c, 0x122c
+        movw 0x022e, 0x122e
+        movw 0x0230, 0x1230
+        movw 0x0232, 0x1232
+        movw 0x0234, 0x1234
+        movw 0x0236, 0x1236
+        movw 0x0238, 0x1238
+        movw 0x023a, 0x123a
+        movw 0x023c, 0x123c
+        movw 0x023e, 0x123e
+        movw 0x0240, 0x1240
+        movw 0x0242, 0x1242
+        movw 0x0244, 0x1244
+        movw 0x0246, 0x1246
+        movw 0x0248, 0x1248
+        movw 0x024a, 0x124a
+        movw 0x024c, 0x124c
+        movw 0x024e, 0x124e
+        movw 0x0250, 0x1250
+        movw 0x0252, 0x1252
+        movw 0x0254, 0x1254
+        movw 0x0256, 0x1256
+        movw 0x0258, 0x1258
+        movw 0x025a, 0x125a
+        movw 0x025c, 0x125c
+        movw 0x025e, 0x125e
+        movw 0x0260, 0x1260
+        movw 0x0262, 0x1262
+        movw 0x0264, 0x1264
+        movw 0x0266, 0x1266
+        movw 0x0268, 0x1268
+        movw 0x026a, 0x126a
+        movw 0x026c, 0x126c
+        movw 0x026e, 0x126e
+        movw 0x0270, 0x1270
+        movw 0x0272, 0x1272
+        movw 0x0274, 0x1274
+        movw 0x0276, 0x1276
+        movw 0x0278, 0x1278
+        movw 0x027a, 0x127a
+        movw 0x027c, 0x127c
+        movw 0x027e, 0x127e
+        movw 0x0280, 0x1280
+        movw 0x0282, 0x1282
+        movw 0x0284, 0x1284
+        movw 0x0286, 0x1286
+        movw 0x0288, 0x1288
+        movw 0x028a, 0x128a
+        movw 0x028c, 0x128c
+        movw 0x028e, 0x128e
+        movw 0x0290, 0x1290
+        movw 0x0292, 0x1292
+        movw 0x0294, 0x1294
+        movw 0x0296, 0x1296
+        movw 0x0298, 0x1298
+        movw 0x029a, 0x129a
+        movw 0x029c, 0x129c
+        movw 0x029e, 0x129e
+        movw 0x02a0, 0x12a0
+        movw 0x02a2, 0x12a2
+        movw 0x02a4, 0x12a4
+        movw 0x02a6, 0x12a6
+        movw 0x02a8, 0x12a8
+        movw 0x02aa, 0x12aa
+        movw 0x02ac, 0x12ac
+        movw 0x02ae, 0x12ae
+        movw 0x02b0, 0x12b0
+        movw 0x02b2, 0x12b2
+        movw 0x02b4, 0x12b4
+        movw 0x02b6, 0x12b6
+        movw 0x02b8, 0x12b8
+        movw 0x02ba, 0x12ba
+        movw 0x02bc, 0x12bc
+        movw 0x02be, 0x12be
+        movw 0x02c0, 0x12c0
+        movw 0x02c2, 0x12c2
+        movw 0x02c4, 0x12c4
+        movw 0x02c6, 0x12c6
+        movw 0x02c8, 0x12c8
+        movw 0x02ca, 0x12ca
+        movw 0x02cc, 0x12cc
+        movw 0x02ce, 0x12ce
+        movw 0x02d0, 0x12d0
+        movw 0x02d2, 0x12d2
+        movw 0x02d4, 0x12d4
+        movw 0x02d6, 0x12d6
+        movw 0x02d8, 0x12d8
+        movw 0x02da, 0x12da
+        movw 0x02dc, 0x12dc
+        movw 0x02de, 0x12de
+        movw 0x02e0, 0x12e0
+        movw 0x02e2, 0x12e2
+        movw 0x02e4, 0x12e4
+        movw 0x02e6, 0x12e6
+        movw 0x02e8, 0x12e8
+        movw 0x02ea, 0x12ea
+        movw 0x02ec, 0x12ec
+        movw 0x02ee, 0x12ee
+        movw 0x02f0, 0x12f0
+        movw 0x02f2, 0x12f2
+        movw 0x02f4, 0x12f4
+        movw 0x02f6, 0x12f6
+        movw 0x02f8, 0x12f8
+        movw 0x02fa, 0x12fa
+        movw 0x02fc, 0x12fc
+        movw 0x02fe, 0x12fe
+        movw 0x0300, 0x1300
+        movw 0x0302, 0x1302
+        movw 0x0304, 0x1304
+        movw 0x0306, 0x1306
+        movw 0x0308, 0x1308
+        movw 0x030a, 0x130a
+        movw 0x030c, 0x130c
+        movw 0x030e, 0x130e
+        movw 0x0310, 0x1310
+        movw 0x0312, 0x1312
+        movw 0x0314, 0x1314
+        movw 0x0316, 0x1316
+        movw 0x0318, 0x1318
+        movw 0x031a, 0x131a
+        movw 0x031c, 0x131c
+        movw 0x031e, 0x131e
+        movw 0x0320, 0x1320
+        movw 0x0322, 0x1322
+        movw 0x0324, 0x1324
+        movw 0x0326, 0x1326
+        movw 0x0328, 0x1328
+        movw 0x032a, 0x132a
+        movw 0x032c, 0x132c
+        movw 0x032e, 0x132e
+        movw 0x0330, 0x1330
+        movw 0x0332, 0x1332
+        movw 0x0334, 0x1334
+        movw 0x0336, 0x1336
+        movw 0x0338, 0x1338
+        movw 0x033a, 0x133a
+        movw 0x033c, 0x133c
+        movw 0x033e, 0x133e
+        movw 0x0340, 0x1340
+        movw 0x0342, 0x1342
+        movw 0x0344, 0x1344
+        movw 0x0346, 0x1346
+        movw 0x0348, 0x1348
+        movw 0x034a, 0x134a
+        movw 0x034c, 0x134c
+        movw 0x034e, 0x134e
+        movw 0x0350, 0x1350
+        movw 0x0352, 0x1352
+        movw 0x0354, 0x1354
+        movw 0x0356, 0x1356
+        movw 0x0358, 0x1358
+        movw 0x035a, 0x135a
+        movw 0x035c, 0x135c
+        movw 0x035e, 0x135e
+        movw 0x0360, 0x1360
+        movw 0x0362, 0x1362
+        movw 0x0364, 0x1364
+        movw 0x0366, 0x1366
+        movw 0x0368, 0x1368
+        movw 0x036a, 0x136a
+        movw 0x036c, 0x136c
+        movw 0x036e, 0x136e
+        movw 0x0370, 0x1370
+        movw 0x0372, 0x1372
+        movw 0x0374, 0x1374
+        movw 0x0376, 0x1376
+        movw 0x0378, 0x1378
+        movw 0x037a, 0x137a
+        movw 0x037c, 0x137c
+        movw 0x037e, 0x137e
+        movw 0x0380, 0x1380
+        movw 0x0382, 0x1382
+        movw 0x0384, 0x1384
+        movw 0x0386, 0x1386
+        movw 0x0388, 0x1388
+        movw 0x038a, 0x138a
+        movw 0x038c, 0x138c
+        movw 0x038e, 0x138e
+        movw 0x0390, 0x1390
+        movw 0x0392, 0x1392
+        movw 0x0394, 0x1394
+        movw 0x0396, 0x1396
+        movw 0x0398, 0x1398
+        movw 0x039a, 0x139a
+        movw 0x039c, 0x139c
+        movw 0x039e, 0x139e
+        movw 0x03a0, 0x13a0
+        movw 0x03a2, 0x13a2
+        movw 0x03a4, 0x13a4
+        movw 0x03a6, 0x13a6
+        movw 0x03a8, 0x13a8
+        movw 0x03aa, 0x13aa
+        movw 0x03ac, 0x13ac
+        movw 0x03ae, 0x13ae
+        movw 0x03b0, 0x13b0
+        movw 0x03b2, 0x13b2
+        movw 0x03b4, 0x13b4
+        movw 0x03b6, 0x13b6
+        movw 0x03b8, 0x13b8
+        movw 0x03ba, 0x13ba
+        movw 0x03bc, 0x13bc
+        movw 0x03be, 0x13be
+        movw 0x03c0, 0x13c0
+        movw 0x03c2, 0x13c2
+        movw 0x03c4, 0x13c4
+        movw 0x03c6, 0x13c6
+        movw 0x03c8, 0x13c8
+        movw 0x03ca, 0x13ca
+        movw 0x03cc, 0x13cc
+        movw 0x03ce, 0x13ce
+        movw 0x03d0, 0x13d0
+        movw 0x03d2, 0x13d2
+        movw 0x03d4, 0x13d4
+        movw 0x03d6, 0x13d6
+        movw 0x03d8, 0x13d8
+        movw 0x03da, 0x13da
+        movw 0x03dc, 0x13dc
+        movw 0x03de, 0x13de
+        movw 0x03e0, 0x13e0
+        movw 0x03e2, 0x13e2
+        movw 0x03e4, 0x13e4
+        movw 0x03e6, 0x13e6
+        movw 0x03e8, 0x13e8
+        movw 0x03ea, 0x13ea
+        movw 0x03ec, 0x13ec
+        movw 0x03ee, 0x13ee
+        movw 0x03f0, 0x13f0
+        movw 0x03f2, 0x13f2
+        movw 0x03f4, 0x13f4
+        movw 0x03f6, 0x13f6
+        movw 0x03f8, 0x13f8
+        movw 0x03fa, 0x13fa
+        movw 0x03fc, 0x13fc
+        movw 0x03fe, 0x13fe
+        movw 0x0400, 0x1400
+        movw 0x0402, 0x1402
+        movw 0x0404, 0x1404
+        movw 0x0406, 0x1406
+        movw 0x0408, 0x1408
+        movw 0x040a, 0x140a
+        movw 0x040c, 0x140c
+        movw 0x040e, 0x140e
+        movw 0x0410, 0x1410
+        movw 0x0412, 0x1412
+        movw 0x0414, 0x1414
+        movw 0x0416, 0x1416
+        movw 0x0418, 0x1418
+        movw 0x041a, 0x141a
+        movw 0x041c, 0x141c
+        movw 0x041e, 0x141e
+        movw 0x0420, 0x1420
+        movw 0x0422, 0x1422
+        movw 0x0424, 0x1424
+        movw 0x0426, 0x1426
+        movw 0x0428, 0x1428
+        movw 0x042a, 0x142a
+        movw 0x042c, 0x142c
+        movw 0x042e, 0x142e
+        movw 0x0430, 0x1430
+        movw 0x0432, 0x1432
+        movw 0x0434, 0x1434
+        movw 0x0436, 0x1436
+        movw 0x0438, 0x1438
+        movw 0x043a, 0x143a
+        movw 0x043c, 0x143c
+        movw 0x043e, 0x143e
+        movw 0x0440, 0x1440
+        movw 0x0442, 0x1442
+        movw 0x0444, 0x1444
+        movw 0x0446, 0x1446
+        movw 0x0448, 0x1448
+        movw 0x044a, 0x144a
+        movw 0x044c, 0x144c
+        movw 0x044e, 0x144e
+        movw 0x0450, 0x1450
+        movw 0x0452, 0x1452
+        movw 0x0454, 0x1454
+        movw 0x0456, 0x1456
+        movw 0x0458, 0x1458
+        movw 0x045a, 0x145a
+        movw 0x045c, 0x145c
+        movw 0x045e, 0x145e
+        movw 0x0460, 0x1460
+        movw 0x0462, 0x1462
+        movw 0x0464, 0x1464
+        movw 0x0466, 0x1466
+        movw 0x0468, 0x1468
+        movw 0x046a, 0x146a
+        movw 0x046c, 0x146c
+        movw 0x046e, 0x146e
+        movw 0x0470, 0x1470
+        movw 0x0472, 0x1472
+        movw 0x0474, 0x1474
+        movw 0x0476, 0x1476
+        movw 0x0478, 0x1478
+        movw 0x047a, 0x147a
+        movw 0x047c, 0x147c
+        movw 0x047e, 0x147e
+        movw 0x0480, 0x1480
+        movw 0x0482, 0x1482
+        movw 0x0484, 0x1484
+        movw 0x0486, 0x1486
+        movw 0x0488, 0x1488
+        movw 0x048a, 0x148a
+        movw 0x048c, 0x148c
+        movw 0x048e, 0x148e
+        movw 0x0490, 0x1490
+        movw 0x0492, 0x1492
+        movw 0x0494, 0x1494
+        movw 0x0496, 0x1496
+        movw 0x0498, 0x1498
+        movw 0x049a, 0x149a
+        movw 0x049c, 0x149c
+        movw 0x049e, 0x149e
+        movw 0x04a0, 0x14a0
+        movw 0x04a2, 0x14a2
+        movw 0x04a4, 0x14a4
+        movw 0x04a6, 0x14a6
+        movw 0x04a8, 0x14a8
+        movw 0x04aa, 0x14aa
+        movw 0x04ac, 0x14ac
+        movw 0x04ae, 0x14ae
+        movw 0x04b0, 0x14b0
+        movw 0x04b2, 0x14b2
+        movw 0x04b4, 0x14b4
+        movw 0x04b6, 0x14b6
+        movw 0x04b8, 0x14b8
+        movw 0x04ba, 0x14ba
+        movw 0x04bc, 0x14bc
+        movw 0x04be, 0x14be
+        movw 0x04c0, 0x14c0
+        movw 0x04c2, 0x14c2
+        movw 0x04c4, 0x14c4
+        movw 0x04c6, 0x14c6
+        movw 0x04c8, 0x14c8
+        movw 0x04ca, 0x14ca
+        movw 0x04cc, 0x14cc
+        movw 0x04ce, 0x14ce
+        movw 0x04d0, 0x14d0
+        movw 0x04d2, 0x14d2
+        movw 0x04d4, 0x14d4
+        movw 0x04d6, 0x14d6
+        movw 0x04d8, 0x14d8
+        movw 0x04da, 0x14da
+        movw 0x04dc, 0x14dc
+        movw 0x04de, 0x14de
+        movw 0x04e0, 0x14e0
+        movw 0x04e2, 0x14e2
+        movw 0x04e4, 0x14e4
+        movw 0x04e6, 0x14e6
+        movw 0x04e8, 0x14e8
+        movw 0x04ea, 0x14ea
+        movw 0x04ec, 0x14ec
+        movw 0x04ee, 0x14ee
+        movw 0x04f0, 0x14f0
+        movw 0x04f2, 0x14f2
+        movw 0x04f4, 0x14f4
+        movw 0x04f6, 0x14f6
+        movw 0x04f8, 0x14f8
+        movw 0x04fa, 0x14fa
+        movw 0x04fc, 0x14fc
+        movw 0x04fe, 0x14fe
+        movw 0x0500, 0x1500
+        movw 0x0502, 0x1502
+        movw 0x0504, 0x1504
+        movw 0x0506, 0x1506
+        movw 0x0508, 0x1508
+        movw 0x050a, 0x150a
+        movw 0x050c, 0x150c
+        movw 0x050e, 0x150e
+        movw 0x0510, 0x1510
+        movw 0x0512, 0x1512
+        movw 0x0514, 0x1514
+        movw 0x0516, 0x1516
+        movw 0x0518, 0x1518
+        movw 0x051a, 0x151a
+        movw 0x051c, 0x151c
+        movw 0x051e, 0x151e
+        movw 0x0520, 0x1520
+        movw 0x0522, 0x1522
+        movw 0x0524, 0x1524
+        movw 0x0526, 0x1526
+        movw 0x0528, 0x1528
+        movw 0x052a, 0x152a
+        movw 0x052c, 0x152c
+        movw 0x052e, 0x152e
+        movw 0x0530, 0x1530
+        movw 0x0532, 0x1532
+        movw 0x0534, 0x1534
+        movw 0x0536, 0x1536
+        movw 0x0538, 0x1538
+        movw 0x053a, 0x153a
+        movw 0x053c, 0x153c
+        movw 0x053e, 0x153e
+        movw 0x0540, 0x1540
+        movw 0x0542, 0x1542
+        movw 0x0544, 0x1544
+        movw 0x0546, 0x1546
+        movw 0x0548, 0x1548
+        movw 0x054a, 0x154a
+        movw 0x054c, 0x154c
+        movw 0x054e, 0x154e
+        movw 0x0550, 0x1550
+        movw 0x0552, 0x1552
+        ldx #0x1234
+        ldab #0x02
+        ldx #0x0000
+        rts
@@ -0,0 +1,13 @@
+; Checksums of the code, stored after it; see checksums.sums.
+        ldab #0x04
+        decb
+        bne 0x00002
+        rts
+        .byte 0x20
+        .byte 0x3f
+        .byte 0x2b
+        .byte 0x43
+        .byte 0x97
+        .byte 0xa3
+        .byte 0x11
+        .byte 0x17
@@ -0,0 +1,22 @@
+; Index arithmetic that carries into, or borrows from, the K field.
+        clrb
+        tbxk
+        ldx #0xffff
+        ldab #0x01
+        abx
+        ldx #0x1234
+        ldaa [%x]+0x00
+        aix #-0x01
+        ldaa [%x]+0x10
+        ldd #0xfffe
+        tbyk
+        adx
+        ldaa [%x]+0x00
+        ldy #0xffff
+        aiy #0x0001
+        ldaa [%y]+0x00
+; Y isn't known after this, so neither is YK after the aiy.
+        xgdy
+        aiy #0x0001
+        ldy #0x0000
+        ldaa [%y]+0x00
@@ -0,0 +1,9 @@
+; A call, a loop and some data, for the database tests.
+        jsr 0x00008
+        bra 0x00004
+        .byte 0xff
+        .byte 0xff
+        ldab #0x04
+        decb
+        bne 0x0000a
+        rts
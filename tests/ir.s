@@ -0,0 +1,16 @@
+; Byte writes into D and a write into XK, a loop, so X and B need phis,
+; and a call, after which everything but SP is unknown.
+        ldaa #0x12
+        ldab #0x34
+        tbxk
+        ldx #0x0000
+; 0x0000a
+        aix #0x01
+        decb
+        bne 0x0000a
+        jsr 0x00018
+        tstb
+        rts
+; 0x00018
+        clra
+        rts
@@ -0,0 +1,3 @@
+; An indexed jump as the very first instruction, so there is nothing in
+; front of it to search for a jump table.
+        jmp [%x]+0x00000
@@ -0,0 +1,16 @@
+; Three calls: one with a fixed time, one to rmac, whose time depends on
+; E, and one to wai, which takes as long as the interrupt does.
+        jsr 0x0000e
+        jsr 0x00014
+        jsr 0x00018
+        rts
+; 0x0000e
+        clr [%x]+0x00
+        staa [%x]+0x10
+        rts
+; 0x00014
+        rmac #0x1, #0x1
+        rts
+; 0x00018
+        wai
+        rts
@@ -0,0 +1,161 @@
+/*
+ * trace.c - render a PC trace as the instructions it ran
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * A trace is what the bench rigs log: a stream of 32-bit big-endian
+ * words, one per instruction executed, with the PC in the low 20 bits.
+ *
+ * Traces are tens of millions of samples over a few thousand distinct
+ * addresses, so every address gets decoded and formatted once, the first
+ * time it turns up, and the text is kept in a direct-mapped table over
+ * the whole 20-bit address space.  After that each sample is a lookup
+ * and a copy into the output buffer.  Anything with a label gets it on
+ * the line before, like the listing.
+ */
+#define ADDR_SPACE      0x100000
+#define SAMPLES         65536
+#define OUTBUF          (1024 * 1024)
+
+typedef struct memo_s {
+        uint32_t off;           // in text
+        uint32_t len;           // 0 if we haven't seen it yet
+} memo;
+
+typedef struct trace_s {
+        const image *img;
+        arena *arena;
+        memo *memo;
+        char *text;
+        size_t ntext;
+        size_t maxtext;
+} trace;
+
+static uint32_t
+be32(const uint8_t * const p)
+{
+        return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static int
+add_text(trace *t, const char * const s, size_t len)
+{
+        if (t->ntext + len > t->maxtext) {
+                size_t max = t->maxtext ? t->maxtext * 2 : OUTBUF;
+                char *text;
+
+                while (t->ntext + len > max)
+                        max *= 2;
+                text = arena_realloc(t->arena, t->text, t->maxtext, max);
+                if (!text)
+                        return -1;
+                t->text = text;
+                t->maxtext = max;
+        }
+        memcpy(t->text + t->ntext, s, len);
+        t->ntext += len;
+        return 0;
+}
+
+/*
+ * Decode and format pc the first time we see it.
+ */
+static memo *
+lookup(trace *t, uint32_t pc)
+{
+        const image *img = t->img;
+        memo *m = &t->memo[pc];
+        char line[INSN_LINE_MAX];
+        const symbol *sym;
+        size_t len;
+        insn insn;
+
+        if (m->len)
+                return m;
+
+        m->off = t->ntext;
+        sym = find_symbol(img, pc);
+        if (sym) {
+                const char *name = image_str(img, sym->name);
+
+                if (add_text(t, name, strlen(name)) < 0 ||
+                    add_text(t, ":\n", 2) < 0)
+                        return NULL;
+        }
+
+        if (pc >= img->size)
+                len = snprintf(line, sizeof(line),
+                               "%08x: %20s; not in the image", pc, "");
+        else if (decode_insn(img->buf, img->size, pc, &insn) < 0)
+                len = snprintf(line, sizeof(line),
+                               "%08x: %02hhx%18s.byte 0x%02hhx", pc,
+                               img->buf[pc], "", img->buf[pc]);
+        else
+                len = format_insn(line, img->buf, &insn);
+        line[len++] = '\n';
+        if (add_text(t, line, len) < 0)
+                return NULL;
+        m->len = t->ntext - m->off;
+        return m;
+}
+
+int
+print_trace(FILE *out, const image * const img, FILE *in)
+{
+        uint8_t *samples;
+        char *buf;
+        size_t nbuf = 0, n, left = 0;
+        arena scratch = { NULL, };
+        trace t = { img, &scratch, };
+        int rc = -1;
+
+        t.memo = arena_alloc(&scratch, ADDR_SPACE * sizeof(*t.memo));
+        samples = arena_alloc(&scratch, SAMPLES * 4);
+        buf = arena_alloc(&scratch, OUTBUF);
+        if (!t.memo || !samples || !buf)
+                goto out;
+
+        while ((n = fread(samples + left, 1, SAMPLES * 4 - left,
+                          in)) > 0) {
+                n += left;
+                for (size_t i = 0; i + 4 <= n; i += 4) {
+                        const memo *m = lookup(&t, be32(samples + i) &
+                                                   (ADDR_SPACE - 1));
+
+                        if (!m)
+                                goto out;
+                        if (nbuf + m->len > OUTBUF) {
+                                if (fwrite(buf, 1, nbuf, out) != nbuf)
+                                        goto out;
+                                nbuf = 0;
+                        }
+                        memcpy(buf + nbuf, t.text + m->off, m->len);
+                        nbuf += m->len;
+                }
+                left = n % 4;
+                memmove(samples, samples + n - left, left);
+        }
+        if (ferror(in) || fwrite(buf, 1, nbuf, out) != nbuf)
+                goto out;
+        if (left)
+                warnx("%s: trace ends with a partial sample",
+                      img->filename);
+        rc = 0;
+out:
+        arena_free(&scratch);
+        return rc;
+}
+
+// vim:fenc=utf-8:tw=75:et
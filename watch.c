@@ -0,0 +1,489 @@
+/*
+ * watch.c - keep listings of a directory's images up to date
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * Every image in the directory gets its listing written next to it as
+ * IMAGE.lst, and rewritten whenever inotify says the image was written or
+ * moved into place.  We keep the last copy of each image and its listing,
+ * so a new copy only has to be listed from a little before the first
+ * byte that changed: the sweep gets to every instruction before there
+ * the same way it did last time.  If the image is the same size, it can
+ * also stop once it's past the last changed byte and lands on a line the
+ * old listing starts on, since everything from there on lists the same
+ * way too; the rest is copied from the old listing.  (If the size
+ * changed, everything after the first change is listed again.)
+ *
+ * To find those spots, each image has a bit for every byte a line starts
+ * on, and, like IMAGE.sync, the line covering every INTERVAL'th byte and
+ * where it is in the listing.  The new listing goes to IMAGE.lst.new and
+ * is renamed over IMAGE.lst, so nothing ever reads half of one.  When an
+ * image is deleted or renamed away, its listing goes with it; one moved
+ * into place is listed under its new name.
+ */
+#define INTERVAL        4096
+#define EVENT_BUF       (64 * 1024)
+
+typedef struct watched_s {
+        char *name;
+        uint8_t *buf;
+        size_t size;
+        size_t stop;            // where decoding gave up
+        char *text;
+        size_t len;
+        uint64_t *starts;       // a line starts on this byte
+        size_t *at;             // the line covering every INTERVAL'th byte
+        size_t *off;            // ... and where it is in text
+        struct watched_s *next;
+} watched;
+
+static watched *images;
+
+static size_t
+npoints(size_t size)
+{
+        return (size + INTERVAL - 1) / INTERVAL;
+}
+
+static size_t
+nwords(size_t size)
+{
+        return (size + 63) / 64;
+}
+
+static int
+is_start(const uint64_t * const starts, size_t pos)
+{
+        return (starts[pos / 64] >> (pos % 64)) & 1;
+}
+
+/*
+ * Names we write ourselves, and the temporary files editors and linkers
+ * leave lying around, aren't images: dotfiles (vim's .NAME.swp, and the
+ * .NAME.XXXXXX that ld and objcopy write before renaming), emacs's
+ * #NAME# and NAME~, and anything that says it's temporary or partial.
+ */
+static int
+ignored(const char * const name)
+{
+        static const char * const suffixes[] = {
+                ".lst", ".new", ".sync", ".db",
+                "~", ".tmp", ".temp", ".swp", ".part", NULL
+        };
+        size_t len = strlen(name);
+
+        if (name[0] == '.' || name[0] == '#')
+                return 1;
+        for (int i = 0; suffixes[i]; i++) {
+                size_t n = strlen(suffixes[i]);
+
+                if (len >= n && !strcmp(name + len - n, suffixes[i]))
+                        return 1;
+        }
+        return 0;
+}
+
+static char *
+join(const char * const dir, const char * const name,
+     const char * const ext)
+{
+        char *path = malloc(strlen(dir) + strlen(name) + strlen(ext) + 2);
+
+        if (path)
+                sprintf(path, "%s/%s%s", dir, name, ext);
+        return path;
+}
+
+/*
+ * Where the line that starts on pos is in w's listing.
+ */
+static size_t
+text_offset(const watched * const w, size_t pos)
+{
+        size_t k, at, off;
+
+        if (pos >= w->size)
+                return w->len;
+        k = pos / INTERVAL;
+        at = w->at[k];
+        off = w->off[k];
+        while (at < pos) {
+                off = (char *)memchr(w->text + off, '\n', w->len - off) -
+                      w->text + 1;
+                while (!is_start(w->starts, ++at))
+                        ;
+        }
+        return off;
+}
+
+static void
+forget(watched *w)
+{
+        free(w->buf);
+        free(w->text);
+        free(w->starts);
+        free(w->at);
+        free(w->off);
+        w->buf = NULL;
+        w->text = NULL;
+        w->starts = NULL;
+        w->at = NULL;
+        w->off = NULL;
+        w->size = w->stop = w->len = 0;
+}
+
+static int
+write_lst(const char * const path, const char * const text, size_t len)
+{
+        char *tmp = malloc(strlen(path) + 5);
+        ssize_t n = 0;
+        int fd, rc = -1;
+
+        if (!tmp)
+                return -1;
+        sprintf(tmp, "%s.new", path);
+        fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+                goto out;
+        for (size_t done = 0; done < len; done += n) {
+                n = write(fd, text + done, len - done);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                n = 0;
+                                continue;
+                        }
+                        break;
+                }
+        }
+        if (close(fd) < 0 || n < 0 || rename(tmp, path) < 0) {
+                unlink(tmp);
+                goto out;
+        }
+        rc = 0;
+out:
+        free(tmp);
+        return rc;
+}
+
+/*
+ * Bring w up to date with its new contents, buf, which it takes over.
+ * Returns 1 with the bytes it had to list again in *fromp and *top, 0 if
+ * nothing changed, or -1 if it couldn't allocate what it needed.
+ */
+static int
+relist(watched *w, uint8_t *buf, size_t size, size_t *fromp, size_t *top)
+{
+        int same = w->buf && w->size == size;
+        size_t p = 0, e = size, from = 0, text_from = 0, stop = size;
+        size_t n = size < w->size ? size : w->size, k, pos, next;
+        size_t old_c = w->len, region_len = 0, *at, *off;
+        uint64_t *starts;
+        char *region = NULL, *text;
+        FILE *out;
+        int stopped = 0;
+
+        while (p < n && w->buf[p] == buf[p])
+                p++;
+        if (same && p == size) {
+                free(buf);
+                return 0;
+        }
+        if (same)
+                while (e > p && w->buf[e - 1] == buf[e - 1])
+                        e--;
+        if (w->size) {
+                k = p / INTERVAL;
+                if (k >= npoints(w->size))
+                        k = npoints(w->size) - 1;
+                from = w->at[k] < w->stop ? w->at[k] : w->stop;
+                text_from = text_offset(w, from);
+        }
+
+        /*
+         * The old ones say where the old listing's lines are until we're
+         * done, so these are new copies, of everything if the tail might
+         * be kept, or else of what's before from.
+         */
+        starts = calloc(nwords(size) + 1, sizeof(*starts));
+        at = calloc(npoints(size) + 1, sizeof(*at));
+        off = calloc(npoints(size) + 1, sizeof(*off));
+        if (!starts || !at || !off)
+                goto fail;
+        if (same) {
+                memcpy(starts, w->starts, nwords(size) * sizeof(*starts));
+                memcpy(at, w->at, npoints(size) * sizeof(*at));
+                memcpy(off, w->off, npoints(size) * sizeof(*off));
+        } else if (w->size) {
+                memcpy(starts, w->starts, from / 64 * sizeof(*starts));
+                starts[from / 64] = w->starts[from / 64] &
+                                    ((1ull << (from % 64)) - 1);
+                memcpy(at, w->at, npoints(from) * sizeof(*at));
+                memcpy(off, w->off, npoints(from) * sizeof(*off));
+        }
+
+        out = open_memstream(&region, &region_len);
+        if (!out)
+                goto fail;
+        k = npoints(from);
+        for (pos = from; pos < size; pos = next) {
+                char line[INSN_LINE_MAX];
+                size_t len;
+                insn insn;
+
+                if (same && pos >= e && is_start(w->starts, pos) &&
+                    stopped == (pos >= w->stop)) {
+                        old_c = text_offset(w, pos);
+                        if (!stopped)
+                                stop = w->stop;
+                        break;
+                }
+                if (!stopped && decode_insn(buf, size, pos, &insn) < 0) {
+                        stopped = 1;
+                        stop = pos;
+                }
+                if (stopped) {
+                        next = pos + 1;
+                        len = snprintf(line, sizeof(line),
+                                       "%08zx: %02hhx%18s.byte 0x%02hhx",
+                                       pos, buf[pos], "", buf[pos]);
+                } else {
+                        next = pos + insn.len;
+                        len = format_insn(line, buf, &insn);
+                }
+                line[len++] = '\n';
+
+                for (; k < npoints(size) && k * INTERVAL < next; k++) {
+                        at[k] = pos;
+                        off[k] = text_from + ftell(out);
+                }
+                for (size_t i = pos; i < next && i < size; i++)
+                        starts[i / 64] &= ~(1ull << (i % 64));
+                starts[pos / 64] |= 1ull << (pos % 64);
+                fwrite(line, 1, len, out);
+        }
+        if (fclose(out) == EOF)
+                goto fail;
+
+        /* the rest is the old listing, moved by however much this grew */
+        for (; k < npoints(size); k++)
+                off[k] = off[k] - old_c + text_from + region_len;
+
+        text = malloc(text_from + region_len + (w->len - old_c) + 1);
+        if (!text)
+                goto fail;
+        memcpy(text, w->text, text_from);
+        memcpy(text + text_from, region, region_len);
+        memcpy(text + text_from + region_len, w->text + old_c,
+               w->len - old_c);
+        free(region);
+
+        *fromp = from;
+        *top = pos;
+        free(w->starts);
+        free(w->at);
+        free(w->off);
+        free(w->buf);
+        free(w->text);
+        w->buf = buf;
+        w->size = size;
+        w->stop = stop;
+        w->len = text_from + region_len + (w->len - old_c);
+        w->text = text;
+        w->starts = starts;
+        w->at = at;
+        w->off = off;
+        return 1;
+
+fail:
+        free(region);
+        free(starts);
+        free(at);
+        free(off);
+        free(buf);
+        errno = ENOMEM;
+        return -1;
+}
+
+static watched *
+find_watched(const char * const name, int add)
+{
+        watched *w;
+
+        for (w = images; w; w = w->next)
+                if (!strcmp(w->name, name))
+                        return w;
+        if (!add)
+                return NULL;
+        w = calloc(1, sizeof(*w));
+        if (!w || !(w->name = strdup(name))) {
+                free(w);
+                return NULL;
+        }
+        w->next = images;
+        images = w;
+        return w;
+}
+
+/*
+ * Read dir/name again, and write its listing if it changed.
+ */
+static void
+update(const char * const dir, const char * const name)
+{
+        char *path = join(dir, name, "");
+        char *lst = join(dir, name, ".lst");
+        size_t size, from, to;
+        struct stat sb;
+        uint8_t *buf;
+        watched *w;
+        int rc;
+
+        if (!path || !lst)
+                err(4, "Could not allocate memory");
+        if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode))
+                goto out;
+        rc = read_image(path, &buf, &size);
+        if (rc) {
+                /* a linker that's still writing it will tell us again */
+                warn("Could not read \"%s\"", path);
+                goto out;
+        }
+        /* keep the last good listing, and keep watching */
+        if (have_checksums() && check_checksums(path, buf, size) > 0) {
+                warnx("%s: checksums do not match; not listed", path);
+                free(buf);
+                goto out;
+        }
+        w = find_watched(name, 1);
+        if (!w)
+                err(4, "Could not allocate memory");
+        rc = relist(w, buf, size, &from, &to);
+        if (rc < 0)
+                err(4, "Could not allocate memory");
+        if (!rc)
+                goto out;
+        if (write_lst(lst, w->text, w->len) < 0)
+                warn("Could not write \"%s\"", lst);
+        else
+                printf("%s: listed 0x%zx-0x%zx\n", lst, from, to);
+        fflush(stdout);
+out:
+        free(path);
+        free(lst);
+}
+
+/*
+ * dir/name is gone, so its listing goes too.
+ */
+static void
+drop(const char * const dir, const char * const name)
+{
+        char *lst = join(dir, name, ".lst");
+        watched *w = find_watched(name, 0);
+
+        if (!lst)
+                err(4, "Could not allocate memory");
+        if (w)
+                forget(w);
+        if (unlink(lst) == 0)
+                printf("%s: removed\n", lst);
+        else if (errno != ENOENT)
+                warn("Could not remove \"%s\"", lst);
+        fflush(stdout);
+        free(lst);
+}
+
+static int
+scan(const char * const dir)
+{
+        DIR *d = opendir(dir);
+        struct dirent *de;
+
+        if (!d)
+                return -1;
+        while ((de = readdir(d)))
+                if (!ignored(de->d_name))
+                        update(dir, de->d_name);
+        closedir(d);
+        return 0;
+}
+
+/*
+ * List everything in dir, and then keep doing it as things change, until
+ * dir goes away.  Returns -1 with errno set if it can't be watched.
+ */
+int
+watch_dir(const char * const dir)
+{
+        static union {
+                struct inotify_event ev;        // for its alignment
+                char buf[EVENT_BUF];
+        } events;
+        int fd;
+
+        fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0)
+                return -1;
+        /* watch first, so nothing written while we scan gets missed */
+        if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO |
+                                       IN_DELETE | IN_MOVED_FROM |
+                                       IN_DELETE_SELF | IN_MOVE_SELF |
+                                       IN_ONLYDIR) < 0 ||
+            scan(dir) < 0) {
+                close(fd);
+                return -1;
+        }
+
+        for (;;) {
+                ssize_t len = read(fd, events.buf, sizeof(events.buf));
+
+                if (len < 0 && errno == EINTR)
+                        continue;
+                if (len <= 0) {
+                        close(fd);
+                        return -1;
+                }
+                for (char *p = events.buf; p < events.buf + len; ) {
+                        const struct inotify_event *ev = (void *)p;
+
+                        p += sizeof(*ev) + ev->len;
+                        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF |
+                                        IN_IGNORED)) {
+                                close(fd);
+                                return 0;
+                        }
+                        if (ev->mask & IN_Q_OVERFLOW) {
+                                scan(dir);
+                                continue;
+                        }
+                        if (!ev->len || (ev->mask & IN_ISDIR) ||
+                            ignored(ev->name))
+                                continue;
+                        if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                                drop(dir, ev->name);
+                                continue;
+                        }
+                        update(dir, ev->name);
+                }
+        }
+}
+
+// vim:fenc=utf-8:tw=75:et
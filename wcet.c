@@ -0,0 +1,635 @@
+/*
+ * wcet.c - cycle counts and worst case execution time
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * The bound for a function is the longest path through its CFG, where a
+ * block costs the worst case of each of its instructions plus the bound
+ * of anything it calls.  Back edges are found with a DFS; each loop
+ * header then adds (N - 1) times the longest trip around its loop, where
+ * N is the bound given for it with --loop-bound, and the rest is longest
+ * path over what's left, which is a DAG.
+ *
+ * Bounds for called functions are kept per image, so a whole image costs
+ * one pass over each function no matter how often it's called.  Loops
+ * nobody put a bound on, recursion, anything we can't follow (indirect
+ * jumps and calls) and instructions that take as long as they take
+ * (rmac, and waiting for an interrupt) make the result unbounded or
+ * unknown, and we say why.
+ */
+#define NO_PATH         INT64_MIN
+
+enum {
+        WHY_NONE,
+        WHY_INDIRECT_JUMP,
+        WHY_INDIRECT_CALL,
+        WHY_LOST,
+        WHY_IRREDUCIBLE,
+        WHY_NO_BOUND,
+        WHY_RECURSION,
+        WHY_REPEATS,
+        WHY_WAITS,
+};
+
+static const char * const whys[] = {
+        [WHY_NONE] = "",
+        [WHY_INDIRECT_JUMP] = "indirect jump",
+        [WHY_INDIRECT_CALL] = "indirect call",
+        [WHY_LOST] = "branch out of the image",
+        [WHY_IRREDUCIBLE] = "overlapping loops",
+        [WHY_NO_BOUND] = "loop with no bound",
+        [WHY_RECURSION] = "recursive call",
+        [WHY_REPEATS] = "repeat count in E",
+        [WHY_WAITS] = "wait for an interrupt",
+};
+
+/*
+ * What's worst about a result, and why.  unknown and unbounded each
+ * remember the first thing that made them so.
+ */
+typedef struct why_s {
+        uint8_t unknown;
+        uint8_t unbounded;
+        uint32_t unknown_at;
+        uint32_t unbounded_at;
+} why;
+
+typedef struct callee_s {
+        int64_t cycles;
+        why why;
+        uint8_t state;
+} callee;
+
+#define CALLEE_ACTIVE   1
+#define CALLEE_DONE     2
+
+typedef struct wcet_ctx_s {
+        const image *img;
+        const loop_bound *bounds;
+        uint32_t nbounds;
+        callee *callees;        // by instruction index
+        arena *scratch;
+        int failed;
+} wcet_ctx;
+
+/*
+ * One function's CFG.  Blocks are in address order; post[] is them in
+ * DFS post-order, so every edge that isn't a back edge goes from later in
+ * post[] to earlier.
+ */
+typedef struct cfg_s {
+        block *blocks;
+        uint32_t nblocks;
+        int32_t **succ;         // block indices, -1 if it isn't one
+        uint8_t **back;         // the edge is a back edge
+        uint32_t *post;
+        int64_t *cost;
+        int64_t *memo;          // longest paths: the function, then loops
+        int32_t *loop;          // index into loops[] if it's a header
+        struct {
+                uint32_t header;
+                uint8_t *body;
+                int64_t iter;
+                uint8_t state;
+                uint32_t bound;
+        } *loops;
+        uint32_t nloops;
+        why why;
+} cfg;
+
+static int64_t
+add(int64_t a, int64_t b)
+{
+        if (a == NO_PATH || b == NO_PATH)
+                return NO_PATH;
+        if (a >= WCET_UNKNOWN || b >= WCET_UNKNOWN)
+                return a > b ? a : b;
+        if (a + b >= WCET_UNKNOWN)
+                return WCET_UNBOUNDED;
+        return a + b;
+}
+
+static int64_t
+max(int64_t a, int64_t b)
+{
+        return a > b ? a : b;
+}
+
+static int64_t
+give_up(why *why, int64_t result, uint8_t reason, uint32_t addr)
+{
+        if (result == WCET_UNKNOWN && !why->unknown) {
+                why->unknown = reason;
+                why->unknown_at = addr;
+        } else if (result == WCET_UNBOUNDED && !why->unbounded) {
+                why->unbounded = reason;
+                why->unbounded_at = addr;
+        }
+        return result;
+}
+
+static void
+merge_why(why *to, const why * const from)
+{
+        if (from->unknown)
+                give_up(to, WCET_UNKNOWN, from->unknown, from->unknown_at);
+        if (from->unbounded)
+                give_up(to, WCET_UNBOUNDED, from->unbounded,
+                        from->unbounded_at);
+}
+
+static int64_t function_wcet(wcet_ctx *w, uint32_t entry, why *why,
+                             FILE *detail);
+
+/*
+ * The worst case for straight through one block, calls included.
+ */
+static int64_t
+block_cost(wcet_ctx *w, const block * const b, why *why)
+{
+        const image *img = w->img;
+        const insn_rec *recs = image_section(img, SEC_INSNS, insn_rec);
+        int64_t i = find_insn(img, b->start);
+        int64_t cost = 0;
+
+        for (; i >= 0 && i < image_count(img, SEC_INSNS) &&
+               recs[i].addr < b->end; i++) {
+                int64_t to;
+                insn insn;
+                int c;
+
+                if (recs[i].flags & INSN_BYTES)
+                        return give_up(why, WCET_UNKNOWN, WHY_LOST,
+                                       recs[i].addr);
+
+                rec_to_insn(&recs[i], &insn);
+                if (insn_timing(&insn).open == TIME_REPEATS)
+                        cost = add(cost, give_up(why, WCET_UNKNOWN,
+                                                 WHY_REPEATS,
+                                                 recs[i].addr));
+                else if (insn_timing(&insn).open == TIME_WAITS)
+                        cost = add(cost, give_up(why, WCET_UNBOUNDED,
+                                                 WHY_WAITS,
+                                                 recs[i].addr));
+                c = insn_cycles(&insn, 0);
+                if (insn_cycles(&insn, 1) > c)
+                        c = insn_cycles(&insn, 1);
+                cost = add(cost, c);
+
+                if (!(insn_flow(&insn) & FLOW_CALL))
+                        continue;
+                to = branch_target(&insn);
+                if (to < 0)
+                        cost = add(cost, give_up(why, WCET_UNKNOWN,
+                                                 WHY_INDIRECT_CALL,
+                                                 recs[i].addr));
+                else
+                        cost = add(cost, function_wcet(w, to, why, NULL));
+        }
+
+        if (b->open)
+                cost = add(cost, give_up(why, WCET_UNKNOWN,
+                                         WHY_INDIRECT_JUMP, b->end));
+        return cost;
+}
+
+static int32_t
+block_index(const cfg * const g, uint32_t addr)
+{
+        uint32_t lo = 0, hi = g->nblocks;
+
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                if (g->blocks[mid].start < addr)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        if (lo < g->nblocks && g->blocks[lo].start == addr)
+                return lo;
+        return -1;
+}
+
+/*
+ * Number the blocks in post-order and mark the back edges.
+ */
+static int
+find_back_edges(cfg *g, int32_t entry, arena *scratch)
+{
+        uint8_t *color = arena_alloc(scratch, g->nblocks);
+        uint32_t *stack = arena_alloc(scratch,
+                                      g->nblocks * sizeof(*stack));
+        uint32_t *next = arena_alloc(scratch, g->nblocks * sizeof(*next));
+        uint32_t nstack = 0, npost = 0;
+
+        if (!color || !stack || !next)
+                return -1;
+
+        color[entry] = 1;
+        stack[nstack++] = entry;
+        while (nstack) {
+                uint32_t b = stack[nstack - 1];
+                int32_t s;
+
+                if (next[b] == g->blocks[b].nsucc) {
+                        color[b] = 2;
+                        g->post[npost++] = b;
+                        nstack--;
+                        continue;
+                }
+                s = g->succ[b][next[b]++];
+                if (s < 0)
+                        continue;
+                if (color[s] == 1)
+                        g->back[b][next[b] - 1] = 1;
+                else if (!color[s]) {
+                        color[s] = 1;
+                        stack[nstack++] = s;
+                }
+        }
+        return 0;
+}
+
+/*
+ * The natural loop of each header: it, and everything that gets to one
+ * of its back edges without going through it.
+ */
+static int
+find_loops(wcet_ctx *w, cfg *g, arena *scratch)
+{
+        uint32_t *preds, *npreds, *first, *stack;
+        uint32_t nedges = 0;
+
+        npreds = arena_alloc(scratch, g->nblocks * sizeof(*npreds));
+        first = arena_alloc(scratch, (g->nblocks + 1) * sizeof(*first));
+        stack = arena_alloc(scratch, g->nblocks * sizeof(*stack));
+        g->loops = arena_alloc(scratch, g->nblocks * sizeof(*g->loops));
+        if (!npreds || !first || !stack || !g->loops)
+                return -1;
+
+        for (uint32_t b = 0; b < g->nblocks; b++) {
+                g->loop[b] = -1;
+                for (uint32_t j = 0; j < g->blocks[b].nsucc; j++) {
+                        if (g->succ[b][j] < 0)
+                                continue;
+                        npreds[g->succ[b][j]]++;
+                        nedges++;
+                        if (g->back[b][j] && g->loop[g->succ[b][j]] < 0)
+                                g->loop[g->succ[b][j]] = g->nloops++;
+                }
+        }
+        if (!g->nloops)
+                return 0;
+
+        preds = arena_alloc(scratch,
+                            (nedges ? nedges : 1) * sizeof(*preds));
+        if (!preds)
+                return -1;
+        for (uint32_t b = 0; b < g->nblocks; b++)
+                first[b + 1] = first[b] + npreds[b];
+        memset(npreds, 0, g->nblocks * sizeof(*npreds));
+        for (uint32_t b = 0; b < g->nblocks; b++)
+                for (uint32_t j = 0; j < g->blocks[b].nsucc; j++)
+                        if (g->succ[b][j] >= 0) {
+                                int32_t s = g->succ[b][j];
+
+                                preds[first[s] + npreds[s]++] = b;
+                        }
+
+        for (uint32_t h = 0; h < g->nblocks; h++) {
+                uint32_t nstack = 0;
+                uint8_t *body;
+                int32_t l = g->loop[h];
+
+                if (l < 0)
+                        continue;
+                body = arena_alloc(scratch, g->nblocks);
+                if (!body)
+                        return -1;
+                g->loops[l].header = h;
+                g->loops[l].body = body;
+                g->loops[l].bound = 0;
+                for (uint32_t i = 0; i < w->nbounds; i++)
+                        if (w->bounds[i].addr == g->blocks[h].start)
+                                g->loops[l].bound = w->bounds[i].count;
+
+                body[h] = 1;
+                for (uint32_t p = first[h]; p < first[h + 1]; p++) {
+                        uint32_t b = preds[p];
+
+                        for (uint32_t j = 0; j < g->blocks[b].nsucc; j++)
+                                if (g->back[b][j] &&
+                                    g->succ[b][j] == (int32_t)h &&
+                                    !body[b]) {
+                                        body[b] = 1;
+                                        stack[nstack++] = b;
+                                }
+                }
+                while (nstack) {
+                        uint32_t b = stack[--nstack];
+
+                        for (uint32_t p = first[b]; p < first[b + 1]; p++)
+                                if (!body[preds[p]]) {
+                                        body[preds[p]] = 1;
+                                        stack[nstack++] = preds[p];
+                                }
+                }
+        }
+        return 0;
+}
+
+static int64_t loop_extra(cfg *g, uint32_t b);
+
+/*
+ * Longest path from each block, in post-order so a block's successors
+ * are always done first.  For a loop (l >= 0) that's only within its
+ * body and only as far as its back edges; for the whole function (l < 0)
+ * it's to wherever the function ends.
+ */
+static int64_t
+longest_path(cfg *g, int32_t l, uint32_t from)
+{
+        int64_t *memo = g->memo + (size_t)(l + 1) * g->nblocks;
+        const uint8_t *body = l >= 0 ? g->loops[l].body : NULL;
+        uint32_t header = l >= 0 ? g->loops[l].header : 0;
+
+        for (uint32_t p = 0; p < g->nblocks; p++) {
+                uint32_t b = g->post[p];
+                int64_t best = NO_PATH;
+                int any = 0;
+
+                if (body && !body[b])
+                        continue;
+                for (uint32_t j = 0; j < g->blocks[b].nsucc; j++) {
+                        int32_t s = g->succ[b][j];
+
+                        if (s < 0)
+                                continue;
+                        if (g->back[b][j]) {
+                                if (body && s == (int32_t)header)
+                                        best = max(best, 0);
+                                continue;
+                        }
+                        any = 1;
+                        if (!body || body[s])
+                                best = max(best, memo[s]);
+                }
+                if (!body && !any)
+                        best = 0;
+                memo[b] = add(g->cost[b], best);
+                if (!body || b != header)
+                        memo[b] = add(memo[b], loop_extra(g, b));
+        }
+        return memo[from];
+}
+
+/*
+ * One trip around a loop, worst case.
+ */
+static int64_t
+loop_iter(cfg *g, int32_t l)
+{
+        if (g->loops[l].state == CALLEE_DONE)
+                return g->loops[l].iter;
+        if (g->loops[l].state == CALLEE_ACTIVE)
+                return give_up(&g->why, WCET_UNKNOWN, WHY_IRREDUCIBLE,
+                               g->blocks[g->loops[l].header].start);
+
+        g->loops[l].state = CALLEE_ACTIVE;
+        g->loops[l].iter = longest_path(g, l, g->loops[l].header);
+        if (g->loops[l].iter == NO_PATH)
+                g->loops[l].iter = 0;
+        g->loops[l].state = CALLEE_DONE;
+        return g->loops[l].iter;
+}
+
+/*
+ * What a loop header costs on top of the last time through: N - 1 more
+ * trips around.
+ */
+static int64_t
+loop_extra(cfg *g, uint32_t b)
+{
+        int32_t l = g->loop[b];
+        int64_t iter, n;
+
+        if (l < 0)
+                return 0;
+        iter = loop_iter(g, l);
+        n = g->loops[l].bound;
+        if (!n)
+                return give_up(&g->why, WCET_UNBOUNDED, WHY_NO_BOUND,
+                               g->blocks[b].start);
+        if (iter >= WCET_UNKNOWN)
+                return iter;
+        if (iter && n - 1 > (WCET_UNKNOWN - 1) / iter)
+                return WCET_UNBOUNDED;
+        return iter * (n - 1);
+}
+
+static const char *
+cycles_str(int64_t cycles, char *buf, size_t size)
+{
+        if (cycles == WCET_UNKNOWN)
+                return "unknown";
+        if (cycles == WCET_UNBOUNDED)
+                return "unbounded";
+        snprintf(buf, size, "%ld cycles", (long)cycles);
+        return buf;
+}
+
+static void
+print_detail(FILE *out, const cfg * const g)
+{
+        char buf[32];
+
+        for (uint32_t b = 0; b < g->nblocks; b++)
+                fprintf(out, "  block 0x%05x-0x%05x: %s\n",
+                        g->blocks[b].start, g->blocks[b].end,
+                        cycles_str(g->cost[b], buf, sizeof(buf)));
+
+        for (uint32_t l = 0; l < g->nloops; l++) {
+                fprintf(out, "  loop 0x%05x: %s per trip",
+                        g->blocks[g->loops[l].header].start,
+                        cycles_str(g->loops[l].iter, buf, sizeof(buf)));
+                if (g->loops[l].bound)
+                        fprintf(out, ", at most %u trips\n",
+                                g->loops[l].bound);
+                else
+                        fprintf(out, ", no bound\n");
+        }
+}
+
+static int64_t
+analyze_function(wcet_ctx *w, uint32_t entry, why *why, FILE *detail)
+{
+        arena *scratch = w->scratch;
+        int64_t result;
+        int32_t start;
+        cfg g = { NULL, };
+
+        if (function_blocks(w->img, entry, scratch, &g.blocks,
+                            &g.nblocks) < 0)
+                return give_up(why, WCET_UNKNOWN, WHY_LOST, entry);
+
+        g.succ = arena_alloc(scratch, g.nblocks * sizeof(*g.succ));
+        g.back = arena_alloc(scratch, g.nblocks * sizeof(*g.back));
+        g.post = arena_alloc(scratch, g.nblocks * sizeof(*g.post));
+        g.cost = arena_alloc(scratch, g.nblocks * sizeof(*g.cost));
+        g.loop = arena_alloc(scratch, g.nblocks * sizeof(*g.loop));
+        if (!g.succ || !g.back || !g.post || !g.cost || !g.loop)
+                goto fail;
+
+        for (uint32_t b = 0; b < g.nblocks; b++) {
+                uint32_t n = g.blocks[b].nsucc;
+
+                g.succ[b] = arena_alloc(scratch, n * sizeof(*g.succ[b]));
+                g.back[b] = arena_alloc(scratch, n);
+                if (!g.succ[b] || !g.back[b])
+                        goto fail;
+                for (uint32_t j = 0; j < n; j++)
+                        g.succ[b][j] = block_index(&g,
+                                                   g.blocks[b].succ[j]);
+        }
+
+        start = block_index(&g, entry);
+        if (find_back_edges(&g, start, scratch) < 0 ||
+            find_loops(w, &g, scratch) < 0)
+                goto fail;
+
+        g.memo = arena_alloc(scratch, (size_t)(g.nloops + 1) * g.nblocks *
+                                      sizeof(*g.memo));
+        if (!g.memo)
+                goto fail;
+
+        for (uint32_t b = 0; b < g.nblocks; b++) {
+                g.cost[b] = block_cost(w, &g.blocks[b], &g.why);
+                for (uint32_t j = 0; j < g.blocks[b].nsucc; j++)
+                        if (g.succ[b][j] < 0)
+                                g.cost[b] = add(g.cost[b],
+                                        give_up(&g.why, WCET_UNKNOWN,
+                                                WHY_LOST,
+                                                g.blocks[b].end));
+        }
+
+        result = longest_path(&g, -1, start);
+        for (uint32_t l = 0; l < g.nloops; l++)
+                loop_iter(&g, l);
+
+        if (detail)
+                print_detail(detail, &g);
+        merge_why(why, &g.why);
+        return result;
+fail:
+        w->failed = 1;
+        return WCET_UNKNOWN;
+}
+
+/*
+ * The bound for the function at entry, worked out once per image.
+ */
+static int64_t
+function_wcet(wcet_ctx *w, uint32_t entry, why *why, FILE *detail)
+{
+        int64_t k = find_insn(w->img, entry);
+        arena_pos pos;
+        callee *c;
+
+        if (k < 0)
+                return give_up(why, WCET_UNKNOWN, WHY_LOST, entry);
+        c = &w->callees[k];
+        if (c->state == CALLEE_ACTIVE)
+                return give_up(why, WCET_UNBOUNDED, WHY_RECURSION, entry);
+
+        if (c->state != CALLEE_DONE || detail) {
+                c->state = CALLEE_ACTIVE;
+                memset(&c->why, 0, sizeof(c->why));
+                arena_mark(w->scratch, &pos);
+                c->cycles = analyze_function(w, entry, &c->why, detail);
+                arena_reset(w->scratch, &pos);
+                c->state = CALLEE_DONE;
+        }
+        merge_why(why, &c->why);
+        return c->cycles;
+}
+
+static void
+print_one(FILE *out, wcet_ctx *w, uint32_t entry, FILE *detail)
+{
+        const symbol *sym = find_symbol(w->img, entry);
+        why why = { 0, };
+        int64_t cycles;
+        char buf[32];
+
+        if (detail)
+                fprintf(out, "function 0x%05x\n", entry);
+        cycles = function_wcet(w, entry, &why, detail);
+
+        if (sym)
+                fprintf(out, "wcet %s (0x%05x): ",
+                        image_str(w->img, sym->name), entry);
+        else
+                fprintf(out, "wcet sub_%05x (0x%05x): ", entry, entry);
+        fprintf(out, "%s", cycles_str(cycles, buf, sizeof(buf)));
+        if (cycles == WCET_UNKNOWN)
+                fprintf(out, " (%s at 0x%05x)", whys[why.unknown],
+                        why.unknown_at);
+        else if (cycles == WCET_UNBOUNDED && why.unbounded)
+                fprintf(out, " (%s at 0x%05x)", whys[why.unbounded],
+                        why.unbounded_at);
+        fprintf(out, "\n");
+}
+
+/*
+ * Bounds for each function in entries[], with the cost of each block and
+ * loop, or just the bound for every function we can find if there are
+ * no entries.
+ */
+int
+print_wcet(FILE *out, const image * const img,
+           const uint32_t * const entries, uint32_t nentries,
+           const loop_bound * const bounds, uint32_t nbounds)
+{
+        arena scratch = { NULL, };
+        wcet_ctx w = { img, bounds, nbounds, NULL, &scratch, 0 };
+        func *funcs = NULL;
+        uint32_t nfuncs = 0;
+
+        w.callees = arena_alloc(&scratch, image_count(img, SEC_INSNS) *
+                                          sizeof(*w.callees));
+        if (!w.callees)
+                goto fail;
+
+        for (uint32_t i = 0; i < nentries; i++)
+                print_one(out, &w, entries[i], out);
+
+        if (!nentries) {
+                if (find_functions(img, &scratch, &funcs, &nfuncs) < 0)
+                        goto fail;
+                for (uint32_t i = 0; i < nfuncs; i++)
+                        print_one(out, &w, funcs[i].start, NULL);
+        }
+
+        if (w.failed)
+                goto fail;
+        arena_free(&scratch);
+        return 0;
+fail:
+        arena_free(&scratch);
+        return -1;
+}
+
+// vim:fenc=utf-8:tw=75:et
@@ -0,0 +1,357 @@
+/*
+ * zout.c - compressed listing output, one gzip member per frame
+ * Copyright 2018 Peter Jones <pjones@redhat.com>
+ *
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "hc16dis.h"
+#include "util.h"
+
+/*
+ * Listings are cut into frames of about FRAME_SIZE bytes, always at the
+ * end of a line and never across two images, and each frame is
+ * compressed on its own as a complete gzip member.  Concatenated members
+ * are still one valid gzip file, so zcat reads the whole thing, but
+ * anything that knows where a member starts can inflate just that one.
+ *
+ * Frames are compressed by a pool of threads and written in the order
+ * they were handed to us by whichever thread finishes the next one due.
+ * At most a few per thread are in flight, so a slow disk holds up the
+ * producer rather than eating memory.
+ *
+ * Next to OUT we write OUT.idx, with a line per frame:
+ *
+ *      OFFSET LENGTH FIRST LAST NAME
+ *
+ * OFFSET and LENGTH are where the member is in OUT, FIRST and LAST are
+ * the first and last instruction addresses listed in it ("-" if there
+ * aren't any), and NAME is the image it came from.  All numbers are hex.
+ *
+ * This is gzip rather than zstd because zlib is everywhere already; we
+ * use level 1, since listings compress well anyway and what we're after
+ * is throughput.
+ */
+#define FRAME_SIZE      (1024 * 1024)
+#define FRAMES_PER_THREAD 4
+#define LEVEL           1
+
+typedef struct frame_s {
+        struct frame_s *next;   // on the work queue
+        uint64_t seq;
+        const char *name;
+        char *text;
+        size_t len;
+        uint8_t *out;
+        size_t outlen;
+        int64_t first;          // -1 if there's no instruction in it
+        int64_t last;
+        int done;
+        int error;
+} frame;
+
+struct zout_s {
+        FILE *file;
+        FILE *index;
+        pthread_t *threads;
+        long nthreads;
+
+        pthread_mutex_t lock;
+        pthread_cond_t work;    // there's a frame to compress
+        pthread_cond_t room;    // a frame was written
+        frame *head;
+        frame *tail;
+        frame **pending;        // by seq % max_pending
+        size_t max_pending;
+        size_t npending;
+        uint64_t next_seq;
+        uint64_t next_write;
+        uint64_t offset;
+        int closing;
+        int error;
+};
+
+static int
+is_hex(char c)
+{
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+/*
+ * The first and last listing lines in a frame that start with an
+ * address.
+ */
+static void
+find_addrs(frame *f)
+{
+        const char *p = f->text, *end = f->text + f->len;
+
+        f->first = f->last = -1;
+        while (p < end) {
+                const char *nl = memchr(p, '\n', end - p);
+                int i;
+
+                for (i = 0; i < 8 && p + i < end && is_hex(p[i]); i++)
+                        ;
+                if (i == 8 && p + 8 < end && p[8] == ':') {
+                        f->last = strtoul(p, NULL, 16);
+                        if (f->first < 0)
+                                f->first = f->last;
+                }
+                if (!nl)
+                        break;
+                p = nl + 1;
+        }
+}
+
+static int
+compress_frame(z_stream *zs, frame *f)
+{
+        uLong bound = deflateBound(zs, f->len) + 32;
+
+        f->out = malloc(bound);
+        if (!f->out)
+                return -1;
+        if (deflateReset(zs) != Z_OK)
+                return -1;
+        zs->next_in = (Bytef *)f->text;
+        zs->avail_in = f->len;
+        zs->next_out = f->out;
+        zs->avail_out = bound;
+        if (deflate(zs, Z_FINISH) != Z_STREAM_END)
+                return -1;
+        f->outlen = bound - zs->avail_out;
+        find_addrs(f);
+        return 0;
+}
+
+/*
+ * Write every frame that's done, in order.  Called with z->lock held.
+ */
+static void
+write_ready(zout *z)
+{
+        frame *f;
+
+        while (z->npending &&
+               (f = z->pending[z->next_write % z->max_pending]) &&
+               f->done) {
+                if (f->error && !z->error)
+                        z->error = f->error;
+                if (!z->error &&
+                    fwrite(f->out, 1, f->outlen, z->file) != f->outlen)
+                        z->error = errno ? errno : EIO;
+                if (!z->error) {
+                        fprintf(z->index, "%" PRIx64 " %zx ", z->offset,
+                                f->outlen);
+                        if (f->first < 0)
+                                fprintf(z->index, "- - %s\n", f->name);
+                        else
+                                fprintf(z->index,
+                                        "%05" PRIx64 " %05" PRIx64 " %s\n",
+                                        f->first, f->last, f->name);
+                }
+                z->offset += f->outlen;
+
+                z->pending[z->next_write % z->max_pending] = NULL;
+                z->next_write++;
+                z->npending--;
+                free(f->text);
+                free(f->out);
+                free(f);
+        }
+        pthread_cond_broadcast(&z->room);
+}
+
+static void *
+compressor(void *data)
+{
+        zout *z = data;
+        z_stream zs;
+        int ok;
+
+        memset(&zs, 0, sizeof(zs));
+        /* 16 + 15: a gzip wrapper around the largest window */
+        ok = deflateInit2(&zs, LEVEL, Z_DEFLATED, 16 + 15, 8,
+                          Z_DEFAULT_STRATEGY) == Z_OK;
+
+        pthread_mutex_lock(&z->lock);
+        for (;;) {
+                frame *f;
+
+                while (!z->head && !z->closing)
+                        pthread_cond_wait(&z->work, &z->lock);
+                f = z->head;
+                if (!f)
+                        break;
+                z->head = f->next;
+                if (!z->head)
+                        z->tail = NULL;
+                pthread_mutex_unlock(&z->lock);
+
+                if (!ok || compress_frame(&zs, f) < 0)
+                        f->error = ENOMEM;
+
+                pthread_mutex_lock(&z->lock);
+                f->done = 1;
+                write_ready(z);
+        }
+        pthread_mutex_unlock(&z->lock);
+
+        if (ok)
+                deflateEnd(&zs);
+        return NULL;
+}
+
+zout *
+zout_open(const char * const path)
+{
+        zout *z = calloc(1, sizeof(*z));
+        size_t len = strlen(path) + sizeof(".idx");
+        char *index_path = malloc(len);
+
+        if (!z || !index_path) {
+                free(index_path);
+                free(z);
+                return NULL;
+        }
+        snprintf(index_path, len, "%s.idx", path);
+        z->nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (z->nthreads < 1)
+                z->nthreads = 1;
+        z->max_pending = z->nthreads * FRAMES_PER_THREAD;
+        z->pending = calloc(z->max_pending, sizeof(*z->pending));
+        z->threads = calloc(z->nthreads, sizeof(*z->threads));
+        if (!z->pending || !z->threads)
+                goto err;
+
+        z->file = fopen(path, "w");
+        if (!z->file)
+                goto err;
+        z->index = fopen(index_path, "w");
+        if (!z->index)
+                goto err;
+        free(index_path);
+        index_path = NULL;
+
+        pthread_mutex_init(&z->lock, NULL);
+        pthread_cond_init(&z->work, NULL);
+        pthread_cond_init(&z->room, NULL);
+        for (long n = 0; n < z->nthreads; n++) {
+                if (pthread_create(&z->threads[n], NULL, compressor, z)) {
+                        z->nthreads = n;
+                        zout_close(z);
+                        errno = EAGAIN;
+                        return NULL;
+                }
+        }
+        return z;
+err:
+        free(index_path);
+        if (z->file)
+                fclose(z->file);
+        free(z->pending);
+        free(z->threads);
+        free(z);
+        return NULL;
+}
+
+/*
+ * Queue name's listing text to be compressed and written.  The text is
+ * copied, so the caller can free it as soon as this returns.
+ */
+int
+zout_write(zout *z, const char * const name, const char *text, size_t len)
+{
+        while (len) {
+                size_t n = len;
+                frame *f;
+
+                if (n > FRAME_SIZE) {
+                        const char *nl = text + FRAME_SIZE;
+
+                        while (nl > text && nl[-1] != '\n')
+                                nl--;
+                        n = nl > text ? (size_t)(nl - text) : FRAME_SIZE;
+                }
+
+                f = calloc(1, sizeof(*f));
+                if (!f || !(f->text = malloc(n))) {
+                        free(f);
+                        return -1;
+                }
+                memcpy(f->text, text, n);
+                f->len = n;
+                f->name = name;
+
+                pthread_mutex_lock(&z->lock);
+                while (z->npending == z->max_pending && !z->error)
+                        pthread_cond_wait(&z->room, &z->lock);
+                if (z->error) {
+                        errno = z->error;
+                        pthread_mutex_unlock(&z->lock);
+                        free(f->text);
+                        free(f);
+                        return -1;
+                }
+                f->seq = z->next_seq++;
+                z->pending[f->seq % z->max_pending] = f;
+                z->npending++;
+                if (z->tail)
+                        z->tail->next = f;
+                else
+                        z->head = f;
+                z->tail = f;
+                pthread_cond_signal(&z->work);
+                pthread_mutex_unlock(&z->lock);
+
+                text += n;
+                len -= n;
+        }
+        return 0;
+}
+
+/*
+ * Wait for everything to be written, and close both files.
+ */
+int
+zout_close(zout *z)
+{
+        int error;
+
+        pthread_mutex_lock(&z->lock);
+        z->closing = 1;
+        pthread_cond_broadcast(&z->work);
+        pthread_mutex_unlock(&z->lock);
+        for (long n = 0; n < z->nthreads; n++)
+                pthread_join(z->threads[n], NULL);
+
+        error = z->error;
+        if (fclose(z->file) == EOF && !error)
+                error = errno;
+        if (fclose(z->index) == EOF && !error)
+                error = errno;
+        pthread_cond_destroy(&z->room);
+        pthread_cond_destroy(&z->work);
+        pthread_mutex_destroy(&z->lock);
+        free(z->pending);
+        free(z->threads);
+        free(z);
+        if (error) {
+                errno = error;
+                return -1;
+        }
+        return 0;
+}
+
+// vim:fenc=utf-8:tw=75:et